@@ -1,8 +1,16 @@
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <queue>
+#include <random>
 #include <vector>
 
 // #define BINHEAP_DEBUG_LOGIC
@@ -15,6 +23,10 @@
 #define NUM_HEAP_NODES  25000u
 #define MAX_HEAP_VALUE 100000u
 
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
 
 
 #if 0
@@ -358,7 +370,488 @@ private:
 
 
 
-int main() {
+// indexed d-ary min-heap; each slot stores the node's priority and id
+// inline next to its handle, so sifting compares and moves slots without
+// dereferencing nodes (priorities are read from a node only by push and
+// update), and node positions live in a dense array indexed by id rather
+// than being written back into the nodes themselves
+//
+// with heap_arity = 4 and 16-byte slots the children of a node fill one
+// cache line (the slot array is offset so that every sibling group is
+// line-aligned), which makes the sift-down after a pop touch one line per
+// level of a tree half as deep as the binary one; sifts move a hole down
+// or up instead of swapping, so each displaced slot is written once
+//
+// node ids are expected to be small and dense (the position array grows
+// to the largest id pushed)
+template<class node_type, size_t heap_arity = 4> class t_dary_heap {
+public:
+	static_assert(heap_arity >= 2, "");
+
+	static constexpr uint32_t NULL_POSITION = ~uint32_t(0);
+
+	struct t_heap_slot {
+		float priority;
+		uint32_t id;
+		node_type node;
+	};
+
+public:
+	t_dary_heap(size_t n = 0) { reserve(n); }
+
+	t_dary_heap(const t_dary_heap&) = delete;
+	t_dary_heap& operator = (const t_dary_heap&) = delete;
+
+	void push(node_type n) { push(n, n->get_heap_priority()); }
+	// like decrease_key, keeps the node's own priority in sync for resort
+	void push(node_type n, float priority) {
+		assert(!contains(n));
+
+		n->set_heap_priority(priority);
+
+		if (m_size == m_capacity)
+			reserve(std::max(m_capacity * 2, size_t(16)));
+
+		const t_heap_slot slot = {priority, get_node_id(n), n};
+
+		if (slot.id >= m_positions.size())
+			m_positions.resize(std::max(size_t(slot.id) + 1, m_positions.size() * 2), NULL_POSITION);
+
+		sift_up(m_size++, slot);
+	}
+
+	void pop() {
+		assert(!empty());
+
+		m_positions[m_slots[0].id] = NULL_POSITION;
+		m_size -= 1;
+
+		// refill the root with the last slot
+		if (m_size > 0)
+			sift_down(0, m_slots[m_size]);
+	}
+
+	node_type top() const { assert(!empty()); return m_slots[0].node; }
+	float top_priority() const { assert(!empty()); return m_slots[0].priority; }
+
+
+	bool empty() const { return (m_size == 0); }
+	bool contains(const node_type n) const { return (get_node_id(n) < m_positions.size() && m_positions[get_node_id(n)] != NULL_POSITION); }
+
+	size_t size() const { return m_size; }
+	size_t capacity() const { return m_capacity; }
+
+	float get_priority(const node_type n) const { assert(contains(n)); return m_slots[m_positions[get_node_id(n)]].priority; }
+
+	void clear() {
+		for (size_t i = 0; i < m_size; i++)
+			m_positions[m_slots[i].id] = NULL_POSITION;
+
+		m_size = 0;
+	}
+
+	void reserve(size_t n) {
+		if (n <= m_capacity)
+			return;
+
+		// extra slots so slot 1 (the first sibling group) can be line-aligned
+		const size_t pad = CACHE_LINE_SIZE / sizeof(t_heap_slot) + 1;
+
+		std::vector<t_heap_slot> storage(n + pad);
+
+		size_t base = 0;
+
+		while (base < pad && (reinterpret_cast<uintptr_t>(storage.data() + base + 1) % CACHE_LINE_SIZE) != 0)
+			base += 1;
+
+		std::copy(m_slots, m_slots + m_size, storage.data() + base);
+
+		m_storage.swap(storage);
+
+		m_slots = m_storage.data() + base;
+		m_capacity = n;
+	}
+
+
+	// builds the heap from scratch out of [first, last) in O(N) (Floyd's
+	// bottom-up method) rather than O(N log N) with pushes; any previous
+	// contents are dropped
+	template<typename t_iter> void heapify(t_iter first, t_iter last) {
+		clear();
+		reserve(last - first);
+
+		for (; first != last; ++first) {
+			const node_type n = *first;
+			const t_heap_slot slot = {n->get_heap_priority(), get_node_id(n), n};
+
+			if (slot.id >= m_positions.size())
+				m_positions.resize(size_t(slot.id) + 1, NULL_POSITION);
+
+			assert(!contains(n));
+			set_slot(m_size++, slot);
+		}
+
+		for (size_t i = (m_size + heap_arity - 2) / heap_arity; i > 0; i--) {
+			sift_down(i - 1, m_slots[i - 1]);
+		}
+	}
+
+	// lowers the priority of <n> (which should not increase it) and
+	// restores the heap; the node's own priority is kept in sync so a
+	// later resort does not read back the old value
+	void decrease_key(node_type n, float priority) {
+		assert(contains(n));
+		assert(priority <= get_priority(n));
+
+		const size_t idx = m_positions[get_node_id(n)];
+
+		n->set_heap_priority(priority);
+		m_slots[idx].priority = priority;
+
+		sift_up(idx, m_slots[idx]);
+	}
+
+	// changes the priority of <n> in either direction
+	void update(node_type n, float priority) {
+		assert(contains(n));
+
+		n->set_heap_priority(priority);
+		resort(n);
+	}
+
+	// call this if outside code has modified a node's priority; like the
+	// binary heap's resort, but the stored copy has to be refreshed first
+	void resort(const node_type n) {
+		assert(contains(n));
+
+		const size_t idx = m_positions[get_node_id(n)];
+		const float priority = n->get_heap_priority();
+
+		const float old_priority = m_slots[idx].priority;
+
+		m_slots[idx].priority = priority;
+
+		if (priority < old_priority) {
+			sift_up(idx, m_slots[idx]);
+		} else if (priority > old_priority) {
+			sift_down(idx, m_slots[idx]);
+		}
+	}
+
+
+	bool check_heap_property() const {
+		for (size_t i = 1; i < m_size; i++) {
+			if (m_slots[i].priority < m_slots[parent_idx(i)].priority)
+				return false;
+			if (m_positions[m_slots[i].id] != i)
+				return false;
+		}
+
+		return true;
+	}
+
+private:
+	size_t parent_idx(size_t idx) const { return ((idx - 1) / heap_arity); }
+	size_t  child_idx(size_t idx) const { return ((idx * heap_arity) + 1); }
+
+	static uint32_t get_node_id(const node_type n) {
+		assert(n->get_id() < NULL_POSITION);
+		return (n->get_id());
+	}
+
+	void set_slot(size_t idx, const t_heap_slot& slot) {
+		m_slots[idx] = slot;
+		m_positions[slot.id] = idx;
+	}
+
+	// moves <slot> (whose old position, if any, is treated as a hole) up
+	// from <idx> while its parent has a larger priority
+	void sift_up(size_t idx, const t_heap_slot slot) {
+		while (idx > 0) {
+			const size_t p_idx = parent_idx(idx);
+
+			if (!(slot.priority < m_slots[p_idx].priority))
+				break;
+
+			set_slot(idx, m_slots[p_idx]);
+			idx = p_idx;
+		}
+
+		set_slot(idx, slot);
+	}
+
+	// moves <slot> down from <idx> while its smallest child has a smaller
+	// priority; all heap_arity children are scanned without branching on
+	// the running minimum
+	void sift_down(size_t idx, const t_heap_slot slot) {
+		while (true) {
+			const size_t min_c_idx = child_idx(idx);
+			const size_t max_c_idx = std::min(min_c_idx + heap_arity, m_size);
+
+			if (min_c_idx >= m_size)
+				break;
+
+			size_t c_idx = min_c_idx;
+
+			for (size_t i = min_c_idx + 1; i < max_c_idx; i++)
+				c_idx = (m_slots[i].priority < m_slots[c_idx].priority)? i: c_idx;
+
+			if (!(m_slots[c_idx].priority < slot.priority))
+				break;
+
+			set_slot(idx, m_slots[c_idx]);
+			idx = c_idx;
+		}
+
+		set_slot(idx, slot);
+	}
+
+private:
+	std::vector<t_heap_slot> m_storage;
+	std::vector<uint32_t> m_positions;
+
+	// first slot, offset into m_storage
+	t_heap_slot* m_slots = nullptr;
+
+	size_t m_size = 0;
+	size_t m_capacity = 0;
+};
+
+template<class node_type, size_t heap_arity> constexpr uint32_t t_dary_heap<node_type, heap_arity>::NULL_POSITION;
+
+
+
+// weighted 4-connected grid; stepping onto a cell costs its (integral,
+// so path sums are exact) weight in [1, 10)
+struct t_grid_graph {
+public:
+	t_grid_graph(size_t width, size_t height, uint32_t seed): m_width(width), m_height(height), m_costs(width * height) {
+		std::mt19937 rng(seed);
+
+		for (size_t n = 0; n < m_costs.size(); n++) {
+			m_costs[n] = 1 + (rng() % 9);
+		}
+	}
+
+	template<typename t_func> void for_each_neighbor(uint32_t c, const t_func& func) const {
+		const size_t x = c % m_width;
+		const size_t y = c / m_width;
+
+		if (x >             0) func(c - 1);
+		if (x < (m_width  - 1)) func(c + 1);
+		if (y >             0) func(c - m_width);
+		if (y < (m_height - 1)) func(c + m_width);
+	}
+
+	// Manhattan distance; consistent since every step costs at least 1
+	float calc_heuristic(uint32_t c, uint32_t goal) const {
+		const long dx = long(c % m_width) - long(goal % m_width);
+		const long dy = long(c / m_width) - long(goal / m_width);
+		return (std::labs(dx) + std::labs(dy));
+	}
+
+	size_t get_num_cells() const { return (m_costs.size()); }
+	float get_cost(uint32_t c) const { return m_costs[c]; }
+
+private:
+	size_t m_width;
+	size_t m_height;
+
+	std::vector<float> m_costs;
+};
+
+
+static bool heap_contains(const t_binary_heap<t_node*>&, const t_node* n) { return (n->get_heap_position() != size_t(-1u)); }
+static void heap_decrease(t_binary_heap<t_node*>& heap, t_node* n, float p) { n->set_heap_priority(p); heap.resort(n); }
+
+static void heap_push(t_binary_heap<t_node*>& heap, t_node* n, float p) { n->set_heap_priority(p); heap.push(n); }
+
+template<size_t heap_arity> static bool heap_contains(const t_dary_heap<t_node*, heap_arity>& heap, const t_node* n) { return (heap.contains(const_cast<t_node*>(n))); }
+template<size_t heap_arity> static void heap_decrease(t_dary_heap<t_node*, heap_arity>& heap, t_node* n, float p) { heap.decrease_key(n, p); }
+template<size_t heap_arity> static void heap_push(t_dary_heap<t_node*, heap_arity>& heap, t_node* n, float p) { heap.push(n, p); }
+
+
+// Dijkstra (goal = -1u, returns the sum of all distances) or A* (returns
+// the distance to <goal>) with an indexed heap and decrease-key; <nodes>
+// holds one fresh node per cell
+template<typename t_heap> static double run_indexed_search(const t_grid_graph& graph, uint32_t start, uint32_t goal, std::vector<t_ext_node>& nodes, t_heap& heap) {
+	const bool astar = (goal != uint32_t(-1u));
+
+	std::vector<float> dists(graph.get_num_cells(), std::numeric_limits<float>::max());
+	std::vector<uint8_t> closed(graph.get_num_cells(), 0);
+
+	dists[start] = 0.0f;
+	heap_push(heap, &nodes[start], astar? graph.calc_heuristic(start, goal): 0.0f);
+
+	while (!heap.empty()) {
+		const uint32_t c = heap.top()->get_id();
+
+		heap.pop();
+		closed[c] = 1;
+
+		if (c == goal)
+			return dists[c];
+
+		graph.for_each_neighbor(c, [&](uint32_t nc) {
+			const float dist = dists[c] + graph.get_cost(nc);
+
+			if (closed[nc] || dist >= dists[nc])
+				return;
+
+			const float priority = dist + (astar? graph.calc_heuristic(nc, goal): 0.0f);
+
+			dists[nc] = dist;
+
+			if (heap_contains(heap, &nodes[nc])) {
+				heap_decrease(heap, &nodes[nc], priority);
+			} else {
+				heap_push(heap, &nodes[nc], priority);
+			}
+		});
+	}
+
+	double sum = 0.0;
+
+	for (size_t n = 0; n < graph.get_num_cells(); n++)
+		sum += dists[n];
+
+	return sum;
+}
+
+// same, with the usual lazy-deletion std::priority_queue (no decrease-key,
+// a better path pushes a duplicate and stale entries are skipped on pop)
+static double run_lazy_search(const t_grid_graph& graph, uint32_t start, uint32_t goal) {
+	typedef std::pair<float, uint32_t> t_queue_entry;
+
+	const bool astar = (goal != uint32_t(-1u));
+
+	std::priority_queue<t_queue_entry, std::vector<t_queue_entry>, std::greater<t_queue_entry> > queue;
+	std::vector<float> dists(graph.get_num_cells(), std::numeric_limits<float>::max());
+	std::vector<uint8_t> closed(graph.get_num_cells(), 0);
+
+	dists[start] = 0.0f;
+	queue.push({astar? graph.calc_heuristic(start, goal): 0.0f, start});
+
+	while (!queue.empty()) {
+		const uint32_t c = queue.top().second;
+
+		queue.pop();
+
+		if (closed[c])
+			continue;
+
+		closed[c] = 1;
+
+		if (c == goal)
+			return dists[c];
+
+		graph.for_each_neighbor(c, [&](uint32_t nc) {
+			const float dist = dists[c] + graph.get_cost(nc);
+
+			if (closed[nc] || dist >= dists[nc])
+				return;
+
+			dists[nc] = dist;
+			queue.push({dist + (astar? graph.calc_heuristic(nc, goal): 0.0f), nc});
+		});
+	}
+
+	double sum = 0.0;
+
+	for (size_t n = 0; n < graph.get_num_cells(); n++)
+		sum += dists[n];
+
+	return sum;
+}
+
+
+template<typename t_heap> static void run_benchmark_case(const char* name, const t_grid_graph& graph, uint32_t goal, t_heap& heap) {
+	// nodes and heap storage are set up outside the timed region, as they
+	// would already exist in an application
+	std::vector<t_ext_node> nodes;
+
+	nodes.reserve(graph.get_num_cells());
+
+	for (uint32_t n = 0; n < graph.get_num_cells(); n++)
+		nodes.emplace_back(n);
+
+	const auto t0 = std::chrono::steady_clock::now();
+	const double result = run_indexed_search(graph, 0, goal, nodes, heap);
+	const auto t1 = std::chrono::steady_clock::now();
+
+	printf("[%s] %-16s %9.1fms result=%.0f\n", __FUNCTION__, name, std::chrono::duration<double, std::milli>(t1 - t0).count(), result);
+}
+
+static void run_benchmark_case(const char* name, const t_grid_graph& graph, uint32_t goal) {
+	const auto t0 = std::chrono::steady_clock::now();
+	const double result = run_lazy_search(graph, 0, goal);
+	const auto t1 = std::chrono::steady_clock::now();
+
+	printf("[%s] %-16s %9.1fms result=%.0f\n", __FUNCTION__, name, std::chrono::duration<double, std::milli>(t1 - t0).count(), result);
+}
+
+static void run_benchmark(size_t grid_size) {
+	const t_grid_graph graph(grid_size, grid_size, grid_size);
+
+	const uint32_t num_cells = graph.get_num_cells();
+	const uint32_t goals[2] = {uint32_t(-1u), num_cells - 1};
+
+	printf("[%s] grid=%lux%lu\n", __FUNCTION__, grid_size, grid_size);
+
+	for (const uint32_t goal: goals) {
+		printf("[%s] %s\n", __FUNCTION__, (goal == uint32_t(-1u))? "dijkstra (all cells)": "a* (corner to corner)");
+
+		{ t_binary_heap<t_node*>  heap(num_cells + 1); run_benchmark_case("binary-heap", graph, goal, heap); }
+		{ t_dary_heap<t_node*, 2> heap(num_cells    ); run_benchmark_case("2-ary heap" , graph, goal, heap); }
+		{ t_dary_heap<t_node*, 4> heap(num_cells    ); run_benchmark_case("4-ary heap" , graph, goal, heap); }
+		{ t_dary_heap<t_node*, 8> heap(num_cells    ); run_benchmark_case("8-ary heap" , graph, goal, heap); }
+
+		run_benchmark_case("priority_queue", graph, goal);
+	}
+
+	{
+		std::mt19937 rng(grid_size);
+		std::vector<t_ext_node> nodes;
+		std::vector<t_node*> node_ptrs;
+
+		nodes.reserve(num_cells);
+
+		for (uint32_t n = 0; n < num_cells; n++) {
+			nodes.emplace_back(n);
+			nodes.back().set_heap_priority(rng() % MAX_HEAP_VALUE);
+			node_ptrs.push_back(&nodes.back());
+		}
+
+		t_dary_heap<t_node*, 4> heap(num_cells);
+
+		const auto t0 = std::chrono::steady_clock::now();
+
+		for (t_node* n: node_ptrs)
+			heap.push(n);
+
+		const auto t1 = std::chrono::steady_clock::now();
+
+		heap.heapify(node_ptrs.begin(), node_ptrs.end());
+
+		const auto t2 = std::chrono::steady_clock::now();
+
+		printf("[%s] build 4-ary heap of %u nodes: push=%.1fms heapify=%.1fms valid=%d\n", __FUNCTION__, num_cells,
+			std::chrono::duration<double, std::milli>(t1 - t0).count(),
+			std::chrono::duration<double, std::milli>(t2 - t1).count(),
+			heap.check_heap_property()
+		);
+	}
+}
+
+
+
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		// --bench [grid_size]
+		run_benchmark((argc > 2)? atol(argv[2]): 1000);
+		return 0;
+	}
+
 	srandom(time(NULL));
 
 	t_binary_heap<t_node*>* heap = new t_binary_heap<t_node*>(NUM_HEAP_NODES);
@@ -0,0 +1,262 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "simple_flat_map.hpp"
+
+#define NUM_LOAD_KEYS   1000000u
+#define NUM_SINGLE_KEYS   30000u
+#define NUM_CHECK_OPS    500000u
+#define MAX_CHECK_KEY      4096u
+#define NUM_BENCH_LOOKUPS 4000000u
+#define NUM_BENCH_PASSES        3u
+
+typedef t_vector_map<uint32_t, uint32_t> t_load_map;
+typedef std::map<uint32_t, uint32_t> t_load_ref_map;
+
+// string values so erased slots that are reused or moved must still be live objects
+typedef t_vector_map<uint32_t, std::string> t_test_map;
+typedef std::map<uint32_t, std::string> t_ref_map;
+
+
+
+static double elapsed_ms(const std::chrono::steady_clock::time_point& t0) {
+	return (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+}
+
+// every key in <ref> must be found with its value, and iteration must
+// visit exactly the live sorted elements in order
+template<typename t_map, typename t_ref> static bool compare_maps(t_map& map, const t_ref& ref) {
+	if (map.size() != ref.size())
+		return false;
+
+	for (const auto& e: ref) {
+		const auto i = map.find(e.first);
+
+		if (i == map.end() || i->second != e.second)
+			return false;
+	}
+
+	auto j = ref.begin();
+
+	for (auto i = map.begin(); i != map.end(); ++i, ++j) {
+		if (j == ref.end() || i->first != j->first || i->second != j->second)
+			return false;
+	}
+
+	return (j == ref.end());
+}
+
+// merging keeps existing values, and the first of several equal new keys
+static void merge_pending(t_ref_map& ref, std::vector<t_test_map::t_elem_pair>& pending) {
+	for (const auto& e: pending) {
+		ref.emplace(e.first, e.second);
+	}
+
+	pending.clear();
+}
+
+
+// loads NUM_LOAD_KEYS random keys in one batch and NUM_SINGLE_KEYS one
+// at a time, then checks both against std::map
+static bool run_load_test(std::mt19937& rng) {
+	std::vector<t_load_map::t_elem_pair> elems(NUM_LOAD_KEYS);
+	t_load_ref_map ref;
+
+	for (size_t n = 0; n < NUM_LOAD_KEYS; n++) {
+		elems[n] = {uint32_t(rng()), uint32_t(n)};
+		ref.emplace(elems[n].first, elems[n].second);
+	}
+
+	t_load_map bulk_map;
+	t_load_map single_map;
+
+	const auto t0 = std::chrono::steady_clock::now();
+	bulk_map.insert_bulk(elems.begin(), elems.end());
+	const double bulk_ms = elapsed_ms(t0);
+
+	const auto t1 = std::chrono::steady_clock::now();
+	for (size_t n = 0; n < NUM_SINGLE_KEYS; n++) {
+		single_map.insert(elems[n]);
+	}
+	const double single_ms = elapsed_ms(t1);
+
+	t_load_ref_map single_ref;
+
+	for (size_t n = 0; n < NUM_SINGLE_KEYS; n++) {
+		single_ref.emplace(elems[n].first, elems[n].second);
+	}
+
+	const bool bulk_ok = compare_maps(bulk_map, ref);
+	const bool single_ok = compare_maps(single_map, single_ref);
+
+	printf("[%s] insert_bulk(%u keys)=%.1fms insert(%u keys)=%.1fms bulk_ok=%d single_ok=%d\n", __func__, NUM_LOAD_KEYS, bulk_ms, NUM_SINGLE_KEYS, single_ms, bulk_ok, single_ok);
+	return (bulk_ok && single_ok);
+}
+
+// random inserts, erases (tombstones), unsorted push_backs, bulk merges
+// and compactions over a small key range, cross-checked against std::map
+static bool run_check_test(std::mt19937& rng) {
+	t_test_map map;
+	t_ref_map ref;
+
+	// elements appended by push_back are invisible to find until merged
+	std::vector<t_test_map::t_elem_pair> pending;
+	std::vector<t_test_map::t_elem_pair> batch;
+
+	size_t num_compactions = 0;
+
+	for (size_t n = 0; n < NUM_CHECK_OPS; n++) {
+		const uint32_t key = rng() % MAX_CHECK_KEY;
+		const std::string val = std::to_string(n);
+
+		switch (rng() % 16) {
+			case 0: case 1: case 2: case 3: {
+				if (map.insert({key, val}).second != ref.emplace(key, val).second)
+					return false;
+			} break;
+			case 4: case 5: case 6: {
+				if (map.erase(key) != (ref.erase(key) != 0))
+					return false;
+			} break;
+			case 7: {
+				map.push_back({key, val});
+				pending.push_back({key, val});
+			} break;
+			case 8: {
+				if ((rng() % 64) != 0)
+					break;
+
+				map.sort();
+				merge_pending(ref, pending);
+			} break;
+			case 9: {
+				if ((rng() % 64) != 0)
+					break;
+
+				batch.clear();
+
+				for (size_t k = rng() % 256; k > 0; k--) {
+					batch.push_back({uint32_t(rng() % MAX_CHECK_KEY), val});
+				}
+
+				// unsorted elements are merged ahead of the batch
+				map.insert_bulk(batch.begin(), batch.end());
+				pending.insert(pending.end(), batch.begin(), batch.end());
+				merge_pending(ref, pending);
+			} break;
+			case 10: {
+				// mostly the default threshold, sometimes any tombstone
+				num_compactions += map.compact(((rng() % 8) == 0)? 0.0f: VECTOR_MAP_COMPACT_FRACTION);
+			} break;
+			case 11: {
+				if ((rng() % 1024) == 0)
+					map.set_read_optimized(!map.read_optimized());
+			} break;
+			case 12: {
+				if ((rng() % 256) != 0)
+					break;
+
+				// revisit the empty-map paths, with and without unsorted elements
+				map.clear();
+				ref.clear();
+				pending.clear();
+			} break;
+			default: {
+				const auto i = map.find(key);
+				const auto j = ref.find(key);
+
+				if ((i == map.end()) != (j == ref.end()))
+					return false;
+				if (j != ref.end() && i->second != j->second)
+					return false;
+			} break;
+		}
+
+		if ((n % (NUM_CHECK_OPS / 16)) == 0 && !compare_maps(map, ref))
+			return false;
+	}
+
+	map.sort();
+	merge_pending(ref, pending);
+
+	printf("[%s] ops=%u compactions=%lu size=%lu\n", __func__, NUM_CHECK_OPS, num_compactions, map.size());
+	return (compare_maps(map, ref));
+}
+
+
+// times NUM_BENCH_LOOKUPS random lookups (about half of them hits) in
+// maps of 10^3 up to <max_keys> keys, with and without the search index;
+// reports the best of NUM_BENCH_PASSES passes since timings are noisy
+static void run_lookup_benchmark(size_t max_keys) {
+	std::mt19937 rng(1);
+
+	printf("[%s] %10s %12s %12s %8s\n", __func__, "keys", "plain", "read-opt", "speedup");
+	printf("[%s] %10s %12s %12s %8s\n", __func__, "", "(ns/op)", "(ns/op)", "");
+
+	for (size_t num_keys = 1000; num_keys <= max_keys; num_keys *= 10) {
+		std::vector<t_load_map::t_elem_pair> elems(num_keys);
+		std::vector<uint32_t> keys(NUM_BENCH_LOOKUPS);
+
+		for (size_t n = 0; n < num_keys; n++) {
+			elems[n] = {uint32_t(rng()) & ~1u, uint32_t(n)};
+		}
+
+		// even keys are present, odd ones never are
+		for (size_t n = 0; n < NUM_BENCH_LOOKUPS; n++) {
+			keys[n] = elems[rng() % num_keys].first | (rng() & 1);
+		}
+
+		t_load_map map;
+		map.insert_bulk(elems.begin(), elems.end());
+
+		double lookup_ns[2] = {1e9, 1e9};
+		size_t num_hits[2] = {0, 0};
+
+		for (size_t p = 0; p < NUM_BENCH_PASSES; p++) {
+			for (size_t k = 0; k < 2; k++) {
+				map.set_read_optimized(k == 1);
+				num_hits[k] = 0;
+
+				const auto t0 = std::chrono::steady_clock::now();
+
+				for (size_t n = 0; n < NUM_BENCH_LOOKUPS; n++) {
+					num_hits[k] += (map.find(keys[n]) != map.end());
+				}
+
+				lookup_ns[k] = std::min(lookup_ns[k], (elapsed_ms(t0) * 1e6) / NUM_BENCH_LOOKUPS);
+			}
+		}
+
+		if (num_hits[0] != num_hits[1])
+			printf("[%s] hit counts differ (%lu vs %lu)\n", __func__, num_hits[0], num_hits[1]);
+		printf("[%s] %10lu %12.1f %12.1f %7.2fx\n", __func__, num_keys, lookup_ns[0], lookup_ns[1], lookup_ns[0] / lookup_ns[1]);
+	}
+}
+
+
+
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		// --bench [max_keys]
+		run_lookup_benchmark((argc > 2)? atol(argv[2]): 10000000);
+		return 0;
+	}
+
+	std::mt19937 rng((argc > 1)? std::atoi(argv[1]): 1);
+
+	const bool load_ok = run_load_test(rng);
+	const bool check_ok = run_check_test(rng);
+
+	printf("[%s] load_test=%s check_test=%s\n", __func__, load_ok? "ok": "FAILED", check_ok? "ok": "FAILED");
+	return ((load_ok && check_ok)? EXIT_SUCCESS: EXIT_FAILURE);
+}
@@ -1,10 +1,18 @@
 #include <cassert>
 #include <cstdint> // std::uint8_t
+#include <cstdio>
+#include <cstdlib>
 #include <cstring> // std::mem{cpy,set}
 
 #include <algorithm> // std::min
-#include <deque>
+#include <atomic>
+#include <chrono>
 #include <new>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h> // sched_getcpu
+#endif
 
 #include <lua5.1/lua.h>
 #include "lua_mem_pool.hpp"
@@ -17,20 +25,78 @@
 #define CHECK_MAX_ALLOC_SIZE 1
 
 
-namespace util {
-	// stubs
-	struct mutex {
-		void lock() {}
-		void unlock() {}
-	};
+// upper bound on the number of non-shared pools that can exist at once
+#define MAX_NUM_POOLS 1024
+// number of per-CPU free-lists that released pools are spread over
+#define NUM_POOL_LISTS 64
+
+
+// lock-free (Treiber) stack of pool indices; the head packs a 32-bit
+// ABA tag above the 32-bit index of the top pool, links are stored in
+// a side-array since indices are popped and pushed by arbitrary threads
+struct t_index_stack {
+public:
+	static constexpr uint32_t NULL_INDEX = ~uint32_t(0);
+
+	void clear() { m_head.store(pack(0, NULL_INDEX), std::memory_order_relaxed); }
+
+	void push(uint32_t idx, std::atomic<uint32_t>* links) {
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+
+		do {
+			links[idx].store(index(head), std::memory_order_relaxed);
+		} while (!m_head.compare_exchange_weak(head, pack(tag(head) + 1, idx), std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	uint32_t pop(const std::atomic<uint32_t>* links) {
+		uint64_t head = m_head.load(std::memory_order_acquire);
+
+		while (index(head) != NULL_INDEX) {
+			// link might be stale if head changed since loading it, the
+			// tag makes the CAS fail in that case (even when the index
+			// was pushed again)
+			const uint32_t next = links[index(head)].load(std::memory_order_relaxed);
+
+			if (m_head.compare_exchange_weak(head, pack(tag(head) + 1, next), std::memory_order_acquire, std::memory_order_acquire))
+				return (index(head));
+		}
+
+		return NULL_INDEX;
+	}
+
+private:
+	static uint64_t pack(uint32_t tag, uint32_t idx) { return ((uint64_t(tag) << 32) | idx); }
+	static uint32_t index(uint64_t head) { return (head & 0xFFFFFFFFu); }
+	static uint32_t tag(uint64_t head) { return (head >> 32); }
+
+private:
+	std::atomic<uint64_t> m_head = {pack(0, NULL_INDEX)};
 };
 
 
 static t_lua_mem_pool g_shared_pool(-1);
 
-static std::deque<t_lua_mem_pool> g_pools;
-static std::vector<size_t> g_indcs;
-static util::mutex g_mutex;
+// non-shared pools are constructed in-place on first use and never move;
+// released pools are pushed onto the free-list of the CPU the releasing
+// thread runs on and preferentially reacquired by threads on that same
+// CPU (hence NUMA-node), whose caches likely still hold its slabs
+alignas(t_lua_mem_pool) static uint8_t g_pool_mem[MAX_NUM_POOLS][sizeof(t_lua_mem_pool)];
+
+static std::atomic<uint32_t> g_pool_links[MAX_NUM_POOLS];
+static std::atomic<uint32_t> g_num_pools = {0};
+
+static t_index_stack g_pool_lists[NUM_POOL_LISTS];
+
+
+static t_lua_mem_pool* pool_ptr(size_t idx) { return (reinterpret_cast<t_lua_mem_pool*>(&g_pool_mem[idx][0])); }
+static size_t pool_list_index() {
+	#ifdef __linux__
+	const int cpu = sched_getcpu();
+	return ((cpu < 0)? 0: (cpu % NUM_POOL_LISTS));
+	#else
+	return 0;
+	#endif
+}
 
 
 static bool alloc_internal(size_t size) { return ((size * CHECK_MAX_ALLOC_SIZE) <= t_lua_mem_pool::MAX_ALLOC_SIZE); }
@@ -62,17 +128,26 @@ t_lua_mem_pool* t_lua_mem_pool::acquire_ptr(const t_lua_ctx_data* ctx) {
 
 	if (!ctx->share_pool) {
 		// for non-shared pools, assume caller can be any thread
-		g_mutex.lock();
+		const size_t list_idx = pool_list_index();
 
-		if (g_indcs.empty()) {
-			g_pools.emplace_back(g_pools.size());
-			p = &(g_pools.back());
-		} else {
-			p = &g_pools[g_indcs.back()];
-			g_indcs.pop_back();
+		uint32_t pool_idx = t_index_stack::NULL_INDEX;
+
+		// try our own CPU's list first, then steal from the others
+		for (size_t n = 0; n < NUM_POOL_LISTS && pool_idx == t_index_stack::NULL_INDEX; n++) {
+			pool_idx = g_pool_lists[(list_idx + n) % NUM_POOL_LISTS].pop(g_pool_links);
+		}
+
+		if (pool_idx == t_index_stack::NULL_INDEX) {
+			// all existing pools are in use; construct a new one
+			if ((pool_idx = g_num_pools.fetch_add(1, std::memory_order_relaxed)) >= MAX_NUM_POOLS) {
+				g_num_pools.fetch_sub(1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			new (pool_ptr(pool_idx)) t_lua_mem_pool(pool_idx);
 		}
 
-		g_mutex.unlock();
+		p = pool_ptr(pool_idx);
 	}
 
 	if (!ctx->clear_pool)
@@ -96,33 +171,43 @@ bool t_lua_mem_pool::release_ptr(const t_lua_ctx_data* ctx) {
 	if (ctx->lmp == acquire_shared_ptr())
 		return (ctx->lmp->inc_shared_count(-1) == 0);
 
-	g_mutex.lock();
-	g_indcs.push_back(ctx->lmp->get_global_index());
-	g_mutex.unlock();
+	g_pool_lists[pool_list_index()].push(ctx->lmp->get_global_index(), g_pool_links);
 	return true;
 }
 
 void t_lua_mem_pool::free_shared() { g_shared_pool.clear(); }
 void t_lua_mem_pool::init_static() {
-	// g_pools.reserve(16);
-	g_indcs.reserve(16);
+	for (t_index_stack& list: g_pool_lists) {
+		list.clear();
+	}
 }
 void t_lua_mem_pool::kill_static() {
-	g_pools.clear(); // invoke dtors
-	g_indcs.clear();
+	// no pool may be in use at this point; invoke dtors
+	for (size_t i = 0, n = g_num_pools.load(); i < n; i++) {
+		pool_ptr(i)->~t_lua_mem_pool();
+	}
+
+	g_num_pools.store(0);
+	init_static();
 }
 
 
 
 void t_lua_mem_pool::log_stats(const char* header) const {
 	#if (LMP_TRACK_ALLOCS == 1)
+	size_t num_classes = 0;
+
+	for (const t_size_class& sc: m_size_classes) {
+		num_classes += (sc.partial_slabs != nullptr || sc.cached_slab != nullptr);
+	}
+
 	std::printf(
 		"[lua_mem_pool::%s][%s] index=%ld {blocks,sizes}={%lu,%lu} {int,ext,rec}_allocs={%lu,%lu,%lu} {chunk,block}_bytes={%lu,%lu}\n",
 		__func__,
 		header,
 		m_global_index,
 		m_alloc_blocks.size(),
-		m_chunk_count_table.size(),
+		num_classes,
 		m_alloc_stats[STAT_NIA],
 		m_alloc_stats[STAT_NEA],
 		m_alloc_stats[STAT_NRA],
@@ -133,10 +218,42 @@ void t_lua_mem_pool::log_stats(const char* header) const {
 }
 
 
+
+size_t t_lua_mem_pool::calc_class_index(size_t size) {
+	static_assert(MIN_ALLOC_SIZE <= 8, "");
+
+	if (size <= 128)
+		return ((std::max(size, size_t(1)) - 1) >> 3);
+
+	// index of the highest set bit selects the power of two, the two
+	// bits below it select one of four linearly spaced steps inside it
+	const size_t s = size - 1;
+	const size_t e = (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(s);
+
+	return (16 + (e - 7) * 4 + ((s >> (e - 2)) & 3));
+}
+
+size_t t_lua_mem_pool::calc_class_size(size_t index) {
+	if (index < 16)
+		return ((index + 1) << 3);
+
+	return ((5 + ((index - 16) & 3)) << (7 + ((index - 16) >> 2) - 2));
+}
+
+size_t t_lua_mem_pool::calc_slab_size(size_t index) {
+	// room for at least three chunks (plus header) in every slab
+	const size_t size = calc_class_size(index) * 4 - 1;
+	const size_t bits = (sizeof(unsigned long) * 8) - __builtin_clzl(size);
+
+	return (std::max(size_t(1) << bits, MIN_SLAB_SIZE));
+}
+
+
+
 void t_lua_mem_pool::delete_blocks() {
 	#if (LMP_TRACK_ALLOCS == 1)
 	for (void* p: m_alloc_blocks) {
-		::operator delete(p);
+		::operator delete(p, std::align_val_t(calc_slab_size(static_cast<t_slab_header*>(p)->class_index)));
 	}
 
 	m_alloc_blocks.clear();
@@ -151,115 +268,318 @@ void* t_lua_mem_pool::alloc(size_t size) {
 		return (::operator new(size));
 	}
 
+	const size_t class_index = calc_class_index(size);
+
 	set_alloc_stat(STAT_NIA, get_alloc_stat(STAT_NIA) + 1);
-	set_alloc_stat(STAT_NCB, get_alloc_stat(STAT_NCB) + (size = std::max(size, size_t(MIN_ALLOC_SIZE))));
+	set_alloc_stat(STAT_NCB, get_alloc_stat(STAT_NCB) + calc_class_size(class_index));
+
+	return (alloc_chunk(class_index));
+}
 
-	// pair<iter, bool>
-	auto free_chunks_pair = std::make_pair(m_free_chunks_table.find(size), false);
+void* t_lua_mem_pool::realloc(void* ptr, size_t nsize, size_t osize) {
+	if (ptr == nullptr)
+		return (alloc(nsize));
 
-	if (free_chunks_pair.first == m_free_chunks_table.end())
-		free_chunks_pair = m_free_chunks_table.insert(std::make_pair(size, nullptr));
+	assert(osize != 0);
 
-	auto& chunk_iter = free_chunks_pair.first;
-	void* chunk_ptr = chunk_iter->second;
+	// old chunk is also large enough for the new size
+	if (!alloc_external(nsize) && !alloc_external(osize) && calc_class_index(nsize) == calc_class_index(osize))
+		return ptr;
 
-	if (chunk_ptr != nullptr) {
-		// first sizeof(void*) bytes of any chunk point to the next
-		// unallocated, copy them so a subsequent alloc-request (of
-		// the same size) will return that chunk if non-null
-		std::memcpy(&chunk_iter->second, chunk_ptr, sizeof(void*));
+	void* ret = alloc(nsize);
 
-		// equivalent
-		// chunk_iter->second = *reinterpret_cast<void**>(chunk_ptr);
+	std::memcpy(ret, ptr, std::min(nsize, osize));
+
+	free(ptr, osize);
+	return ret;
+}
+
+void t_lua_mem_pool::free(void* ptr, size_t size) {
+	if (ptr == nullptr)
+		return;
+
+	assert(size != 0);
+
+	if (alloc_external(size)) {
+		::operator delete(ptr);
+		return;
+	}
+
+	const size_t class_index = calc_class_index(size);
+
+	set_alloc_stat(STAT_NCB, get_alloc_stat(STAT_NCB) - calc_class_size(class_index));
+	free_chunk(ptr, class_index);
+}
+
+
+
+void* t_lua_mem_pool::alloc_chunk(size_t class_index) {
+	t_size_class& size_class = m_size_classes[class_index];
+	t_slab_header* slab = size_class.partial_slabs;
+
+	if (slab == nullptr) {
+		if ((slab = size_class.cached_slab) == nullptr) {
+			slab = new_slab(class_index);
+		} else {
+			size_class.cached_slab = nullptr;
+		}
+
+		link_slab(slab);
+	}
+
+	void* chunk_ptr = slab->free_chunks;
+
+	if (chunk_ptr != nullptr) {
+		// first sizeof(void*) bytes of any free chunk point to the next
+		// one, copy them so a subsequent alloc-request (of the same size
+		// class) will return that chunk if non-null
+		std::memcpy(&slab->free_chunks, chunk_ptr, sizeof(void*));
 
 		set_alloc_stat(STAT_NRA, get_alloc_stat(STAT_NRA) + 1);
-		return chunk_ptr;
+	} else {
+		// carve the next untouched chunk; slabs are never pre-linked
+		assert(slab->num_carved < slab->num_chunks);
+		chunk_ptr = reinterpret_cast<uint8_t*>(slab) + SLAB_HDR_SIZE + calc_class_size(class_index) * (slab->num_carved++);
+	}
+
+	// slab is now full, stop considering it for allocations
+	if ((slab->num_used += 1) == slab->num_chunks)
+		unlink_slab(slab);
+
+	return chunk_ptr;
+}
+
+void t_lua_mem_pool::free_chunk(void* ptr, size_t class_index) {
+	const uintptr_t slab_mask = ~uintptr_t(calc_slab_size(class_index) - 1);
+	const uintptr_t slab_addr = reinterpret_cast<uintptr_t>(ptr) & slab_mask;
+
+	t_slab_header* slab = reinterpret_cast<t_slab_header*>(slab_addr);
+	t_size_class& size_class = m_size_classes[class_index];
+
+	assert(slab->class_index == class_index);
+	assert(slab->num_used != 0);
+
+	// write address of the slab's first free chunk (null if none)
+	// into first sizeof(void*) bytes of this freed chunk
+	std::memcpy(ptr, &slab->free_chunks, sizeof(void*));
+
+	slab->free_chunks = ptr;
+
+	// slab was full, make it available again
+	if ((slab->num_used -= 1) == (slab->num_chunks - 1))
+		link_slab(slab);
+
+	if (slab->num_used != 0)
+		return;
+
+	unlink_slab(slab);
+
+	// keep one empty slab per class so alternating alloc and free
+	// requests around a slab boundary do not hit the system each time
+	if (size_class.cached_slab == nullptr) {
+		slab->free_chunks = nullptr;
+		slab->num_carved = 0;
+
+		size_class.cached_slab = slab;
+		return;
 	}
 
-	// pair<iter, bool>
-	auto chunk_count_pair = std::make_pair(m_chunk_count_table.find(size), false);
+	delete_slab(slab);
+}
+
 
-	if (chunk_count_pair.first == m_chunk_count_table.end())
-		chunk_count_pair = m_chunk_count_table.insert(std::make_pair(size, 8));
+t_lua_mem_pool::t_slab_header* t_lua_mem_pool::new_slab(size_t class_index) {
+	const size_t slab_size = calc_slab_size(class_index);
 
-	const size_t num_chunks = (chunk_count_pair.first)->second;
-	const size_t num_bytes = size * num_chunks;
+	void* new_block = ::operator new(slab_size, std::align_val_t(slab_size));
+	t_slab_header* slab = new (new_block) t_slab_header();
 
-	void* new_block = ::operator new(num_bytes);
-	uint8_t* new_bytes = reinterpret_cast<uint8_t*>(new_block);
+	static_assert(sizeof(t_slab_header) <= SLAB_HDR_SIZE, "");
+
+	slab->prev_slab = nullptr;
+	slab->next_slab = nullptr;
+	slab->free_chunks = nullptr;
+
+	slab->class_index = class_index;
+	slab->num_chunks = (slab_size - SLAB_HDR_SIZE) / calc_class_size(class_index);
+	slab->num_carved = 0;
+	slab->num_used = 0;
 
 	#if (LMP_TRACK_ALLOCS == 1)
+	slab->block_index = m_alloc_blocks.size();
 	m_alloc_blocks.push_back(new_block);
 	#endif
 
-	// new allocation; construct chain of chunks within the memory block
-	// (this requires the block size to be at least MIN_ALLOC_SIZE bytes)
-	for (size_t i = 0; i < (num_chunks - 1); ++i) {
-		const void* addr_val = &new_bytes[(i + 1) * size];
-		const void** addr_ptr = &addr_val;
+	set_alloc_stat(STAT_NBB, get_alloc_stat(STAT_NBB) + slab_size);
+	return slab;
+}
 
-		// write next-pointer into first bytes of chunk
-		std::memcpy(&new_bytes[i * size], addr_ptr, sizeof(void*));
+void t_lua_mem_pool::delete_slab(t_slab_header* slab) {
+	#if (LMP_TRACK_ALLOCS == 1)
+	t_slab_header* last = static_cast<t_slab_header*>(m_alloc_blocks.back());
 
-		// equivalent
-		// *reinterpret_cast<void**>(&new_bytes[i * size]) = &new_bytes[(i + 1) * size];
-	}
+	// swap-and-pop; keeps block indices dense
+	m_alloc_blocks[last->block_index = slab->block_index] = last;
+	m_alloc_blocks.pop_back();
+	#endif
 
-	std::memset(&new_bytes[(num_chunks - 1) * size], 0, sizeof(void*)); // list tail
-	std::memcpy(&m_free_chunks_table[size], new_block, sizeof(void*)); // next free
+	const size_t slab_size = calc_slab_size(slab->class_index);
 
-	// equivalent
-	// *reinterpret_cast<void**>(&new_bytes[(num_chunks - 1) * size]) = nullptr;
-	// m_free_chunks_table[size] = *reinterpret_cast<void**>(new_block);
+	set_alloc_stat(STAT_NBB, get_alloc_stat(STAT_NBB) - slab_size);
+	::operator delete(slab, std::align_val_t(slab_size));
+}
+
+
+void t_lua_mem_pool::link_slab(t_slab_header* slab) {
+	t_size_class& size_class = m_size_classes[slab->class_index];
 
-	// increase number of chunks per block geometrically for this size
-	m_chunk_count_table[size] *= 2;
+	slab->prev_slab = nullptr;
+	slab->next_slab = size_class.partial_slabs;
 
-	set_alloc_stat(STAT_NBB, get_alloc_stat(STAT_NBB) + num_bytes);
-	return new_block;
+	if (slab->next_slab != nullptr)
+		slab->next_slab->prev_slab = slab;
+
+	size_class.partial_slabs = slab;
 }
 
-void* t_lua_mem_pool::realloc(void* ptr, size_t nsize, size_t osize) {
-	void* ret = alloc(nsize);
+void t_lua_mem_pool::unlink_slab(t_slab_header* slab) {
+	t_size_class& size_class = m_size_classes[slab->class_index];
 
-	if (ptr == nullptr)
-		return ret;
+	if (slab->prev_slab != nullptr)
+		slab->prev_slab->next_slab = slab->next_slab;
+	else
+		size_class.partial_slabs = slab->next_slab;
 
-	assert(osize != 0);
-	std::memcpy(ret, ptr, std::min(nsize, osize));
-	std::memset(ptr, 0, osize);
+	if (slab->next_slab != nullptr)
+		slab->next_slab->prev_slab = slab->prev_slab;
 
-	free(ptr, osize);
-	return ret;
+	slab->prev_slab = nullptr;
+	slab->next_slab = nullptr;
 }
 
-void t_lua_mem_pool::free(void* ptr, size_t size) {
-	if (ptr == nullptr)
-		return;
 
-	assert(size != 0);
 
-	if (alloc_external(size)) {
-		::operator delete(ptr);
-		return;
+// one Lua allocator call; pointers are replaced by slot numbers
+// so a trace can be replayed (or stored) independently of where
+// the blocks end up in memory
+struct t_alloc_event {
+	uint32_t slot;
+	uint32_t osize;
+	uint32_t nsize;
+};
+
+static bool load_alloc_trace(const char* name, std::vector<t_alloc_event>& trace) {
+	FILE* f = std::fopen(name, "r");
+	t_alloc_event e;
+
+	if (f == nullptr)
+		return false;
+
+	// one "<slot> <osize> <nsize>" triplet per line
+	while (std::fscanf(f, "%u %u %u", &e.slot, &e.osize, &e.nsize) == 3) {
+		trace.push_back(e);
 	}
 
-	set_alloc_stat(STAT_NCB, get_alloc_stat(STAT_NCB) - (size = std::max(size, size_t(MIN_ALLOC_SIZE))));
+	std::fclose(f);
+	return true;
+}
+
+// approximates the request mix of a running script: mostly short
+// strings and small tables, table and buffer parts which grow by
+// doubling through realloc, and the occasional large buffer
+static void make_alloc_trace(std::vector<t_alloc_event>& trace, size_t num_events, unsigned int seed) {
+	std::vector<uint32_t> live_slots;
+	std::vector<uint32_t> live_sizes;
+	std::vector<uint32_t> free_slots;
+
+	std::srand(seed);
+
+	while (trace.size() < num_events) {
+		const uint32_t r = std::rand() % 100;
+
+		if (r < 45 || live_slots.empty()) {
+			uint32_t slot = live_slots.size() + free_slots.size();
+			uint32_t size = 0;
+
+			if (r < 30) {
+				size = 17 + std::rand() % 48; // string
+			} else if (r < 40) {
+				size = 32 + std::rand() % 32; // table header, closure, userdata
+			} else if (r < 44) {
+				size = 64 << (std::rand() % 6); // array or hash part
+			} else {
+				size = 4096 << (std::rand() % 6); // buffer
+			}
+
+			// take a free slot if any, else append one
+			if (!free_slots.empty()) {
+				slot = free_slots.back();
+				free_slots.pop_back();
+			}
+
+			trace.push_back({slot, 0, size});
+			live_slots.push_back(slot);
+			live_sizes.push_back(size);
+			continue;
+		}
 
-	// write address of an available unallocated chunk (null if
-	// none) into first sizeof(void*) bytes of this freed chunk
-	std::memset(ptr, 0, size);
-	std::memcpy(ptr, &m_free_chunks_table[size], sizeof(void*));
+		const size_t i = std::rand() % live_slots.size();
+
+		if (r < 55 && live_sizes[i] < (t_lua_mem_pool::MAX_ALLOC_SIZE / 2)) {
+			// grow
+			trace.push_back({live_slots[i], live_sizes[i], live_sizes[i] * 2});
+			live_sizes[i] *= 2;
+			continue;
+		}
 
-	// equivalent
-	// *reinterpret_cast<void**>(ptr) = m_free_chunks_table[size];
+		trace.push_back({live_slots[i], live_sizes[i], 0});
+		free_slots.push_back(live_slots[i]);
 
-	m_free_chunks_table[size] = ptr;
+		live_slots[i] = live_slots.back(); live_slots.pop_back();
+		live_sizes[i] = live_sizes.back(); live_sizes.pop_back();
+	}
+
+	// release everything still live at the end
+	for (size_t i = 0; i < live_slots.size(); i++) {
+		trace.push_back({live_slots[i], live_sizes[i], 0});
+	}
+}
+
+
+static void* libc_alloc_func(void*, void* ptr, size_t /*osize*/, size_t nsize) {
+	if (nsize == 0) {
+		std::free(ptr);
+		return nullptr;
+	}
+
+	return (std::realloc(ptr, nsize));
+}
+
+// returns the number of nanoseconds taken to replay <trace> through <func>
+static double replay_alloc_trace(const std::vector<t_alloc_event>& trace, lua_Alloc func, void* ud, size_t num_slots) {
+	std::vector<void*> ptrs(num_slots, nullptr);
+
+	const auto t0 = std::chrono::steady_clock::now();
+
+	for (const t_alloc_event& e: trace) {
+		void*& ptr = ptrs[e.slot];
+
+		if ((ptr = func(ud, ptr, e.osize, e.nsize)) != nullptr)
+			static_cast<uint8_t*>(ptr)[0] = e.slot;
+	}
+
+	const auto t1 = std::chrono::steady_clock::now();
+	const auto dt = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0);
+
+	return (dt.count() * 1.0);
 }
 
 
 
 int main(int argc, char** argv) {
+	// optional file containing a recorded allocation trace
+	const char* trace_name = (argc > 1)? argv[1]: nullptr;
+
 	{
 		argv += (argc > 1);
 		argc -= (argc > 1);
@@ -289,7 +609,72 @@ int main(int argc, char** argv) {
 
 		t_lua_mem_pool::kill_static();
 	}
+	{
+		// stress test; N threads repeatedly create and destroy contexts
+		// (without the registry being thread-safe this corrupts it)
+		const size_t num_threads = std::max(4u, std::thread::hardware_concurrency() * 2);
+		const size_t num_cycles = 2000;
+
+		std::vector<std::thread> threads;
+		std::atomic<size_t> num_failed = {0};
+
+		t_lua_mem_pool::init_static();
+
+		for (size_t n = 0; n < num_threads; n++) {
+			threads.emplace_back([&]() {
+				for (size_t i = 0; i < num_cycles; i++) {
+					t_lua_ctx_data ctx;
+					ctx.clear_pool = true;
+
+					if ((ctx.lmp = t_lua_mem_pool::acquire_ptr(&ctx)) == nullptr) {
+						num_failed += 1;
+						continue;
+					}
+
+					ctx.lvm = lua_newstate(&t_lua_mem_pool::vm_alloc_func, &ctx);
+					lua_close(ctx.lvm);
+
+					t_lua_mem_pool::release_ptr(&ctx);
+				}
+			});
+		}
+
+		for (std::thread& t: threads) {
+			t.join();
+		}
+
+		std::printf("[%s] threads=%lu cycles=%lu pools=%u failed=%lu\n", __func__, num_threads, num_cycles, g_num_pools.load(), num_failed.load());
+		assert(g_num_pools.load() <= num_threads);
+
+		t_lua_mem_pool::kill_static();
+	}
+	{
+		// replay benchmark
+		std::vector<t_alloc_event> trace;
+
+		if (trace_name == nullptr || !load_alloc_trace(trace_name, trace))
+			make_alloc_trace(trace, 1 << 22, 123);
+
+		size_t num_slots = 0;
+
+		for (const t_alloc_event& e: trace) {
+			num_slots = std::max(num_slots, size_t(e.slot) + 1);
+		}
+
+		t_lua_ctx_data ctx;
+		ctx.share_pool = true;
+		ctx.clear_pool = true;
+		ctx.lmp = t_lua_mem_pool::acquire_ptr(&ctx);
+
+		const double libc_ns = replay_alloc_trace(trace, &libc_alloc_func, nullptr, num_slots);
+		const double pool_ns = replay_alloc_trace(trace, &t_lua_mem_pool::vm_alloc_func, &ctx, num_slots);
+
+		std::printf("[%s] events=%lu slots=%lu {libc,pool}_ns_per_event={%.2f,%.2f}\n", __func__, trace.size(), num_slots, libc_ns / trace.size(), pool_ns / trace.size());
+
+		ctx.lmp->log_stats(__func__);
+		t_lua_mem_pool::release_ptr(&ctx);
+		ctx.lmp->clear();
+	}
 
 	return 0;
 }
-
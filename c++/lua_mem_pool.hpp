@@ -2,8 +2,10 @@
 #define LUA_MEM_POOL_HDR
 
 #include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
 #include <vector>
-#include <unordered_map>
 
 #define LMP_TRACK_ALLOCS 1
 
@@ -25,7 +27,7 @@ public:
 		STAT_NEA = 1, // number of external allocs
 		STAT_NRA = 2, // number of recycled allocs
 		STAT_NCB = 3, // number of chunk bytes currently in use
-		STAT_NBB = 4, // number of block bytes alloced in total
+		STAT_NBB = 4, // number of block bytes currently alloced
 	};
 
 public:
@@ -48,9 +50,6 @@ public:
 	}
 
 	void reserve(size_t size) {
-		m_free_chunks_table.reserve(size);
-		m_chunk_count_table.reserve(size);
-
 		#if (LMP_TRACK_ALLOCS == 1)
 		m_alloc_blocks.reserve(size / 16);
 		#endif
@@ -70,8 +69,9 @@ public:
 		m_alloc_stats[STAT_NBB] *= (1 - b);
 	}
 	void clear_tables() {
-		m_free_chunks_table.clear();
-		m_chunk_count_table.clear();
+		for (t_size_class& sc: m_size_classes) {
+			sc = {nullptr, nullptr};
+		}
 	}
 
 	size_t  get_alloc_stat(size_t i          ) const { return (m_alloc_stats[i]    ); }
@@ -85,11 +85,50 @@ public:
 	static constexpr size_t MIN_ALLOC_SIZE = sizeof(void*);
 	static constexpr size_t MAX_ALLOC_SIZE = (1024 * 1024) - 1;
 
+	// sizes up to 128 bytes are rounded to multiples of MIN_ALLOC_SIZE
+	// (16 classes), larger sizes to one of four steps per power of two
+	static constexpr size_t NUM_SIZE_CLASSES = 16 + 4 * 13;
+	// slabs are aligned to their own size so a chunk can find its slab
+	// header by masking; large classes get (power-of-two) bigger slabs
+	static constexpr size_t MIN_SLAB_SIZE = 64 * 1024;
+	static constexpr size_t SLAB_HDR_SIZE = 64;
+
 	static bool is_enabled() { return true; }
 
+	static size_t calc_class_index(size_t size);
+	static size_t calc_class_size(size_t index);
+	static size_t calc_slab_size(size_t index);
+
+private:
+	struct t_slab_header {
+		t_slab_header* prev_slab; // links within the partial-list of its class
+		t_slab_header* next_slab;
+		void* free_chunks; // intrusive list of recycled chunks
+
+		uint32_t class_index;
+		uint32_t num_chunks; // total number that fit in this slab
+		uint32_t num_carved; // number ever handed out; the rest are untouched
+		uint32_t num_used;
+
+		size_t block_index; // position in m_alloc_blocks
+	};
+
+	struct t_size_class {
+		t_slab_header* partial_slabs; // slabs with at least one free chunk
+		t_slab_header* cached_slab; // at most one fully free slab is kept around
+	};
+
+	void* alloc_chunk(size_t class_index);
+	void free_chunk(void* ptr, size_t class_index);
+
+	t_slab_header* new_slab(size_t class_index);
+	void delete_slab(t_slab_header* slab);
+
+	void link_slab(t_slab_header* slab);
+	void unlink_slab(t_slab_header* slab);
+
 private:
-	std::unordered_map<size_t, void*> m_free_chunks_table;
-	std::unordered_map<size_t, size_t> m_chunk_count_table;
+	std::array<t_size_class, NUM_SIZE_CLASSES> m_size_classes = {};
 
 	#if (LMP_TRACK_ALLOCS == 1)
 	std::vector<void*> m_alloc_blocks;
@@ -97,7 +136,7 @@ private:
 
 	size_t m_alloc_stats[5] = {0, 0, 0, 0, 0};
 	size_t m_global_index = 0;
-	size_t m_shared_count = 0;
+	std::atomic<size_t> m_shared_count = {0};
 };
 
 
@@ -4,9 +4,13 @@
 #include <sstream>
 #include <vector>
 #include <list>
+#include <string>
 
 #include <cmath>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <ctime>
 #include <cassert>
 #include <sys/stat.h>
@@ -23,6 +27,13 @@
 #include <boost/thread/mutex.hpp>
 #endif
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
 typedef unsigned int uint;
 typedef const uint cuint;
 typedef const float cfloat;
@@ -32,10 +43,87 @@ using std::cout;
 using std::endl;
 
 enum ColorMode {CM_DISCRETE, CM_CONTINUOUS};
-enum ComputeMode {COMPUTE_IMAGE, COMPUTE_AREA};
+enum ComputeMode {COMPUTE_IMAGE, COMPUTE_AREA, COMPUTE_DEEP_IMAGE};
+enum SIMDMode {SIMD_NONE, SIMD_SSE2, SIMD_AVX2};
+enum DeepMode {DEEP_NEVER, DEEP_ALWAYS, DEEP_AUTO};
 
 const static float FRAND_MAX = float(RAND_MAX);
 
+// first iteration at which an orbit is saved for the periodicity
+// check, later saves happen at every power of two after it (Brent)
+const static uint PERIOD_CHECK_ITERS = 8;
+
+static const char* SIMD_MODE_NAMES[] = {"none", "sse2", "avx2"};
+
+// pixel spacing below which plain doubles can no longer tell nearby
+// pixels apart well enough and DEEP_AUTO switches to perturbation
+const static double DEEP_ZOOM_MIN_SPACING = 1e-13;
+
+// Pauldelbrot's criterion; a pixel whose orbit comes this much closer
+// to 0 than the reference orbit does has lost all of its precision
+const static double DEEP_ZOOM_GLITCH_TOL = 1e-6;
+
+// the series approximation is used up to the last iteration at which
+// its truncated (cubic) term is this small relative to the linear one
+const static double DEEP_ZOOM_SERIES_TOL = 1e-12;
+
+// maximum number of reference orbits computed for a single image
+const static uint DEEP_ZOOM_MAX_REFS = 32;
+
+
+
+#if (HAVE_X86_SIMD == 1)
+// detection logic from c/cpuid_sse_bits_test.c; ECX is an input too
+// here since leaf 7 (which has the AVX2 bit) takes a sub-leaf index
+__attribute__((__noinline__)) static void ExecCPUID(uint* regs) {
+	__asm__ __volatile__(
+		"cpuid"
+		: "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+		: "0" (regs[0]), "2" (regs[2])
+	);
+}
+
+static SIMDMode GetCPUSIMDMode() {
+	uint regs[4] = {0, 0, 0, 0};
+
+	// get the maximum standard level
+	ExecCPUID(regs);
+
+	cuint maxLevel = regs[0];
+
+	if (maxLevel < 1)
+		return SIMD_NONE;
+
+	regs[0] = 1; regs[2] = 0;
+	ExecCPUID(regs);
+
+	const bool sse2Bit = (regs[3] >> 26) & 1;
+	const bool avx1Bit = (regs[2] >> 28) & 1;
+	const bool xsavBit = (regs[2] >> 27) & 1; // OSXSAVE
+
+	if (!sse2Bit)
+		return SIMD_NONE;
+	if (!avx1Bit || !xsavBit || maxLevel < 7)
+		return SIMD_SSE2;
+
+	// the OS must also preserve the upper halves of the ymm registers
+	uint xcr0Lo = 0;
+	uint xcr0Hi = 0;
+
+	__asm__ __volatile__("xgetbv" : "=a" (xcr0Lo), "=d" (xcr0Hi) : "c" (0));
+
+	if ((xcr0Lo & 6) != 6)
+		return SIMD_SSE2;
+
+	regs[0] = 7; regs[2] = 0;
+	ExecCPUID(regs);
+
+	return (((regs[1] >> 5) & 1)? SIMD_AVX2: SIMD_SSE2);
+}
+#else
+static SIMDMode GetCPUSIMDMode() { return SIMD_NONE; }
+#endif
+
 
 
 /**
@@ -236,19 +324,23 @@ struct MandelbrotPoint {
 		n++;
 	}
 
-	// the basic escape-time test
-	inline bool IsInSet(cdouble sqEscRad, cuint nMax) {
+	inline bool InCardioidOrBulb() const {
 		cdouble ySq = y * y;
 		cdouble p = ((x - 0.25) * (x - 0.25)) + ySq;
 		cdouble q = sqrt(p);
 
 		// test if point in large center cardioid
 		if (x <= ((q - 2.0 * p) + 0.25)) {
-			return (inSet = true);
+			return true;
 		}
 
 		// test if point in circle left of center cardioid
-		if ((((x + 1.0) * (x + 1.0)) + ySq) <= 0.0625) {
+		return ((((x + 1.0) * (x + 1.0)) + ySq) <= 0.0625);
+	}
+
+	// the basic escape-time test
+	inline bool IsInSet(cdouble sqEscRad, cuint nMax) {
+		if (InCardioidOrBulb()) {
 			return (inSet = true);
 		}
 
@@ -303,6 +395,555 @@ struct MandelbrotPoint {
 
 
 
+#if (HAVE_X86_SIMD == 1)
+// iteration state of up to eight points (one per lane) in SoA form
+struct LaneState {
+	alignas(32) double x[8], xn[8], xnSq[8], sxn[8];
+	alignas(32) double y[8], yn[8], ynSq[8], syn[8];
+
+	// iteration count, and count at which the next event is due
+	alignas(32) double n[8], ev[8];
+};
+
+typedef void (*IterateLanesFunc)(LaneState&, cdouble);
+
+// both kernels run every lane through the recurrence (as two vectors
+// to keep two independent dependency chains in flight) until at least
+// one lane has an event after an iteration: it escaped, it exactly
+// revisited its saved orbit point (so is periodic and will never
+// escape) or it reached the iteration at which it is due for a new
+// save or has to give up
+// since all lanes are always live there is no per-lane masking, which
+// makes the per-iteration cost the same as that of a scalar loop
+__attribute__((target("sse2")))
+static void IterateLanesSSE2(LaneState& ls, cdouble sqEscRad) {
+	__m128d x[2], xn[2], xnSq[2], sxn[2];
+	__m128d y[2], yn[2], ynSq[2], syn[2];
+	__m128d n[2], ev[2];
+
+	const __m128d escRad = _mm_set1_pd(sqEscRad);
+
+	for (uint k = 0; k < 2; k++) {
+		x[k] = _mm_load_pd(&ls.x[k * 2]); xn[k] = _mm_load_pd(&ls.xn[k * 2]); xnSq[k] = _mm_load_pd(&ls.xnSq[k * 2]); sxn[k] = _mm_load_pd(&ls.sxn[k * 2]);
+		y[k] = _mm_load_pd(&ls.y[k * 2]); yn[k] = _mm_load_pd(&ls.yn[k * 2]); ynSq[k] = _mm_load_pd(&ls.ynSq[k * 2]); syn[k] = _mm_load_pd(&ls.syn[k * 2]);
+		n[k] = _mm_load_pd(&ls.n[k * 2]); ev[k] = _mm_load_pd(&ls.ev[k * 2]);
+	}
+
+	while (true) {
+		int eventBits = 0;
+
+		for (uint k = 0; k < 2; k++) {
+			// same operation order as Iterate, so results are bit-identical
+			yn[k] = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(_mm_set1_pd(2.0), xn[k]), yn[k]), y[k]);
+			xn[k] = _mm_add_pd(_mm_sub_pd(xnSq[k], ynSq[k]), x[k]);
+
+			xnSq[k] = _mm_mul_pd(xn[k], xn[k]);
+			ynSq[k] = _mm_mul_pd(yn[k], yn[k]);
+
+			n[k] = _mm_add_pd(n[k], _mm_set1_pd(1.0));
+		}
+
+		for (uint k = 0; k < 2; k++) {
+			const __m128d esc = _mm_cmpgt_pd(_mm_add_pd(xnSq[k], ynSq[k]), escRad);
+			const __m128d cyc = _mm_and_pd(_mm_cmpeq_pd(xn[k], sxn[k]), _mm_cmpeq_pd(yn[k], syn[k]));
+
+			eventBits |= _mm_movemask_pd(_mm_or_pd(_mm_or_pd(esc, cyc), _mm_cmpeq_pd(n[k], ev[k])));
+		}
+
+		if (eventBits != 0)
+			break;
+	}
+
+	for (uint k = 0; k < 2; k++) {
+		_mm_store_pd(&ls.xn[k * 2], xn[k]); _mm_store_pd(&ls.xnSq[k * 2], xnSq[k]);
+		_mm_store_pd(&ls.yn[k * 2], yn[k]); _mm_store_pd(&ls.ynSq[k * 2], ynSq[k]);
+		_mm_store_pd(&ls.n[k * 2], n[k]);
+	}
+}
+
+__attribute__((target("avx2")))
+static void IterateLanesAVX2(LaneState& ls, cdouble sqEscRad) {
+	__m256d x[2], xn[2], xnSq[2], sxn[2];
+	__m256d y[2], yn[2], ynSq[2], syn[2];
+	__m256d n[2], ev[2];
+
+	const __m256d escRad = _mm256_set1_pd(sqEscRad);
+
+	for (uint k = 0; k < 2; k++) {
+		x[k] = _mm256_load_pd(&ls.x[k * 4]); xn[k] = _mm256_load_pd(&ls.xn[k * 4]); xnSq[k] = _mm256_load_pd(&ls.xnSq[k * 4]); sxn[k] = _mm256_load_pd(&ls.sxn[k * 4]);
+		y[k] = _mm256_load_pd(&ls.y[k * 4]); yn[k] = _mm256_load_pd(&ls.yn[k * 4]); ynSq[k] = _mm256_load_pd(&ls.ynSq[k * 4]); syn[k] = _mm256_load_pd(&ls.syn[k * 4]);
+		n[k] = _mm256_load_pd(&ls.n[k * 4]); ev[k] = _mm256_load_pd(&ls.ev[k * 4]);
+	}
+
+	while (true) {
+		int eventBits = 0;
+
+		for (uint k = 0; k < 2; k++) {
+			yn[k] = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2.0), xn[k]), yn[k]), y[k]);
+			xn[k] = _mm256_add_pd(_mm256_sub_pd(xnSq[k], ynSq[k]), x[k]);
+
+			xnSq[k] = _mm256_mul_pd(xn[k], xn[k]);
+			ynSq[k] = _mm256_mul_pd(yn[k], yn[k]);
+
+			n[k] = _mm256_add_pd(n[k], _mm256_set1_pd(1.0));
+		}
+
+		for (uint k = 0; k < 2; k++) {
+			const __m256d esc = _mm256_cmp_pd(_mm256_add_pd(xnSq[k], ynSq[k]), escRad, _CMP_GT_OQ);
+			const __m256d cyc = _mm256_and_pd(_mm256_cmp_pd(xn[k], sxn[k], _CMP_EQ_OQ), _mm256_cmp_pd(yn[k], syn[k], _CMP_EQ_OQ));
+
+			eventBits |= _mm256_movemask_pd(_mm256_or_pd(_mm256_or_pd(esc, cyc), _mm256_cmp_pd(n[k], ev[k], _CMP_EQ_OQ)));
+		}
+
+		if (eventBits != 0)
+			break;
+	}
+
+	for (uint k = 0; k < 2; k++) {
+		_mm256_store_pd(&ls.xn[k * 4], xn[k]); _mm256_store_pd(&ls.xnSq[k * 4], xnSq[k]);
+		_mm256_store_pd(&ls.yn[k * 4], yn[k]); _mm256_store_pd(&ls.ynSq[k * 4], ynSq[k]);
+		_mm256_store_pd(&ls.n[k * 4], n[k]);
+	}
+}
+
+// streams <pts> through the lanes of <iterFunc>; whenever a lane has an
+// event it is handled here, and a lane whose point is done is refilled
+// with the next one so lanes never sit idle waiting for slower points
+// the results (n, inSet, final orbit point) are identical to IsInSet's
+static void IteratePoints(MandelbrotPoint* pts, cuint numPts, cdouble sqEscRad, cuint maxIters, cuint numLanes, IterateLanesFunc iterFunc) {
+	LaneState ls;
+
+	uint lanePts[8];
+	uint nxtSave[8];
+
+	uint nextPt = 0;
+	uint numBusy = 0;
+
+	cdouble nan = std::numeric_limits<double>::quiet_NaN();
+	cdouble inf = std::numeric_limits<double>::infinity();
+
+	// puts the next point that needs iterating into lane <i>, or parks it
+	auto FillLane = [&](uint i) {
+		while (nextPt < numPts) {
+			MandelbrotPoint& mp = pts[nextPt++];
+
+			if (mp.InCardioidOrBulb() || maxIters == 0) {
+				mp.inSet = true;
+				continue;
+			}
+
+			ls.x[i] = mp.x; ls.xn[i] = 0.0; ls.xnSq[i] = 0.0; ls.sxn[i] = nan;
+			ls.y[i] = mp.y; ls.yn[i] = 0.0; ls.ynSq[i] = 0.0; ls.syn[i] = nan;
+
+			ls.n[i] = 0.0;
+			ls.ev[i] = std::min(PERIOD_CHECK_ITERS, maxIters);
+
+			lanePts[i] = &mp - pts;
+			nxtSave[i] = PERIOD_CHECK_ITERS;
+			numBusy += 1;
+			return;
+		}
+
+		// c=0 never escapes nor cycles (NaN never compares equal) and
+		// can not reach an infinite event count, so lane stays silent
+		ls.x[i] = 0.0; ls.xn[i] = 0.0; ls.xnSq[i] = 0.0; ls.sxn[i] = nan;
+		ls.y[i] = 0.0; ls.yn[i] = 0.0; ls.ynSq[i] = 0.0; ls.syn[i] = nan;
+
+		ls.n[i] = 0.0;
+		ls.ev[i] = inf;
+
+		lanePts[i] = numPts;
+	};
+
+	for (uint i = 0; i < numLanes; i++) {
+		FillLane(i);
+	}
+
+	while (numBusy > 0) {
+		iterFunc(ls, sqEscRad);
+
+		for (uint i = 0; i < numLanes; i++) {
+			if (lanePts[i] == numPts)
+				continue;
+
+			bool done = false;
+
+			if ((ls.xnSq[i] + ls.ynSq[i]) > sqEscRad) {
+				done = true;
+			} else if (ls.xn[i] == ls.sxn[i] && ls.yn[i] == ls.syn[i]) {
+				// periodic orbit; IsInSet would run this to maxIters
+				ls.n[i] = maxIters;
+				done = true;
+			} else if (ls.n[i] == ls.ev[i]) {
+				if (!(done = (ls.n[i] == maxIters))) {
+					// Brent-style; saves at exponentially growing intervals
+					// catch cycles of any period without storing the orbit
+					ls.sxn[i] = ls.xn[i];
+					ls.syn[i] = ls.yn[i];
+					ls.ev[i] = std::min(nxtSave[i] <<= 1, maxIters);
+				}
+			}
+
+			if (!done)
+				continue;
+
+			MandelbrotPoint& mp = pts[lanePts[i]];
+
+			mp.xn = ls.xn[i]; mp.xnSq = ls.xnSq[i];
+			mp.yn = ls.yn[i]; mp.ynSq = ls.ynSq[i];
+			mp.n = ls.n[i];
+			mp.inSet = (mp.n == maxIters);
+
+			numBusy -= 1;
+			FillLane(i);
+		}
+	}
+}
+#endif
+
+
+// signed fixed-point number for computing deep-zoom reference orbits
+// limbs are stored MSB-first as in t_bignum (simple_bignum_lib.cpp),
+// but in two's complement with limb 0 holding the integer part and
+// the remaining ones (NumLimbs - 1) * 32 bits of fraction
+// values are assumed to stay well within the +/-2^31 integer range,
+// which the orbits of non-escaped points do (|z| <= 2)
+template<uint NumLimbs> struct FixedPoint {
+	FixedPoint(double v = 0.0) {
+		FromDouble(v);
+	}
+
+	void FromDouble(double v) {
+		const bool neg = (v < 0.0);
+
+		// exact; each step moves 32 bits of the mantissa into a limb
+		v = std::fabs(v);
+
+		for (uint i = 0; i < NumLimbs; i++) {
+			limbs[i] = uint32_t(v);
+			v = (v - limbs[i]) * 4294967296.0;
+		}
+
+		if (neg) {
+			Negate();
+		}
+	}
+
+	// accepts plain decimal notation ("-0.743643887037158704752191506114774")
+	// so that view centers can be specified beyond double precision
+	bool FromString(const char* str) {
+		const bool neg = (*str == '-');
+		const char* dot = nullptr;
+
+		str += (neg || *str == '+');
+		memset(&limbs[0], 0, sizeof(limbs));
+
+		if ((dot = strchr(str, '.')) == nullptr)
+			dot = str + strlen(str);
+
+		// fraction, consumed from the least significant digit upward
+		for (const char* c = str + strlen(str) - 1; c > dot; c--) {
+			if (*c < '0' || *c > '9')
+				return false;
+
+			limbs[0] = *c - '0';
+			DivideSmall(10);
+		}
+
+		for (const char* c = str; c < dot; c++) {
+			if (*c < '0' || *c > '9')
+				return false;
+
+			limbs[0] = limbs[0] * 10 + (*c - '0');
+		}
+
+		if (neg) {
+			Negate();
+		}
+
+		return true;
+	}
+
+	double ToDouble() const {
+		FixedPoint m = Abs();
+		double v = 0.0;
+
+		for (uint i = NumLimbs; i > 0; i--) {
+			v = (v * (1.0 / 4294967296.0)) + m.limbs[i - 1];
+		}
+
+		return (IsNegative()? -v: v);
+	}
+
+	std::string ToString(uint numDigits) const {
+		FixedPoint m = Abs();
+		std::string str = (IsNegative()? "-": "") + std::to_string(m.limbs[0]) + ".";
+
+		for (uint d = 0; d < numDigits; d++) {
+			m.limbs[0] = 0;
+			m.MultiplySmall(10);
+
+			str += char('0' + m.limbs[0]);
+		}
+
+		return str;
+	}
+
+
+	FixedPoint operator + (const FixedPoint& f) const {
+		FixedPoint r;
+		uint64_t c = 0;
+
+		for (uint i = NumLimbs; i > 0; i--) {
+			c += uint64_t(limbs[i - 1]) + f.limbs[i - 1];
+			r.limbs[i - 1] = uint32_t(c);
+			c >>= 32;
+		}
+
+		return r;
+	}
+
+	FixedPoint operator - (const FixedPoint& f) const {
+		return ((*this) + f.Negated());
+	}
+
+	// truncates the product to NumLimbs; the dropped low-order partial
+	// products make it accurate to within a few units of the last limb
+	FixedPoint operator * (const FixedPoint& f) const {
+		const FixedPoint a = Abs();
+		const FixedPoint b = f.Abs();
+
+		// rl[k + 1] receives the products of limbs i and j with i + j = k
+		uint32_t rl[NumLimbs * 2 + 1] = {0};
+
+		for (uint i = NumLimbs; i > 0; i--) {
+			uint64_t c = 0;
+
+			for (uint j = NumLimbs; j > 0; j--) {
+				c += uint64_t(a.limbs[i - 1]) * b.limbs[j - 1] + rl[i + j - 1];
+				rl[i + j - 1] = uint32_t(c);
+				c >>= 32;
+			}
+
+			rl[i - 1] = uint32_t(c);
+		}
+
+		FixedPoint r;
+		memcpy(&r.limbs[0], &rl[1], sizeof(limbs));
+
+		if (IsNegative() != f.IsNegative()) {
+			r.Negate();
+		}
+
+		return r;
+	}
+
+
+	bool IsNegative() const { return ((limbs[0] >> 31) != 0); }
+
+	FixedPoint Abs() const { return (IsNegative()? Negated(): *this); }
+	FixedPoint Negated() const { FixedPoint r = *this; r.Negate(); return r; }
+
+	void Negate() {
+		uint64_t c = 1;
+
+		for (uint i = NumLimbs; i > 0; i--) {
+			c += uint32_t(~limbs[i - 1]);
+			limbs[i - 1] = uint32_t(c);
+			c >>= 32;
+		}
+	}
+
+	// both only for non-negative values
+	void MultiplySmall(uint32_t m) {
+		uint64_t c = 0;
+
+		for (uint i = NumLimbs; i > 0; i--) {
+			c += uint64_t(limbs[i - 1]) * m;
+			limbs[i - 1] = uint32_t(c);
+			c >>= 32;
+		}
+	}
+
+	void DivideSmall(uint32_t d) {
+		uint64_t r = 0;
+
+		for (uint i = 0; i < NumLimbs; i++) {
+			r = (r << 32) | limbs[i];
+			limbs[i] = uint32_t(r / d);
+			r %= d;
+		}
+	}
+
+	uint32_t limbs[NumLimbs];
+};
+
+// 224 fractional bits (~67 decimal digits) which is plenty for views
+// down to ~1e-60; deeper than ~1e-300 the double deltas would underflow
+typedef FixedPoint<8> DeepReal;
+
+
+
+// orbit Z_n of the reference point C, computed at high precision but
+// stored as doubles (|Z_n| stays small) for perturbing pixels against
+// it; holds Z_0 through either Z_maxIters or the first escaped Z_n
+struct ReferenceOrbit {
+	void Compute(const DeepReal& _cx, const DeepReal& _cy, cuint maxIters, cdouble sqEscRad) {
+		DeepReal zx;
+		DeepReal zy;
+
+		cx = _cx;
+		cy = _cy;
+
+		zr.clear();
+		zi.clear();
+
+		for (uint n = 0; n <= maxIters; n++) {
+			cdouble zxd = zx.ToDouble();
+			cdouble zyd = zy.ToDouble();
+
+			zr.push_back(zxd);
+			zi.push_back(zyd);
+
+			if ((zxd * zxd + zyd * zyd) > sqEscRad)
+				break;
+
+			const DeepReal zxSq = zx * zx;
+			const DeepReal zySq = zy * zy;
+			const DeepReal zxzy = zx * zy;
+
+			zx = (zxSq - zySq) + cx;
+			zy = (zxzy + zxzy) + cy;
+		}
+	}
+
+	uint GetLength() const { return zr.size(); }
+
+	DeepReal cx;
+	DeepReal cy;
+
+	std::vector<double> zr;
+	std::vector<double> zi;
+};
+
+
+// series approximation of the perturbation delta: as long as all the
+// pixel offsets dc from the reference are small, each pixel's delta
+// is d_n = A_n*dc + B_n*dc^2 + C_n*dc^3 (plus higher-order terms that
+// are negligible) with coefficients shared by all pixels, so the first
+// <skip> iterations of every pixel can be replaced by this polynomial
+struct SeriesApprox {
+	SeriesApprox(): skip(0) {
+		ar = 0.0; br = 0.0; cr = 0.0;
+		ai = 0.0; bi = 0.0; ci = 0.0;
+	}
+
+	// <maxOffset> is the largest |dc| that will be evaluated
+	void Compute(const ReferenceOrbit& ro, cdouble maxOffset, cdouble sqEscRad) {
+		cdouble r1 = maxOffset;
+		cdouble r2 = r1 * r1;
+		cdouble r3 = r2 * r1;
+
+		*this = SeriesApprox();
+
+		for (uint n = 0; (n + 1) < ro.GetLength(); n++) {
+			cdouble zr = ro.zr[n];
+			cdouble zi = ro.zi[n];
+
+			// A' = 2ZA + 1, B' = 2ZB + A^2, C' = 2ZC + 2AB
+			cdouble nar = 2.0 * (zr * ar - zi * ai) + 1.0;
+			cdouble nai = 2.0 * (zr * ai + zi * ar);
+			cdouble nbr = 2.0 * (zr * br - zi * bi) + (ar * ar - ai * ai);
+			cdouble nbi = 2.0 * (zr * bi + zi * br) + (2.0 * ar * ai);
+			cdouble ncr = 2.0 * (zr * cr - zi * ci) + 2.0 * (ar * br - ai * bi);
+			cdouble nci = 2.0 * (zr * ci + zi * cr) + 2.0 * (ar * bi + ai * br);
+
+			cdouble aMag = sqrt(nar * nar + nai * nai) * r1;
+			cdouble bMag = sqrt(nbr * nbr + nbi * nbi) * r2;
+			cdouble cMag = sqrt(ncr * ncr + nci * nci) * r3;
+
+			cdouble nzr = ro.zr[n + 1];
+			cdouble nzi = ro.zi[n + 1];
+			cdouble zMag = sqrt(nzr * nzr + nzi * nzi);
+
+			if (cMag > (aMag * DEEP_ZOOM_SERIES_TOL))
+				break;
+
+			// no pixel may escape or approach a glitch during the skip
+			if ((zMag + aMag + bMag) * (zMag + aMag + bMag) > sqEscRad)
+				break;
+			if ((aMag + bMag) > (0.5 * zMag))
+				break;
+
+			ar = nar; br = nbr; cr = ncr;
+			ai = nai; bi = nbi; ci = nci;
+
+			skip = n + 1;
+		}
+	}
+
+	void Evaluate(cdouble dcr, cdouble dci, double* dr, double* di) const {
+		// Horner; ((C*dc + B)*dc + A)*dc
+		double tr = cr * dcr - ci * dci + br;
+		double ti = cr * dci + ci * dcr + bi;
+		double ur = tr * dcr - ti * dci + ar;
+		double ui = tr * dci + ti * dcr + ai;
+
+		*dr = ur * dcr - ui * dci;
+		*di = ur * dci + ui * dcr;
+	}
+
+	uint skip;
+
+	double ar, br, cr;
+	double ai, bi, ci;
+};
+
+
+// iterates the pixel at offset dc=(dcr, dci) from the reference point
+// as a delta d against the reference orbit (z_n = Z_n + d_n, so that
+// d_n+1 = 2*Z_n*d_n + d_n^2 + dc) starting from iteration <n0>, which
+// makes double precision sufficient at any zoom depth
+// returns false if the pixel glitched, ie. must be redone against a
+// different reference; on success <mp> is in the same state IsInSet
+// would have left it in (apart from rounding)
+static bool IsInSetPerturbed(MandelbrotPoint& mp, const ReferenceOrbit& ro, cdouble dcr, cdouble dci, uint n0, double dr, double di, cdouble sqEscRad, cuint maxIters) {
+	cuint refLen = ro.GetLength();
+
+	for (uint n = n0; true; n++) {
+		cdouble zr = ro.zr[n];
+		cdouble zi = ro.zi[n];
+
+		cdouble xn = zr + dr;
+		cdouble yn = zi + di;
+
+		if ((xn * xn + yn * yn) > sqEscRad || n == maxIters) {
+			mp.xn = xn; mp.xnSq = xn * xn;
+			mp.yn = yn; mp.ynSq = yn * yn;
+			mp.n = n;
+			mp.inSet = (n == maxIters);
+			return true;
+		}
+
+		// reference escaped before this pixel did, or the pixel got so
+		// close to 0 that d_n swamps the (more precise) Z_n it perturbs
+		if ((n + 1) == refLen)
+			return false;
+		if ((xn * xn + yn * yn) < ((zr * zr + zi * zi) * DEEP_ZOOM_GLITCH_TOL))
+			return false;
+
+		cdouble ndr = 2.0 * (zr * dr - zi * di) + (dr * dr - di * di) + dcr;
+		cdouble ndi = 2.0 * (zr * di + zi * dr) + (2.0 * dr * di) + dci;
+
+		dr = ndr;
+		di = ndi;
+	}
+
+	return false;
+}
+
+
+
 struct Pixel {
 	Pixel(): l(0.0) {
 	}
@@ -331,6 +972,19 @@ struct ZoomRectangle {
 		xmin = -2.5, xmax = 1.5, xrange = xmax - xmin, dx = xrange / sw;
 		ymin = -1.5, ymax = 1.5, yrange = ymax - ymin, dy = yrange / sh;
 		ar = sw / double(sh);
+
+		cx.FromDouble((xmin + xmax) * 0.5);
+		cy.FromDouble((ymin + ymax) * 0.5);
+	}
+
+	// centers the frame on (_cx, _cy) at <mag> times the magnification
+	// of the default frame, for views deeper than doubles can express
+	void SetCenter(const DeepReal& _cx, const DeepReal& _cy, cdouble mag) {
+		cx = _cx; xrange /= mag; dx /= mag;
+		cy = _cy; yrange /= mag; dy /= mag;
+
+		xmin = cx.ToDouble() - xrange * 0.5; xmax = xmin + xrange;
+		ymax = cy.ToDouble() + yrange * 0.5; ymin = ymax - yrange;
 	}
 
 	// derive the zooming frame given the top-left corner
@@ -353,6 +1007,11 @@ struct ZoomRectangle {
 		cdouble ndx = (nxrange / sw);
 		cdouble ndy = (nyrange / sh);
 
+		// move the center by its offset, which (unlike the new bounds
+		// themselves) stays accurate relative to the pixel spacing
+		cx = cx + DeepReal(((tlx / sw) - 0.5) * xrange + (nxrange * 0.5));
+		cy = cy + DeepReal((0.5 - (tly / sh)) * yrange - (nyrange * 0.5));
+
 		xmin = nxmin; xmax = nxmax; xrange = nxrange; dx = ndx;
 		ymin = nymin; ymax = nymax; yrange = nyrange; dy = ndy;
 	}
@@ -360,6 +1019,11 @@ struct ZoomRectangle {
 	double xmin, xmax, xrange, dx;
 	double ymin, ymax, yrange, dy;
 	double ar;
+
+	// exact center of the frame, (xmin + xmax) / 2 and (ymin + ymax) / 2
+	// are only approximations of it once dx and dy get small enough
+	DeepReal cx;
+	DeepReal cy;
 };
 
 
@@ -370,6 +1034,8 @@ private:
 	uint sheight;
 
 	ColorMode cm;
+	SIMDMode sm;
+	DeepMode dm;
 	ColorWeights cw;
 	const RGBColor<uint> setColor;
 	RNG rng;
@@ -388,11 +1054,20 @@ private:
 
 	std::vector< std::vector<Pixel> > image;
 
+	// state shared by the threads computing a deep-zoom image; each of
+	// them collects the (w * sheight + h) indices of glitched pixels
+	ReferenceOrbit refOrbit;
+	SeriesApprox refSeries;
+
+	std::vector< std::vector<uint> > glitches;
+
 public:
 	MandelbrotSet(cuint sw, cuint sh, ColorMode c, cuint t, bool w): setColor(255, 255, 255) {
 		swidth = sw;
 		sheight = sh;
 		cm = c;
+		sm = GetCPUSIMDMode();
+		dm = DEEP_AUTO;
 
 		zrLst.push_front(ZoomRectangle(sw, sh));
 
@@ -404,6 +1079,9 @@ public:
 
 		#ifdef THREADED
 		threads.resize(t, 0x0);
+		glitches.resize(t);
+		#else
+		glitches.resize(1);
 		#endif
 
 		image.resize(sw, std::vector<Pixel>(sh, Pixel()));
@@ -440,6 +1118,15 @@ public:
 				));
 				continue;
 			}
+
+			if (m == COMPUTE_DEEP_IMAGE) {
+				threads[threadID] = new boost::thread(boost::bind(
+					&MandelbrotSet::ComputeDeepImage, this,
+					maxIters, threadID, thrJobSize,
+					&ptsIn[threadID], &ptsOut[threadID]
+				));
+				continue;
+			}
 		}
 
 		return true;
@@ -460,6 +1147,47 @@ public:
 
 
 
+	// can only downgrade from what the CPU supports
+	void SetSIMDMode(SIMDMode m) { sm = std::min(m, GetCPUSIMDMode()); }
+	SIMDMode GetSIMDMode() const { return sm; }
+
+	void SetDeepMode(DeepMode m) { dm = m; }
+	DeepMode GetDeepMode() const { return dm; }
+
+	// replaces the default frame at the bottom of the zoom stack
+	void SetCenter(const DeepReal& cx, const DeepReal& cy, cdouble mag) {
+		zrLst.clear();
+		zrLst.push_front(ZoomRectangle(swidth, sheight));
+		zrLst.front().SetCenter(cx, cy, mag);
+	}
+
+	bool UseDeepZoom() const {
+		const ZoomRectangle& zr = zrLst.front();
+
+		switch (dm) {
+			case DEEP_NEVER : { return false; } break;
+			case DEEP_ALWAYS: { return  true; } break;
+			default: {} break;
+		}
+
+		return (std::min(zr.dx, zr.dy) < DEEP_ZOOM_MIN_SPACING);
+	}
+
+	// equivalent to calling IsInSet on each point
+	void IteratePoints(MandelbrotPoint* pts, cuint numPts, cdouble sqEscRad, cuint maxIters) const {
+		#if (HAVE_X86_SIMD == 1)
+		if (sm == SIMD_AVX2) { ::IteratePoints(pts, numPts, sqEscRad, maxIters, 8, IterateLanesAVX2); return; }
+		if (sm == SIMD_SSE2) { ::IteratePoints(pts, numPts, sqEscRad, maxIters, 4, IterateLanesSSE2); return; }
+		#endif
+
+		for (uint i = 0; i < numPts; i++) {
+			// iterate a fresh local so its state can live in registers
+			MandelbrotPoint mp(pts[i].x, pts[i].y);
+			mp.IsInSet(sqEscRad, maxIters);
+			pts[i] = mp;
+		}
+	}
+
 	// the basic escape-time algorithm
 	void ComputeImage(cuint maxIters, cuint tID, cuint tCols, uint* ptsIn, uint* ptsOut) {
 		// nDistrib[i] is the total number of points
@@ -474,16 +1202,15 @@ public:
 		cdouble rlogExp  = 1.0 / log(setExp);
 		cdouble sqEscRad = 2.0 * 2.0;
 
-		RGBColor<uint> co;
-		MandelbrotPoint mp;
-
 		cuint wMin = tID * tCols, wMax = wMin + tCols;
 		cuint hMin =           0, hMax = sheight;
 
+		// one column at a time, so the SIMD kernels have enough points
+		std::vector<MandelbrotPoint> mps(hMax - hMin);
+
 		const ZoomRectangle& zr = zrLst.front();
 		double x = zr.xmin + (wMin * zr.dx);
 		double y = zr.ymax;
-		double lu = 0.0;
 
 		// w and h are the screen-coors of the projected pixel,
 		// x and y are its (real, imaginary) coordinates in the
@@ -495,34 +1222,50 @@ public:
 			y = zr.ymax;
 
 			for (uint h = hMin; h < hMax; h++) {
-				mp.Init(x, y);
+				mps[h - hMin].Init(x, y);
+				y -= zr.dy;
+			}
+
+			IteratePoints(&mps[0], hMax - hMin, sqEscRad, maxIters);
+
+			for (uint h = hMin; h < hMax; h++) {
+				StorePixel(w, h, mps[h - hMin], maxIters, rlogExp, ptsIn, ptsOut);
+			}
 
-				if (mp.IsInSet(sqEscRad, maxIters)) {
-					(*ptsIn) += 1;
+			x += zr.dx;
+		}
+	}
 
-					co = setColor;
-					lu = maxIters;
+	// colors and stores an iterated point
+	void StorePixel(cuint w, cuint h, MandelbrotPoint& mp, cuint maxIters, cdouble rlogExp, uint* ptsIn, uint* ptsOut) {
+		RGBColor<uint> co;
+		double lu = 0.0;
 
-					// lu = 1.0 / sqrt(mp.xnSq + mp.ynSq + 0.01);
-					// co = mp.GetColor(cm, lum, &cw);
-				} else {
-					(*ptsOut) += 1;
+		if (mp.inSet) {
+			(*ptsIn) += 1;
 
-					lu = mp.GetLuminance(cm, rlogExp);
-					co = mp.GetColor(cm, lu, &cw);
-				}
+			co = setColor;
+			lu = maxIters;
 
-				image[w][h].p = mp;
-				image[w][h].c = co;
-				image[w][h].l = lu;
-				y -= zr.dy;
-			}
+			// lu = 1.0 / sqrt(mp.xnSq + mp.ynSq + 0.01);
+			// co = mp.GetColor(cm, lum, &cw);
+		} else {
+			(*ptsOut) += 1;
 
-			x += zr.dx;
+			lu = mp.GetLuminance(cm, rlogExp);
+			co = mp.GetColor(cm, lu, &cw);
 		}
+
+		image[w][h].p = mp;
+		image[w][h].c = co;
+		image[w][h].l = lu;
 	}
 
 	bool ComputeImage(cuint maxIters, bool verbose) {
+		if (UseDeepZoom()) {
+			return (ComputeDeepImage(maxIters, verbose));
+		}
+
 		uint tPointsIn = 0;
 		uint tPointsOut = 0;
 		uint ticks = SDL_GetTicks();
@@ -559,6 +1302,184 @@ public:
 			cout << "\tdrawn set area:         " << (zr.xrange * zr.yrange * inTotRatio) << endl;
 			cout << "\timage computation time: " << (SDL_GetTicks() - ticks) << "ms" << endl;
 			cout << "\titeration limit:        " << maxIters << endl;
+			cout << "\tSIMD mode:              " << SIMD_MODE_NAMES[sm] << endl;
+		}
+
+		return true;
+	}
+
+
+
+	// the perturbation (deep-zoom) algorithm; every pixel is iterated
+	// in double precision as an offset from the reference orbit, which
+	// (the only part done at high precision) belongs to the view center
+	void ComputeDeepImage(cuint maxIters, cuint tID, cuint tCols, uint* ptsIn, uint* ptsOut) {
+		cdouble setExp   = 2.0;
+		cdouble rlogExp  = 1.0 / log(setExp);
+		cdouble sqEscRad = 2.0 * 2.0;
+
+		cuint wMin = tID * tCols, wMax = wMin + tCols;
+		cuint hMin =           0, hMax = sheight;
+
+		const ZoomRectangle& zr = zrLst.front();
+		cdouble cx = zr.cx.ToDouble();
+		cdouble cy = zr.cy.ToDouble();
+
+		std::vector<uint>& tGlitches = glitches[tID];
+		MandelbrotPoint mp;
+
+		tGlitches.clear();
+
+		for (uint w = wMin; w < wMax; w++) {
+			for (uint h = hMin; h < hMax; h++) {
+				// offset of (w, h) from the center (and reference) point
+				cdouble dcr = (w - (swidth  * 0.5)) * zr.dx;
+				cdouble dci = ((sheight * 0.5) - h) * zr.dy;
+
+				double dr = 0.0;
+				double di = 0.0;
+
+				refSeries.Evaluate(dcr, dci, &dr, &di);
+				mp.Init(cx + dcr, cy + dci);
+
+				if (!IsInSetPerturbed(mp, refOrbit, dcr, dci, refSeries.skip, dr, di, sqEscRad, maxIters)) {
+					tGlitches.push_back(w * sheight + h);
+					continue;
+				}
+
+				StorePixel(w, h, mp, maxIters, rlogExp, ptsIn, ptsOut);
+			}
+		}
+	}
+
+	// redoes glitched pixels against new references, each taken from
+	// the middle of the remaining glitched set (where the structure that
+	// the current references can not resolve is) and computed directly
+	// without the series approximation since the pixel count is small
+	// returns the number of pixels that could not be resolved at all
+	uint ResolveGlitches(cuint maxIters, uint* numRefs, uint* ptsIn, uint* ptsOut) {
+		cdouble setExp   = 2.0;
+		cdouble rlogExp  = 1.0 / log(setExp);
+		cdouble sqEscRad = 2.0 * 2.0;
+
+		const ZoomRectangle& zr = zrLst.front();
+		cdouble cx = zr.cx.ToDouble();
+		cdouble cy = zr.cy.ToDouble();
+
+		std::vector<uint> curGlitches;
+		std::vector<uint> nxtGlitches;
+
+		ReferenceOrbit ro;
+		MandelbrotPoint mp;
+
+		for (uint i = 0; i < glitches.size(); i++) {
+			curGlitches.insert(curGlitches.end(), glitches[i].begin(), glitches[i].end());
+		}
+
+		for (; !curGlitches.empty() && (*numRefs) < DEEP_ZOOM_MAX_REFS; (*numRefs) += 1) {
+			cuint rw = curGlitches[curGlitches.size() >> 1] / sheight;
+			cuint rh = curGlitches[curGlitches.size() >> 1] % sheight;
+
+			ro.Compute(
+				zr.cx + DeepReal((rw - (swidth  * 0.5)) * zr.dx),
+				zr.cy + DeepReal(((sheight * 0.5) - rh) * zr.dy),
+				maxIters,
+				sqEscRad
+			);
+
+			nxtGlitches.clear();
+
+			for (uint i = 0; i < curGlitches.size(); i++) {
+				cuint w = curGlitches[i] / sheight;
+				cuint h = curGlitches[i] % sheight;
+
+				// offset relative to the new reference point
+				cdouble dcr = (double(w) - double(rw)) * zr.dx;
+				cdouble dci = (double(rh) - double(h)) * zr.dy;
+
+				mp.Init(cx + (w - (swidth * 0.5)) * zr.dx, cy + ((sheight * 0.5) - h) * zr.dy);
+
+				if (!IsInSetPerturbed(mp, ro, dcr, dci, 0, 0.0, 0.0, sqEscRad, maxIters)) {
+					nxtGlitches.push_back(curGlitches[i]);
+					continue;
+				}
+
+				StorePixel(w, h, mp, maxIters, rlogExp, ptsIn, ptsOut);
+			}
+
+			curGlitches.swap(nxtGlitches);
+		}
+
+		// out of references; these get whatever doubles make of them
+		for (uint i = 0; i < curGlitches.size(); i++) {
+			cuint w = curGlitches[i] / sheight;
+			cuint h = curGlitches[i] % sheight;
+
+			mp.Init(cx + (w - (swidth * 0.5)) * zr.dx, cy + ((sheight * 0.5) - h) * zr.dy);
+			mp.IsInSet(sqEscRad, maxIters);
+
+			StorePixel(w, h, mp, maxIters, rlogExp, ptsIn, ptsOut);
+		}
+
+		return (curGlitches.size());
+	}
+
+	bool ComputeDeepImage(cuint maxIters, bool verbose) {
+		uint tPointsIn = 0;
+		uint tPointsOut = 0;
+		uint numRefs = 1;
+		uint ticks = SDL_GetTicks();
+
+		const ZoomRectangle& zr = zrLst.front();
+
+		// largest pixel offset from the center is half the diagonal
+		cdouble maxOffset = 0.5 * sqrt((zr.xrange * zr.xrange) + (zr.yrange * zr.yrange));
+		cdouble sqEscRad = 2.0 * 2.0;
+
+		refOrbit.Compute(zr.cx, zr.cy, maxIters, sqEscRad);
+		refSeries.Compute(refOrbit, maxOffset, sqEscRad);
+
+		#ifdef THREADED
+		cuint numThreads = threads.size();
+
+		std::vector<uint> ptsIn; ptsIn.resize(numThreads, 0);
+		std::vector<uint> ptsOut; ptsOut.resize(numThreads, 0);
+
+		if (SpawnThreads(COMPUTE_DEEP_IMAGE, swidth, maxIters, ptsIn, ptsOut)) {
+			JoinThreads(ptsIn, ptsOut, &tPointsIn, &tPointsOut);
+		} else {
+			return false;
+		}
+
+		#else
+		ComputeDeepImage(maxIters, 0, swidth, &tPointsIn, &tPointsOut);
+		#endif
+
+		uint numGlitched = 0;
+
+		for (uint i = 0; i < glitches.size(); i++) {
+			numGlitched += glitches[i].size();
+		}
+
+		cuint numUnresolved = ResolveGlitches(maxIters, &numRefs, &tPointsIn, &tPointsOut);
+
+		if (verbose) {
+			// enough digits to locate the center to within a pixel
+			cuint numDigits = 3 + std::max(0.0, -log10(std::min(zr.dx, zr.dy)));
+
+			cout << "[MandelbrotSet::" << __FUNCTION__ << "]" << endl;
+			cout << "\tpoints drawn total:     " << (tPointsIn + tPointsOut) << endl;
+			cout << "\tpoints inside set:      " << tPointsIn << endl;
+			cout << "\tpoints outside set:     " << tPointsOut << endl;
+			cout << "\tview center (real):     " << zr.cx.ToString(numDigits) << endl;
+			cout << "\tview center (imag):     " << zr.cy.ToString(numDigits) << endl;
+			cout << "\tpixel spacing:          " << zr.dx << endl;
+			cout << "\treference orbit length: " << refOrbit.GetLength() << endl;
+			cout << "\tseries-skipped iters:   " << refSeries.skip << endl;
+			cout << "\treference orbits used:  " << numRefs << endl;
+			cout << "\tglitched pixels:        " << numGlitched << " (" << numUnresolved << " unresolved)" << endl;
+			cout << "\timage computation time: " << (SDL_GetTicks() - ticks) << "ms" << endl;
+			cout << "\titeration limit:        " << maxIters << endl;
 		}
 
 		return true;
@@ -1032,6 +1953,9 @@ int main(int argc, char** argv) {
 	uint numSamplePoints = 10000;
 	uint numThreads      =     1;
 	uint numBatches      =     1;
+	uint simdMode        = SIMD_AVX2;
+	uint deepMode        = DEEP_AUTO;
+	double zoomFactor    =   1.0;
 
 	bool computeImage    =  true;
 	bool outputImage     = false;
@@ -1040,6 +1964,11 @@ int main(int argc, char** argv) {
 	bool showWindow      =  true;
 	bool batchMode       = false;
 
+	// view center, as decimal strings since doubles can not hold
+	// the coordinates of deep zooms
+	const char* centerRe = nullptr;
+	const char* centerIm = nullptr;
+
 	for (int i = 0; i < argc; i++) {
 		const std::string s(argv[i]);
 		const bool moreArgs = (i < argc - 1);
@@ -1056,10 +1985,33 @@ int main(int argc, char** argv) {
 		if (s == "--ccol" && moreArgs) { contColors      = !!atoi(argv[i + 1]); continue; }
 		if (s == "--wind" && moreArgs) { showWindow      = !!atoi(argv[i + 1]); continue; }
 		if (s == "--bmod" && moreArgs) { batchMode       = !!atoi(argv[i + 1]); continue; }
+		if (s == "--simd" && moreArgs) { simdMode        =   atoi(argv[i + 1]); continue; }
+		if (s == "--deep" && moreArgs) { deepMode        =   atoi(argv[i + 1]); continue; }
+		if (s == "--zoom" && moreArgs) { zoomFactor      =   atof(argv[i + 1]); continue; }
+		if (s == "--cnre" && moreArgs) { centerRe        =        argv[i + 1] ; continue; }
+		if (s == "--cnim" && moreArgs) { centerIm        =        argv[i + 1] ; continue; }
 	}
 
 	MandelbrotSet m(xResolution, yResolution, (contColors? CM_CONTINUOUS: CM_DISCRETE), numThreads, showWindow);
 
+	// 0 forces the scalar path, 1 SSE2, 2 (default) the best available
+	m.SetSIMDMode(SIMDMode(std::min(simdMode, uint(SIMD_AVX2))));
+	// 0 never uses perturbation, 1 always does, 2 (default) when needed
+	m.SetDeepMode(DeepMode(std::min(deepMode, uint(DEEP_AUTO))));
+
+	if (centerRe != nullptr || centerIm != nullptr || zoomFactor != 1.0) {
+		/// usage example: "./mandelbrot_fractal_gen --cnre -0.743643887037158704752191506114774 --cnim 0.131825904205311970493132056385139 --zoom 1e25 --iter 20000"
+		DeepReal cx(-0.5);
+		DeepReal cy( 0.0);
+
+		if ((centerRe != nullptr && !cx.FromString(centerRe)) || (centerIm != nullptr && !cy.FromString(centerIm))) {
+			cout << "[" << __FUNCTION__ << "] malformed view center" << endl;
+			return 1;
+		}
+
+		m.SetCenter(cx, cy, std::max(zoomFactor, 1e-3));
+	}
+
 	if (computeImage) {
 		m.ComputeImage(maxIterations, true);
 	}
@@ -0,0 +1,179 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "memory_pool_types.hpp"
+
+#define MAX_THREADS   64
+#define NUM_OBJECTS 4096
+#define NUM_ROUNDS   256
+
+#define OBJECT_SIZE   64
+#define CHUNK_PAGES 1024
+#define MAX_CHUNKS  (((MAX_THREADS * NUM_OBJECTS * 2) / CHUNK_PAGES) + MAX_THREADS)
+
+
+struct t_object {
+	uint8_t bytes[OBJECT_SIZE - sizeof(size_t)];
+};
+
+typedef t_chunked_mem_pool<MAX_CHUNKS, OBJECT_SIZE, CHUNK_PAGES> t_serial_pool;
+typedef t_concurrent_chunked_mem_pool<MAX_CHUNKS, OBJECT_SIZE, CHUNK_PAGES, MAX_THREADS> t_shared_pool;
+
+
+
+// spin-barrier; threads are expected to arrive at roughly the same time
+struct t_thread_barrier {
+public:
+	t_thread_barrier(size_t n): m_num_threads(n) {}
+
+	void wait() {
+		const size_t gen = m_generation.load(std::memory_order_acquire);
+
+		if (m_num_waiting.fetch_add(1, std::memory_order_acq_rel) == (m_num_threads - 1)) {
+			m_num_waiting.store(0, std::memory_order_relaxed);
+			m_generation.fetch_add(1, std::memory_order_release);
+			return;
+		}
+
+		while (m_generation.load(std::memory_order_acquire) == gen) {
+			std::this_thread::yield();
+		}
+	}
+
+private:
+	const size_t m_num_threads;
+
+	std::atomic<size_t> m_num_waiting = {0};
+	std::atomic<size_t> m_generation = {0};
+};
+
+
+// each allocator exposes {alloc,free}(tid, ...) so that the
+// same driver can be used for all of them; the serial pool
+// is only usable when frees never cross threads, otherwise
+// it has to be wrapped in a mutex
+struct t_malloc_allocator {
+	t_object* alloc(size_t) { return (new t_object()); }
+	void free(size_t, t_object* p) { delete p; }
+	void exit(size_t) {}
+};
+
+struct t_serial_allocator {
+	t_serial_allocator(size_t n): pools(n) {}
+
+	t_object* alloc(size_t tid) { return (pools[tid]->alloc<t_object>()); }
+	void free(size_t tid, t_object* p) { pools[tid]->free(p); }
+	void exit(size_t) {}
+
+	std::vector< std::unique_ptr<t_serial_pool> > pools;
+};
+
+struct t_locked_allocator {
+	t_object* alloc(size_t) { std::lock_guard<std::mutex> lock(mutex); return (pool.alloc<t_object>()); }
+	void free(size_t, t_object* p) { std::lock_guard<std::mutex> lock(mutex); pool.free(p); }
+	void exit(size_t) {}
+
+	std::unique_ptr<t_serial_pool> pool_ptr = std::unique_ptr<t_serial_pool>(new t_serial_pool());
+	t_serial_pool& pool = *pool_ptr;
+	std::mutex mutex;
+};
+
+struct t_shared_allocator {
+	t_object* alloc(size_t) { return (pool.alloc<t_object>()); }
+	void free(size_t, t_object* p) { pool.free(p); }
+	void exit(size_t) { pool.thread_exit(); }
+
+	std::unique_ptr<t_shared_pool> pool_ptr = std::unique_ptr<t_shared_pool>(new t_shared_pool());
+	t_shared_pool& pool = *pool_ptr;
+};
+
+
+
+// in each round every thread allocates NUM_OBJECTS objects, then
+// frees either its own set (<cross>=false) or that of its right
+// neighbour (<cross>=true), which exercises remote frees
+template<typename t_allocator> double run_benchmark(t_allocator& allocator, size_t num_threads, bool cross) {
+	std::vector<std::thread> threads;
+	std::vector< std::vector<t_object*> > objects(num_threads, std::vector<t_object*>(NUM_OBJECTS, nullptr));
+
+	t_thread_barrier barrier(num_threads);
+
+	const auto t0 = std::chrono::steady_clock::now();
+
+	for (size_t tid = 0; tid < num_threads; tid++) {
+		threads.emplace_back([&, tid]() {
+			std::vector<t_object*>& own_objs = objects[tid];
+			std::vector<t_object*>& ngb_objs = objects[(tid + cross) % num_threads];
+
+			for (size_t r = 0; r < NUM_ROUNDS; r++) {
+				for (size_t i = 0; i < NUM_OBJECTS; i++) {
+					assert(own_objs[i] == nullptr);
+					own_objs[i] = allocator.alloc(tid);
+					own_objs[i]->bytes[0] = i;
+				}
+
+				if (cross)
+					barrier.wait();
+
+				for (size_t i = 0; i < NUM_OBJECTS; i++) {
+					allocator.free(tid, ngb_objs[i]);
+					ngb_objs[i] = nullptr;
+				}
+
+				if (cross)
+					barrier.wait();
+			}
+
+			allocator.exit(tid);
+		});
+	}
+
+	for (std::thread& t: threads) {
+		t.join();
+	}
+
+	const auto t1 = std::chrono::steady_clock::now();
+	const auto dt = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0);
+
+	// nanoseconds per alloc+free pair
+	return (dt.count() / double(num_threads * NUM_ROUNDS * NUM_OBJECTS));
+}
+
+
+int main(int argc, char** argv) {
+	const size_t max_threads = std::min(size_t((argc > 1)? std::atoi(argv[1]): std::thread::hardware_concurrency()), size_t(MAX_THREADS));
+
+	printf("[%s] object_size=%u num_objects=%u num_rounds=%u\n", __func__, OBJECT_SIZE, NUM_OBJECTS, NUM_ROUNDS);
+	printf("[%s] %8s %12s %12s %12s %12s %12s %12s\n", __func__, "threads", "malloc", "serial-pool", "shared-pool", "malloc-x", "locked-x", "shared-x");
+	printf("[%s] %8s %12s %12s %12s %12s %12s %12s\n", __func__, "", "(ns/op)", "(ns/op)", "(ns/op)", "(ns/op)", "(ns/op)", "(ns/op)");
+
+	for (size_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+		t_malloc_allocator malloc_allocator;
+		t_serial_allocator serial_allocator(num_threads);
+		t_locked_allocator locked_allocator;
+		t_shared_allocator shared_allocator;
+
+		for (size_t i = 0; i < num_threads; i++) {
+			serial_allocator.pools[i].reset(new t_serial_pool());
+		}
+
+		const double malloc_ns = run_benchmark(malloc_allocator, num_threads, false);
+		const double serial_ns = run_benchmark(serial_allocator, num_threads, false);
+		const double shared_ns = run_benchmark(shared_allocator, num_threads, false);
+
+		const double malloc_x_ns = run_benchmark(malloc_allocator, num_threads, true);
+		const double locked_x_ns = run_benchmark(locked_allocator, num_threads, true);
+		const double shared_x_ns = run_benchmark(shared_allocator, num_threads, true);
+
+		printf("[%s] %8lu %12.2f %12.2f %12.2f %12.2f %12.2f %12.2f\n", __func__, num_threads, malloc_ns, serial_ns, shared_ns, malloc_x_ns, locked_x_ns, shared_x_ns);
+	}
+
+	return 0;
+}
@@ -3,15 +3,20 @@
 
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring> // memset
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
 
 #include <array>
 #include <deque>
 #include <vector>
 
+#include "simple_atomic_spinlock.hpp"
+
 #define ENABLE_MEMORY_POOL
 
 namespace util {
@@ -274,6 +279,303 @@ private:
 
 
 
+// thread-safe variant of t_chunked_mem_pool; each thread keeps a small
+// magazine of free page-indices which is refilled from (and drained to)
+// a global depot in batches of <mag_size>, so the common alloc and free
+// paths touch only thread-local state
+//
+// chunks are owned by the thread that created them; pages freed by any
+// other thread are pushed (lock-free) onto the owner's remote-free list
+// and reclaimed by the owner on its next refill, which keeps each chunk
+// hot in the cache of a single core
+//
+// threads that stop using the pool can call thread_exit() to return
+// their cached indices and disown their chunks; otherwise these pass
+// to the next thread that claims the same slot
+template<size_t max_chunks, size_t page_size, size_t num_pages, size_t max_threads = 64, size_t mag_size = 64>
+struct t_concurrent_chunked_mem_pool {
+public:
+	static_assert(page_size >= sizeof(size_t), "");
+	static_assert(mag_size != 0, "");
+
+	t_concurrent_chunked_mem_pool() {
+		for (size_t i = 0; i < max_chunks; i++) {
+			m_chunk_owners[i] = NO_OWNER;
+		}
+	}
+
+	template<typename t_type, typename... t_args> t_type* alloc(t_args&&... a) {
+		#ifndef ENABLE_MEMORY_POOL
+			return (new t_type(std::forward<t_args>(a)...));
+		#else
+			static_assert(sizeof(t_type) <= page_size, "");
+
+			void* ptr = alloc_raw(sizeof(t_type));
+
+			if (ptr == nullptr)
+				return nullptr;
+
+			return (new (ptr) t_type(std::forward<t_args>(a)...));
+		#endif
+	}
+
+	template<typename t_type> void free(t_type*& ptr) {
+		#ifndef ENABLE_MEMORY_POOL
+			util::safe_delete(ptr);
+		#else
+			static_assert(sizeof(t_type) <= page_size, "");
+
+			t_type* tmp = ptr;
+
+			util::safe_destruct(ptr);
+			free_raw(tmp);
+		#endif
+	}
+
+
+	void* alloc_raw(size_t size) {
+		t_thread_cache& cache = m_caches[thread_index()];
+
+		assert(size <= page_size);
+
+		if (cache.num_indcs == 0 && !refill_cache(cache))
+			return nullptr;
+
+		const size_t idx = cache.indcs[--cache.num_indcs];
+		uint8_t* ptr = page_mem(idx);
+
+		memcpy(ptr, &idx, sizeof(size_t));
+		return (ptr + sizeof(size_t));
+	}
+
+	void free_raw(void* ptr) {
+		const size_t tid = thread_index();
+		const size_t idx = page_idx(ptr);
+		const size_t own = m_chunk_owners[idx / num_pages].load(std::memory_order_relaxed);
+
+		// zero-fill page
+		assert(idx < (max_chunks * num_pages));
+		memset(page_mem(idx), 0, sizeof(size_t) + page_size);
+
+		if (own != tid && own != NO_OWNER) {
+			// cross-thread free; hand the page back to its owner
+			push_remote(m_caches[own], idx);
+			return;
+		}
+
+		t_thread_cache& cache = m_caches[tid];
+
+		// magazine is full, drain one batch to the depot
+		if (cache.num_indcs == (mag_size * 2))
+			drain_cache(cache, mag_size);
+
+		cache.indcs[cache.num_indcs++] = idx;
+	}
+
+
+	// returns all indices cached by the calling thread to the depot
+	// and makes its chunks ownerless (frees are then always local)
+	void thread_exit() {
+		const size_t tid = thread_index();
+		t_thread_cache& cache = m_caches[tid];
+
+		for (size_t i = 0, n = m_num_chunks.load(std::memory_order_acquire); i < n; i++) {
+			size_t own = tid;
+			m_chunk_owners[i].compare_exchange_strong(own, NO_OWNER, std::memory_order_acq_rel);
+		}
+
+		// pages pushed before the owner-reset are still in our list
+		// (a free racing with the reset can leave one behind, which
+		// is reclaimed if this thread ever allocates again)
+		drain_remote(cache);
+		drain_cache(cache, cache.num_indcs);
+	}
+
+	// only safe to call when no other thread is using the pool
+	void clear() {
+		m_depot.clear();
+
+		for (t_thread_cache& cache: m_caches) {
+			cache.num_indcs = 0;
+			cache.remote_head.store(0, std::memory_order_relaxed);
+		}
+
+		// for every allocated chunk, add back all indices
+		// (objects are assumed to have already been freed)
+		for (size_t i = 0, n = m_num_chunks.load(std::memory_order_relaxed); i < n; i++) {
+			for (size_t j = 0; j < num_pages; j++) {
+				m_depot.push_back((i + 1) * num_pages - j - 1);
+			}
+
+			m_chunk_owners[i] = NO_OWNER;
+		}
+	}
+
+
+	const uint8_t* page_mem(size_t idx, size_t ofs = 0) const { return (&(*m_chunks[idx / num_pages])[idx % num_pages][0] + ofs); }
+	      uint8_t* page_mem(size_t idx, size_t ofs = 0)       { return (&(*m_chunks[idx / num_pages])[idx % num_pages][0] + ofs); }
+
+	size_t page_idx(void* ptr) const {
+		const uint8_t* raw_ptr = reinterpret_cast<const uint8_t*>(ptr);
+		const uint8_t* idx_ptr = raw_ptr - sizeof(size_t);
+
+		return (*reinterpret_cast<const size_t*>(idx_ptr));
+	}
+
+	size_t alloc_size() const { return (m_num_chunks.load() * num_pages * page_size); } // size of total number of pages added over the pool's lifetime
+	size_t depot_size() const { return (m_depot.size() * page_size); } // size of free pages not cached by any thread (racy)
+
+	bool mapped(void* ptr) const { return ((page_idx(ptr) < (m_num_chunks.load() * num_pages)) && (page_mem(page_idx(ptr), sizeof(size_t)) == ptr)); }
+
+private:
+	static constexpr size_t NO_OWNER = max_threads;
+
+	struct alignas(64) t_thread_cache {
+		// page-index plus one of the most recent remote free; the
+		// link to the next is stored in the first bytes of a page
+		// body (after its header) so the list is fully intrusive
+		std::atomic<size_t> remote_head = {0};
+
+		size_t num_indcs = 0;
+		size_t indcs[mag_size * 2];
+	};
+
+	// first size_t bytes are reserved for index
+	typedef std::array<uint8_t[sizeof(size_t) + page_size], num_pages> t_chunk_mem;
+	typedef std::unique_ptr<t_chunk_mem> t_chunk_ptr;
+
+private:
+	// small per-thread integer, released again when the thread exits;
+	// a thread that inherits a slot also inherits its cache and chunks
+	struct t_thread_slot {
+		t_thread_slot() {
+			for (index = 0; index < max_threads; index++) {
+				if (!slot_flags()[index].exchange(true, std::memory_order_acquire))
+					return;
+			}
+
+			// more live threads than caches; indexing past them would
+			// corrupt the pool, and assert() is compiled out in release
+			fprintf(stderr, "[t_thread_slot] more than %lu threads are using the pool\n", size_t(max_threads));
+			abort();
+		}
+		~t_thread_slot() { slot_flags()[index].store(false, std::memory_order_release); }
+
+		size_t index = 0;
+	};
+
+	// shared by all pools of this type
+	static std::array<std::atomic<bool>, max_threads>& slot_flags() {
+		static std::array<std::atomic<bool>, max_threads> flags;
+		return flags;
+	}
+
+	static size_t thread_index() {
+		static thread_local t_thread_slot slot;
+		return slot.index;
+	}
+
+
+	bool refill_cache(t_thread_cache& cache) {
+		// reclaim pages freed by other threads first
+		if (drain_remote(cache))
+			return true;
+
+		m_depot_lock.lock();
+
+		if (!m_depot.empty()) {
+			const size_t n = std::min(m_depot.size(), mag_size);
+
+			std::copy(m_depot.end() - n, m_depot.end(), &cache.indcs[0]);
+			m_depot.resize(m_depot.size() - n);
+			m_depot_lock.unlock();
+
+			cache.num_indcs = n;
+			return true;
+		}
+
+		const size_t chunk_idx = m_num_chunks.load(std::memory_order_relaxed);
+
+		// pool is full
+		if (chunk_idx == max_chunks) {
+			m_depot_lock.unlock();
+			return false;
+		}
+
+		assert(m_chunks[chunk_idx] == nullptr);
+		m_chunks[chunk_idx].reset(new t_chunk_mem());
+		m_chunk_owners[chunk_idx].store(&cache - &m_caches[0], std::memory_order_relaxed);
+
+		// reserve new indices; those that do not fit the magazine go to
+		// the depot, the rest in reverse order since each will be popped
+		// from the back
+		for (size_t j = num_pages; j > std::min(num_pages, mag_size); j--) {
+			m_depot.push_back(chunk_idx * num_pages + j - 1);
+		}
+		for (size_t j = std::min(num_pages, mag_size); j > 0; j--) {
+			cache.indcs[cache.num_indcs++] = chunk_idx * num_pages + j - 1;
+		}
+
+		m_num_chunks.store(chunk_idx + 1, std::memory_order_release);
+		m_depot_lock.unlock();
+		return true;
+	}
+
+	void drain_cache(t_thread_cache& cache, size_t n) {
+		assert(n <= cache.num_indcs);
+
+		m_depot_lock.lock();
+		m_depot.insert(m_depot.end(), &cache.indcs[cache.num_indcs - n], &cache.indcs[cache.num_indcs]);
+		m_depot_lock.unlock();
+
+		cache.num_indcs -= n;
+	}
+
+
+	void push_remote(t_thread_cache& cache, size_t idx) {
+		size_t head = cache.remote_head.load(std::memory_order_relaxed);
+
+		do {
+			memcpy(page_mem(idx, sizeof(size_t)), &head, sizeof(size_t));
+		} while (!cache.remote_head.compare_exchange_weak(head, idx + 1, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	bool drain_remote(t_thread_cache& cache) {
+		// single consumer detaches the whole list, so no ABA issues
+		size_t head = cache.remote_head.exchange(0, std::memory_order_acquire);
+		size_t next = 0;
+
+		if (head == 0)
+			return false;
+
+		for (; head != 0; head = next) {
+			memcpy(&next, page_mem(head - 1, sizeof(size_t)), sizeof(size_t));
+			memset(page_mem(head - 1, sizeof(size_t)), 0, sizeof(size_t));
+
+			if (cache.num_indcs == (mag_size * 2))
+				drain_cache(cache, mag_size);
+
+			cache.indcs[cache.num_indcs++] = head - 1;
+		}
+
+		return true;
+	}
+
+private:
+	std::array<t_chunk_ptr, max_chunks> m_chunks;
+	std::array<std::atomic<size_t>, max_chunks> m_chunk_owners;
+	std::array<t_thread_cache, max_threads> m_caches;
+
+	// global depot of free page-indices not cached by any thread
+	std::vector<size_t> m_depot;
+	t_atomic_spinlock m_depot_lock;
+
+	std::atomic<size_t> m_num_chunks = {0};
+};
+
+
+
+
 template<size_t num_pages, size_t page_size> struct t_array_mem_pool {
 public:
 	t_array_mem_pool() { clear(); }
@@ -1,24 +1,567 @@
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 #include <algorithm>
+#include <chrono>
 #include <limits>
+#include <vector>
 
 // set this value to e.g. 2 or 10 to (inefficiently)
 // emulate base-2 or base-10 arithmetic respectively
 // leave it at <= 1 for maximally-filled limbs
 #define BIGNUM_ARITHMETIC_BASE 10lu
 
+// operand sizes (in limbs, of the smaller operand) from which on
+// each multiplication algorithm takes over from the previous one
+// run with --bench to measure the crossovers for a given machine
+#define BIGNUM_KARATSUBA_THRESHOLD   24
+#define BIGNUM_TOOM3_THRESHOLD      224
+#define BIGNUM_NTT_THRESHOLD       8192
+
 // need this in lieu of exponentiation operators
 // #define private public
 
+// wide enough for the product of two 64-bit limbs (GCC and Clang)
+typedef unsigned __int128 t_uint128;
+
 static const char* LIMB_FORMAT_STRS[] = {
 	" %3u" , // uint8
 	" %5u" , // uint16
 	" %10u", // uint32
-	" %20u", // uint64
+	" %20lu", // uint64
+};
+
+
+
+// multiplication of little-endian (LSB-first) limb arrays in radix
+// c_limb_max + 1, used by t_bignum but also usable on its own for
+// operands of any length; picks one of four algorithms by size:
+//
+//   schoolbook    O(n^2)
+//   karatsuba     O(n^1.585), splits operands in 2 and needs 3 products
+//   toom-3        O(n^1.465), splits operands in 3 and needs 5 products
+//   ntt           O(n log n), exact convolution modulo three 62-bit
+//                 primes recombined by CRT (supports up to 2^40 limbs)
+//
+// the recursive algorithms fall through to the cheaper ones for the
+// sub-products, so the thresholds only decide where each one starts
+template<typename t_limb_type, t_limb_type c_limb_max> struct t_bignum_mul_engine {
+public:
+	enum {
+		MUL_ALGO_SCHOOLBOOK = 0,
+		MUL_ALGO_KARATSUBA  = 1,
+		MUL_ALGO_TOOM3      = 2,
+		MUL_ALGO_NTT        = 3,
+		MUL_ALGO_AUTOMATIC  = 4,
+	};
+
+	typedef std::vector<t_limb_type> t_limb_vec;
+
+	static t_uint128 limb_radix() { return (t_uint128(c_limb_max) + 1); }
+
+
+	// r[0, na + nb) = a[0, na) * b[0, nb); <r> may not alias a or b
+	static void mul(t_limb_type* r, const t_limb_type* a, size_t na, const t_limb_type* b, size_t nb, size_t algo = MUL_ALGO_AUTOMATIC) {
+		const size_t nr = na + nb;
+
+		memset(r, 0, nr * sizeof(t_limb_type));
+
+		// leading zero limbs contribute nothing
+		while (na > 0 && a[na - 1] == 0) na--;
+		while (nb > 0 && b[nb - 1] == 0) nb--;
+
+		if (na < nb) {
+			std::swap(a, b);
+			std::swap(na, nb);
+		}
+
+		if (nb == 0)
+			return;
+
+		if (algo == MUL_ALGO_AUTOMATIC)
+			algo = select_algo(nb);
+
+		// the splitting algorithms want balanced operands, so cut a
+		// much longer <a> into <nb>-sized chunks and sum the products
+		if (algo != MUL_ALGO_SCHOOLBOOK && algo != MUL_ALGO_NTT && na >= (nb * 2)) {
+			t_limb_vec t(nb * 2);
+
+			for (size_t i = 0; i < na; i += nb) {
+				const size_t nc = std::min(nb, na - i);
+
+				mul(&t[0], a + i, nc, b, nb, algo);
+				add_to(r + i, nr - i, &t[0], nc + nb);
+			}
+
+			return;
+		}
+
+		switch (algo) {
+			case MUL_ALGO_SCHOOLBOOK: { mul_schoolbook(r, a, na, b, nb); } break;
+			case MUL_ALGO_KARATSUBA : { mul_karatsuba (r, a, na, b, nb); } break;
+			case MUL_ALGO_TOOM3     : { mul_toom3     (r, a, na, b, nb); } break;
+			case MUL_ALGO_NTT       : { mul_ntt       (r, a, na, b, nb); } break;
+			default                 : { assert(false);                    } break;
+		}
+	}
+
+	static size_t select_algo(size_t n) {
+		if (n < BIGNUM_KARATSUBA_THRESHOLD) return MUL_ALGO_SCHOOLBOOK;
+		if (n < BIGNUM_TOOM3_THRESHOLD    ) return MUL_ALGO_KARATSUBA;
+		if (n < BIGNUM_NTT_THRESHOLD      ) return MUL_ALGO_TOOM3;
+		return MUL_ALGO_NTT;
+	}
+
+private:
+	// sign-magnitude number for toom-3 interpolation, which produces
+	// negative intermediates
+	struct t_signed_limbs {
+		t_limb_vec mag;
+		bool neg = false;
+	};
+
+
+	// r[0, nr) += a[0, na); the sum must fit in nr limbs
+	static void add_to(t_limb_type* r, size_t nr, const t_limb_type* a, size_t na) {
+		t_uint128 c = 0;
+		size_t i = 0;
+
+		for (; i < na; i++) {
+			c += t_uint128(r[i]) + a[i];
+			r[i] = c % limb_radix();
+			c /= limb_radix();
+		}
+		for (; c != 0 && i < nr; i++) {
+			c += r[i];
+			r[i] = c % limb_radix();
+			c /= limb_radix();
+		}
+
+		assert(c == 0);
+	}
+
+	// r[0, nr) -= a[0, na); requires r >= a
+	static void sub_from(t_limb_type* r, size_t nr, const t_limb_type* a, size_t na) {
+		t_limb_type b = 0;
+		size_t i = 0;
+
+		for (; i < na; i++) {
+			const t_uint128 s = t_uint128(a[i]) + b;
+
+			b = (r[i] < s);
+			r[i] = (r[i] + (limb_radix() * b)) - s;
+		}
+		for (; b != 0 && i < nr; i++) {
+			b = (r[i] == 0);
+			r[i] = (b? c_limb_max: r[i] - 1);
+		}
+
+		assert(b == 0);
+	}
+
+	static int cmp_limbs(const t_limb_vec& a, const t_limb_vec& b) {
+		size_t na = a.size();
+		size_t nb = b.size();
+
+		while (na > 0 && a[na - 1] == 0) na--;
+		while (nb > 0 && b[nb - 1] == 0) nb--;
+
+		if (na != nb)
+			return ((na < nb)? -1: 1);
+
+		for (size_t i = na; i > 0; i--) {
+			if (a[i - 1] != b[i - 1]) {
+				return ((a[i - 1] < b[i - 1])? -1: 1);
+			}
+		}
+
+		return 0;
+	}
+
+
+	static void mul_schoolbook(t_limb_type* r, const t_limb_type* a, size_t na, const t_limb_type* b, size_t nb) {
+		for (size_t i = 0; i < na; i++) {
+			t_uint128 c = 0;
+
+			if (a[i] == 0)
+				continue;
+
+			// (R-1)^2 + 2(R-1) = R^2 - 1, so this can never overflow
+			for (size_t j = 0; j < nb; j++) {
+				c += t_uint128(a[i]) * b[j] + r[i + j];
+				r[i + j] = c % limb_radix();
+				c /= limb_radix();
+			}
+
+			r[i + nb] = c;
+		}
+	}
+
+	// a = a1*R^m + a0, b = b1*R^m + b0
+	// a*b = z2*R^2m + (z1 - z2 - z0)*R^m + z0 with z1 = (a0 + a1)(b0 + b1)
+	static void mul_karatsuba(t_limb_type* r, const t_limb_type* a, size_t na, const t_limb_type* b, size_t nb) {
+		const size_t m = (na + 1) >> 1;
+
+		const size_t na0 = m, na1 = na - m;
+		const size_t nb0 = std::min(m, nb), nb1 = nb - nb0;
+
+		t_limb_vec sa(m + 1, 0);
+		t_limb_vec sb(m + 1, 0);
+		t_limb_vec z1((m + 1) * 2, 0);
+
+		std::copy(a, a + na0, sa.begin()); add_to(&sa[0], m + 1, a + m, na1);
+		std::copy(b, b + nb0, sb.begin()); add_to(&sb[0], m + 1, b + m, nb1);
+
+		// z0 and z2 go straight to their final (non-overlapping) places
+		mul(r        , a    , na0, b    , nb0);
+		mul(r + m * 2, a + m, na1, b + m, nb1);
+		mul(&z1[0], &sa[0], m + 1, &sb[0], m + 1);
+
+		sub_from(&z1[0], z1.size(), r        , na0 + nb0);
+		sub_from(&z1[0], z1.size(), r + m * 2, na1 + nb1);
+
+		add_to(r + m, na + nb - m, &z1[0], std::min(z1.size(), na + nb - m));
+	}
+
+
+	static t_signed_limbs add_signed(const t_signed_limbs& a, const t_signed_limbs& b) {
+		t_signed_limbs r;
+
+		if (a.neg == b.neg) {
+			r.mag.assign(std::max(a.mag.size(), b.mag.size()) + 1, 0);
+			r.neg = a.neg;
+
+			std::copy(a.mag.begin(), a.mag.end(), r.mag.begin());
+			add_to(&r.mag[0], r.mag.size(), b.mag.data(), b.mag.size());
+			return r;
+		}
+
+		// signs differ; subtract the smaller magnitude from the larger
+		const bool a_larger = (cmp_limbs(a.mag, b.mag) >= 0);
+		const t_signed_limbs& x = a_larger? a: b;
+		const t_signed_limbs& y = a_larger? b: a;
+
+		r.mag = x.mag;
+		r.neg = x.neg;
+
+		sub_from(&r.mag[0], r.mag.size(), y.mag.data(), y.mag.size());
+		return r;
+	}
+
+	static t_signed_limbs sub_signed(const t_signed_limbs& a, t_signed_limbs b) {
+		b.neg = !b.neg;
+		return (add_signed(a, b));
+	}
+
+	static t_signed_limbs mul_signed(const t_signed_limbs& a, const t_signed_limbs& b) {
+		t_signed_limbs r;
+
+		r.mag.assign(a.mag.size() + b.mag.size(), 0);
+		r.neg = (a.neg != b.neg);
+
+		if (!a.mag.empty() && !b.mag.empty())
+			mul(&r.mag[0], a.mag.data(), a.mag.size(), b.mag.data(), b.mag.size());
+
+		return r;
+	}
+
+	static t_signed_limbs mul_signed_small(const t_signed_limbs& a, t_limb_type s) {
+		t_signed_limbs r;
+		t_uint128 c = 0;
+
+		r.mag.assign(a.mag.size() + 1, 0);
+		r.neg = a.neg;
+
+		for (size_t i = 0; i < a.mag.size(); i++) {
+			c += t_uint128(a.mag[i]) * s;
+			r.mag[i] = c % limb_radix();
+			c /= limb_radix();
+		}
+
+		r.mag[a.mag.size()] = c;
+		return r;
+	}
+
+	// exact division by a small constant
+	static t_signed_limbs div_signed_small(const t_signed_limbs& a, t_limb_type d) {
+		t_signed_limbs r = a;
+		t_uint128 c = 0;
+
+		for (size_t i = a.mag.size(); i > 0; i--) {
+			c = c * limb_radix() + a.mag[i - 1];
+			r.mag[i - 1] = c / d;
+			c %= d;
+		}
+
+		assert(c == 0);
+		return r;
+	}
+
+	static t_signed_limbs slice(const t_limb_type* a, size_t na, size_t i, size_t n) {
+		t_signed_limbs r;
+
+		if (i < na)
+			r.mag.assign(a + i, a + std::min(na, i + n));
+
+		return r;
+	}
+
+	// evaluates both operands (as polynomials in x = R^k) in the points
+	// 0, 1, -1, -2, inf, multiplies pointwise and interpolates following
+	// Bodrato's sequence, which only needs exact divisions by 2 and 3
+	static void mul_toom3(t_limb_type* r, const t_limb_type* a, size_t na, const t_limb_type* b, size_t nb) {
+		const size_t k = (na + 2) / 3;
+
+		const t_signed_limbs a0 = slice(a, na, 0, k), a1 = slice(a, na, k, k), a2 = slice(a, na, k * 2, na);
+		const t_signed_limbs b0 = slice(b, nb, 0, k), b1 = slice(b, nb, k, k), b2 = slice(b, nb, k * 2, nb);
+
+		const t_signed_limbs pa = add_signed(a0, a2);
+		const t_signed_limbs pb = add_signed(b0, b2);
+
+		const t_signed_limbs am1 = sub_signed(pa, a1);
+		const t_signed_limbs bm1 = sub_signed(pb, b1);
+		const t_signed_limbs am2 = sub_signed(mul_signed_small(add_signed(am1, a2), 2), a0);
+		const t_signed_limbs bm2 = sub_signed(mul_signed_small(add_signed(bm1, b2), 2), b0);
+
+		const t_signed_limbs r0 = mul_signed(a0, b0);
+		const t_signed_limbs r4 = mul_signed(a2, b2);
+		const t_signed_limbs v1 = mul_signed(add_signed(pa, a1), add_signed(pb, b1));
+		const t_signed_limbs vm1 = mul_signed(am1, bm1);
+		const t_signed_limbs vm2 = mul_signed(am2, bm2);
+
+		t_signed_limbs r3 = div_signed_small(sub_signed(vm2, v1), 3);
+		t_signed_limbs r1 = div_signed_small(sub_signed(v1, vm1), 2);
+		t_signed_limbs r2 = sub_signed(vm1, r0);
+
+		r3 = add_signed(div_signed_small(sub_signed(r2, r3), 2), mul_signed_small(r4, 2));
+		r2 = sub_signed(add_signed(r2, r1), r4);
+		r1 = sub_signed(r1, r3);
+
+		// all coefficients of the product polynomial are non-negative
+		const t_signed_limbs* coeffs[] = {&r0, &r1, &r2, &r3, &r4};
+
+		for (size_t i = 0; i < 5; i++) {
+			const t_limb_vec& c = coeffs[i]->mag;
+
+			size_t nc = c.size();
+
+			while (nc > 0 && c[nc - 1] == 0) nc--;
+
+			assert(nc == 0 || !coeffs[i]->neg);
+
+			if (nc > 0)
+				add_to(r + k * i, na + nb - k * i, c.data(), nc);
+		}
+	}
+
+
+	// 62-bit primes p = c*2^k+1 (k >= 40) with a primitive root g each
+	static uint64_t ntt_prime(size_t i) {
+		static const uint64_t primes[3] = {0x3fffc00000000001ull, 0x3fffbe0000000001ull, 0x3fff840000000001ull};
+		return primes[i];
+	}
+	static uint64_t ntt_root(size_t i) {
+		static const uint64_t roots[3] = {11, 3, 19};
+		return roots[i];
+	}
+
+	// arithmetic modulo one NTT prime, with operands in Montgomery form
+	// (x*2^64 mod p) so that products need no 128-bit division
+	struct t_mont_field {
+		t_mont_field(uint64_t p): m_p(p) {
+			// -p^-1 mod 2^64 by Newton iteration, each step doubles the bits
+			uint64_t inv = p;
+
+			for (size_t i = 0; i < 6; i++) {
+				inv *= (2 - p * inv);
+			}
+
+			m_pinv = -inv;
+			m_r2 = (-t_uint128(p)) % p;
+		}
+
+		uint64_t mul(uint64_t a, uint64_t b) const {
+			const t_uint128 t = t_uint128(a) * b;
+			const uint64_t m = uint64_t(t) * m_pinv;
+			const uint64_t u = (t + t_uint128(m) * m_p) >> 64;
+			return ((u >= m_p)? u - m_p: u);
+		}
+
+		uint64_t add(uint64_t a, uint64_t b) const { a += b; return ((a >= m_p)? a - m_p: a); }
+		uint64_t sub(uint64_t a, uint64_t b) const { return ((a >= b)? a - b: a + m_p - b); }
+
+		uint64_t to_mont(uint64_t a) const { return (mul(a % m_p, m_r2)); }
+		uint64_t from_mont(uint64_t a) const { return (mul(a, 1)); }
+
+		uint64_t pow(uint64_t a, uint64_t e) const {
+			uint64_t r = to_mont(1);
+
+			for (; e != 0; e >>= 1) {
+				if ((e & 1) != 0)
+					r = mul(r, a);
+
+				a = mul(a, a);
+			}
+
+			return r;
+		}
+
+		uint64_t m_p;
+		uint64_t m_pinv;
+		uint64_t m_r2;
+	};
+
+	// in-place iterative radix-2 transform of Montgomery-form values
+	static void calc_ntt(std::vector<uint64_t>& v, const t_mont_field& f, uint64_t g, bool inverse) {
+		const size_t n = v.size();
+
+		for (size_t i = 1, j = 0; i < n; i++) {
+			size_t bit = n >> 1;
+
+			for (; (j & bit) != 0; bit >>= 1) {
+				j ^= bit;
+			}
+
+			if (i < (j ^= bit))
+				std::swap(v[i], v[j]);
+		}
+
+		for (size_t len = 2; len <= n; len <<= 1) {
+			uint64_t w = f.pow(f.to_mont(g), (f.m_p - 1) / len);
+
+			if (inverse)
+				w = f.pow(w, f.m_p - 2);
+
+			// twiddles for this level, so the inner loop is multiply-free
+			// apart from the butterfly itself
+			std::vector<uint64_t> ws(len >> 1);
+
+			ws[0] = f.to_mont(1);
+
+			for (size_t i = 1; i < ws.size(); i++) {
+				ws[i] = f.mul(ws[i - 1], w);
+			}
+
+			for (size_t i = 0; i < n; i += len) {
+				for (size_t j = 0; j < (len >> 1); j++) {
+					const uint64_t x = v[i + j];
+					const uint64_t y = f.mul(v[i + j + (len >> 1)], ws[j]);
+
+					v[i + j                ] = f.add(x, y);
+					v[i + j + (len >> 1)] = f.sub(x, y);
+				}
+			}
+		}
+
+		if (!inverse)
+			return;
+
+		const uint64_t n_inv = f.pow(f.to_mont(n), f.m_p - 2);
+
+		for (size_t i = 0; i < n; i++) {
+			v[i] = f.mul(v[i], n_inv);
+		}
+	}
+
+	static void mul_ntt(t_limb_type* r, const t_limb_type* a, size_t na, const t_limb_type* b, size_t nb) {
+		size_t n = 1;
+
+		while (n < (na + nb))
+			n <<= 1;
+
+		assert(n <= (size_t(1) << 40));
+
+		// convolution modulo each prime
+		std::vector<uint64_t> conv[3];
+
+		for (size_t k = 0; k < 3; k++) {
+			const t_mont_field f(ntt_prime(k));
+
+			std::vector<uint64_t> fa(n, 0);
+			std::vector<uint64_t> fb(n, 0);
+
+			for (size_t i = 0; i < na; i++) { fa[i] = f.to_mont(a[i]); }
+			for (size_t i = 0; i < nb; i++) { fb[i] = f.to_mont(b[i]); }
+
+			calc_ntt(fa, f, ntt_root(k), false);
+			calc_ntt(fb, f, ntt_root(k), false);
+
+			for (size_t i = 0; i < n; i++) {
+				fa[i] = f.mul(fa[i], fb[i]);
+			}
+
+			calc_ntt(fa, f, ntt_root(k), true);
+
+			for (size_t i = 0; i < (na + nb); i++) {
+				fa[i] = f.from_mont(fa[i]);
+			}
+
+			conv[k].swap(fa);
+		}
+
+		const uint64_t p0 = ntt_prime(0);
+		const uint64_t p1 = ntt_prime(1);
+		const uint64_t p2 = ntt_prime(2);
+		const t_uint128 p01 = t_uint128(p0) * p1;
+
+		// CRT constants; p0^-1 mod p1 and (p0*p1)^-1 mod p2
+		const t_mont_field f1(p1);
+		const t_mont_field f2(p2);
+		const uint64_t p0_inv = f1.from_mont(f1.pow(f1.to_mont(p0), p1 - 2));
+		const uint64_t p01_inv = f2.from_mont(f2.pow(f2.to_mont(p01 % p2), p2 - 2));
+
+		// coefficients are < (na + nb) * R^2 < 2^186, so they and the
+		// running carry are kept as three 64-bit words (w0 least)
+		uint64_t acc[3] = {0, 0, 0};
+
+		for (size_t i = 0; i < (na + nb); i++) {
+			const uint64_t r0 = conv[0][i];
+			const uint64_t r1 = conv[1][i];
+			const uint64_t r2 = conv[2][i];
+
+			// x01 = r0 + p0 * ((r1 - r0) * p0^-1 mod p1), which is < p0*p1
+			const uint64_t t1 = (t_uint128((r1 + p1 - (r0 % p1)) % p1) * p0_inv) % p1;
+			const t_uint128 x01 = t_uint128(r0) + t_uint128(t1) * p0;
+			// x = x01 + p0*p1 * ((r2 - x01) * (p0*p1)^-1 mod p2)
+			const uint64_t t2 = (t_uint128((r2 + p2 - uint64_t(x01 % p2)) % p2) * p01_inv) % p2;
+
+			// acc += x01 + p01 * t2, where p01 * t2 needs 3 words
+			const t_uint128 lo = (p01 & ~uint64_t(0)) * t2;
+			const t_uint128 hi = (p01 >> 64) * t2 + (lo >> 64);
+
+			t_uint128 c = t_uint128(acc[0]) + uint64_t(x01) + uint64_t(lo);
+			acc[0] = c; c >>= 64;
+			c += t_uint128(acc[1]) + uint64_t(x01 >> 64) + uint64_t(hi);
+			acc[1] = c; c >>= 64;
+			acc[2] += uint64_t(c) + uint64_t(hi >> 64);
+
+			// emit one limb; acc = acc div R, limb = acc mod R
+			if (limb_radix() == (t_uint128(1) << 64)) {
+				r[i] = acc[0];
+
+				acc[0] = acc[1];
+				acc[1] = acc[2];
+				acc[2] = 0;
+				continue;
+			}
+
+			t_uint128 rem = 0;
+
+			for (size_t w = 3; w > 0; w--) {
+				rem = (rem << 64) | acc[w - 1];
+				acc[w - 1] = rem / limb_radix();
+				rem %= limb_radix();
+			}
+
+			r[i] = rem;
+		}
+
+		assert(acc[0] == 0 && acc[1] == 0 && acc[2] == 0);
+	}
 };
 
 
@@ -32,9 +575,10 @@ public:
 	};
 
 
-	static t_limb_type limb_max_val() {
+	static constexpr t_limb_type limb_max_val() {
 		#if (BIGNUM_ARITHMETIC_BASE >= 2)
-		return (std::min(BIGNUM_ARITHMETIC_BASE - 1, static_cast<size_t>(std::numeric_limits<t_limb_type>::max())));
+		// (std::min is not constexpr before C++14)
+		return ((BIGNUM_ARITHMETIC_BASE - 1) < static_cast<size_t>(std::numeric_limits<t_limb_type>::max())? (BIGNUM_ARITHMETIC_BASE - 1): std::numeric_limits<t_limb_type>::max());
 		#else
 		// in this case radix simply equals type::max + 1
 		//
@@ -48,8 +592,9 @@ public:
 		#endif
 	}
 
-	static size_t limb_radix() {
-		return (static_cast<size_t>(t_bignum::limb_max_val()) + 1);
+	// needs to be wider than size_t for full-range 64-bit limbs
+	static t_uint128 limb_radix() {
+		return (static_cast<t_uint128>(t_bignum::limb_max_val()) + 1);
 	}
 
 	static size_t raw_size() {
@@ -74,12 +619,9 @@ public:
 
 
 	t_bignum(t_limb_type msb = 0, t_limb_type lsb = 0) {
-		// temporary results need to be stored in types that
-		// are twice as wide as t_limb_type, which would not
-		// be possible (without native 128-bit type support)
-		// if t_limb_type is itself 8 bytes
-		assert(sizeof(t_limb_type) <= 4);
-		assert(sizeof(size_t) == 8);
+		// temporary results are stored in t_uint128 which is
+		// twice as wide as the largest supported t_limb_type
+		static_assert(sizeof(t_limb_type) <= sizeof(uint64_t), "");
 
 		memset(&m_limbs[0], 0, t_bignum::raw_size());
 		memset(&m_flags[0], 0, sizeof(bool) * BIGNUM_CONDITION_FLAGS);
@@ -228,12 +770,25 @@ private:
 	}
 
 	static t_bignum mul_bn(const t_bignum& a, const t_bignum& b) {
+		typedef t_bignum_mul_engine<t_limb_type, t_bignum::limb_max_val()> t_mul_engine;
+
+		t_limb_type a_limbs[c_num_limbs];
+		t_limb_type b_limbs[c_num_limbs];
+		t_limb_type c_limbs[c_num_limbs * 2];
+
+		// the engine wants LSB-first limbs
+		std::reverse_copy(&a.m_limbs[0], &a.m_limbs[c_num_limbs], &a_limbs[0]);
+		std::reverse_copy(&b.m_limbs[0], &b.m_limbs[c_num_limbs], &b_limbs[0]);
+
+		t_mul_engine::mul(&c_limbs[0], &a_limbs[0], c_num_limbs, &b_limbs[0], c_num_limbs);
+
 		t_bignum c;
 
-		for (size_t i = 0; i < c_num_limbs; i++) {
-			for (size_t j = 0; j < c_num_limbs; j++) {
-				c.mul_limbs(a, b, i, j);
-			}
+		// keep the low half, anything in the high half is overflow
+		std::reverse_copy(&c_limbs[0], &c_limbs[c_num_limbs], &c.m_limbs[0]);
+
+		for (size_t n = c_num_limbs; n < (c_num_limbs * 2); n++) {
+			c.m_flags[BIGNUM_COND_OFLOW_FLAG] |= (c_limbs[n] != 0);
 		}
 
 		return c;
@@ -244,9 +799,9 @@ private:
 
 		// trivial cases: a/1=a and a/a=1
 		if (b == t_bignum::unit_value())
-			return (std::make_pair<t_bignum, t_bignum>(a, t_bignum::zero_value()));
+			return (std::pair<t_bignum, t_bignum>(a, t_bignum::zero_value()));
 		if (b == a)
-			return (std::make_pair<t_bignum, t_bignum>(t_bignum::unit_value(), t_bignum::zero_value()));
+			return (std::pair<t_bignum, t_bignum>(t_bignum::unit_value(), t_bignum::zero_value()));
 
 		t_bignum q; // quotient
 		t_bignum r; // remainder
@@ -258,15 +813,29 @@ private:
 			// bring down next limb of numerator (a) to new LSB
 			r[c_num_limbs - 1] = a[i];
 
-			while (r >= b) {
-				// find greatest multiple of denominator (b) < quotient
-				// new remainder is quotient modulo the denominator (b)
-				r -= b;
-				q[i] += 1;
+			// find greatest multiple of denominator (b) <= remainder
+			// by bisection, repeated subtraction would take up to one
+			// step per unit of the radix (2^64 for full-range limbs)
+			t_limb_type q_min = 0;
+			t_limb_type q_max = t_bignum::limb_max_val();
+
+			while (q_min < q_max) {
+				const t_limb_type q_mid = q_min + ((q_max - q_min) >> 1) + ((q_max - q_min) & 1);
+				const t_bignum m = b * t_bignum(0, q_mid);
+
+				if (!m.get_flag(BIGNUM_COND_OFLOW_FLAG) && m <= r) {
+					q_min = q_mid;
+				} else {
+					q_max = q_mid - 1;
+				}
 			}
+
+			// new remainder is quotient modulo the denominator (b)
+			r -= (b * t_bignum(0, q_min));
+			q[i] = q_min;
 		}
 
-		return (std::make_pair<t_bignum, t_bignum>(q, r));
+		return (std::pair<t_bignum, t_bignum>(q, r));
 	}
 
 	// NOTE: redundant since div() also returns the remainder
@@ -432,7 +1001,7 @@ private:
 		const size_t limb_idx = c_num_limbs - ab_limb_order - 1;
 
 		// get carry from last limb-addition (if any)
-		const size_t prev_limb_carry = m_limbs[limb_idx];
+		const t_uint128 prev_limb_carry = m_limbs[limb_idx];
 
 		// due to the carry it is not possible to reliably detect
 		// limb-type overflow without casting them to larger type
@@ -440,8 +1009,8 @@ private:
 		// e.g. a rule like (a + b + c) % N < min(a, b) will fail
 		// for ((a=9 + b=9 + c=1) % N=10) == 9  >=  min(a=9, b=9)
 		//
-		#define LIMB_SUM(a, b, c) (static_cast<size_t>(a) + static_cast<size_t>(b) + c)
-		const size_t limb_sum = LIMB_SUM(a_limbs[limb_idx], b_limbs[limb_idx], prev_limb_carry);
+		#define LIMB_SUM(a, b, c) (static_cast<t_uint128>(a) + static_cast<t_uint128>(b) + c)
+		const t_uint128 limb_sum = LIMB_SUM(a_limbs[limb_idx], b_limbs[limb_idx], prev_limb_carry);
 		#undef LIMB_SUM
 
 		// set new carry for next limb-addition (if any)
@@ -474,7 +1043,7 @@ private:
 		const size_t limb_idx = c_num_limbs - ab_limb_order - 1;
 
 		// get carry from last limb-subtraction (if any)
-		const size_t prev_limb_carry = m_limbs[limb_idx];
+		const t_uint128 prev_limb_carry = m_limbs[limb_idx];
 
 		// due to the carry it is not possible to reliably detect
 		// limb-type underflow without casting them to larger type
@@ -482,8 +1051,8 @@ private:
 		// e.g. a rule like (a - b - c) % N > max(a, b) will fail
 		// for ((a=0 - b=9 - c=0) % N=10) == 1  <=  max(a=0, b=9)
 		//
-		#define LIMB_DIF(a, b, c) (static_cast<size_t>(a) - static_cast<size_t>(b) - c)
-		const size_t limb_dif = LIMB_DIF(a_limbs[limb_idx], b_limbs[limb_idx], prev_limb_carry);
+		#define LIMB_DIF(a, b, c) (static_cast<t_uint128>(a) - static_cast<t_uint128>(b) - c)
+		const t_uint128 limb_dif = LIMB_DIF(a_limbs[limb_idx], b_limbs[limb_idx], prev_limb_carry);
 		#undef LIMB_DIF
 
 		// set new carry for next limb-subtraction (if any)
@@ -509,56 +1078,6 @@ private:
 		m_limbs[limb_idx - 1] = next_limb_carry;
 	}
 
-	void mul_limbs(const t_bignum& a_limbs, const t_bignum& b_limbs, size_t a_limb_order, size_t b_limb_order) {
-		const size_t limb_idx_a = c_num_limbs - a_limb_order - 1;
-		const size_t limb_idx_b = c_num_limbs - b_limb_order - 1;
-		const size_t limb_idx_c = c_num_limbs - (a_limb_order + b_limb_order) - 1;
-
-		// NOTE:
-		//   this requires a type twice as wide as t_limb_type
-		//   otherwise we only get the result modulo type::max
-		//   (i.e. the low-order part)
-		const size_t limb_mul = static_cast<size_t>(a_limbs[limb_idx_a]) * static_cast<size_t>(b_limbs[limb_idx_b]);
-
-		if (limb_mul == 0)
-			return;
-
-		const t_limb_type limb_lo_val = limb_mul % t_bignum::limb_radix();
-		const t_limb_type limb_hi_val = limb_mul / t_bignum::limb_radix();
-
-		bool limb_carry = false;
-
-		// overflow if this is the MSB and it can not hold limb_mul
-		m_flags[BIGNUM_COND_OFLOW_FLAG] |= (limb_idx_c == 0 && limb_hi_val != 0);
-
-		// limb_idx_c can underflow, in which case it represents a
-		// negative index (meaning the result does not have enough
-		// limbs to store limb_mul in its entirety)
-		if (limb_idx_c <  c_num_limbs) { m_limbs[limb_idx_c    ] += limb_lo_val; limb_carry |= (m_limbs[limb_idx_c    ] > t_bignum::limb_max_val()); }
-		if (limb_idx_c >=           1) { m_limbs[limb_idx_c - 1] += limb_hi_val; limb_carry |= (m_limbs[limb_idx_c - 1] > t_bignum::limb_max_val()); }
-
-		if (!limb_carry)
-			return;
-
-		// propagate carry across limbs
-		for (size_t n = limb_idx_c; n > 0; n -= 1) {
-			if (m_limbs[n] >= t_bignum::limb_max_val()) {
-				assert((m_limbs[n] / t_bignum::limb_max_val()) == 1);
-
-				m_limbs[n - 1] += 1;
-				m_limbs[n    ] -= t_bignum::limb_max_val();
-			}
-
-			// terminate propagation early if possible
-			if (m_limbs[n - 1] < t_bignum::limb_max_val()) {
-				break;
-			}
-		}
-
-		// handle last limb (MSB), no wrap-around
-		m_limbs[0] %= t_bignum::limb_radix();
-	}
-
 
 private:
 	// least-significant limb is [num_limbs-1]
@@ -585,10 +1104,91 @@ typedef t_bignum<unsigned  char,  4> t_bignum_uc4;
 typedef t_bignum<unsigned  char, 32> t_bignum_uc32;
 typedef t_bignum<unsigned short,  8> t_bignum_us8;
 typedef t_bignum<unsigned   int, 16> t_bignum_ui16;
+typedef t_bignum<unsigned  long, 32> t_bignum_ul32;
 
 
 
-int main() {
+// times every multiplication algorithm on random full-range 64-bit
+// limb operands of increasing size, verifies that all of them agree
+// and reports the sizes at which each one first beats its predecessor
+// (the algorithm being timed is only forced at the top level, so the
+// crossovers depend on the thresholds of the lower tiers)
+static void benchmark_mul_algos(size_t max_limbs) {
+	typedef t_bignum_mul_engine<uint64_t, std::numeric_limits<uint64_t>::max()> t_engine;
+
+	const char* algo_names[] = {"schoolbook", "karatsuba", "toom-3", "ntt"};
+	const size_t num_algos = t_engine::MUL_ALGO_AUTOMATIC;
+
+	// schoolbook gets too slow to bother beyond this
+	const size_t max_schoolbook_limbs = 8192;
+
+	size_t crossovers[num_algos] = {0, 0, 0, 0};
+	uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+	printf("[%s] %8s %14s %14s %14s %14s\n", __func__, "limbs", "schoolbook", "karatsuba", "toom-3", "ntt");
+	printf("[%s] %8s %14s %14s %14s %14s\n", __func__, "", "(us/mul)", "(us/mul)", "(us/mul)", "(us/mul)");
+
+	for (size_t n = 8; n <= max_limbs; n += std::max(n >> 2, size_t(1))) {
+		std::vector<uint64_t> a(n);
+		std::vector<uint64_t> b(n);
+		std::vector<uint64_t> r(n * 2);
+		std::vector<uint64_t> s(n * 2);
+
+		double times[num_algos] = {0.0, 0.0, 0.0, 0.0};
+
+		for (size_t i = 0; i < n; i++) {
+			// xorshift64
+			rng ^= (rng << 13); rng ^= (rng >> 7); rng ^= (rng << 17); a[i] = rng;
+			rng ^= (rng << 13); rng ^= (rng >> 7); rng ^= (rng << 17); b[i] = rng;
+		}
+
+		for (size_t algo = 0; algo < num_algos; algo++) {
+			if (algo == t_engine::MUL_ALGO_SCHOOLBOOK && n > max_schoolbook_limbs)
+				continue;
+
+			size_t num_reps = 0;
+
+			const auto t0 = std::chrono::steady_clock::now();
+			      auto t1 = t0;
+
+			// repeat for at least 20ms to get a stable average
+			while ((t1 - t0) < std::chrono::milliseconds(20)) {
+				t_engine::mul(&r[0], &a[0], n, &b[0], n, algo);
+				t1 = std::chrono::steady_clock::now();
+				num_reps += 1;
+			}
+
+			times[algo] = std::chrono::duration<double, std::micro>(t1 - t0).count() / num_reps;
+
+			if (algo != 0 && !(algo == 1 && n > max_schoolbook_limbs))
+				assert(r == s);
+
+			if (algo != 0 && times[algo] < times[algo - 1] && crossovers[algo] == 0)
+				crossovers[algo] = n;
+
+			s.swap(r);
+		}
+
+		printf("[%s] %8lu %14.2f %14.2f %14.2f %14.2f\n", __func__, n, times[0], times[1], times[2], times[3]);
+	}
+
+	for (size_t algo = 1; algo < num_algos; algo++) {
+		if (crossovers[algo] == 0) {
+			printf("[%s] %s never beats %s up to %lu limbs\n", __func__, algo_names[algo], algo_names[algo - 1], max_limbs);
+		} else {
+			printf("[%s] %s beats %s from %lu limbs on\n", __func__, algo_names[algo], algo_names[algo - 1], crossovers[algo]);
+		}
+	}
+}
+
+
+
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		benchmark_mul_algos((argc > 2)? atoi(argv[2]): 16384);
+		return 0;
+	}
+
 	const unsigned char a_limbs[4] = {9, 3, 3, 3};
 	const unsigned char b_limbs[4] = {9, 7, 0, 5};
 
@@ -1,13 +1,21 @@
+#include <algorithm>
+#include <chrono>
 #include <limits>
 #include <list>
+#include <random>
+#include <thread>
 #include <vector>
 
 #include <cassert>
+#include <cmath>
 #include <cstddef>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <ctime>
 
+#include "simple_work_stealing_pool.hpp"
+
 typedef unsigned int uint_type;
 // typedef size_t uint_type;
 
@@ -20,6 +28,8 @@ static const uint_type  MAX_NUMBER_DATA_POINTS = 10000;
 static const uint_type DATA_POINT_COOR_RANGE_X =   100;
 static const uint_type DATA_POINT_COOR_RANGE_Y =   100;
 static const uint_type  MAX_POINTS_PER_CLUSTER =    50;
+// points per k-means pool task
+static const uint_type      KMEANS_BLOCK_SIZE = 4096;
 
 template<typename t> struct t_point {
 	t_point(t x = t(0), t y = t(0)) { m_x = x; m_y = y; }
@@ -150,98 +160,468 @@ void generate_simple_clusters(const std::vector<point_type>& points, std::list<c
 
 
 
-template<typename point_type>
-void kmeans_assign_points(
-	const std::vector<point_type>& points,
-	const std::vector<point_type>& cluster_centers,
-	      std::vector<uint_type>& cluster_points
-) {
-	for (uint_type n = 0; n < points.size(); n++) {
-		uint_type min_cluster_idx = 0;
+// point-set with one contiguous coordinate array per dimension, so
+// that per-dimension loops over many points (or centers) are unit-stride
+struct t_soa_points {
+public:
+	t_soa_points(size_t num_points = 0, size_t num_dims = 0): m_num_points(num_points), m_num_dims(num_dims) {
+		m_coors.resize(num_points * num_dims, 0.0f);
+	}
+
+	float calc_squared_dist(size_t i, const t_soa_points& q, size_t j) const {
+		float d2 = 0.0f;
+
+		for (size_t d = 0; d < m_num_dims; d++)
+			d2 += ((get_coor(i, d) - q.get_coor(j, d)) * (get_coor(i, d) - q.get_coor(j, d)));
+
+		return d2;
+	}
+
+	void copy_point(size_t i, const t_soa_points& q, size_t j) {
+		for (size_t d = 0; d < m_num_dims; d++)
+			get_coor(i, d) = q.get_coor(j, d);
+	}
+
+	float  get_coor(size_t i, size_t d) const { return m_coors[d * m_num_points + i]; }
+	float& get_coor(size_t i, size_t d)       { return m_coors[d * m_num_points + i]; }
+
+	const float* get_dim(size_t d) const { return &m_coors[d * m_num_points]; }
+
+	size_t get_num_points() const { return m_num_points; }
+	size_t get_num_dims() const { return m_num_dims; }
+
+private:
+	size_t m_num_points;
+	size_t m_num_dims;
 
-		for (uint_type k = min_cluster_idx + 1; k < cluster_centers.size(); k++) {
-			if ((cluster_centers[k] - points[n]).squared_length() < (cluster_centers[min_cluster_idx] - points[n]).squared_length()) {
-				min_cluster_idx = k;
+	std::vector<float> m_coors;
+};
+
+
+
+// k-means over SoA points with k-means++ seeding and Hamerly's bounds:
+// every point keeps an upper bound on the distance to its own center and
+// a lower bound on the distance to any other center, and only re-scans
+// all centers when neither the bounds nor half the distance from its
+// center to the nearest other center prove the assignment unchanged
+//
+// points are processed in blocks of KMEANS_BLOCK_SIZE by pool tasks; the
+// per-center coordinate sums are kept up to date incrementally from the
+// per-thread deltas of points that changed cluster
+class t_kmeans_engine {
+public:
+	t_kmeans_engine(size_t num_threads = 1): m_thread_pool(num_threads) {}
+
+	// picks each next center with probability proportional to its squared
+	// distance from the nearest center chosen so far (Arthur-Vassilvitskii)
+	void seed_centers(const t_soa_points& points, size_t num_clusters, uint64_t seed) {
+		const size_t num_points = points.get_num_points();
+		const size_t num_blocks = (num_points + KMEANS_BLOCK_SIZE - 1) / KMEANS_BLOCK_SIZE;
+
+		assert(num_clusters != 0);
+		assert(num_clusters <= num_points);
+
+		std::mt19937_64 rng(seed);
+		std::vector<float> min_dists(num_points, std::numeric_limits<float>::max());
+		std::vector<double> block_sums(num_blocks, 0.0);
+
+		m_centers = t_soa_points(num_clusters, points.get_num_dims());
+		m_centers.copy_point(0, points, rng() % num_points);
+
+		for (size_t k = 0; (k + 1) < num_clusters; k++) {
+			m_thread_pool.run(num_blocks, [&](size_t block_idx, size_t) {
+				const size_t i0 = block_idx * KMEANS_BLOCK_SIZE;
+				const size_t i1 = std::min(i0 + KMEANS_BLOCK_SIZE, num_points);
+
+				double sum = 0.0;
+
+				for (size_t i = i0; i < i1; i++) {
+					sum += (min_dists[i] = std::min(min_dists[i], points.calc_squared_dist(i, m_centers, k)));
+				}
+
+				block_sums[block_idx] = sum;
+			});
+
+			double r = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+			double sum = 0.0;
+
+			for (size_t b = 0; b < num_blocks; b++)
+				sum += block_sums[b];
+
+			if (sum <= 0.0) {
+				// every point coincides with a center already
+				m_centers.copy_point(k + 1, points, rng() % num_points);
+				continue;
 			}
+
+			size_t block_idx = 0;
+			size_t point_idx = 0;
+
+			// find the block containing the r-th fraction of the total, then the point
+			for (r *= sum; block_idx < (num_blocks - 1) && r >= block_sums[block_idx]; block_idx++)
+				r -= block_sums[block_idx];
+
+			const size_t i0 = block_idx * KMEANS_BLOCK_SIZE;
+			const size_t i1 = std::min(i0 + KMEANS_BLOCK_SIZE, num_points);
+
+			for (point_idx = i0; point_idx < (i1 - 1) && r >= min_dists[point_idx]; point_idx++)
+				r -= min_dists[point_idx];
+
+			m_centers.copy_point(k + 1, points, point_idx);
+		}
+	}
+
+	// alternates assignment and update steps until no point changes its
+	// cluster or <max_iters> is reached; <use_bounds=false> runs plain
+	// Lloyd iterations (all k distances per point) for comparison
+	size_t run(const t_soa_points& points, size_t max_iters, bool use_bounds = true) {
+		const size_t num_points = points.get_num_points();
+		const size_t num_clusters = m_centers.get_num_points();
+		const size_t num_dims = points.get_num_dims();
+
+		assert(num_clusters != 0);
+		assert(num_dims == m_centers.get_num_dims());
+
+		m_assignments.assign(num_points, 0);
+		m_upper_bounds.assign(num_points, 0.0f);
+		m_lower_bounds.assign(num_points, 0.0f);
+
+		m_center_moves.assign(num_clusters, 0.0f);
+		m_center_seps.assign(num_clusters, 0.0f);
+		m_center_sums.assign(num_clusters * num_dims, 0.0);
+		m_center_sizes.assign(num_clusters, 0);
+
+		m_thread_partials.resize(m_thread_pool.get_num_threads());
+		m_num_dist_calcs = 0;
+
+		size_t iter = 0;
+
+		for (; iter < max_iters; iter++) {
+			calc_center_separations();
+
+			if (assign_points(points, iter == 0, use_bounds) == 0 && iter != 0)
+				break;
+
+			update_centers(points);
 		}
 
-		// map point <n> to cluster <min_cluster_idx>
-		cluster_points[n] = min_cluster_idx;
+		return iter;
 	}
-}
 
-template<typename point_type>
-uint_type kmeans_update_centers(
-	const std::vector<point_type>& points,
-	const std::vector<uint_type>& cluster_points,
-	      std::vector<uint_type>& cluster_sizes,
-	      std::vector<point_type>& cluster_centers,
-	float epsilon = 0.001f
-) {
-	uint_type num_converged_clusters = 0;
+	const t_soa_points& get_centers() const { return m_centers; }
+
+	const std::vector<uint_type>& get_assignments() const { return m_assignments; }
+	const std::vector<int64_t>& get_cluster_sizes() const { return m_center_sizes; }
+
+	uint64_t get_num_dist_calcs() const { return m_num_dist_calcs; }
+
+private:
+	struct alignas(CACHE_LINE_SIZE) t_thread_partials {
+		std::vector<double> sums;
+		std::vector<int64_t> sizes;
+		std::vector<float> dists;
 
-	for (uint_type k = 0; k < cluster_centers.size(); k++) {
-		const point_type cluster_center = cluster_centers[k];
+		size_t num_changed;
+		uint64_t num_dist_calcs;
+	};
 
-		// reset the count of points belonging to cluster k
-		cluster_sizes[k] = 0;
+	// s(j) = half the distance from center j to its nearest other center;
+	// a point closer than that to center j can not be closer to another
+	void calc_center_separations() {
+		const size_t num_clusters = m_centers.get_num_points();
 
-		// for each cluster, calculate its new center
-		for (uint_type n = 0; n < points.size(); n++) {
-			if (cluster_points[n] == k) {
-				cluster_sizes[k] += 1;
-				cluster_centers[k] += points[n];
+		std::fill(m_center_seps.begin(), m_center_seps.end(), std::numeric_limits<float>::max());
+
+		for (size_t j = 0; j < num_clusters; j++) {
+			for (size_t k = j + 1; k < num_clusters; k++) {
+				const float d = std::sqrt(m_centers.calc_squared_dist(j, m_centers, k)) * 0.5f;
+
+				m_center_seps[j] = std::min(m_center_seps[j], d);
+				m_center_seps[k] = std::min(m_center_seps[k], d);
 			}
 		}
+	}
+
+	// distances from point <i> to all centers, one dimension at a time so
+	// the inner loop runs over the contiguous center coordinates
+	void calc_center_dists(const t_soa_points& points, size_t i, float* dists) const {
+		const size_t num_clusters = m_centers.get_num_points();
 
-		// prevent possible div0's
-		cluster_centers[k] /= std::max(uint_type(1), cluster_sizes[k]);
-		num_converged_clusters += ((cluster_center - cluster_centers[k]).squared_length() < epsilon);
+		std::fill(dists, dists + num_clusters, 0.0f);
+
+		for (size_t d = 0; d < points.get_num_dims(); d++) {
+			const float x = points.get_coor(i, d);
+			const float* c = m_centers.get_dim(d);
+
+			for (size_t k = 0; k < num_clusters; k++) {
+				dists[k] += ((c[k] - x) * (c[k] - x));
+			}
+		}
 	}
 
-	return num_converged_clusters;
-}
+	size_t assign_points(const t_soa_points& points, bool first_pass, bool use_bounds) {
+		const size_t num_points = points.get_num_points();
+		const size_t num_clusters = m_centers.get_num_points();
+		const size_t num_dims = points.get_num_dims();
+		const size_t num_blocks = (num_points + KMEANS_BLOCK_SIZE - 1) / KMEANS_BLOCK_SIZE;
+
+		// largest and second-largest center movement of the last update
+		size_t max_move_idx = 0;
+		float max_moves[2] = {0.0f, 0.0f};
+
+		for (size_t k = 0; k < num_clusters; k++) {
+			if (m_center_moves[k] > max_moves[0]) {
+				max_moves[1] = max_moves[0];
+				max_moves[0] = m_center_moves[k];
+				max_move_idx = k;
+			} else {
+				max_moves[1] = std::max(max_moves[1], m_center_moves[k]);
+			}
+		}
+
+		for (t_thread_partials& partials: m_thread_partials) {
+			partials.sums.assign(num_clusters * num_dims, 0.0);
+			partials.sizes.assign(num_clusters, 0);
+			partials.dists.resize(num_clusters);
+			partials.num_changed = 0;
+			partials.num_dist_calcs = 0;
+		}
+
+		m_thread_pool.run(num_blocks, [&](size_t block_idx, size_t thread_idx) {
+			const size_t i0 = block_idx * KMEANS_BLOCK_SIZE;
+			const size_t i1 = std::min(i0 + KMEANS_BLOCK_SIZE, num_points);
+
+			t_thread_partials& partials = m_thread_partials[thread_idx];
+
+			for (size_t i = i0; i < i1; i++) {
+				const uint_type a = m_assignments[i];
+
+				if (!first_pass) {
+					// centers moved since the bounds were computed
+					m_upper_bounds[i] += m_center_moves[a];
+					m_lower_bounds[i] -= max_moves[a == max_move_idx];
+
+					if (use_bounds) {
+						const float bound = std::max(m_center_seps[a], m_lower_bounds[i]);
+
+						if (m_upper_bounds[i] <= bound)
+							continue;
+
+						// tighten the upper bound and test again
+						m_upper_bounds[i] = std::sqrt(points.calc_squared_dist(i, m_centers, a));
+						partials.num_dist_calcs += 1;
+
+						if (m_upper_bounds[i] <= bound)
+							continue;
+					}
+				}
+
+				float* dists = partials.dists.data();
+
+				calc_center_dists(points, i, dists);
+				partials.num_dist_calcs += num_clusters;
+
+				uint_type b = 0;
+				float min_dists[2] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+
+				for (size_t k = 0; k < num_clusters; k++) {
+					if (dists[k] < min_dists[0]) {
+						min_dists[1] = min_dists[0];
+						min_dists[0] = dists[k];
+						b = k;
+					} else {
+						min_dists[1] = std::min(min_dists[1], dists[k]);
+					}
+				}
+
+				m_upper_bounds[i] = std::sqrt(min_dists[0]);
+				m_lower_bounds[i] = std::sqrt(min_dists[1]);
+
+				if (!first_pass && b == a)
+					continue;
+
+				// move the point's contribution from cluster a to cluster b
+				for (size_t d = 0; d < num_dims; d++) {
+					const double x = points.get_coor(i, d);
+
+					partials.sums[b * num_dims + d] += x;
+					partials.sums[a * num_dims + d] -= (x * (!first_pass));
+				}
+
+				partials.sizes[b] += 1;
+				partials.sizes[a] -= (!first_pass);
+				partials.num_changed += 1;
+
+				m_assignments[i] = b;
+			}
+		});
+
+		size_t num_changed = 0;
+
+		for (const t_thread_partials& partials: m_thread_partials) {
+			for (size_t n = 0; n < partials.sums.size(); n++)
+				m_center_sums[n] += partials.sums[n];
+			for (size_t k = 0; k < num_clusters; k++)
+				m_center_sizes[k] += partials.sizes[k];
+
+			num_changed += partials.num_changed;
+			m_num_dist_calcs += partials.num_dist_calcs;
+		}
+
+		return num_changed;
+	}
+
+	void update_centers(const t_soa_points& points) {
+		const size_t num_dims = points.get_num_dims();
+
+		for (size_t k = 0; k < m_centers.get_num_points(); k++) {
+			float move_sq = 0.0f;
+
+			// an empty cluster keeps its center (and does not move)
+			for (size_t d = 0; d < num_dims && m_center_sizes[k] > 0; d++) {
+				const float c = m_center_sums[k * num_dims + d] / m_center_sizes[k];
+
+				move_sq += ((c - m_centers.get_coor(k, d)) * (c - m_centers.get_coor(k, d)));
+				m_centers.get_coor(k, d) = c;
+			}
+
+			m_center_moves[k] = std::sqrt(move_sq);
+		}
+	}
+
+private:
+	t_work_stealing_pool m_thread_pool;
+	t_soa_points m_centers;
+
+	std::vector<uint_type> m_assignments;
+
+	// per point; upper bound on the distance to its own center, lower
+	// bound on the distance to the nearest other one
+	std::vector<float> m_upper_bounds;
+	std::vector<float> m_lower_bounds;
+
+	// per center
+	std::vector<float> m_center_moves;
+	std::vector<float> m_center_seps;
+	std::vector<double> m_center_sums;
+	std::vector<int64_t> m_center_sizes;
+
+	std::vector<t_thread_partials> m_thread_partials;
+
+	uint64_t m_num_dist_calcs = 0;
+};
+
+
 
 template<typename cluster_type, typename point_type>
 void generate_kmeans_clusters(
 	uint_type num_clusters,
 	uint_type num_iterations,
 	const std::vector<point_type>& points,
-	      std::list<cluster_type>& clusters
+	      std::list<cluster_type>& clusters,
+	uint_type num_threads = std::thread::hardware_concurrency()
 ) {
-	std::vector<point_type> cluster_centers(num_clusters);
-	std::vector<uint_type> cluster_points(points.size(), 0);
-	std::vector<uint_type> cluster_sizes(num_clusters, 0);
+	t_soa_points soa_points(points.size(), 2);
+	t_kmeans_engine engine(num_threads);
 
 	assert(num_clusters <= points.size());
 
-	// step 0: initialize centers (randomly, Forgy method)
-	for (uint_type k = 0; k < cluster_centers.size(); k++) {
-		cluster_centers[k] = points[random() % points.size()];
+	for (uint_type n = 0; n < points.size(); n++) {
+		soa_points.get_coor(n, 0) = points[n].x();
+		soa_points.get_coor(n, 1) = points[n].y();
 	}
 
-	for (uint_type i = 0; i < num_iterations; i++) {
-		// step 1: assign points
-		kmeans_assign_points(points, cluster_centers, cluster_points);
+	// step 0: initialize centers (k-means++)
+	engine.seed_centers(soa_points, num_clusters, random());
+	// steps 1 and 2: assign points and update centers until stable
+	engine.run(soa_points, num_iterations);
 
-		// step 2: update centers
-		const uint_type num_converged_clusters = kmeans_update_centers(points, cluster_points, cluster_sizes, cluster_centers);
+	for (uint_type k = 0; k < num_clusters; k++) {
+		const t_soa_points& centers = engine.get_centers();
 
-		// bail if no cluster has moved more than <epsilon> since last update
-		if (num_converged_clusters == num_clusters) {
-			break;
+		// note: could also add the actual points here, but unnecessary
+		clusters.push_back(cluster_type(point_type(centers.get_coor(k, 0), centers.get_coor(k, 1))));
+	}
+}
+
+
+
+// clusters <num_points> points drawn from <num_clusters> gaussian blobs
+// with plain Lloyd iterations and with Hamerly's bounds from the same
+// seeds, reporting time, iterations and distance computations of each
+static void run_benchmark(size_t num_points, size_t num_clusters, size_t num_dims, size_t num_threads) {
+	std::mt19937 rng(num_points);
+	std::normal_distribution<float> noise(0.0f, 2.0f);
+
+	t_soa_points points(num_points, num_dims);
+	t_soa_points blobs(num_clusters, num_dims);
+
+	for (size_t k = 0; k < num_clusters; k++) {
+		for (size_t d = 0; d < num_dims; d++) {
+			blobs.get_coor(k, d) = std::uniform_real_distribution<float>(0.0f, DATA_POINT_COOR_RANGE_X)(rng);
 		}
 	}
+	for (size_t i = 0; i < num_points; i++) {
+		const size_t k = rng() % num_clusters;
 
-	for (uint_type k = 0; k < cluster_centers.size(); k++) {
-		// note: could also add the actual points here, but unnecessary
-		clusters.push_back(cluster_type(cluster_centers[k]));
+		for (size_t d = 0; d < num_dims; d++) {
+			points.get_coor(i, d) = blobs.get_coor(k, d) + noise(rng);
+		}
+	}
+
+	printf("[%s] points=%lu clusters=%lu dims=%lu threads=%lu\n", __func__, num_points, num_clusters, num_dims, num_threads);
+
+	std::vector<uint_type> lloyd_assignments;
+
+	for (size_t use_bounds = 0; use_bounds < 2; use_bounds++) {
+		t_kmeans_engine engine(num_threads);
+
+		const auto t0 = std::chrono::steady_clock::now();
+
+		engine.seed_centers(points, num_clusters, 1);
+
+		const auto t1 = std::chrono::steady_clock::now();
+		const size_t num_iters = engine.run(points, 1000, use_bounds);
+		const auto t2 = std::chrono::steady_clock::now();
+
+		const double seed_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+		const double iter_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+		size_t num_diffs = 0;
+
+		if (use_bounds) {
+			for (size_t i = 0; i < num_points; i++) {
+				num_diffs += (engine.get_assignments()[i] != lloyd_assignments[i]);
+			}
+		} else {
+			lloyd_assignments = engine.get_assignments();
+		}
+
+		printf("[%s] %-8s seed=%.1fms run=%.1fms iters=%lu dists/point/iter=%.2f diffs=%lu\n", __func__,
+			use_bounds? "hamerly": "lloyd",
+			seed_ms,
+			iter_ms,
+			num_iters,
+			// the final assignment pass finds no changes and does not update
+			engine.get_num_dist_calcs() / double(num_points * (num_iters + 1)),
+			num_diffs
+		);
 	}
 }
 
 
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		// --bench [points] [clusters] [dims] [threads]
+		run_benchmark(
+			(argc > 2)? atol(argv[2]): 1000000,
+			(argc > 3)? atoi(argv[3]): 50,
+			(argc > 4)? atoi(argv[4]): 2,
+			(argc > 5)? atoi(argv[5]): std::thread::hardware_concurrency()
+		);
+		return 0;
+	}
 
-int main() {
 	srandom(time(NULL));
 
 	FILE* DATA_POINTS_FILE = fopen("data_points.dat", "w");
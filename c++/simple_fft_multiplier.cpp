@@ -1,8 +1,34 @@
 #include <cassert>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
 #include <complex>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <vector>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+#define NTT_MAX_PRIMES 3
+// smallest transform that t_fft_soa_plan splits into row FFT's; below
+// 2^21 points (32 MB of SoA data) the plain Stockham passes stay in L2/L3
+// well enough that the extra twiddle pass does not pay off
+#define FFT_FOUR_STEP_MIN_SIZE (1u << 21)
+#define FFT_TRANSPOSE_TILE_SIZE 32
+
+typedef unsigned __int128 t_uint128;
+
 template<typename type>
 struct t_complex_num {
 public:
@@ -44,6 +70,20 @@ static bool is_power_of_two(size_t i) {
 	return ((i & (i - 1)) == 0);
 }
 
+// (b ^ e) % m for m < 2^32
+static uint64_t mod_pow(uint64_t b, uint64_t e, uint64_t m) {
+	uint64_t r = 1;
+
+	for (b %= m; e != 0; e >>= 1) {
+		if ((e & 1) != 0)
+			r = (r * b) % m;
+
+		b = (b * b) % m;
+	}
+
+	return r;
+}
+
 template<typename type>
 static void print_complex_vector(const std::vector< t_complex_num<type> >& v) {
 	printf("[%s]\n", __FUNCTION__);
@@ -128,49 +168,1324 @@ void fft_inverse(std::vector< t_complex_num<type> >& elems, const std::vector< t
 
 
 
+// precomputed twiddles and bit-reversal permutation for complex FFT's
+// of one power-of-two size; the stage which combines transforms of size
+// h into size 2h reads its h twiddles w_2h^m contiguously starting at
+// m_twiddles[h - 1] (n - 1 in total), and all twiddles are evaluated in
+// double precision once rather than per call
+template<typename type>
+struct t_fft_plan {
+public:
+	t_fft_plan(size_t n) {
+		assert(n > 0 && is_power_of_two(n));
+
+		m_size = n;
+		m_twiddles.resize(n - 1);
+
+		for (size_t h = 1; h < n; h *= 2) {
+			for (size_t m = 0; m < h; m++) {
+				const double t = (M_PI * -1 * m) / h;
+
+				m_twiddles[h - 1 + m] = t_complex_num<type>(std::cos(t), std::sin(t));
+			}
+		}
+
+		for (size_t i = 0, j = 0; i < n; i++) {
+			if (i < j)
+				m_swaps.push_back(std::make_pair(uint32_t(i), uint32_t(j)));
+
+			// increment j in bit-reversed order
+			size_t m = n >> 1;
+
+			for (; m != 0 && (j & m) != 0; m >>= 1)
+				j ^= m;
+
+			j |= m;
+		}
+	}
+
+	// plans are immutable once built, one per size is shared by all callers
+	static const t_fft_plan& get(size_t n) {
+		static std::mutex mutex;
+		static std::map<size_t, std::unique_ptr<t_fft_plan> > plans;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unique_ptr<t_fft_plan>& plan = plans[n];
+
+		if (plan == nullptr)
+			plan.reset(new t_fft_plan(n));
+
+		return *plan;
+	}
+
+	// unnormalized; inverse(forward(x)) equals x * size()
+	void forward(t_complex_num<type>* elems) const { transform<-1>(elems); }
+	void inverse(t_complex_num<type>* elems) const { transform< 1>(elems); }
+
+	size_t size() const { return m_size; }
+
+private:
+	template<int sign> void transform(t_complex_num<type>* elems) const {
+		for (const auto& s: m_swaps) {
+			std::swap(elems[s.first], elems[s.second]);
+		}
+
+		for (size_t h = 1; h < m_size; h *= 2) {
+			const t_complex_num<type>* w = &m_twiddles[h - 1];
+
+			for (size_t i = 0; i < m_size; i += (h * 2)) {
+				t_complex_num<type>* lo = &elems[i    ];
+				t_complex_num<type>* hi = &elems[i + h];
+
+				for (size_t m = 0; m < h; m++) {
+					// positive sign means *inverse* FFT, which uses the conjugate roots
+					const t_complex_num<type> t = ((sign < 0)? w[m]: w[m].conjugate()) * hi[m];
+					const t_complex_num<type> z = lo[m];
+
+					lo[m] = z + t;
+					hi[m] = z - t;
+				}
+			}
+		}
+	}
+
+private:
+	size_t m_size;
+
+	std::vector< t_complex_num<type> > m_twiddles;
+	std::vector< std::pair<uint32_t, uint32_t> > m_swaps;
+};
+
+
+// FFT of <n> real inputs: pairs of reals are packed into n/2 complex
+// values which go through a half-size complex FFT, after which the
+// spectra of the even and odd samples are separated and combined into
+// bins [0, n/2] (the others follow by conjugate symmetry), for half
+// the work of a complex transform of the same size
+template<typename type>
+struct t_real_fft_plan {
+public:
+	t_real_fft_plan(size_t n): m_plan(t_fft_plan<type>::get(std::max(n / 2, size_t(1)))) {
+		assert(n >= 2 && is_power_of_two(n));
+
+		m_size = n;
+		m_twiddles.resize(n / 2);
+
+		for (size_t k = 0; k < (n / 2); k++) {
+			const double t = (M_PI * 2 * -1 * k) / n;
+
+			m_twiddles[k] = t_complex_num<type>(std::cos(t), std::sin(t));
+		}
+	}
+
+	static const t_real_fft_plan& get(size_t n) {
+		static std::mutex mutex;
+		static std::map<size_t, std::unique_ptr<t_real_fft_plan> > plans;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unique_ptr<t_real_fft_plan>& plan = plans[n];
+
+		if (plan == nullptr)
+			plan.reset(new t_real_fft_plan(n));
+
+		return *plan;
+	}
+
+	// reads size() reals from <x>, writes size()/2 + 1 bins to <y>
+	void forward(const type* x, t_complex_num<type>* y) const {
+		const size_t h = m_size / 2;
+
+		for (size_t k = 0; k < h; k++) {
+			y[k] = t_complex_num<type>(x[k * 2], x[k * 2 + 1]);
+		}
+
+		m_plan.forward(y);
+
+		// DC and Nyquist bins are both real
+		y[h] = t_complex_num<type>(y[0].real() - y[0].imag(), type(0));
+		y[0] = t_complex_num<type>(y[0].real() + y[0].imag(), type(0));
+
+		for (size_t k = 1; k <= (h / 2); k++) {
+			const t_complex_num<type> a = y[k];
+			const t_complex_num<type> b = y[h - k].conjugate();
+
+			// even and odd spectra, fe = (a + b) / 2 and fo = (a - b) / 2i
+			const t_complex_num<type> fe = (a + b) * type(0.5);
+			const t_complex_num<type> fo = t_complex_num<type>(a.imag() - b.imag(), b.real() - a.real()) * type(0.5);
+			const t_complex_num<type> wo = m_twiddles[k] * fo;
+
+			y[k    ] = fe + wo;
+			y[h - k] = (fe - wo).conjugate();
+		}
+	}
+
+	// reads size()/2 + 1 bins from <y> (which is clobbered), writes
+	// size() reals scaled by size() to <x> like the complex inverse
+	void inverse(t_complex_num<type>* y, type* x) const {
+		const size_t h = m_size / 2;
+
+		const type y0 = y[0].real();
+		const type yh = y[h].real();
+
+		for (size_t k = 1; k <= (h / 2); k++) {
+			const t_complex_num<type> a = y[k];
+			const t_complex_num<type> b = y[h - k].conjugate();
+
+			// undo the forward combination, scaled by 2
+			const t_complex_num<type> fe = a + b;
+			const t_complex_num<type> fo = (a - b) * m_twiddles[k].conjugate();
+
+			y[k    ] = t_complex_num<type>(fe.real() - fo.imag(), fe.imag() + fo.real());
+			y[h - k] = t_complex_num<type>(fe.real() + fo.imag(), fo.real() - fe.imag());
+		}
+
+		y[0] = t_complex_num<type>(y0 + yh, y0 - yh);
+
+		m_plan.inverse(y);
+
+		for (size_t k = 0; k < h; k++) {
+			x[k * 2    ] = y[k].real();
+			x[k * 2 + 1] = y[k].imag();
+		}
+	}
+
+	size_t size() const { return m_size; }
+
+private:
+	const t_fft_plan<type>& m_plan;
+
+	size_t m_size;
+
+	// w_n^k for k in [0, n/2)
+	std::vector< t_complex_num<type> > m_twiddles;
+};
+
+
+
+// structure-of-arrays FFT engine (double precision): real and imaginary
+// parts live in separate arrays so that every load fills a SIMD register
+// with four independent values; transforms are Stockham autosort radix-4
+// (plus one radix-2 stage for odd powers of two) which ping-pong between
+// the data and a work buffer and never need a bit-reversal pass
+//
+// transforms too large for L2 are decomposed as N = N1 * N2 by Bailey's
+// four-step algorithm (the six-step one minus its first and second
+// transposes, which the Stockham kernel makes unnecessary): N1 strided
+// column FFT's of length N2 run as Stockham stages that start at stride
+// N1, after which each row is twiddled and transformed while it sits in
+// cache, and a single transpose puts the result in natural order
+struct t_fft_soa_plan {
+public:
+	t_fft_soa_plan(size_t n, bool use_simd = true, bool use_four_step = true) {
+		assert(n > 0 && is_power_of_two(n));
+
+		m_size = n;
+		m_use_avx2 = use_simd && cpu_has_avx2_fma();
+		m_use_four_step = use_four_step && (n >= FFT_FOUR_STEP_MIN_SIZE);
+
+		if (m_use_four_step) {
+			size_t log2n = 0;
+
+			while ((size_t(1) << log2n) < n)
+				log2n += 1;
+
+			// N = N1 * N2 with N1 >= N2
+			m_n2_log2 = log2n / 2;
+			m_n2 = size_t(1) << m_n2_log2;
+			m_n1 = n / m_n2;
+
+			m_sub_plans[0].reset(new t_fft_soa_plan(m_n1, use_simd, false));
+			m_sub_plans[1].reset(new t_fft_soa_plan(m_n2, use_simd, false));
+
+			// w_N^e = fine[e % N2] * coarse[e / N2] for the twiddles between
+			// the passes; real parts first, then imaginary parts
+			m_fine_twiddles.resize(m_n2 * 2);
+			m_coarse_twiddles.resize(m_n1 * 2);
+
+			for (size_t e = 0; e < m_n2; e++) {
+				const double t = (M_PI * 2 * -1 * e) / n;
+
+				m_fine_twiddles[e       ] = std::cos(t);
+				m_fine_twiddles[e + m_n2] = std::sin(t);
+			}
+			for (size_t e = 0; e < m_n1; e++) {
+				const double t = (M_PI * 2 * -1 * (e * m_n2)) / n;
+
+				m_coarse_twiddles[e       ] = std::cos(t);
+				m_coarse_twiddles[e + m_n1] = std::sin(t);
+			}
+
+			return;
+		}
+
+		// stage with sub-length m uses w_m^p, w_m^2p, w_m^3p for p < m/4,
+		// stored as six consecutive arrays {w1r,w1i,w2r,w2i,w3r,w3i}
+		for (size_t m = n; m >= 4; m /= 4) {
+			const size_t q = m / 4;
+
+			m_stage_offsets.push_back(m_twiddles.size());
+			m_twiddles.resize(m_twiddles.size() + q * 6);
+
+			double* w = &m_twiddles[m_stage_offsets.back()];
+
+			for (size_t p = 0; p < q; p++) {
+				for (size_t k = 1; k <= 3; k++) {
+					const double t = (M_PI * 2 * -1 * (k * p)) / m;
+
+					w[((k - 1) * 2 + 0) * q + p] = std::cos(t);
+					w[((k - 1) * 2 + 1) * q + p] = std::sin(t);
+				}
+			}
+		}
+	}
+
+	static const t_fft_soa_plan& get(size_t n) {
+		static std::mutex mutex;
+		static std::map<size_t, std::unique_ptr<t_fft_soa_plan> > plans;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unique_ptr<t_fft_soa_plan>& plan = plans[n];
+
+		if (plan == nullptr)
+			plan.reset(new t_fft_soa_plan(n));
+
+		return *plan;
+	}
+
+	// same conventions as t_fft_plan: unnormalized, forward uses w = exp(-2 pi i / N)
+	void forward(double* re, double* im) const {
+		std::unique_ptr<double[]> work(new double[m_size * 2]);
+		transform(re, im, &work[0], &work[m_size]);
+	}
+
+	// via conj(FFT(conj(x)))
+	void inverse(double* re, double* im) const {
+		std::unique_ptr<double[]> work(new double[m_size * 2]);
+
+		negate(im, m_size);
+		transform(re, im, &work[0], &work[m_size]);
+		negate(im, m_size);
+	}
+
+	size_t size() const { return m_size; }
+	bool use_avx2() const { return m_use_avx2; }
+	bool use_four_step() const { return m_use_four_step; }
+
+private:
+	static bool cpu_has_avx2_fma() {
+		#if (HAVE_X86_SIMD == 1)
+		return (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
+		#else
+		return false;
+		#endif
+	}
+
+	static void negate(double* v, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			v[i] = -v[i];
+		}
+	}
+
+	// result ends up in <xr, xi>, <wr, wi> is scratch of the same size
+	void transform(double* xr, double* xi, double* wr, double* wi) const {
+		if (m_use_four_step) {
+			four_step(xr, xi, wr, wi);
+			return;
+		}
+
+		if (stages(xr, xi, wr, wi, 1)) {
+			std::copy(wr, wr + m_size, xr);
+			std::copy(wi, wi + m_size, xi);
+		}
+	}
+
+	// runs all stages over <s> interleaved transforms (of m_size elements
+	// each) starting in <x>, returns true if the result ended up in <w>
+	bool stages(double* xr, double* xi, double* wr, double* wi, size_t s) const {
+		double* src[2] = {xr, xi};
+		double* dst[2] = {wr, wi};
+
+		size_t m = m_size;
+
+		for (size_t stage = 0; m >= 4; stage++, m /= 4, s *= 4) {
+			const double* w = &m_twiddles[m_stage_offsets[stage]];
+
+			#if (HAVE_X86_SIMD == 1)
+			if (m_use_avx2 && (s >= 4 || m >= 16)) {
+				stockham_radix4_avx2(m, s, src[0], src[1], dst[0], dst[1], w);
+			} else
+			#endif
+			{
+				stockham_radix4_scalar(m, s, src[0], src[1], dst[0], dst[1], w);
+			}
+
+			std::swap(src[0], dst[0]);
+			std::swap(src[1], dst[1]);
+		}
+
+		if (m == 2) {
+			stockham_radix2_scalar(s, src[0], src[1], dst[0], dst[1]);
+			std::swap(src[0], dst[0]);
+			std::swap(src[1], dst[1]);
+		}
+
+		return (src[0] != xr);
+	}
+
+
+	// one decimation-in-frequency Stockham stage over <s> interleaved
+	// sub-transforms of length <m>; y[q + s * (4p + k)] receives output
+	// k of butterfly p of sub-transform q, which puts the final result
+	// in natural order
+	static void stockham_radix4_scalar(size_t m, size_t s, const double* xr, const double* xi, double* yr, double* yi, const double* w) {
+		const size_t n1 = m / 4;
+
+		const double* w1r = w + n1 * 0; const double* w1i = w + n1 * 1;
+		const double* w2r = w + n1 * 2; const double* w2i = w + n1 * 3;
+		const double* w3r = w + n1 * 4; const double* w3i = w + n1 * 5;
+
+		for (size_t p = 0; p < n1; p++) {
+			for (size_t q = 0; q < s; q++) {
+				const double ar = xr[q + s * (p         )], ai = xi[q + s * (p         )];
+				const double br = xr[q + s * (p + n1    )], bi = xi[q + s * (p + n1    )];
+				const double cr = xr[q + s * (p + n1 * 2)], ci = xi[q + s * (p + n1 * 2)];
+				const double dr = xr[q + s * (p + n1 * 3)], di = xi[q + s * (p + n1 * 3)];
+
+				const double apcr = ar + cr, apci = ai + ci;
+				const double amcr = ar - cr, amci = ai - ci;
+				const double bpdr = br + dr, bpdi = bi + di;
+				// j * (b - d)
+				const double jbmdr = di - bi, jbmdi = br - dr;
+
+				const double y1r = amcr - jbmdr, y1i = amci - jbmdi;
+				const double y2r = apcr -  bpdr, y2i = apci -  bpdi;
+				const double y3r = amcr + jbmdr, y3i = amci + jbmdi;
+
+				yr[q + s * (p * 4 + 0)] = apcr + bpdr;
+				yi[q + s * (p * 4 + 0)] = apci + bpdi;
+				yr[q + s * (p * 4 + 1)] = y1r * w1r[p] - y1i * w1i[p];
+				yi[q + s * (p * 4 + 1)] = y1r * w1i[p] + y1i * w1r[p];
+				yr[q + s * (p * 4 + 2)] = y2r * w2r[p] - y2i * w2i[p];
+				yi[q + s * (p * 4 + 2)] = y2r * w2i[p] + y2i * w2r[p];
+				yr[q + s * (p * 4 + 3)] = y3r * w3r[p] - y3i * w3i[p];
+				yi[q + s * (p * 4 + 3)] = y3r * w3i[p] + y3i * w3r[p];
+			}
+		}
+	}
+
+	static void stockham_radix2_scalar(size_t s, const double* xr, const double* xi, double* yr, double* yi) {
+		for (size_t q = 0; q < s; q++) {
+			const double ar = xr[q    ], ai = xi[q    ];
+			const double br = xr[q + s], bi = xi[q + s];
+
+			yr[q    ] = ar + br; yi[q    ] = ai + bi;
+			yr[q + s] = ar - br; yi[q + s] = ai - bi;
+		}
+	}
+
+	#if (HAVE_X86_SIMD == 1)
+	// 4-wide version of stockham_radix4_scalar; for s >= 4 the vectors run
+	// along q, for s = 1 (the first stage) along p, in which case outputs
+	// k = 0..3 of four consecutive butterflies form a 4x4 block that gets
+	// transposed to be stored contiguously
+	__attribute__((target("avx2,fma")))
+	static void stockham_radix4_avx2(size_t m, size_t s, const double* xr, const double* xi, double* yr, double* yi, const double* w) {
+		const size_t n1 = m / 4;
+
+		const double* w1r = w + n1 * 0; const double* w1i = w + n1 * 1;
+		const double* w2r = w + n1 * 2; const double* w2i = w + n1 * 3;
+		const double* w3r = w + n1 * 4; const double* w3i = w + n1 * 5;
+
+		// butterfly on four lanes; y0 untwiddled, y1..y3 multiplied by w1..w3
+		#define RADIX4_BUTTERFLY_AVX2(xofs, wr1, wi1, wr2, wi2, wr3, wi3)                   \
+			const __m256d ar = _mm256_loadu_pd(xr + (xofs)         ), ai = _mm256_loadu_pd(xi + (xofs)         ); \
+			const __m256d br = _mm256_loadu_pd(xr + (xofs) + s * n1    ), bi = _mm256_loadu_pd(xi + (xofs) + s * n1    ); \
+			const __m256d cr = _mm256_loadu_pd(xr + (xofs) + s * n1 * 2), ci = _mm256_loadu_pd(xi + (xofs) + s * n1 * 2); \
+			const __m256d dr = _mm256_loadu_pd(xr + (xofs) + s * n1 * 3), di = _mm256_loadu_pd(xi + (xofs) + s * n1 * 3); \
+			const __m256d apcr = _mm256_add_pd(ar, cr), apci = _mm256_add_pd(ai, ci);       \
+			const __m256d amcr = _mm256_sub_pd(ar, cr), amci = _mm256_sub_pd(ai, ci);       \
+			const __m256d bpdr = _mm256_add_pd(br, dr), bpdi = _mm256_add_pd(bi, di);       \
+			const __m256d jbmdr = _mm256_sub_pd(di, bi), jbmdi = _mm256_sub_pd(br, dr);     \
+			const __m256d u1r = _mm256_sub_pd(amcr, jbmdr), u1i = _mm256_sub_pd(amci, jbmdi); \
+			const __m256d u2r = _mm256_sub_pd(apcr,  bpdr), u2i = _mm256_sub_pd(apci,  bpdi); \
+			const __m256d u3r = _mm256_add_pd(amcr, jbmdr), u3i = _mm256_add_pd(amci, jbmdi); \
+			const __m256d y0r = _mm256_add_pd(apcr, bpdr), y0i = _mm256_add_pd(apci, bpdi); \
+			const __m256d y1r = _mm256_fmsub_pd(u1r, wr1, _mm256_mul_pd(u1i, wi1));         \
+			const __m256d y1i = _mm256_fmadd_pd(u1r, wi1, _mm256_mul_pd(u1i, wr1));         \
+			const __m256d y2r = _mm256_fmsub_pd(u2r, wr2, _mm256_mul_pd(u2i, wi2));         \
+			const __m256d y2i = _mm256_fmadd_pd(u2r, wi2, _mm256_mul_pd(u2i, wr2));         \
+			const __m256d y3r = _mm256_fmsub_pd(u3r, wr3, _mm256_mul_pd(u3i, wi3));         \
+			const __m256d y3i = _mm256_fmadd_pd(u3r, wi3, _mm256_mul_pd(u3i, wr3));
+
+		if (s == 1) {
+			for (size_t p = 0; p < n1; p += 4) {
+				RADIX4_BUTTERFLY_AVX2(p,
+					_mm256_loadu_pd(w1r + p), _mm256_loadu_pd(w1i + p),
+					_mm256_loadu_pd(w2r + p), _mm256_loadu_pd(w2i + p),
+					_mm256_loadu_pd(w3r + p), _mm256_loadu_pd(w3i + p)
+				)
+
+				store_transposed_4x4(yr + p * 4, y0r, y1r, y2r, y3r);
+				store_transposed_4x4(yi + p * 4, y0i, y1i, y2i, y3i);
+			}
+
+			return;
+		}
+
+		for (size_t p = 0; p < n1; p++) {
+			const __m256d vw1r = _mm256_set1_pd(w1r[p]), vw1i = _mm256_set1_pd(w1i[p]);
+			const __m256d vw2r = _mm256_set1_pd(w2r[p]), vw2i = _mm256_set1_pd(w2i[p]);
+			const __m256d vw3r = _mm256_set1_pd(w3r[p]), vw3i = _mm256_set1_pd(w3i[p]);
+
+			for (size_t q = 0; q < s; q += 4) {
+				RADIX4_BUTTERFLY_AVX2(q + s * p, vw1r, vw1i, vw2r, vw2i, vw3r, vw3i)
+
+				_mm256_storeu_pd(yr + q + s * (p * 4 + 0), y0r); _mm256_storeu_pd(yi + q + s * (p * 4 + 0), y0i);
+				_mm256_storeu_pd(yr + q + s * (p * 4 + 1), y1r); _mm256_storeu_pd(yi + q + s * (p * 4 + 1), y1i);
+				_mm256_storeu_pd(yr + q + s * (p * 4 + 2), y2r); _mm256_storeu_pd(yi + q + s * (p * 4 + 2), y2i);
+				_mm256_storeu_pd(yr + q + s * (p * 4 + 3), y3r); _mm256_storeu_pd(yi + q + s * (p * 4 + 3), y3i);
+			}
+		}
+
+		#undef RADIX4_BUTTERFLY_AVX2
+	}
+
+	// writes row r of the transpose of rows {v0, v1, v2, v3} to y[4r .. 4r + 3]
+	__attribute__((target("avx2")))
+	static inline void store_transposed_4x4(double* y, __m256d v0, __m256d v1, __m256d v2, __m256d v3) {
+		const __m256d t0 = _mm256_unpacklo_pd(v0, v1);
+		const __m256d t1 = _mm256_unpackhi_pd(v0, v1);
+		const __m256d t2 = _mm256_unpacklo_pd(v2, v3);
+		const __m256d t3 = _mm256_unpackhi_pd(v2, v3);
+
+		_mm256_storeu_pd(y +  0, _mm256_permute2f128_pd(t0, t2, 0x20));
+		_mm256_storeu_pd(y +  4, _mm256_permute2f128_pd(t1, t3, 0x20));
+		_mm256_storeu_pd(y +  8, _mm256_permute2f128_pd(t0, t2, 0x31));
+		_mm256_storeu_pd(y + 12, _mm256_permute2f128_pd(t1, t3, 0x31));
+	}
+	#endif
+
+
+	#if (HAVE_X86_SIMD == 1)
+	__attribute__((target("avx2")))
+	static void transpose_avx2(const double* x, double* y, size_t rows, size_t cols) {
+		const size_t b = FFT_TRANSPOSE_TILE_SIZE;
+
+		for (size_t r0 = 0; r0 < rows; r0 += b) {
+			for (size_t c0 = 0; c0 < cols; c0 += b) {
+				for (size_t r = r0; r < (r0 + b); r += 4) {
+					for (size_t c = c0; c < (c0 + b); c += 4) {
+						const __m256d v0 = _mm256_loadu_pd(x + (r + 0) * cols + c);
+						const __m256d v1 = _mm256_loadu_pd(x + (r + 1) * cols + c);
+						const __m256d v2 = _mm256_loadu_pd(x + (r + 2) * cols + c);
+						const __m256d v3 = _mm256_loadu_pd(x + (r + 3) * cols + c);
+
+						const __m256d t0 = _mm256_unpacklo_pd(v0, v1);
+						const __m256d t1 = _mm256_unpackhi_pd(v0, v1);
+						const __m256d t2 = _mm256_unpacklo_pd(v2, v3);
+						const __m256d t3 = _mm256_unpackhi_pd(v2, v3);
+
+						_mm256_storeu_pd(y + (c + 0) * rows + r, _mm256_permute2f128_pd(t0, t2, 0x20));
+						_mm256_storeu_pd(y + (c + 1) * rows + r, _mm256_permute2f128_pd(t1, t3, 0x20));
+						_mm256_storeu_pd(y + (c + 2) * rows + r, _mm256_permute2f128_pd(t0, t2, 0x31));
+						_mm256_storeu_pd(y + (c + 3) * rows + r, _mm256_permute2f128_pd(t1, t3, 0x31));
+					}
+				}
+			}
+		}
+	}
+	#endif
+
+	// transposes the <rows> x <cols> matrix <x> into <y> in cache-sized tiles
+	void transpose(const double* x, double* y, size_t rows, size_t cols) const {
+		const size_t b = FFT_TRANSPOSE_TILE_SIZE;
+
+		#if (HAVE_X86_SIMD == 1)
+		// four-step sizes are always multiples of the tile size
+		if (m_use_avx2 && (rows % b) == 0 && (cols % b) == 0) {
+			transpose_avx2(x, y, rows, cols);
+			return;
+		}
+		#endif
+
+		for (size_t r0 = 0; r0 < rows; r0 += b) {
+			for (size_t c0 = 0; c0 < cols; c0 += b) {
+				for (size_t r = r0; r < std::min(r0 + b, rows); r++) {
+					for (size_t c = c0; c < std::min(c0 + b, cols); c++) {
+						y[c * rows + r] = x[r * cols + c];
+					}
+				}
+			}
+		}
+	}
+
+	// multiplies element n1 of row k2 by w_N^(n1 k2)
+	void twiddle_row_scalar(double* rr, double* ri, size_t k2) const {
+		const double* fr = &m_fine_twiddles[0];
+		const double* fi = &m_fine_twiddles[m_n2];
+		const double* cr = &m_coarse_twiddles[0];
+		const double* ci = &m_coarse_twiddles[m_n1];
+
+		for (size_t n1 = 1; n1 < m_n1; n1++) {
+			const size_t e = n1 * k2;
+			const size_t f = e & (m_n2 - 1);
+			const size_t c = e >> m_n2_log2;
+
+			const double tr = fr[f] * cr[c] - fi[f] * ci[c];
+			const double ti = fr[f] * ci[c] + fi[f] * cr[c];
+			const double vr = rr[n1];
+			const double vi = ri[n1];
+
+			rr[n1] = vr * tr - vi * ti;
+			ri[n1] = vr * ti + vi * tr;
+		}
+	}
+
+	#if (HAVE_X86_SIMD == 1)
+	__attribute__((target("avx2,fma")))
+	void twiddle_row_avx2(double* rr, double* ri, size_t k2) const {
+		const double* fr = &m_fine_twiddles[0];
+		const double* fi = &m_fine_twiddles[m_n2];
+		const double* cr = &m_coarse_twiddles[0];
+		const double* ci = &m_coarse_twiddles[m_n1];
+
+		const __m256i mask = _mm256_set1_epi64x(m_n2 - 1);
+		const __m256i step = _mm256_set1_epi64x(k2 * 4);
+
+		// exponents n1 * k2 of four consecutive elements
+		__m256i e = _mm256_set_epi64x(k2 * 3, k2 * 2, k2 * 1, 0);
+
+		for (size_t n1 = 0; n1 < m_n1; n1 += 4, e = _mm256_add_epi64(e, step)) {
+			const __m256i f = _mm256_and_si256(e, mask);
+			const __m256i c = _mm256_srli_epi64(e, m_n2_log2);
+
+			const __m256d vfr = _mm256_i64gather_pd(fr, f, 8);
+			const __m256d vfi = _mm256_i64gather_pd(fi, f, 8);
+			const __m256d vcr = _mm256_i64gather_pd(cr, c, 8);
+			const __m256d vci = _mm256_i64gather_pd(ci, c, 8);
+
+			const __m256d tr = _mm256_fmsub_pd(vfr, vcr, _mm256_mul_pd(vfi, vci));
+			const __m256d ti = _mm256_fmadd_pd(vfr, vci, _mm256_mul_pd(vfi, vcr));
+			const __m256d vr = _mm256_loadu_pd(rr + n1);
+			const __m256d vi = _mm256_loadu_pd(ri + n1);
+
+			_mm256_storeu_pd(rr + n1, _mm256_fmsub_pd(vr, tr, _mm256_mul_pd(vi, ti)));
+			_mm256_storeu_pd(ri + n1, _mm256_fmadd_pd(vr, ti, _mm256_mul_pd(vi, tr)));
+		}
+	}
+	#endif
+
+	// with n = n1 + N1 * n2 and k = k2 + N2 * k1 the input is an N2 x N1
+	// matrix whose columns are transformed first (over n2), then its rows
+	// are multiplied by w_N^(n1 k2) and transformed (over n1), and the
+	// final transpose turns element (k2, k1) into X[k2 + N2 * k1]
+	void four_step(double* xr, double* xi, double* wr, double* wi) const {
+		const t_fft_soa_plan& row_plan = *m_sub_plans[0];
+		const t_fft_soa_plan& col_plan = *m_sub_plans[1];
+
+		std::unique_ptr<double[]> row_work(new double[m_n1 * 2]);
+
+		// N1 interleaved column transforms are exactly what the Stockham
+		// stages of the length-N2 plan compute when started at stride N1
+		const bool in_work = col_plan.stages(xr, xi, wr, wi, m_n1);
+
+		double* ar = in_work? wr: xr;
+		double* ai = in_work? wi: xi;
+		double* br = in_work? xr: wr;
+		double* bi = in_work? xi: wi;
+
+		for (size_t k2 = 0; k2 < m_n2; k2++) {
+			double* rr = ar + k2 * m_n1;
+			double* ri = ai + k2 * m_n1;
+
+			#if (HAVE_X86_SIMD == 1)
+			if (m_use_avx2) {
+				twiddle_row_avx2(rr, ri, k2);
+			} else
+			#endif
+			{
+				twiddle_row_scalar(rr, ri, k2);
+			}
+
+			row_plan.transform(rr, ri, &row_work[0], &row_work[m_n1]);
+		}
+
+		transpose(ar, br, m_n2, m_n1);
+		transpose(ai, bi, m_n2, m_n1);
+
+		if (br != xr) {
+			std::copy(br, br + m_size, xr);
+			std::copy(bi, bi + m_size, xi);
+		}
+	}
+
+private:
+	size_t m_size;
+	size_t m_n1 = 0;
+	size_t m_n2 = 0;
+	size_t m_n2_log2 = 0;
+
+	bool m_use_avx2;
+	bool m_use_four_step;
+
+	std::vector<size_t> m_stage_offsets;
+	std::vector<double> m_twiddles;
+	std::vector<double> m_fine_twiddles;
+	std::vector<double> m_coarse_twiddles;
+
+	std::unique_ptr<t_fft_soa_plan> m_sub_plans[2];
+};
+
+
+
+// the rounding error of the floating-point transforms grows with
+// size and coefficient magnitude, so exact integer products are done
+// by number-theoretic transforms modulo primes p = c * 2^k + 1 (which
+// have 2^k-th roots of unity) and recombined by the CRT
+struct t_ntt_prime {
+	uint32_t modulus;
+	uint32_t generator;
+	uint32_t max_log2;
+};
+
+static const t_ntt_prime NTT_PRIMES[NTT_MAX_PRIMES] = {
+	{998244353, 3, 23}, // 119 * 2^23 + 1
+	{469762049, 3, 26}, //   7 * 2^26 + 1
+	{167772161, 3, 25}, //   5 * 2^25 + 1
+};
+
+
+// Montgomery arithmetic modulo an odd p < 2^30 with R = 2^32; the
+// reduction replaces the division of a '%' by two multiplications
+struct t_mont32_field {
+public:
+	t_mont32_field(uint32_t p = 1) {
+		uint32_t inv = p;
+
+		// p^-1 mod 2^32 by Newton iteration (each step doubles the correct low bits)
+		for (unsigned int i = 0; i < 4; i++) {
+			inv *= (2 - p * inv);
+		}
+
+		m_p = p;
+		m_p_neg_inv = -inv;
+		m_r2 = (uint64_t(uint64_t(1) << 32) % p) * (uint64_t(uint64_t(1) << 32) % p) % p;
+	}
+
+	// t * R^-1 mod p for t < p * 2^32
+	uint32_t reduce(uint64_t t) const {
+		const uint32_t m = uint32_t(t) * m_p_neg_inv;
+		const uint32_t u = (t + uint64_t(m) * m_p) >> 32;
+
+		return ((u >= m_p)? (u - m_p): u);
+	}
+
+	uint32_t mul(uint32_t a, uint32_t b) const { return (reduce(uint64_t(a) * b)); }
+	uint32_t add(uint32_t a, uint32_t b) const { return (((a += b) >= m_p)? (a - m_p): a); }
+	uint32_t sub(uint32_t a, uint32_t b) const { return ((a >= b)? (a - b): (a + m_p - b)); }
+
+	uint32_t to_mont(uint32_t a) const { return (mul(a % m_p, m_r2)); }
+	uint32_t from_mont(uint32_t a) const { return (reduce(a)); }
+
+	// a^e with <a> and the result in Montgomery form
+	uint32_t pow(uint32_t a, uint64_t e) const {
+		uint32_t r = to_mont(1);
+
+		for (; e != 0; e >>= 1) {
+			if ((e & 1) != 0)
+				r = mul(r, a);
+
+			a = mul(a, a);
+		}
+
+		return r;
+	}
+
+	uint32_t modulus() const { return m_p; }
+
+private:
+	uint32_t m_p;
+	uint32_t m_p_neg_inv; // -p^-1 mod 2^32
+	uint32_t m_r2; // R^2 mod p
+};
+
+
+// NTT counterpart of t_fft_plan (same twiddle layout) for one prime;
+// the twiddles are kept in Montgomery form while the data stays in
+// normal form, which Montgomery multiplication by a Montgomery-form
+// twiddle preserves
+struct t_ntt_plan {
+public:
+	t_ntt_plan(size_t n, size_t prime_idx) {
+		const t_ntt_prime& prime = NTT_PRIMES[prime_idx];
+
+		assert(n > 0 && is_power_of_two(n));
+		assert(n <= (size_t(1) << prime.max_log2));
+
+		m_size = n;
+		m_field = t_mont32_field(prime.modulus);
+		m_fwd_twiddles.resize(n - 1);
+		m_inv_twiddles.resize(n - 1);
+
+		const uint32_t g = m_field.to_mont(prime.generator);
+
+		for (size_t h = 1; h < n; h *= 2) {
+			// primitive 2h-th root of unity and its inverse
+			const uint32_t w = m_field.pow(g, (prime.modulus - 1) / (h * 2));
+			const uint32_t v = m_field.pow(w, prime.modulus - 2);
+
+			m_fwd_twiddles[h - 1] = m_field.to_mont(1);
+			m_inv_twiddles[h - 1] = m_field.to_mont(1);
+
+			for (size_t m = 1; m < h; m++) {
+				m_fwd_twiddles[h - 1 + m] = m_field.mul(m_fwd_twiddles[h - 2 + m], w);
+				m_inv_twiddles[h - 1 + m] = m_field.mul(m_inv_twiddles[h - 2 + m], v);
+			}
+		}
+
+		// the pointwise Montgomery products of two normal-form spectra are
+		// off by a factor R^-1, so the final 1/n scaling (a Montgomery mul
+		// by n^-1 * R^2) also cancels that one
+		const uint32_t n_inv = m_field.pow(m_field.to_mont(n), prime.modulus - 2);
+
+		m_scale = m_field.to_mont(n_inv);
+
+		for (size_t i = 0, j = 0; i < n; i++) {
+			if (i < j)
+				m_swaps.push_back(std::make_pair(uint32_t(i), uint32_t(j)));
+
+			size_t m = n >> 1;
+
+			for (; m != 0 && (j & m) != 0; m >>= 1)
+				j ^= m;
+
+			j |= m;
+		}
+	}
+
+	static const t_ntt_plan& get(size_t n, size_t prime_idx) {
+		static std::mutex mutex;
+		static std::map<std::pair<size_t, size_t>, std::unique_ptr<t_ntt_plan> > plans;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unique_ptr<t_ntt_plan>& plan = plans[std::make_pair(n, prime_idx)];
+
+		if (plan == nullptr)
+			plan.reset(new t_ntt_plan(n, prime_idx));
+
+		return *plan;
+	}
+
+	// computes the cyclic convolution of <a> and <b> (both of size()
+	// elements reduced mod p) into <a>, destroying <b>
+	void convolve(uint32_t* a, uint32_t* b) const {
+		transform(a, m_fwd_twiddles.data());
+		transform(b, m_fwd_twiddles.data());
+
+		for (size_t k = 0; k < m_size; k++) {
+			a[k] = m_field.mul(a[k], b[k]);
+		}
+
+		transform(a, m_inv_twiddles.data());
+
+		for (size_t k = 0; k < m_size; k++) {
+			a[k] = m_field.mul(a[k], m_scale);
+		}
+	}
+
+	const t_mont32_field& field() const { return m_field; }
+
+private:
+	void transform(uint32_t* elems, const uint32_t* twiddles) const {
+		// local copy, stores through <elems> could otherwise alias the members
+		const t_mont32_field field = m_field;
+
+		for (const auto& s: m_swaps) {
+			std::swap(elems[s.first], elems[s.second]);
+		}
+
+		for (size_t h = 1; h < m_size; h *= 2) {
+			const uint32_t* w = &twiddles[h - 1];
+
+			for (size_t i = 0; i < m_size; i += (h * 2)) {
+				uint32_t* lo = &elems[i    ];
+				uint32_t* hi = &elems[i + h];
+
+				for (size_t m = 0; m < h; m++) {
+					const uint32_t t = field.mul(hi[m], w[m]);
+					const uint32_t z = lo[m];
+
+					lo[m] = field.add(z, t);
+					hi[m] = field.sub(z, t);
+				}
+			}
+		}
+	}
+
+private:
+	size_t m_size;
+
+	t_mont32_field m_field;
+
+	uint32_t m_scale;
+
+	std::vector<uint32_t> m_fwd_twiddles;
+	std::vector<uint32_t> m_inv_twiddles;
+	std::vector< std::pair<uint32_t, uint32_t> > m_swaps;
+};
+
+
+
+static size_t next_power_of_two(size_t n) {
+	size_t p = 1;
+
+	while (p < n)
+		p *= 2;
+
+	return p;
+}
+
+
+// product of two polynomials with coefficients (in increasing order of
+// degree) <p> and <q>; the result has p.size() + q.size() terms (ie. as
+// many digits as the product of two integers with these digit-counts)
 template<typename type>
 std::vector< t_complex_num<type> > fft_multiply(
-	std::vector< t_complex_num<type> >& p,
-	std::vector< t_complex_num<type> >& q
+	const std::vector< t_complex_num<type> >& p,
+	const std::vector< t_complex_num<type> >& q
 ) {
-	assert(p.size() == q.size());
-	assert(is_power_of_two(p.size()));
-	assert(is_power_of_two(q.size()));
-	assert(is_power_of_two(p.size() + q.size()));
+	const t_fft_plan<type>& plan = t_fft_plan<type>::get(next_power_of_two(p.size() + q.size()));
+
+	// zero-padded copies
+	std::vector< t_complex_num<type> > fp(plan.size());
+	std::vector< t_complex_num<type> > fq(plan.size());
+	std::vector< t_complex_num<type> > r;
+
+	std::copy(p.begin(), p.end(), fp.begin());
+	std::copy(q.begin(), q.end(), fq.begin());
+
+	// compute DFT's
+	plan.forward(fp.data());
+	plan.forward(fq.data());
+
+	// pointwise-multiply in the frequency domain
+	for (size_t k = 0; k < plan.size(); k++) {
+		fp[k] = fp[k] * fq[k];
+	}
 
-	const std::vector< t_complex_num<type> >& v = calc_roots<type>(p.size() + q.size());
-	      std::vector< t_complex_num<type> > r;
+	plan.inverse(fp.data());
 
+	// normalize the result terms
 	r.resize(p.size() + q.size());
 
-	// pad p and q with zero-terms
-	for (size_t i = p.size(); i < r.size(); i++) {
-		p.push_back(t_complex_num<type>());
-		q.push_back(t_complex_num<type>());
+	for (size_t k = 0; k < r.size(); k++) {
+		r[k] = fp[k] / type(plan.size());
 	}
 
-	// compute DFT's
-	fft_forward<type>(p, v);
-	fft_forward<type>(q, v);
+	return r;
+}
+
+// same for real coefficients, through the half-size real transform
+template<typename type>
+std::vector<type> fft_multiply_real(const std::vector<type>& p, const std::vector<type>& q) {
+	const t_real_fft_plan<type>& plan = t_real_fft_plan<type>::get(next_power_of_two(std::max(p.size() + q.size(), size_t(2))));
+
+	std::vector<type> x(plan.size(), type(0));
+	std::vector<type> r;
+
+	std::vector< t_complex_num<type> > fp(plan.size() / 2 + 1);
+	std::vector< t_complex_num<type> > fq(plan.size() / 2 + 1);
+
+	std::copy(p.begin(), p.end(), x.begin());
+	plan.forward(x.data(), fp.data());
+	std::fill(x.begin(), x.end(), type(0));
+	std::copy(q.begin(), q.end(), x.begin());
+	plan.forward(x.data(), fq.data());
+
+	for (size_t k = 0; k < fp.size(); k++) {
+		fp[k] = fp[k] * fq[k];
+	}
+
+	plan.inverse(fp.data(), x.data());
+
+	r.resize(p.size() + q.size());
 
-	// pointwise-multiply in the frequency domain
 	for (size_t k = 0; k < r.size(); k++) {
-		r[k] = p[k] * q[k];
+		r[k] = x[k] / type(plan.size());
 	}
 
-	fft_inverse<type>(r, v);
+	return r;
+}
+
+
+// product of two real polynomials through one forward and one inverse
+// SoA transform: p and q are packed as the real and imaginary parts of
+// a single input, and their spectra separated by conjugate symmetry
+static std::vector<double> fft_multiply_soa(const std::vector<double>& p, const std::vector<double>& q) {
+	const t_fft_soa_plan& plan = t_fft_soa_plan::get(next_power_of_two(p.size() + q.size()));
+	const size_t n = plan.size();
+
+	std::vector<double> re(n, 0.0);
+	std::vector<double> im(n, 0.0);
+	std::vector<double> rr(n);
+	std::vector<double> ri(n);
+
+	std::copy(p.begin(), p.end(), re.begin());
+	std::copy(q.begin(), q.end(), im.begin());
+
+	plan.forward(re.data(), im.data());
+
+	for (size_t k = 0; k < n; k++) {
+		const size_t j = (n - k) & (n - 1);
+
+		// P[k] = (X[k] + conj(X[j])) / 2, Q[k] = (X[k] - conj(X[j])) / 2i
+		const double pr = (re[k] + re[j]) * 0.5, pi = (im[k] - im[j]) * 0.5;
+		const double qr = (im[k] + im[j]) * 0.5, qi = (re[j] - re[k]) * 0.5;
+
+		rr[k] = pr * qr - pi * qi;
+		ri[k] = pr * qi + pi * qr;
+	}
+
+	plan.inverse(rr.data(), ri.data());
+
+	std::vector<double> r(p.size() + q.size());
+
+	for (size_t k = 0; k < r.size(); k++) {
+		r[k] = rr[k] / n;
+	}
+
+	return r;
+}
+
+
+// exact product of two polynomials with non-negative integer coefficients
+// (less than 2^32); convolves modulo as many NTT primes as the largest
+// possible result coefficient min(|p|, |q|) * max(p) * max(q) requires
+// and recombines the residues by Garner's algorithm
+static std::vector<t_uint128> ntt_multiply(const std::vector<uint32_t>& p, const std::vector<uint32_t>& q) {
+	std::vector<t_uint128> r(p.size() + q.size(), 0);
+
+	if (p.empty() || q.empty())
+		return r;
+
+	const size_t n = next_power_of_two(p.size() + q.size());
+	const t_uint128 max_coeff = t_uint128(std::min(p.size(), q.size())) * (*std::max_element(p.begin(), p.end())) * (*std::max_element(q.begin(), q.end()));
+
+	t_uint128 modulus = 1;
+	size_t num_primes = 0;
+
+	while (num_primes < NTT_MAX_PRIMES && modulus <= max_coeff) {
+		modulus *= NTT_PRIMES[num_primes++].modulus;
+	}
+
+	assert(max_coeff < modulus);
+
+	std::vector<uint32_t> residues[NTT_MAX_PRIMES];
+	std::vector<uint32_t> tmp(n);
+
+	for (size_t i = 0; i < num_primes; i++) {
+		const t_ntt_plan& plan = t_ntt_plan::get(n, i);
+		const uint32_t m = NTT_PRIMES[i].modulus;
+
+		residues[i].assign(n, 0);
+		std::fill(tmp.begin(), tmp.end(), 0);
+
+		for (size_t k = 0; k < p.size(); k++) residues[i][k] = p[k] % m;
+		for (size_t k = 0; k < q.size(); k++) tmp[k] = q[k] % m;
+
+		plan.convolve(residues[i].data(), tmp.data());
+	}
+
+	// x = v0 + m0 * (v1 + m1 * v2), with v_i in [0, m_i) from mixed-radix CRT
+	const uint64_t m0 = NTT_PRIMES[0].modulus;
+	const uint64_t m1 = NTT_PRIMES[1].modulus;
+	const uint64_t m2 = NTT_PRIMES[2].modulus;
+
+	const uint64_t m0_inv_m1 = mod_pow(m0 % m1, m1 - 2, m1);
+	const uint64_t m0_inv_m2 = mod_pow(m0 % m2, m2 - 2, m2);
+	const uint64_t m1_inv_m2 = mod_pow(m1 % m2, m2 - 2, m2);
 
-	// normalize the result terms
 	for (size_t k = 0; k < r.size(); k++) {
-		r[k] /= r.size();
+		const uint64_t v0 = residues[0][k];
+
+		if (num_primes == 1) {
+			r[k] = v0;
+			continue;
+		}
+
+		const uint64_t v1 = ((residues[1][k] + m1 - (v0 % m1)) * m0_inv_m1) % m1;
+
+		if (num_primes == 2) {
+			r[k] = v0 + t_uint128(m0) * v1;
+			continue;
+		}
+
+		const uint64_t u2 = ((residues[2][k] + m2 - (v0 % m2)) * m0_inv_m2) % m2;
+		const uint64_t v2 = ((u2 + m2 - (v1 % m2)) * m1_inv_m2) % m2;
+
+		r[k] = v0 + t_uint128(m0) * (v1 + t_uint128(m1) * v2);
 	}
 
 	return r;
 }
 
+// exact product of two integers given as digits in base <radix> <= 2^32
+// (least significant first), returns a.size() + b.size() digits
+static std::vector<uint32_t> ntt_multiply_integers(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b, uint64_t radix) {
+	const std::vector<t_uint128>& c = ntt_multiply(a, b);
+
+	std::vector<uint32_t> r(c.size(), 0);
+	t_uint128 carry = 0;
+
+	for (size_t k = 0; k < c.size(); k++) {
+		carry += c[k];
+		r[k] = carry % radix;
+		carry /= radix;
+	}
+
+	assert(carry == 0);
+	return r;
+}
+
+
+
+// schoolbook references for the tests
+template<typename type>
+static std::vector<type> naive_multiply(const std::vector<type>& p, const std::vector<type>& q) {
+	std::vector<type> r(p.size() + q.size(), type(0));
+
+	for (size_t i = 0; i < p.size(); i++) {
+		for (size_t j = 0; j < q.size(); j++) {
+			r[i + j] += (p[i] * q[j]);
+		}
+	}
+
+	return r;
+}
+
+static std::vector<t_uint128> naive_multiply(const std::vector<uint32_t>& p, const std::vector<uint32_t>& q) {
+	std::vector<t_uint128> r(p.size() + q.size(), 0);
+
+	for (size_t i = 0; i < p.size(); i++) {
+		for (size_t j = 0; j < q.size(); j++) {
+			r[i + j] += (t_uint128(p[i]) * q[j]);
+		}
+	}
+
+	return r;
+}
+
+
+// checks every multiplier against the schoolbook products of random
+// polynomials of <n> terms with <bits>-bit coefficients; reports the
+// largest rounding error of the floating-point paths (exact up to 0.5)
+static bool run_test(size_t n, size_t bits) {
+	std::mt19937_64 rng(n * 31 + bits);
+
+	std::vector<uint32_t> a(n);
+	std::vector<uint32_t> b(n);
+
+	std::vector<double> ra(n);
+	std::vector<double> rb(n);
+	std::vector<t_complex64f> ca(n);
+	std::vector<t_complex64f> cb(n);
+
+	for (size_t i = 0; i < n; i++) {
+		ca[i] = ra[i] = a[i] = rng() & ((uint64_t(1) << bits) - 1);
+		cb[i] = rb[i] = b[i] = rng() & ((uint64_t(1) << bits) - 1);
+	}
+
+	const std::vector<t_uint128>& exact = naive_multiply(a, b);
+	const std::vector<t_uint128>& ntt = ntt_multiply(a, b);
+	const std::vector<double>& fft_real = fft_multiply_real(ra, rb);
+	const std::vector<t_complex64f>& fft_cplx = fft_multiply(ca, cb);
+	const std::vector<double>& fft_soa = fft_multiply_soa(ra, rb);
+
+	double real_err = 0.0;
+	double cplx_err = 0.0;
+	double soa_err = 0.0;
+
+	for (size_t k = 0; k < exact.size(); k++) {
+		real_err = std::max(real_err, std::fabs(fft_real[k] - double(exact[k])));
+		cplx_err = std::max(cplx_err, std::fabs(fft_cplx[k].real() - double(exact[k])));
+		soa_err = std::max(soa_err, std::fabs(fft_soa[k] - double(exact[k])));
+	}
+
+	// carry the exact coefficients into base-2^bits digits
+	const std::vector<uint32_t>& digits = ntt_multiply_integers(a, b, uint64_t(1) << bits);
 
+	bool digits_ok = true;
+	t_uint128 carry = 0;
+
+	for (size_t k = 0; k < exact.size(); k++) {
+		carry += exact[k];
+		digits_ok &= (digits[k] == uint32_t(carry & ((uint64_t(1) << bits) - 1)));
+		carry >>= bits;
+	}
+
+	printf("[%s] n=%lu bits=%lu ntt=%s max_err={cplx=%g,real=%g,soa=%g}\n", __FUNCTION__, n, bits, (ntt == exact && digits_ok)? "exact": "WRONG", cplx_err, real_err, soa_err);
+	return (ntt == exact && digits_ok);
+}
+
+static void run_benchmark(size_t max_log2) {
+	std::mt19937_64 rng(max_log2);
+
+	printf("[%s] %10s %14s %14s %14s %14s\n", __FUNCTION__, "N", "unplanned", "planned", "real", "ntt");
+	printf("[%s] %10s %14s %14s %14s %14s\n", __FUNCTION__, "", "(us/mul)", "(us/mul)", "(us/mul)", "(us/mul)");
+
+	for (size_t log2 = 10; log2 <= max_log2; log2 += 2) {
+		// operands fill half the transform each
+		const size_t n = size_t(1) << (log2 - 1);
+		const size_t num_reps = std::max(size_t(1), (size_t(1) << 20) >> log2);
+
+		std::vector<uint32_t> a(n);
+		std::vector<double> ra(n);
+		std::vector<t_complex64f> ca(n);
+
+		for (size_t i = 0; i < n; i++) {
+			ca[i] = ra[i] = a[i] = rng() & 0xffff;
+		}
+
+		double times[4] = {0.0, 0.0, 0.0, 0.0};
+
+		for (size_t algo = 0; algo < 4; algo++) {
+			const auto t0 = std::chrono::steady_clock::now();
+
+			for (size_t rep = 0; rep < num_reps; rep++) {
+				switch (algo) {
+					case 0: {
+						// the pre-plan path: roots recomputed and inputs grown per call
+						std::vector<t_complex64f> p = ca;
+						std::vector<t_complex64f> q = ca;
+						std::vector<t_complex64f> r(n * 2);
+
+						const std::vector<t_complex64f>& v = calc_roots<double>(n * 2);
+
+						for (size_t i = p.size(); i < r.size(); i++) {
+							p.push_back(t_complex64f());
+							q.push_back(t_complex64f());
+						}
+
+						fft_forward<double>(p, v);
+						fft_forward<double>(q, v);
+
+						for (size_t k = 0; k < r.size(); k++) {
+							r[k] = p[k] * q[k];
+						}
+
+						fft_inverse<double>(r, v);
+					} break;
+					case 1: { fft_multiply(ca, ca); } break;
+					case 2: { fft_multiply_real(ra, ra); } break;
+					case 3: { ntt_multiply(a, a); } break;
+				}
+			}
+
+			const auto t1 = std::chrono::steady_clock::now();
+
+			times[algo] = std::chrono::duration<double, std::micro>(t1 - t0).count() / num_reps;
+		}
+
+		printf("[%s] %10lu %14.2f %14.2f %14.2f %14.2f\n", __FUNCTION__, n * 2, times[0], times[1], times[2], times[3]);
+	}
+}
+
+
+// times one forward transform of size N through the AoS radix-2 plan
+// (t_fft_plan), the scalar and AVX2 SoA kernels and the AVX2 kernel
+// with four-step above FFT_FOUR_STEP_MIN_SIZE, and reports the largest
+// deviation of the SoA results from the AoS one
+static void run_soa_benchmark(size_t min_log2, size_t max_log2) {
+	std::mt19937_64 rng(max_log2);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	printf("[%s] avx2+fma=%d four_step_min=%u\n", __FUNCTION__, t_fft_soa_plan(16).use_avx2(), FFT_FOUR_STEP_MIN_SIZE);
+	printf("[%s] %10s %12s %12s %12s %12s %10s\n", __FUNCTION__, "N", "aos-radix2", "soa-scalar", "soa-avx2", "avx2+4step", "max-err");
+	printf("[%s] %10s %12s %12s %12s %12s %10s\n", __FUNCTION__, "", "(ns/NlogN)", "(ns/NlogN)", "(ns/NlogN)", "(ns/NlogN)", "");
+
+	for (size_t log2 = min_log2; log2 <= max_log2; log2++) {
+		const size_t n = size_t(1) << log2;
+		const size_t num_reps = std::max(size_t(1), (size_t(1) << 22) >> log2);
+
+		std::vector<t_complex64f> aos(n);
+		std::vector<double> re(n);
+		std::vector<double> im(n);
+
+		for (size_t i = 0; i < n; i++) {
+			aos[i] = t_complex64f(re[i] = dist(rng), im[i] = dist(rng));
+		}
+
+		const t_fft_plan<double> aos_plan(n);
+		const t_fft_soa_plan soa_plans[3] = {
+			t_fft_soa_plan(n, false, false),
+			t_fft_soa_plan(n, true, false),
+			t_fft_soa_plan(n, true, true),
+		};
+
+		double times[4] = {0.0, 0.0, 0.0, 0.0};
+		double max_err = 0.0;
+
+		for (size_t algo = 0; algo < 4; algo++) {
+			std::vector<t_complex64f> x = aos;
+			std::vector<double> xr = re;
+			std::vector<double> xi = im;
+
+			const auto t0 = std::chrono::steady_clock::now();
+
+			for (size_t rep = 0; rep < num_reps; rep++) {
+				if (algo == 0) {
+					aos_plan.forward(x.data());
+				} else {
+					soa_plans[algo - 1].forward(xr.data(), xi.data());
+				}
+			}
+
+			const auto t1 = std::chrono::steady_clock::now();
+
+			times[algo] = std::chrono::duration<double, std::nano>(t1 - t0).count() / (num_reps * n * log2);
+
+			if (algo == 0) {
+				aos_plan.forward(aos.data());
+				continue;
+			}
+
+			// compare one transform of the original input
+			xr = re;
+			xi = im;
+			soa_plans[algo - 1].forward(xr.data(), xi.data());
+
+			for (size_t k = 0; k < n; k++) {
+				max_err = std::max(max_err, std::max(std::fabs(xr[k] - aos[k].real()), std::fabs(xi[k] - aos[k].imag())));
+			}
+		}
+
+		printf("[%s] %10lu %12.3f %12.3f %12.3f %12.3f %10.2e\n", __FUNCTION__, n, times[0], times[1], times[2], times[3], max_err);
+	}
+}
+
+
+
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--test") == 0) {
+		bool ret = true;
+
+		ret &= run_test(   1, 32);
+		ret &= run_test(  17, 32);
+		ret &= run_test(1000, 16);
+		ret &= run_test(4096, 32);
+		ret &= run_test(1 << 15, 16);
+		return (ret? 0: 1);
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		run_benchmark((argc > 2)? atoi(argv[2]): 20);
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--soa-bench") == 0) {
+		run_soa_benchmark((argc > 2)? atoi(argv[2]): 10, (argc > 3)? atoi(argv[3]): 24);
+		return 0;
+	}
 
-int main() {
 	std::vector<t_complex32f> p = {t_complex32f(4), t_complex32f(3), t_complex32f(2), t_complex32f(1)};
 	std::vector<t_complex32f> q = {t_complex32f(1), t_complex32f(2), t_complex32f(3), t_complex32f(4)};
 
@@ -179,4 +1494,3 @@ int main() {
 	print_complex_vector(fft_multiply<float>(p, q));
 	return 0;
 }
-
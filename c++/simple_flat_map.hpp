@@ -3,12 +3,34 @@
 
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 
 #include <algorithm>
 #include <functional>
+#include <limits>
+#include <type_traits>
 #include <vector>
 
+#ifndef HAVE_X86_SIMD
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+#endif
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
 #define USE_CUSTOM_ITERATOR
+// keys per node of the read-optimized search index; one cache line
+// for 4-byte keys, and a multiple of the SIMD width for 4/8-byte ones
+#define VECTOR_MAP_INDEX_NODE_SIZE 16
+// fraction of erased slots in the sorted region above which compact()
+// reclaims them by default
+#define VECTOR_MAP_COMPACT_FRACTION 0.25f
 
 namespace util {
 	template<typename t_iter, typename t_pred, typename t_type>
@@ -21,6 +43,80 @@ namespace util {
 
 		return i;
 	}
+
+
+	// number of keys in a (sorted) node of the search index that are less
+	// than <k>; counting rather than searching keeps the loop branchless
+	template<typename t_key_type, typename t_key_cmp> struct t_scalar_node_ranker {
+		static size_t rank(const t_key_type* keys, const t_key_type& k) {
+			const t_key_cmp cmp;
+			size_t r = 0;
+
+			for (size_t i = 0; i < VECTOR_MAP_INDEX_NODE_SIZE; i++)
+				r += cmp(keys[i], k);
+
+			return r;
+		}
+	};
+
+	// specialized below for keys that can be ranked with SIMD compares
+	template<typename t_key_type, typename t_key_cmp> struct t_node_ranker: public t_scalar_node_ranker<t_key_type, t_key_cmp> {};
+
+	#if (HAVE_X86_SIMD == 1)
+	inline bool have_avx2() {
+		static const bool have = __builtin_cpu_supports("avx2");
+		return have;
+	}
+
+	// signed compares; unsigned keys are biased by the sign bit first
+	__attribute__((target("avx2")))
+	inline size_t rank_node_avx2(const int32_t* keys, int32_t k, int32_t bias) {
+		const __m256i b = _mm256_set1_epi32(bias);
+		const __m256i x = _mm256_xor_si256(_mm256_set1_epi32(k), b);
+
+		uint32_t mask = 0;
+
+		for (size_t i = 0; i < VECTOR_MAP_INDEX_NODE_SIZE; i += 8) {
+			const __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), b);
+			mask |= (uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, v)))) << i);
+		}
+
+		return (__builtin_popcount(mask));
+	}
+
+	__attribute__((target("avx2")))
+	inline size_t rank_node_avx2(const int64_t* keys, int64_t k, int64_t bias) {
+		const __m256i b = _mm256_set1_epi64x(bias);
+		const __m256i x = _mm256_xor_si256(_mm256_set1_epi64x(k), b);
+
+		uint32_t mask = 0;
+
+		for (size_t i = 0; i < VECTOR_MAP_INDEX_NODE_SIZE; i += 4) {
+			const __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), b);
+			mask |= (uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(x, v)))) << i);
+		}
+
+		return (__builtin_popcount(mask));
+	}
+
+	// 4- and 8-byte integer keys under std::less compare 8 or 4 at a time
+	template<typename t_key_type> struct t_simd_node_ranker {
+		typedef typename std::conditional<sizeof(t_key_type) == 4, int32_t, int64_t>::type t_lane_type;
+
+		static size_t rank(const t_key_type* keys, const t_key_type& k) {
+			if (!have_avx2())
+				return (t_scalar_node_ranker<t_key_type, std::less<t_key_type> >::rank(keys, k));
+
+			const t_lane_type bias = std::is_signed<t_key_type>::value? t_lane_type(0): std::numeric_limits<t_lane_type>::min();
+			return (rank_node_avx2(reinterpret_cast<const t_lane_type*>(keys), t_lane_type(k), bias));
+		}
+	};
+
+	template<> struct t_node_ranker<  int32_t, std::less<  int32_t> >: public t_simd_node_ranker<  int32_t> {};
+	template<> struct t_node_ranker< uint32_t, std::less< uint32_t> >: public t_simd_node_ranker< uint32_t> {};
+	template<> struct t_node_ranker<  int64_t, std::less<  int64_t> >: public t_simd_node_ranker<  int64_t> {};
+	template<> struct t_node_ranker< uint64_t, std::less< uint64_t> >: public t_simd_node_ranker< uint64_t> {};
+	#endif
 };
 
 // maintains a sorted std::vector of elements; best used
@@ -28,13 +124,22 @@ namespace util {
 // similar to (though much simpler than) boost::flat_map,
 // but our erase always runs in O(log(N)) time by merely
 // tombstoning elements
-template<typename t_key_type, typename t_val_type> struct t_vector_map {
+//
+// keys are ordered by <t_key_cmp>, a stateless functor which is inlined
+// into every comparison; for maps that are mostly read, an optional
+// search index (see set_read_optimized) keeps a copy of the keys in a
+// separate, cache-friendly layout
+template<typename t_key_type, typename t_val_type, typename t_key_cmp = std::less<t_key_type> > struct t_vector_map {
 public:
 	typedef  std::pair<t_key_type, t_val_type>  t_elem_pair;
 	typedef  std::pair<t_key_type,       bool>  t_flag_pair;
 
-	typedef  std::function<bool(const t_elem_pair& a, const t_elem_pair& b)>  t_sort_pred;
-	typedef  std::function< int(const t_elem_pair& a, const t_elem_pair& b)>  t_find_pred;
+	struct t_sort_pred {
+		bool operator () (const t_elem_pair& a, const t_elem_pair& b) const { return (t_key_cmp()(a.first, b.first)); }
+	};
+	struct t_find_pred {
+		int operator () (const t_elem_pair& a, const t_elem_pair& b) const { return ((t_key_cmp()(a.first, b.first))? -1: (t_key_cmp()(b.first, a.first))? +1: 0); }
+	};
 
 	typedef  typename std::vector<t_elem_pair>::iterator  t_iter_type_i;
 	typedef  typename std::vector<t_elem_pair>::const_iterator  t_citer_type_i;
@@ -65,6 +170,7 @@ public:
 			// move to the first non-erased element
 			advance();
 		}
+		t_iter(const t_iter& i) = default;
 		t_iter& operator = (const t_iter& i) {
 			m_elem_ptr = i.m_elem_ptr;
 			m_sent_ptr = i.m_sent_ptr;
@@ -149,11 +255,12 @@ public:
 		m_elems = map.m_elems;
 		m_flags = map.m_flags;
 
-		m_sort_pred = map.m_sort_pred;
-		m_find_pred = map.m_find_pred;
-
 		m_num_sorted_elems = map.m_num_sorted_elems;
 		m_num_erased_elems = map.m_num_erased_elems;
+		m_read_optimized = map.m_read_optimized;
+
+		// the copy would not keep the node alignment
+		build_index();
 		return *this;
 	}
 
@@ -161,11 +268,15 @@ public:
 		m_elems = std::move(map.m_elems);
 		m_flags = std::move(map.m_flags);
 
-		m_sort_pred = std::move(map.m_sort_pred);
-		m_find_pred = std::move(map.m_find_pred);
+		m_index_keys = std::move(map.m_index_keys);
+		m_index_layers = std::move(map.m_index_layers);
+
+		m_index_base = map.m_index_base;
+		m_index_nodes = map.m_index_nodes;
 
 		m_num_sorted_elems = map.m_num_sorted_elems;
 		m_num_erased_elems = map.m_num_erased_elems;
+		m_read_optimized = map.m_read_optimized;
 		return *this;
 	}
 
@@ -181,9 +292,9 @@ public:
 		#ifdef DEBUG
 		// count the number of *in-order* elements, erased or not
 		// this should always equal the size of the sorted region
-		size_t num_sorted_elems = 1;
+		size_t num_sorted_elems = (map_size() != 0);
 		size_t num_erased_elems = 0;
-		for (size_t n = 0; n < (map_size() - 1); n++) { num_sorted_elems += m_sort_pred(m_elems[n], m_elems[n + 1]); }
+		for (size_t n = 0; (n + 1) < map_size(); n++) { num_sorted_elems += m_sort_pred(m_elems[n], m_elems[n + 1]); }
 		for (size_t n = 0; n < (map_size()    ); n++) { num_erased_elems += erased(n); }
 		return ((num_sorted_elems == map_size()) && (num_erased_elems == m_num_erased_elems));
 		#else
@@ -246,16 +357,31 @@ public:
 		set_flag(i.first - begin_i(), false);
 		assert(valid());
 
+		// keys have moved or changed
+		if (i.second)
+			build_index();
+
 		return (std::make_pair<>(iter(i.first), i.second));
 	}
 
 	void insert(t_iter_type first, t_iter_type last) {
-		// assume caller has already reserve'd
-		for (; first != last; ++first) {
-			push_back(*first);
-		}
+		insert_bulk(first, last);
+	}
 
-		sort();
+	// inserts a batch of elements in O((N + M) + M log(M)) time: the batch
+	// (plus any unsorted elements appended by push_back) is sorted and then
+	// merged with the sorted region in one linear pass, which also drops
+	// erased slots; like insert, existing keys keep their values and of
+	// several equal keys in the batch the first one wins
+	template<typename t_pair_iter> void insert_bulk(t_pair_iter first, t_pair_iter last) {
+		std::vector<t_elem_pair> batch(m_elems.begin() + map_size(), m_elems.end());
+
+		batch.insert(batch.end(), first, last);
+
+		m_elems.erase(m_elems.begin() + map_size(), m_elems.end());
+		m_flags.erase(m_flags.begin() + map_size(), m_flags.end());
+
+		merge_i(batch);
 	}
 
 	bool erase(const t_key_type& k) { return (erase({k, t_val_type()})); }
@@ -272,9 +398,9 @@ public:
 		set_flag(i - cbegin_i(), true);
 		set_ctrs(-1, 1);
 
-		// destruct only the value; key is needed for future inserts
-		// (i->first ).~t_key_type();
-		(i->second).~t_val_type();
+		// release only the value; key is needed for future inserts
+		// (the slot stays a live object, compact and merge move it)
+		const_cast<t_val_type&>(i->second) = t_val_type();
 		return true;
 	}
 
@@ -289,39 +415,69 @@ public:
 	}
 
 
+	// merges elements appended by push_back into the sorted region
 	void sort() {
 		if (sorted())
 			return;
 
-		// note: can not sort pairs with const keys, write-protect iterators
-		std::sort(m_elems.begin(), m_elems.begin() + vec_size(), m_sort_pred);
-		std::sort(m_flags.begin(), m_flags.begin() + vec_size(), m_sort_pred);
+		insert_bulk(m_elems.end(), m_elems.end());
 
-		t_iter_type_i i = begin_i();
+		assert(sorted());
+		assert(valid());
+	}
 
-		// filter duplicates; without this we would need linear search fallback
-		// if push_back added any duplicates, adjust the num_erased count here
-		for (size_t n = 1; n < vec_size(); n++) {
-			if (m_elems[n].first != i->first) {
-				i += 1;
-				*i = m_elems[n];
-			} else {
-				set_ctrs(0, -1 * get_flag(i - begin_i()));
-				set_flag(i - begin_i(), false);
+	// drops erased slots once they make up more than <max_erased_frac> of
+	// the sorted region, in one stable pass over both vectors; returns
+	// true if it did so, which invalidates all iterators
+	bool compact(float max_erased_frac = VECTOR_MAP_COMPACT_FRACTION) {
+		const size_t num_map_elems = map_size();
+
+		if (m_num_erased_elems == 0 || m_num_erased_elems <= (max_erased_frac * num_map_elems))
+			return false;
+
+		size_t k = 0;
+
+		for (size_t n = 0; n < vec_size(); n++) {
+			if (n < num_map_elems && get_flag(n))
+				continue;
+
+			if (k != n) {
+				m_elems[k] = std::move(m_elems[n]);
+				m_flags[k] = m_flags[n];
 			}
-		}
 
-		// remove excess space left by duplicates; would confuse ::sorted
-		while (vec_size() > ((i - begin_i()) + 1)) {
-			pop_back();
+			k += 1;
 		}
 
-		m_num_sorted_elems = vec_size() - m_num_erased_elems;
+		m_elems.erase(m_elems.begin() + k, m_elems.end());
+		m_flags.erase(m_flags.begin() + k, m_flags.end());
 
-		assert(sorted());
+		m_num_erased_elems = 0;
+
+		build_index();
 		assert(valid());
+		return true;
+	}
+
+	// in read-optimized mode lookups go through a copy of the keys laid out
+	// as a static B+-tree: the leaf layer is the sorted keys themselves (so
+	// a leaf position is also the element's slot), and each internal node
+	// holds the largest key under each of its first VECTOR_MAP_INDEX_NODE_SIZE
+	// children; a lookup touches one node per layer instead of every probe
+	// of a binary search over the (key, value) pairs, and each node is
+	// ranked with a branchless count, or SIMD compares for integer keys
+	//
+	// the index is rebuilt in O(N) by every operation that moves or changes
+	// keys (erase only sets a flag and does not), so this mode is meant for
+	// maps that are loaded in bulk and then mostly read
+	void set_read_optimized(bool b) {
+		m_read_optimized = b;
+
+		build_index();
 	}
 
+	bool read_optimized() const { return m_read_optimized; }
+
 
 	void push_back(const t_elem_pair& e) {
 		m_flags.push_back({e.first, false});
@@ -332,19 +488,25 @@ public:
 		m_elems.emplace_back(e.first, e.second);
 	}
 	void pop_back() {
+		const bool in_map = sorted();
+
 		set_ctrs((-1 * sorted() * (1 - get_flag(vec_size() - 1))), (-1 * sorted() * get_flag(vec_size() - 1)));
 
 		m_elems.pop_back();
 		m_flags.pop_back();
+
+		if (in_map)
+			build_index();
 	}
 
 	void clear() {
 		m_elems.clear();
 		m_flags.clear();
 
-		// always sort according to key_type::operator<
-		m_sort_pred = [](const t_elem_pair& a, const t_elem_pair& b) { return (a.first < b.first); };
-		m_find_pred = [](const t_elem_pair& a, const t_elem_pair& b) { return ((a.first < b.first)? -1: (a.first > b.first)? +1: 0); };
+		m_index_keys.clear();
+		m_index_layers.clear();
+
+		m_index_nodes = 0;
 
 		m_num_sorted_elems = 0;
 		m_num_erased_elems = 0;
@@ -372,29 +534,152 @@ private:
 		push_back(e);
 
 		// move all elements one slot to the right
-		for (size_t n = vec_size() - 1; n != 0; n -= 1) {
-			std::swap(m_elems[n - 1], m_elems[n]);
-			std::swap(m_flags[n - 1], m_flags[n]);
+		std::rotate(m_elems.begin(), m_elems.end() - 1, m_elems.end());
+		std::rotate(m_flags.begin(), m_flags.end() - 1, m_flags.end());
+
+		assert(valid());
+	}
+
+	// merges a batch into the sorted region; erased slots are skipped, so
+	// a batch element with the key of one takes its place
+	void merge_i(std::vector<t_elem_pair>& batch) {
+		const size_t num_map_elems = map_size();
+
+		std::stable_sort(batch.begin(), batch.end(), m_sort_pred);
+
+		std::vector<t_elem_pair> elems;
+		std::vector<t_flag_pair> flags;
+
+		elems.reserve(m_num_sorted_elems + batch.size());
+
+		for (size_t i = 0, j = 0; i < num_map_elems || j < batch.size(); ) {
+			// later duplicates within the batch, or of an existing key
+			if (j < batch.size() && !elems.empty() && !m_sort_pred(elems.back(), batch[j])) {
+				j += 1;
+				continue;
+			}
+
+			// on equal keys the existing element goes first
+			if (i < num_map_elems && (j == batch.size() || !m_sort_pred(batch[j], m_elems[i]))) {
+				if (!get_flag(i))
+					elems.push_back(std::move(m_elems[i]));
+
+				i += 1;
+			} else {
+				elems.push_back(std::move(batch[j++]));
+			}
 		}
 
-		m_elems[0] = e;
-		m_flags[0] = {e.first, false};
+		flags.reserve(elems.size());
+
+		for (const t_elem_pair& e: elems)
+			flags.push_back({e.first, false});
 
+		m_elems.swap(elems);
+		m_flags.swap(flags);
+
+		m_num_sorted_elems = m_elems.size();
+		m_num_erased_elems = 0;
+
+		build_index();
+
+		assert(sorted());
 		assert(valid());
 	}
 
 
-	std::pair<t_iter_type_i, bool> insert_i(const t_elem_pair& e) {
-		assert(map_size() != 0);
-		assert(valid());
+	// layers are stored root first; node <j> of one layer has children
+	// j * (NODE_SIZE + 1) + [0, NODE_SIZE] in the next
+	size_t index_child(size_t j, size_t r) const { return (j * (VECTOR_MAP_INDEX_NODE_SIZE + 1) + r); }
 
-		if (m_elems.empty()) {
-			push_back(e);
-			set_flag(0, false);
+	const t_key_type* index_node(size_t layer, size_t j) const {
+		return (m_index_keys.data() + m_index_base + (m_index_layers[layer] + j) * VECTOR_MAP_INDEX_NODE_SIZE);
+	}
+
+	// copies the keys of the sorted region (erased ones included, find
+	// checks the flag) into the leaf layer, then builds the internal ones;
+	// a child covering keys [a, b) is represented by key b - 1, clamped to
+	// the last one, which also fills the entries of missing children and
+	// leaf entries past the end
+	void build_index() {
+		const size_t num_keys = map_size();
+
+		m_index_keys.clear();
+		m_index_layers.clear();
+
+		m_index_base = 0;
+		m_index_nodes = 0;
+
+		if (!m_read_optimized || num_keys == 0)
+			return;
+
+		// layer sizes in nodes, leaves first
+		std::vector<size_t> layer_sizes(1, (num_keys + VECTOR_MAP_INDEX_NODE_SIZE - 1) / VECTOR_MAP_INDEX_NODE_SIZE);
+
+		while (layer_sizes.back() > 1)
+			layer_sizes.push_back((layer_sizes.back() + VECTOR_MAP_INDEX_NODE_SIZE) / (VECTOR_MAP_INDEX_NODE_SIZE + 1));
+
+		for (size_t n = layer_sizes.size(); n > 0; n--) {
+			m_index_layers.push_back(m_index_nodes);
+			m_index_nodes += layer_sizes[n - 1];
+		}
 
-			std::swap(m_elems.back(), m_elems[0]);
-			std::swap(m_flags.back(), m_flags[0]);
+		// over-allocate by a node so the first one can start on a cache line
+		// boundary (vector storage is only aligned for t_key_type), else each
+		// node visited would straddle two lines
+		m_index_keys.resize((m_index_nodes + 1) * VECTOR_MAP_INDEX_NODE_SIZE, m_elems[num_keys - 1].first);
 
+		while ((reinterpret_cast<uintptr_t>(m_index_keys.data() + m_index_base) % CACHE_LINE_SIZE) != 0 && m_index_base < VECTOR_MAP_INDEX_NODE_SIZE)
+			m_index_base += 1;
+
+		t_key_type* leaves = m_index_keys.data() + m_index_base + m_index_layers.back() * VECTOR_MAP_INDEX_NODE_SIZE;
+
+		for (size_t n = 0; n < num_keys; n++) {
+			leaves[n] = m_elems[n].first;
+		}
+
+		// keys covered by one child of a node in the current layer
+		size_t child_span = VECTOR_MAP_INDEX_NODE_SIZE;
+
+		for (size_t layer = m_index_layers.size() - 1; layer > 0; layer--) {
+			t_key_type* nodes = m_index_keys.data() + m_index_base + m_index_layers[layer - 1] * VECTOR_MAP_INDEX_NODE_SIZE;
+
+			for (size_t j = 0; j < layer_sizes[m_index_layers.size() - layer]; j++) {
+				for (size_t r = 0; r < VECTOR_MAP_INDEX_NODE_SIZE; r++) {
+					nodes[j * VECTOR_MAP_INDEX_NODE_SIZE + r] = leaves[std::min((index_child(j, r) + 1) * child_span, num_keys) - 1];
+				}
+			}
+
+			child_span *= (VECTOR_MAP_INDEX_NODE_SIZE + 1);
+		}
+	}
+
+	// position of the first key not less than <k>, or map_size() if there
+	// is none; below a node, the child to descend into is the first one whose
+	// largest key is >= k, which is the node's rank of k
+	size_t find_index_entry(const t_key_type& k) const {
+		const size_t num_keys = map_size();
+
+		// every search below this point ends inside the leaf layer
+		if (t_key_cmp()(m_elems[num_keys - 1].first, k))
+			return num_keys;
+
+		size_t j = 0;
+
+		for (size_t layer = 0; (layer + 1) < m_index_layers.size(); layer++) {
+			j = index_child(j, util::t_node_ranker<t_key_type, t_key_cmp>::rank(index_node(layer, j), k));
+		}
+
+		return (j * VECTOR_MAP_INDEX_NODE_SIZE + util::t_node_ranker<t_key_type, t_key_cmp>::rank(index_node(m_index_layers.size() - 1, j), k));
+	}
+
+
+	std::pair<t_iter_type_i, bool> insert_i(const t_elem_pair& e) {
+		assert(valid());
+
+		// map-segment is empty, but push_back may have left unsorted elements
+		if (map_size() == 0) {
+			push_front(e);
 			assert((*begin_i()) == e);
 			set_ctrs(1, 0);
 			assert(valid());
@@ -413,11 +698,11 @@ private:
 		// insert at end (of map-segment); best-case
 		if (m_sort_pred(m_elems[map_size() - 1], e)) {
 			push_back(e);
-			set_flag(map_size(), false);
 
-			// re-purpose the first non-map element
-			std::swap(m_elems.back(), m_elems[map_size()]);
-			std::swap(m_flags.back(), m_flags[map_size()]);
+			// rotate rather than swap past the unsorted elements, their order
+			// decides which of several equal keys a later merge keeps
+			std::rotate(m_elems.begin() + map_size(), m_elems.end() - 1, m_elems.end());
+			std::rotate(m_flags.begin() + map_size(), m_flags.end() - 1, m_flags.end());
 
 			assert((*end_i()) == e);
 			set_ctrs(1, 0);
@@ -433,7 +718,7 @@ private:
 
 		// can't use std::distance with custom iterators
 		assert((i - begin_i()) >=          0);
-		assert((i - begin_i()) <  map_size());
+		assert(size_t(i - begin_i()) < map_size());
 		assert(valid());
 
 		// check if we have a previously erased slot; caller resets flag
@@ -443,25 +728,24 @@ private:
 			return (std::make_pair(i, true));
 		}
 
-		// new element, prevent duplicates
-		if (e.first == i->first)
+		// new element, prevent duplicates (i is the lower bound, so keys
+		// are equivalent unless e orders before it)
+		if (!m_sort_pred(e, *i))
 			return (std::make_pair(i, false));
 
 		return (std::make_pair(insert_mid(e), true));
 	}
 
 	t_iter_type_i insert_mid(const t_elem_pair& e) {
-		size_t n = 0;
+		const size_t n = std::lower_bound(begin_i(), end_i(), e, m_sort_pred) - begin_i();
 
 		push_back(e);
 		assert(m_elems.back() == e);
 		assert(valid());
 
-		// swap the new element into position; same as moving existing elements over
-		for (n = vec_size() - 1; (n != 0 && m_sort_pred(m_elems[n], m_elems[n - 1])); n -= 1) {
-			std::swap(m_elems[n - 1], m_elems[n]);
-			std::swap(m_flags[n - 1], m_flags[n]);
-		}
+		// shift everything from the insertion point one slot over in a single move
+		std::rotate(m_elems.begin() + n, m_elems.end() - 1, m_elems.end());
+		std::rotate(m_flags.begin() + n, m_flags.end() - 1, m_flags.end());
 
 		// vector has grown by 1 element; LEQ comparison is valid
 		assert(n <= map_size());
@@ -475,7 +759,20 @@ private:
 
 	// note: only the sorted region of elements is searched
 	t_citer_type_i cfind_i(const t_key_type& k) const { return (cfind_i({k, t_val_type()})); }
-	t_citer_type_i cfind_i(const t_elem_pair& e) const { return (util::bfind(cbegin_i(), cend_i(), m_sort_pred, e)); }
+	t_citer_type_i cfind_i(const t_elem_pair& e) const {
+		if (m_index_nodes != 0) {
+			const size_t n = find_index_entry(e.first);
+
+			// the lower bound is a match unless its key is greater; test
+			// the copy in the leaf, which is already in cache
+			if (n == map_size() || t_key_cmp()(e.first, index_node(m_index_layers.size() - 1, 0)[n]))
+				return (cend_i());
+
+			return (cbegin_i() + n);
+		}
+
+		return (util::bfind(cbegin_i(), cend_i(), m_sort_pred, e));
+	}
 
 	t_iter_type_i find_i(const t_key_type& k) { return (find_i({k, t_val_type()})); }
 	t_iter_type_i find_i(const t_elem_pair& e) { return (begin_i() + (cfind_i(e) - cbegin_i())); }
@@ -494,10 +791,21 @@ private:
 	t_sort_pred m_sort_pred;
 	t_find_pred m_find_pred;
 
+	// read-optimized search index; see set_read_optimized
+	std::vector<t_key_type> m_index_keys;
+	// offset (in nodes) of each index layer, root first
+	std::vector<size_t> m_index_layers;
+
+	// offset of the first (aligned) node in m_index_keys, and node count
+	size_t m_index_base = 0;
+	size_t m_index_nodes = 0;
+
 	// number of non-erased sorted elements
 	size_t m_num_sorted_elems;
 	// number of external erase() calls made
 	size_t m_num_erased_elems;
+
+	bool m_read_optimized = false;
 };
 
 #endif
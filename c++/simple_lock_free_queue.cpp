@@ -1,10 +1,25 @@
+#include <algorithm>
 #include <atomic>
+#include <cassert>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <exception>
+#include <thread>
+#include <vector>
 
 #include <boost/chrono.hpp>
 #include <boost/thread.hpp>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
+
 
 
 template<typename t_counter> struct t_atomic_counter {
@@ -148,3 +163,383 @@ private:
 	volatile std::atomic<size_t> m_tail_idx;
 };
 
+
+
+
+// waiting primitive for the blocking queue operations; a waiter first
+// spins (cheapest wake-up, burns a core), then yields its time-slice,
+// and finally sleeps in the kernel until notified; unlike a sleep for
+// a fixed period this wakes up as soon as the queue state changes
+struct t_event_count {
+public:
+	uint32_t prepare_wait() {
+		m_num_waiters.fetch_add(1, std::memory_order_seq_cst);
+		// order the increment before the caller re-checks the queue
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return (m_event_seq.load(std::memory_order_seq_cst));
+	}
+
+	void cancel_wait() { m_num_waiters.fetch_sub(1, std::memory_order_seq_cst); }
+	void commit_wait(uint32_t seq) {
+		#ifdef __linux__
+		// returns immediately if the sequence has already moved on
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_event_seq), FUTEX_WAIT_PRIVATE, seq, nullptr, nullptr, 0);
+		#else
+		std::this_thread::yield();
+		#endif
+
+		cancel_wait();
+	}
+
+	void notify_all() {
+		// pairs with the fence in prepare_wait; either a waiter sees the
+		// queue change made by our caller or we see the waiter, so the
+		// common no-waiter case costs no shared write and no syscall
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (m_num_waiters.load(std::memory_order_relaxed) == 0)
+			return;
+
+		m_event_seq.fetch_add(1, std::memory_order_seq_cst);
+
+		#ifdef __linux__
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_event_seq), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+		#endif
+	}
+
+	static void spin_pause() {
+		#if defined(__i386__) || defined(__x86_64__)
+		__builtin_ia32_pause();
+		#endif
+	}
+
+private:
+	std::atomic<uint32_t> m_event_seq = {0};
+	std::atomic<uint32_t> m_num_waiters = {0};
+};
+
+
+
+//
+// bounded multi-producer multi-consumer queue (Vyukov); every
+// cell carries a sequence number which tells a producer at pos
+// whether the cell is free (seq == pos) and a consumer whether
+// it has been filled (seq == pos + 1), so producers contend on
+// the tail index and consumers on the head index but never with
+// each other
+//
+template<typename t_elem> class t_bounded_mpmc_queue {
+public:
+	// capacity is rounded up to a power of two
+	t_bounded_mpmc_queue(size_t capacity) {
+		size_t size = 2;
+
+		while (size < capacity)
+			size *= 2;
+
+		m_cells = std::vector<t_cell>(size);
+		m_index_mask = size - 1;
+
+		for (size_t i = 0; i < size; i++) {
+			m_cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+
+	bool try_enqueue(const t_elem& e) { return (try_enqueue_batch(&e, 1) == 1); }
+	bool try_dequeue(t_elem& e) { return (try_dequeue_batch(&e, 1) == 1); }
+
+	// claims up to <n> consecutive cells with a single CAS on the tail
+	// index; returns the number of elements actually enqueued (which
+	// is zero if the queue is full)
+	size_t try_enqueue_batch(const t_elem* elems, size_t n) {
+		size_t pos = m_tail_idx.load(std::memory_order_relaxed);
+		size_t num = 0;
+
+		while (true) {
+			// count the free cells starting at pos
+			for (num = 0; num < n; num++) {
+				const t_cell& cell = m_cells[(pos + num) & m_index_mask];
+				const size_t seq = cell.seq.load(std::memory_order_acquire);
+
+				if (seq != (pos + num))
+					break;
+			}
+
+			if (num == 0) {
+				const t_cell& cell = m_cells[pos & m_index_mask];
+				const intptr_t dif = intptr_t(cell.seq.load(std::memory_order_acquire)) - intptr_t(pos);
+
+				// cell still holds an element from the previous lap
+				if (dif < 0)
+					return 0;
+
+				// another producer claimed pos, retry with its successor
+				pos = m_tail_idx.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			if (m_tail_idx.compare_exchange_weak(pos, pos + num, std::memory_order_relaxed, std::memory_order_relaxed))
+				break;
+		}
+
+		for (size_t i = 0; i < num; i++) {
+			t_cell& cell = m_cells[(pos + i) & m_index_mask];
+
+			cell.elem = elems[i];
+			cell.seq.store(pos + i + 1, std::memory_order_release);
+		}
+
+		m_not_empty.notify_all();
+		return num;
+	}
+
+	// returns the number of elements dequeued (zero if the queue is empty)
+	size_t try_dequeue_batch(t_elem* elems, size_t n) {
+		size_t pos = m_head_idx.load(std::memory_order_relaxed);
+		size_t num = 0;
+
+		while (true) {
+			for (num = 0; num < n; num++) {
+				const t_cell& cell = m_cells[(pos + num) & m_index_mask];
+				const size_t seq = cell.seq.load(std::memory_order_acquire);
+
+				if (seq != (pos + num + 1))
+					break;
+			}
+
+			if (num == 0) {
+				const t_cell& cell = m_cells[pos & m_index_mask];
+				const intptr_t dif = intptr_t(cell.seq.load(std::memory_order_acquire)) - intptr_t(pos + 1);
+
+				// cell has not been filled yet
+				if (dif < 0)
+					return 0;
+
+				pos = m_head_idx.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			if (m_head_idx.compare_exchange_weak(pos, pos + num, std::memory_order_relaxed, std::memory_order_relaxed))
+				break;
+		}
+
+		for (size_t i = 0; i < num; i++) {
+			t_cell& cell = m_cells[(pos + i) & m_index_mask];
+
+			elems[i] = cell.elem;
+			cell.seq.store(pos + i + m_index_mask + 1, std::memory_order_release);
+		}
+
+		m_not_full.notify_all();
+		return num;
+	}
+
+
+	// blocking variants; these only return once all elements were transferred
+	void enqueue(const t_elem& e) { enqueue_batch(&e, 1); }
+	void dequeue(t_elem& e) { dequeue_batch(&e, 1); }
+
+	void enqueue_batch(const t_elem* elems, size_t n) {
+		for (size_t num = 0; num < n; ) {
+			num += wait_for([&]() { return (try_enqueue_batch(elems + num, n - num)); }, m_not_full);
+		}
+	}
+	void dequeue_batch(t_elem* elems, size_t n) {
+		for (size_t num = 0; num < n; ) {
+			num += wait_for([&]() { return (try_dequeue_batch(elems + num, n - num)); }, m_not_empty);
+		}
+	}
+
+
+	size_t capacity() const { return (m_index_mask + 1); }
+	size_t size_approx() const {
+		const size_t head = m_head_idx.load(std::memory_order_relaxed);
+		const size_t tail = m_tail_idx.load(std::memory_order_relaxed);
+		return ((tail >= head)? (tail - head): 0);
+	}
+
+private:
+	template<typename t_func> size_t wait_for(t_func&& func, t_event_count& event) {
+		static constexpr size_t NUM_SPINS = 256;
+		static constexpr size_t NUM_YIELDS = 16;
+
+		size_t num = 0;
+
+		for (size_t i = 0; i < NUM_SPINS; i++) {
+			if ((num = func()) != 0)
+				return num;
+
+			t_event_count::spin_pause();
+		}
+
+		for (size_t i = 0; i < NUM_YIELDS; i++) {
+			if ((num = func()) != 0)
+				return num;
+
+			std::this_thread::yield();
+		}
+
+		while (true) {
+			const uint32_t seq = event.prepare_wait();
+
+			// re-check after announcing ourselves to avoid a lost wake-up
+			if ((num = func()) != 0) {
+				event.cancel_wait();
+				return num;
+			}
+
+			event.commit_wait(seq);
+
+			if ((num = func()) != 0)
+				return num;
+		}
+	}
+
+private:
+	struct alignas(CACHE_LINE_SIZE) t_cell {
+		std::atomic<size_t> seq;
+		t_elem elem;
+	};
+
+	std::vector<t_cell> m_cells;
+
+	size_t m_index_mask = 0;
+
+	// producers and consumers each get their own cache line
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail_idx = {0};
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head_idx = {0};
+
+	alignas(CACHE_LINE_SIZE) t_event_count m_not_full;
+	alignas(CACHE_LINE_SIZE) t_event_count m_not_empty;
+};
+
+
+
+// element type of the benchmark; carries the time it was enqueued at
+// so consumers can measure latency, end-of-stream is signalled by an
+// element with an all-ones timestamp
+struct t_bench_elem {
+	uint64_t time;
+	uint64_t data;
+};
+
+static uint64_t bench_time_ns() {
+	const auto now = std::chrono::steady_clock::now();
+	return (std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count());
+}
+
+static void run_benchmark(size_t num_producers, size_t num_consumers, size_t batch_size) {
+	constexpr size_t NUM_ELEMS = 1 << 21;
+	constexpr size_t QUEUE_SIZE = 1 << 10;
+
+	t_bounded_mpmc_queue<t_bench_elem> queue(QUEUE_SIZE);
+
+	std::vector<std::thread> threads;
+	std::vector< std::vector<uint32_t> > latencies(num_consumers);
+
+	const uint64_t t0 = bench_time_ns();
+
+	for (size_t i = 0; i < num_consumers; i++) {
+		threads.emplace_back([&, i]() {
+			std::vector<t_bench_elem> elems(batch_size);
+			std::vector<uint32_t>& samples = latencies[i];
+
+			samples.reserve(NUM_ELEMS / num_consumers + 1);
+
+			while (true) {
+				// take whatever is available, block only when nothing is
+				size_t num = queue.try_dequeue_batch(elems.data(), batch_size);
+
+				if (num == 0) {
+					queue.dequeue(elems[0]);
+					num = 1;
+				}
+
+				const uint64_t t = bench_time_ns();
+
+				for (size_t j = 0; j < num; j++) {
+					if (elems[j].time == ~uint64_t(0)) {
+						// markers are enqueued after all data, so the rest of
+						// this batch are markers meant for other consumers
+						queue.enqueue_batch(elems.data() + j + 1, num - j - 1);
+						return;
+					}
+
+					samples.push_back(std::min(t - elems[j].time, uint64_t(UINT32_MAX)));
+				}
+			}
+		});
+	}
+
+	for (size_t i = 0; i < num_producers; i++) {
+		threads.emplace_back([&, i]() {
+			std::vector<t_bench_elem> elems(batch_size);
+
+			const size_t count = (NUM_ELEMS / num_producers) + ((i == 0)? (NUM_ELEMS % num_producers): 0);
+
+			for (size_t n = 0; n < count; n += batch_size) {
+				const size_t num = std::min(batch_size, count - n);
+				const uint64_t t = bench_time_ns();
+
+				for (size_t j = 0; j < num; j++) {
+					elems[j] = {t, n + j};
+				}
+
+				queue.enqueue_batch(elems.data(), num);
+			}
+		});
+	}
+
+	// wait for the producers, then stop the consumers
+	for (size_t i = num_consumers; i < threads.size(); i++) {
+		threads[i].join();
+	}
+	for (size_t i = 0; i < num_consumers; i++) {
+		queue.enqueue({~uint64_t(0), 0});
+	}
+	for (size_t i = 0; i < num_consumers; i++) {
+		threads[i].join();
+	}
+
+	const uint64_t t1 = bench_time_ns();
+
+	std::vector<uint32_t> samples;
+
+	for (const std::vector<uint32_t>& v: latencies) {
+		samples.insert(samples.end(), v.begin(), v.end());
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	const double secs = (t1 - t0) * 1e-9;
+	const double mops = samples.size() / secs * 1e-6;
+
+	printf(
+		"[%s] P=%2lu C=%2lu batch=%3lu elems=%lu mops/s=%7.2f latency_us={p50=%.2f,p99=%.2f,p999=%.2f,max=%.2f}\n",
+		__func__,
+		num_producers,
+		num_consumers,
+		batch_size,
+		samples.size(),
+		mops,
+		samples[samples.size() * 500 / 1000] * 1e-3,
+		samples[samples.size() * 990 / 1000] * 1e-3,
+		samples[samples.size() * 999 / 1000] * 1e-3,
+		samples.back() * 1e-3
+	);
+}
+
+
+int main(int argc, char** argv) {
+	const size_t max_threads = (argc > 1)? std::atoi(argv[1]): std::max(2u, std::thread::hardware_concurrency());
+	const size_t n = std::max(size_t(1), max_threads / 2);
+
+	for (size_t batch_size: {1, 32}) {
+		run_benchmark(1, 1, batch_size); // 1:1
+		run_benchmark(n, 1, batch_size); // N:1
+		run_benchmark(n, n, batch_size); // N:M
+	}
+
+	return 0;
+}
@@ -1,5 +1,8 @@
 #include <algorithm>
+#include <chrono>
 #include <limits>
+#include <random>
+#include <thread>
 #include <vector>
 
 #include <cassert>
@@ -9,8 +12,263 @@
 #include <cstdio>
 #include <cmath>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "simple_work_stealing_pool.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+// register block (rows x cols of C) of the GEMM micro-kernel, and the
+// cache blocks around it; a packed MC x KC block of A stays in L2 and a
+// KC x NR sliver of B in L1 while the kernel sweeps over the A panels
+#define GEMM_MR  16
+#define GEMM_NR   6
+#define GEMM_MC 128
+#define GEMM_NC  96
+#define GEMM_KC 256
+// products with fewer multiply-adds than this run on the calling thread
+#define GEMM_MIN_PARALLEL_WORK (1u << 18)
+
+// samples per work unit of the streaming moment pass
+#define PCA_STREAM_CHUNK_ROWS 1024
+// extra random directions and power iterations of the randomized solver
+#define RSVD_OVERSAMPLING 10
+#define RSVD_POWER_ITERS 2
+
+// cyclic Jacobi stops when off(A) <= JACOBI_TOLERANCE * ||A|| or when a
+// sweep no longer finds any rotation that changes A
+#define JACOBI_MAX_SWEEPS 50
+#define JACOBI_TOLERANCE 1e-6
+// rotations (or columns) per pool task, and the smallest matrix for
+// which rounds are spread over threads at all
+#define JACOBI_TASK_SIZE 16
+#define JACOBI_MIN_PARALLEL_SIZE 128
+
 template<typename type> type square(type x) { return (x * x); }
 
+
+// shared by the matrix product and the eigen-solver
+static t_work_stealing_pool& get_thread_pool() {
+	static t_work_stealing_pool pool(std::max(std::thread::hardware_concurrency(), 1u));
+	return pool;
+}
+
+static void set_num_threads(size_t num_threads) {
+	if (num_threads != get_thread_pool().get_num_threads()) {
+		get_thread_pool().spawn_threads(num_threads);
+	}
+}
+
+// runs func(i, thread) for i in [0, num_tasks) on the pool, or inline
+// if the job is too small to be worth waking the workers for
+template<typename t_func> static void run_tasks(size_t num_tasks, bool parallel, const t_func& func) {
+	t_work_stealing_pool& pool = get_thread_pool();
+
+	if (!parallel || num_tasks == 1 || pool.get_num_threads() == 1) {
+		for (size_t i = 0; i < num_tasks; i++) {
+			func(i, 0);
+		}
+	} else {
+		pool.run(num_tasks, func);
+	}
+}
+
+
+
+static bool have_avx2_fma() {
+	#if (HAVE_X86_SIMD == 1)
+	static const bool have = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
+	return have;
+	#else
+	return false;
+	#endif
+}
+
+// copies rows [0, mc) and columns [0, kc) of a column-major block of A
+// (leading dimension lda) into MR-row panels, each stored k-major so the
+// micro-kernel reads it sequentially; rows past mc are zero-padded
+template<typename type>
+static void gemm_pack_a(const type* a, type* pa, size_t lda, size_t mc, size_t kc) {
+	for (size_t i0 = 0; i0 < mc; i0 += GEMM_MR) {
+		const size_t mr = std::min(mc - i0, size_t(GEMM_MR));
+
+		for (size_t p = 0; p < kc; p++) {
+			const type* src = a + i0 + p * lda;
+
+			for (size_t i = 0; i < mr; i++)
+				pa[i] = src[i];
+			for (size_t i = mr; i < GEMM_MR; i++)
+				pa[i] = type(0);
+
+			pa += GEMM_MR;
+		}
+	}
+}
+
+// C[mr x nr] += A_panel[MR x kc] * B[kc x nr]; the columns of B past nr
+// alias the last valid one and their results are dropped
+template<typename type>
+static void gemm_micro_kernel(const type* pa, const type* b, type* c, size_t ldb, size_t ldc, size_t kc, size_t mr, size_t nr) {
+	type acc[GEMM_NR][GEMM_MR] = {};
+
+	const type* bc[GEMM_NR];
+
+	for (size_t j = 0; j < GEMM_NR; j++)
+		bc[j] = b + std::min(j, nr - 1) * ldb;
+
+	for (size_t p = 0; p < kc; p++, pa += GEMM_MR) {
+		for (size_t j = 0; j < GEMM_NR; j++) {
+			const type bv = bc[j][p];
+
+			for (size_t i = 0; i < GEMM_MR; i++) {
+				acc[j][i] += pa[i] * bv;
+			}
+		}
+	}
+
+	for (size_t j = 0; j < nr; j++) {
+		for (size_t i = 0; i < mr; i++) {
+			c[i + j * ldc] += acc[j][i];
+		}
+	}
+}
+
+#if (HAVE_X86_SIMD == 1)
+static_assert(GEMM_MR == 16 && GEMM_NR == 6, "AVX2 GEMM kernel is written for a 16x6 register block");
+
+// 16x6 block of C in twelve ymm accumulators; each k-step loads two
+// vectors of the A panel and broadcasts one element per column of B
+__attribute__((target("avx2,fma")))
+static void gemm_micro_kernel_avx2(const float* pa, const float* b, float* c, size_t ldb, size_t ldc, size_t kc, size_t mr, size_t nr) {
+	const float* b0 = b + std::min(size_t(0), nr - 1) * ldb;
+	const float* b1 = b + std::min(size_t(1), nr - 1) * ldb;
+	const float* b2 = b + std::min(size_t(2), nr - 1) * ldb;
+	const float* b3 = b + std::min(size_t(3), nr - 1) * ldb;
+	const float* b4 = b + std::min(size_t(4), nr - 1) * ldb;
+	const float* b5 = b + std::min(size_t(5), nr - 1) * ldb;
+
+	__m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+	__m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+	__m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+	__m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+	__m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+	__m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+	#define GEMM_FMA_COLUMN(j)                                \
+		do {                                                  \
+			const __m256 bv = _mm256_broadcast_ss(b##j + p);  \
+			c##j##0 = _mm256_fmadd_ps(a0, bv, c##j##0);       \
+			c##j##1 = _mm256_fmadd_ps(a1, bv, c##j##1);       \
+		} while (0)
+
+	for (size_t p = 0; p < kc; p++, pa += GEMM_MR) {
+		const __m256 a0 = _mm256_loadu_ps(pa + 0);
+		const __m256 a1 = _mm256_loadu_ps(pa + 8);
+
+		GEMM_FMA_COLUMN(0);
+		GEMM_FMA_COLUMN(1);
+		GEMM_FMA_COLUMN(2);
+		GEMM_FMA_COLUMN(3);
+		GEMM_FMA_COLUMN(4);
+		GEMM_FMA_COLUMN(5);
+	}
+
+	#undef GEMM_FMA_COLUMN
+
+	const __m256 acc[GEMM_NR][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}, {c40, c41}, {c50, c51}};
+
+	if (mr == GEMM_MR) {
+		for (size_t j = 0; j < nr; j++) {
+			float* cc = c + j * ldc;
+
+			_mm256_storeu_ps(cc + 0, _mm256_add_ps(_mm256_loadu_ps(cc + 0), acc[j][0]));
+			_mm256_storeu_ps(cc + 8, _mm256_add_ps(_mm256_loadu_ps(cc + 8), acc[j][1]));
+		}
+	} else {
+		float tmp[GEMM_MR];
+
+		for (size_t j = 0; j < nr; j++) {
+			_mm256_storeu_ps(tmp + 0, acc[j][0]);
+			_mm256_storeu_ps(tmp + 8, acc[j][1]);
+
+			for (size_t i = 0; i < mr; i++) {
+				c[i + j * ldc] += tmp[i];
+			}
+		}
+	}
+}
+#endif
+
+static void gemm_micro_kernel(const float* pa, const float* b, float* c, size_t ldb, size_t ldc, size_t kc, size_t mr, size_t nr) {
+	#if (HAVE_X86_SIMD == 1)
+	if (have_avx2_fma()) {
+		gemm_micro_kernel_avx2(pa, b, c, ldb, ldc, kc, mr, nr);
+		return;
+	}
+	#endif
+
+	gemm_micro_kernel<float>(pa, b, c, ldb, ldc, kc, mr, nr);
+}
+
+// C (m x n) = A (m x k) * B (k x n), all densely stored column-major;
+// every task owns one MC x NC tile of C and accumulates it over all KC
+// blocks, packing the matching block of A into a per-thread buffer
+//
+// <parallel> must be false when called from inside a pool task
+template<typename type>
+static void gemm(const type* a, const type* b, type* c, size_t m, size_t k, size_t n, bool parallel = true) {
+	const size_t num_row_blocks = (m + GEMM_MC - 1) / GEMM_MC;
+	const size_t num_col_blocks = (n + GEMM_NC - 1) / GEMM_NC;
+
+	std::vector< std::vector<type> > packed_blocks(get_thread_pool().get_num_threads());
+
+	std::fill(c, c + m * n, type(0));
+
+	if (k == 0)
+		return;
+
+	run_tasks(num_row_blocks * num_col_blocks, parallel && (m * n * k) >= GEMM_MIN_PARALLEL_WORK, [&](size_t task_idx, size_t thread_idx) {
+		const size_t i0 = (task_idx % num_row_blocks) * GEMM_MC;
+		const size_t j0 = (task_idx / num_row_blocks) * GEMM_NC;
+		const size_t mc = std::min(m - i0, size_t(GEMM_MC));
+		const size_t nc = std::min(n - j0, size_t(GEMM_NC));
+
+		std::vector<type>& packed_block = packed_blocks[thread_idx];
+
+		if (packed_block.empty())
+			packed_block.resize(GEMM_MC * GEMM_KC);
+
+		for (size_t p0 = 0; p0 < k; p0 += GEMM_KC) {
+			const size_t kc = std::min(k - p0, size_t(GEMM_KC));
+
+			gemm_pack_a(a + i0 + p0 * m, packed_block.data(), m, mc, kc);
+
+			for (size_t j = 0; j < nc; j += GEMM_NR) {
+				for (size_t i = 0; i < mc; i += GEMM_MR) {
+					gemm_micro_kernel(
+						packed_block.data() + i * kc,
+						b + p0 + (j0 + j) * k,
+						c + (i0 + i) + (j0 + j) * m,
+						k,
+						m,
+						kc,
+						std::min(mc - i, size_t(GEMM_MR)),
+						std::min(nc - j, size_t(GEMM_NR))
+					);
+				}
+			}
+		}
+	});
+}
+
 // point or vector (single-column matrix)
 template<typename type> struct t_tuple {
 	t_tuple<type>() {}
@@ -119,14 +377,8 @@ public:
 		// inner dimensions must match
 		assert(get_num_cols() == m.get_num_rows());
 
-		for (size_t row_idx = 0; row_idx < get_num_rows(); row_idx++) {
-			for (size_t col_idx = 0; col_idx < m.get_num_cols(); col_idx++) {
-				const t_tuple<type>& row =   get_row_vec(row_idx);
-				const t_tuple<type>& col = m.get_col_vec(col_idx);
-
-				r.set_value(calc_idx(row_idx, col_idx), row.inner_product(col));
-			}
-		}
+		if (r.get_size_sq() != 0)
+			gemm(m_values.data(), m.get_values().data(), r.get_values_raw(), get_num_rows(), get_num_cols(), m.get_num_cols());
 
 		return r;
 	}
@@ -138,15 +390,22 @@ public:
 		// inner dimensions must match
 		assert(get_num_cols() == p.get_num_rows());
 
-		for (size_t row_idx = 0; row_idx < get_num_rows(); row_idx++)
-			r[row_idx] = p.inner_product(get_row_vec(row_idx));
+		// accumulate scaled columns, which are contiguous
+		for (size_t col_idx = 0; col_idx < get_num_cols(); col_idx++) {
+			const type  s = p[col_idx];
+			const type* c = &m_values[col_idx * get_num_rows()];
+
+			for (size_t row_idx = 0; row_idx < get_num_rows(); row_idx++) {
+				r.get_values()[row_idx] += (c[row_idx] * s);
+			}
+		}
 
 		return r;
 	}
 
 
 	// matrix * scalar
-	t_matrix<type> operator * (const type s) {
+	t_matrix<type> operator * (const type s) const {
 		t_matrix<type> ret = *this;
 
 		for (size_t n = 0; n < get_size_sq(); n++)
@@ -155,7 +414,7 @@ public:
 		return ret;
 	}
 
-	t_matrix<type> operator / (const type s) {
+	t_matrix<type> operator / (const type s) const {
 		return ((*this) * (type(1) / s));
 	}
 
@@ -323,15 +582,24 @@ typedef std::pair<t_tuple_vector, t_value_vector> t_vector_pair;
 
 
 
+// <mat> is an <NxD> matrix with N data-points of dimensionality D, so
+// (column-major) every dimension is a contiguous column of N values
 t_tuple_type calc_data_avg(const t_matrix_type& mat) {
 	t_tuple_type avg(mat.get_num_cols());
 
 	assert(mat.get_num_rows() != 0);
 
-	for (size_t n = 0; n < mat.get_num_rows(); n++)
-		avg += mat.get_row_vec(n);
+	for (size_t col = 0; col < mat.get_num_cols(); col++) {
+		const t_value_type* x = mat.get_values_raw() + col * mat.get_num_rows();
+		double sum = 0.0;
 
-	return (avg / mat.get_num_rows());
+		for (size_t n = 0; n < mat.get_num_rows(); n++)
+			sum += x[n];
+
+		avg[col] = sum / mat.get_num_rows();
+	}
+
+	return avg;
 }
 
 t_tuple_type calc_data_var(const t_matrix_type& mat, const t_tuple_type& avg) {
@@ -339,10 +607,17 @@ t_tuple_type calc_data_var(const t_matrix_type& mat, const t_tuple_type& avg) {
 
 	assert(mat.get_num_rows() != 0);
 
-	for (size_t n = 0; n < mat.get_num_rows(); n++)
-		var += ((mat.get_row_vec(n) - avg) * (mat.get_row_vec(n) - avg));
+	for (size_t col = 0; col < mat.get_num_cols(); col++) {
+		const t_value_type* x = mat.get_values_raw() + col * mat.get_num_rows();
+		double sum = 0.0;
+
+		for (size_t n = 0; n < mat.get_num_rows(); n++)
+			sum += square(double(x[n] - avg[col]));
+
+		var[col] = sum / mat.get_num_rows();
+	}
 
-	return (var / mat.get_num_rows());
+	return var;
 }
 
 t_tuple_type calc_data_std(const t_tuple_type var) {
@@ -355,24 +630,231 @@ t_tuple_type calc_data_std(const t_tuple_type var) {
 }
 
 t_matrix_type calc_data_cov(const t_matrix_type& mat, const t_tuple_type avg) {
-	// <mat> is an <NxD> matrix with N data-points of dimensionality D
-	t_matrix_type cov(mat.get_num_cols(), mat.get_num_cols());
+	t_matrix_type dev = mat;
 
 	assert(mat.get_num_rows() != 0);
 
-	for (size_t n = 0; n < mat.get_num_rows(); n++) {
-		const t_tuple_type p = (mat.get_row_vec(n) - avg) * (mat.get_row_vec(n) - avg);
+	// center the data, then sum the products of each Carthesian pair of
+	// dimensions (xx, xy, xz, ...) over all points as (X^T * X)
+	for (size_t col = 0; col < mat.get_num_cols(); col++) {
+		t_value_type* x = dev.get_values_raw() + col * mat.get_num_rows();
 
-		// sum the covariances for each Carthesian pair of dimensions (xx, xy, xz, ...)
-		for (size_t row = 0; row < cov.get_num_rows(); row++) {
-			for (size_t col = 0; col < cov.get_num_cols(); col++) {
-				// cov[p][q] += (pt[p] * pt[q])
-				cov.set_value(cov.calc_idx(row, col), cov.get_value(row, col) + p[row] * p[col]);
+		for (size_t n = 0; n < mat.get_num_rows(); n++)
+			x[n] -= avg[col];
+	}
+
+	return ((dev.transpose() * dev) / t_value_type(mat.get_num_rows()));
+}
+
+
+
+// running mean and co-moment (sum of outer products of the deviations
+// from the mean) of a stream of D-dimensional samples; partial results
+// over disjoint parts of the stream combine exactly via Chan's parallel
+// update, so chunks can be reduced in any grouping
+struct t_moment_accumulator {
+public:
+	t_moment_accumulator(size_t num_dims = 0) {
+		m_mean.resize(num_dims, 0.0);
+		m_comoment.resize(num_dims * num_dims, 0.0);
+	}
+
+	// folds in a chunk of <n> samples with mean <mean> and co-moment
+	// <comoment> (column-major DxD); with d = mean - m_mean this is
+	//   M2 += comoment + d * d^T * (m_num_samples * n / total)
+	template<typename type> void merge(size_t n, const double* mean, const type* comoment) {
+		const size_t num_dims = m_mean.size();
+		const size_t num_samples = m_num_samples + n;
+
+		if (n == 0)
+			return;
+
+		const double scale = (double(m_num_samples) * n) / num_samples;
+
+		std::vector<double> delta(num_dims);
+
+		for (size_t i = 0; i < num_dims; i++)
+			delta[i] = mean[i] - m_mean[i];
+
+		for (size_t j = 0; j < num_dims; j++) {
+			double* dst = &m_comoment[j * num_dims];
+			const type* src = &comoment[j * num_dims];
+			const double dj = delta[j] * scale;
+
+			for (size_t i = 0; i < num_dims; i++) {
+				dst[i] += (src[i] + delta[i] * dj);
+			}
+		}
+
+		for (size_t i = 0; i < num_dims; i++)
+			m_mean[i] += (delta[i] * n) / num_samples;
+
+		m_num_samples = num_samples;
+	}
+
+	void merge(const t_moment_accumulator& acc) {
+		merge(acc.get_num_samples(), acc.m_mean.data(), acc.m_comoment.data());
+	}
+
+	// adds <n> row-major samples; the chunk is centered on its own mean
+	// before forming its co-moment (Y * Y^T with Y = DxN column-major),
+	// which keeps the float product well-conditioned
+	void add_samples(const t_value_type* samples, size_t n, bool parallel = true) {
+		const size_t num_dims = m_mean.size();
+
+		std::vector<double> mean(num_dims, 0.0);
+		std::vector<t_value_type> dev(num_dims * n);
+		std::vector<t_value_type> dev_t(num_dims * n);
+		std::vector<t_value_type> comoment(num_dims * num_dims);
+
+		if (n == 0)
+			return;
+
+		for (size_t s = 0; s < n; s++) {
+			for (size_t i = 0; i < num_dims; i++) {
+				mean[i] += samples[s * num_dims + i];
 			}
 		}
+		for (size_t i = 0; i < num_dims; i++)
+			mean[i] /= n;
+
+		for (size_t s = 0; s < n; s++) {
+			for (size_t i = 0; i < num_dims; i++) {
+				const t_value_type v = samples[s * num_dims + i] - mean[i];
+
+				dev[s * num_dims + i] = v;
+				dev_t[i * n + s] = v;
+			}
+		}
+
+		gemm(dev.data(), dev_t.data(), comoment.data(), num_dims, n, num_dims, parallel);
+		merge(n, mean.data(), comoment.data());
+	}
+
+	// population statistics, like calc_data_{avg,cov}
+	t_tuple_type get_mean() const {
+		t_tuple_type r(m_mean.size());
+
+		for (size_t i = 0; i < m_mean.size(); i++)
+			r[i] = m_mean[i];
+
+		return r;
+	}
+
+	t_matrix_type get_covariance() const {
+		t_matrix_type r(m_mean.size(), m_mean.size());
+
+		for (size_t i = 0; i < m_comoment.size(); i++)
+			r.get_value(i) = m_comoment[i] / std::max(m_num_samples, size_t(1));
+
+		return r;
+	}
+
+	size_t get_num_samples() const { return m_num_samples; }
+	size_t get_num_dims() const { return (m_mean.size()); }
+
+private:
+	size_t m_num_samples = 0;
+
+	std::vector<double> m_mean;
+	std::vector<double> m_comoment;
+};
+
+
+// read-only mapping of a file of row-major t_value_type samples with
+// <num_dims> values each (no header, e.g. as written by numpy's tofile);
+// pages are faulted in on access, so the data need not fit in memory
+struct t_sample_file {
+public:
+	t_sample_file() {}
+	t_sample_file(const t_sample_file&) = delete;
+	t_sample_file& operator = (const t_sample_file&) = delete;
+
+	~t_sample_file() { close(); }
+
+	bool open(const char* path, size_t num_dims) {
+		struct stat st;
+
+		close();
+
+		if ((m_fd = ::open(path, O_RDONLY)) < 0) {
+			printf("[t_sample_file::%s] failed to open \"%s\"\n", __func__, path);
+			return false;
+		}
+
+		if (fstat(m_fd, &st) != 0 || num_dims == 0 || (size_t(st.st_size) % (num_dims * sizeof(t_value_type))) != 0) {
+			printf("[t_sample_file::%s] size of \"%s\" is not a multiple of %lu samples\n", __func__, path, num_dims);
+			close();
+			return false;
+		}
+
+		m_num_dims = num_dims;
+		m_num_samples = st.st_size / (num_dims * sizeof(t_value_type));
+		m_size = st.st_size;
+
+		if (m_size == 0)
+			return true;
+
+		if ((m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0)) == MAP_FAILED) {
+			printf("[t_sample_file::%s] failed to map \"%s\"\n", __func__, path);
+			m_data = nullptr;
+			close();
+			return false;
+		}
+
+		// every chunk is visited once, front to back
+		madvise(m_data, m_size, MADV_SEQUENTIAL);
+		return true;
 	}
 
-	return (cov / mat.get_num_rows());
+	void close() {
+		if (m_data != nullptr)
+			munmap(m_data, m_size);
+		if (m_fd >= 0)
+			::close(m_fd);
+
+		m_data = nullptr;
+		m_fd = -1;
+		m_size = 0;
+		m_num_samples = 0;
+	}
+
+	const t_value_type* get_samples(size_t i) const { return (reinterpret_cast<const t_value_type*>(m_data) + i * m_num_dims); }
+
+	size_t get_num_samples() const { return m_num_samples; }
+	size_t get_num_dims() const { return m_num_dims; }
+
+private:
+	void* m_data = nullptr;
+
+	int m_fd = -1;
+
+	size_t m_size = 0;
+	size_t m_num_samples = 0;
+	size_t m_num_dims = 0;
+};
+
+
+// one pass over the file: pool tasks take chunks of PCA_STREAM_CHUNK_ROWS
+// samples and fold them into their thread's accumulator, which are then
+// merged; memory use is O(threads * D^2) regardless of the sample count
+t_moment_accumulator calc_streaming_moments(const t_sample_file& file) {
+	const size_t num_dims = file.get_num_dims();
+	const size_t num_chunks = (file.get_num_samples() + PCA_STREAM_CHUNK_ROWS - 1) / PCA_STREAM_CHUNK_ROWS;
+
+	std::vector<t_moment_accumulator> thread_accs(get_thread_pool().get_num_threads(), t_moment_accumulator(num_dims));
+
+	run_tasks(num_chunks, true, [&](size_t chunk_idx, size_t thread_idx) {
+		const size_t s0 = chunk_idx * PCA_STREAM_CHUNK_ROWS;
+		const size_t s1 = std::min(s0 + PCA_STREAM_CHUNK_ROWS, file.get_num_samples());
+
+		thread_accs[thread_idx].add_samples(file.get_samples(s0), s1 - s0, false);
+	});
+
+	for (size_t n = 1; n < thread_accs.size(); n++)
+		thread_accs[0].merge(thread_accs[n]);
+
+	return thread_accs[0];
 }
 
 
@@ -381,86 +863,202 @@ t_matrix_type calc_data_cov(const t_matrix_type& mat, const t_tuple_type avg) {
 // symmetric Schur-decomposition (useful for covariance
 // matrices which are always symmetric by definition)
 //
-t_tuple_type calc_sym_schur_rotation_angles(const t_matrix_type& mat, size_t row, size_t col, float eps = 0.01f) {
-	t_tuple_type angle_pair(2);
+struct t_jacobi_rotation {
+	size_t row;
+	size_t col;
 
-	assert(row < col);
-	assert(row < mat.get_num_rows());
-	assert(col < mat.get_num_cols());
+	// x=cos(t), y=sin(t)
+	t_value_type cos;
+	t_value_type sin;
+};
 
-	if (std::fabs(mat.get_value(row, col)) > eps) {
-		t_value_type r = mat.get_value(col, col) - mat.get_value(row, row);
-		t_value_type t = 0.0f;
+// angles of the rotation J(row, col) for which J^T * A * J zeroes the
+// (row, col) element of a symmetric A, computed in double precision
+// from a_pp, a_qq and a_pq; returns false if a_pq is already negligible
+// compared to the diagonal
+bool calc_sym_schur_rotation_angles(double a_pp, double a_qq, double a_pq, t_jacobi_rotation& rot) {
+	const double eps = std::numeric_limits<t_value_type>::epsilon() * 0.5;
+
+	if (a_pq == 0.0 || std::fabs(a_pq) <= (eps * std::sqrt(std::fabs(a_pp * a_qq))))
+		return false;
+
+	const double r = (a_qq - a_pp) / (2.0 * a_pq);
+	const double t = (r >= 0.0)?
+		( 1.0 / ( r + std::sqrt(1.0 + r * r))):
+		(-1.0 / (-r + std::sqrt(1.0 + r * r)));
+	const double c = 1.0 / std::sqrt(1.0 + t * t);
+
+	rot.cos = c;
+	rot.sin = t * c;
+	return true;
+}
 
-		if ((r /= (2.0f * mat.get_value(row, col))) >= 0.0f) {
-			t =  1.0f / ( r + std::sqrt(1.0f + r*r));
-		} else {
-			t = -1.0f / (-r + std::sqrt(1.0f + r*r));
-		}
+#if (HAVE_X86_SIMD == 1)
+__attribute__((target("avx2,fma")))
+static size_t rotate_columns_avx2(float* x, float* y, size_t n, float c, float s) {
+	const __m256 vc = _mm256_set1_ps(c);
+	const __m256 vs = _mm256_set1_ps(s);
 
-		// x=cos(t), y=sin(t)
-		angle_pair[0] = 1.0f / std::sqrt(1.0f + t*t);
-		angle_pair[1] = t * angle_pair[0];
-	} else {
-		angle_pair[0] = 1.0f;
-		angle_pair[1] = 0.0f;
+	size_t i = 0;
+
+	for (; (i + 8) <= n; i += 8) {
+		const __m256 xi = _mm256_loadu_ps(x + i);
+		const __m256 yi = _mm256_loadu_ps(y + i);
+
+		_mm256_storeu_ps(x + i, _mm256_fmsub_ps(vc, xi, _mm256_mul_ps(vs, yi)));
+		_mm256_storeu_ps(y + i, _mm256_fmadd_ps(vs, xi, _mm256_mul_ps(vc, yi)));
 	}
 
-	return angle_pair;
+	return i;
+}
+#endif
+
+// (x, y) <- (c * x - s * y, s * x + c * y) for two contiguous columns
+static void rotate_columns(t_value_type* x, t_value_type* y, size_t n, t_value_type c, t_value_type s) {
+	size_t i = 0;
+
+	#if (HAVE_X86_SIMD == 1)
+	if (have_avx2_fma())
+		i = rotate_columns_avx2(x, y, n, c, s);
+	#endif
+
+	for (; i < n; i++) {
+		const t_value_type xi = x[i];
+		const t_value_type yi = y[i];
+
+		x[i] = c * xi - s * yi;
+		y[i] = s * xi + c * yi;
+	}
+}
+
+// applies a round of rotations on disjoint index pairs, which commute,
+// as A <- J^T * A * J and V <- V * J; the right-hand products only touch
+// columns p and q of each pair and the left-hand one only rows p and q,
+// so both passes split into independent tasks
+static void apply_jacobi_rotations(t_matrix_type& a, t_matrix_type& v, const t_jacobi_rotation* rots, size_t num_rots) {
+	const size_t n = a.get_num_rows();
+	const bool parallel = (n >= JACOBI_MIN_PARALLEL_SIZE);
+
+	t_value_type* av = a.get_values_raw();
+	t_value_type* vv = v.get_values_raw();
+
+	run_tasks((num_rots + JACOBI_TASK_SIZE - 1) / JACOBI_TASK_SIZE, parallel, [&](size_t task_idx, size_t) {
+		const size_t i0 = task_idx * JACOBI_TASK_SIZE;
+		const size_t i1 = std::min(i0 + JACOBI_TASK_SIZE, num_rots);
+
+		for (size_t i = i0; i < i1; i++) {
+			const t_jacobi_rotation& r = rots[i];
+
+			rotate_columns(av + r.row * n, av + r.col * n, n, r.cos, r.sin);
+			rotate_columns(vv + r.row * n, vv + r.col * n, n, r.cos, r.sin);
+		}
+	});
+
+	run_tasks((n + JACOBI_TASK_SIZE - 1) / JACOBI_TASK_SIZE, parallel, [&](size_t task_idx, size_t) {
+		const size_t j0 = task_idx * JACOBI_TASK_SIZE;
+		const size_t j1 = std::min(j0 + JACOBI_TASK_SIZE, n);
+
+		for (size_t j = j0; j < j1; j++) {
+			t_value_type* col = av + j * n;
+
+			for (size_t i = 0; i < num_rots; i++) {
+				const t_jacobi_rotation& r = rots[i];
+
+				const t_value_type x = col[r.row];
+				const t_value_type y = col[r.col];
+
+				col[r.row] = r.cos * x - r.sin * y;
+				col[r.col] = r.sin * x + r.cos * y;
+			}
+		}
+	});
+
+	// these were zeroed up to rounding
+	for (size_t i = 0; i < num_rots; i++) {
+		a.get_value(rots[i].row, rots[i].col) = t_value_type(0);
+		a.get_value(rots[i].col, rots[i].row) = t_value_type(0);
+	}
 }
 
 //
-// calculates eigen-vectors and eigen-values using the Jacobi decomposition
+// calculates eigen-vectors and eigen-values using the cyclic Jacobi
+// method; every sweep visits all n(n-1)/2 off-diagonal pairs in n-1
+// rounds of a round-robin tournament (Brent-Luk ordering), so that the
+// n/2 rotations within a round are disjoint and applied together in
+// O(n) per rotation instead of as dense rotation-matrix products
 //
-t_matrix_pair calc_eigen_decomposition(const t_matrix_type& mat) {
+t_matrix_pair calc_eigen_decomposition(const t_matrix_type& mat, size_t max_sweeps = JACOBI_MAX_SWEEPS) {
+	const size_t n = mat.get_num_rows();
+	// for odd n the extra player (index n) sits out one round each
+	const size_t m = n + (n & 1);
+
+	assert(mat.get_num_rows() == mat.get_num_cols());
+
 	t_matrix_type eig_val_mat = mat;
-	t_matrix_type eig_vec_mat(mat.get_num_rows(), mat.get_num_cols());
-	t_matrix_type jac_rot_mat(mat.get_num_rows(), mat.get_num_cols());
+	t_matrix_type eig_vec_mat(n, n);
 
-	// set eigen-values to the identity-matrix
+	// set eigen-vectors to the identity-matrix
 	eig_vec_mat.set_identity();
 
-	t_value_type min_norm_sq = std::numeric_limits<t_value_type>::max();
-	t_value_type cur_norm_sq = 0.0f;
+	std::vector<size_t> players(m);
+	std::vector<t_jacobi_rotation> rotations(m / 2);
 
-	for (size_t iter = 0; iter < 10; iter++) {
-		size_t max_row = 0;
-		size_t max_col = 1;
+	for (size_t i = 0; i < m; i++)
+		players[i] = i;
 
-		// find indices of largest non-diagonal element
-		for (size_t cur_row = 0; cur_row < eig_val_mat.get_num_rows(); cur_row++) {
-			for (size_t cur_col = 0; cur_col < eig_val_mat.get_num_cols(); cur_col++) {
-				if (cur_row == cur_col)
-					continue;
+	for (size_t sweep = 0; sweep < max_sweeps && n > 1; sweep++) {
+		double off_norm_sq = 0.0;
+		double all_norm_sq = 0.0;
+
+		for (size_t col = 0; col < n; col++) {
+			for (size_t row = 0; row < n; row++) {
+				const double v = square(double(eig_val_mat.get_value(row, col)));
+
+				off_norm_sq += (v * (row != col));
+				all_norm_sq += v;
+			}
+		}
 
-				const t_value_type cur_val = std::fabs(eig_val_mat.get_value(cur_row, cur_col));
-				const t_value_type max_val = std::fabs(eig_val_mat.get_value(max_row, max_col));
+		if (off_norm_sq <= (square(JACOBI_TOLERANCE) * all_norm_sq))
+			break;
+
+		size_t num_sweep_rotations = 0;
+
+		for (size_t round = 0; round < (m - 1); round++) {
+			size_t num_rotations = 0;
 
-				if (cur_val <= max_val)
+			for (size_t k = 0; k < (m / 2); k++) {
+				const size_t p = std::min(players[k], players[m - 1 - k]);
+				const size_t q = std::max(players[k], players[m - 1 - k]);
+
+				if (q >= n)
 					continue;
 
-				max_row = cur_row;
-				max_col = cur_col;
+				t_jacobi_rotation& rot = rotations[num_rotations];
+
+				rot.row = p;
+				rot.col = q;
+
+				const double a_pp = eig_val_mat.get_value(p, p);
+				const double a_qq = eig_val_mat.get_value(q, q);
+				const double a_pq = eig_val_mat.get_value(p, q);
+
+				num_rotations += calc_sym_schur_rotation_angles(a_pp, a_qq, a_pq, rot);
 			}
-		}
 
-		const t_tuple_type rot_angles = calc_sym_schur_rotation_angles(eig_val_mat, max_row, max_col);
+			// player 0 stays, everyone else moves one seat along
+			std::rotate(players.begin() + 1, players.end() - 1, players.end());
 
-		// set the Jacobi rotation matrix
-		jac_rot_mat.set_identity();
-		jac_rot_mat.set_value(jac_rot_mat.calc_idx(max_row, max_row),  rot_angles[0]);
-		jac_rot_mat.set_value(jac_rot_mat.calc_idx(max_row, max_col),  rot_angles[1]);
-		jac_rot_mat.set_value(jac_rot_mat.calc_idx(max_col, max_row), -rot_angles[1]);
-		jac_rot_mat.set_value(jac_rot_mat.calc_idx(max_col, max_col),  rot_angles[0]);
+			if (num_rotations == 0)
+				continue;
 
-		// accumulate rotations, bring eig_val_mat closer to diagonal form
-		eig_vec_mat = eig_vec_mat * jac_rot_mat;
-		eig_val_mat = (jac_rot_mat.transpose() * eig_val_mat) * jac_rot_mat;
+			apply_jacobi_rotations(eig_val_mat, eig_vec_mat, rotations.data(), num_rotations);
 
-		if ((cur_norm_sq = eig_val_mat.calc_pairwise_squared_sum()) >= min_norm_sq)
-			break;
+			num_sweep_rotations += num_rotations;
+		}
 
-		min_norm_sq = cur_norm_sq;
+		if (num_sweep_rotations == 0)
+			break;
 	}
 
 	return (t_matrix_pair(eig_vec_mat, eig_val_mat));
@@ -468,10 +1066,92 @@ t_matrix_pair calc_eigen_decomposition(const t_matrix_type& mat) {
 
 
 
-int index_value_pair_cmp(const t_index_value_pair& a, const t_index_value_pair& b) {
-	if (a.second > b.second) return  1;
-	if (a.second < b.second) return -1;
-	return 0;
+// orthonormalizes the columns of <q> in place; two passes of modified
+// Gram-Schmidt keep Q^T * Q = I to working precision
+static void orthonormalize_columns(t_matrix_type& q) {
+	const size_t d = q.get_num_rows();
+
+	for (size_t pass = 0; pass < 2; pass++) {
+		for (size_t j = 0; j < q.get_num_cols(); j++) {
+			t_value_type* qj = q.get_values_raw() + j * d;
+
+			for (size_t i = 0; i < j; i++) {
+				const t_value_type* qi = q.get_values_raw() + i * d;
+				double dot = 0.0;
+
+				for (size_t n = 0; n < d; n++)
+					dot += qi[n] * qj[n];
+				for (size_t n = 0; n < d; n++)
+					qj[n] -= (qi[n] * dot);
+			}
+
+			double len_sq = 0.0;
+
+			for (size_t n = 0; n < d; n++)
+				len_sq += square(double(qj[n]));
+
+			// directions already spanned by earlier columns stay zero
+			const double len = std::sqrt(len_sq);
+
+			for (size_t n = 0; n < d; n++)
+				qj[n] = (len > 0.0)? (qj[n] / len): t_value_type(0);
+		}
+	}
+}
+
+//
+// approximates the <k> dominant eigen-pairs of a symmetric positive semi-
+// definite matrix by randomized subspace iteration (Halko, Martinsson and
+// Tropp): the range of A is sampled as Q = orth(A * Omega) with k plus
+// RSVD_OVERSAMPLING gaussian vectors, sharpened by RSVD_POWER_ITERS rounds
+// of Q = orth(A * Q), and A is solved exactly within that subspace as
+// Q^T * A * Q = U * L * U^T, giving eigen-vectors Q * U; the cost is a few
+// DxD by Dx(k+p) products instead of the O(D^3) Jacobi sweeps, and the
+// result can be passed to sort_eigen_decomposition like that of
+// calc_eigen_decomposition
+//
+t_matrix_pair calc_randomized_eigen_decomposition(const t_matrix_type& mat, size_t k, size_t seed = 1) {
+	const size_t d = mat.get_num_rows();
+	const size_t l = std::min(k + RSVD_OVERSAMPLING, d);
+
+	assert(mat.get_num_rows() == mat.get_num_cols());
+
+	std::mt19937 rng(seed);
+	std::normal_distribution<t_value_type> dist;
+
+	t_matrix_type q(d, l);
+
+	for (size_t i = 0; i < q.get_size_sq(); i++)
+		q.get_value(i) = dist(rng);
+
+	// sample the range, Q = orth(A * Omega)
+	q = mat * q;
+	orthonormalize_columns(q);
+
+	for (size_t iter = 0; iter < RSVD_POWER_ITERS; iter++) {
+		q = mat * q;
+		orthonormalize_columns(q);
+	}
+
+	t_matrix_type b = q.transpose() * (mat * q);
+
+	// remove the asymmetry introduced by rounding
+	for (size_t col = 0; col < l; col++) {
+		for (size_t row = 0; row < col; row++) {
+			b.get_value(row, col) = b.get_value(col, row) = (b.get_value(row, col) + b.get_value(col, row)) * 0.5f;
+		}
+	}
+
+	const t_matrix_pair& eig = calc_eigen_decomposition(b);
+
+	return (t_matrix_pair(q * eig.first, eig.second));
+}
+
+
+
+// orders eigen-values from largest to smallest (principal components first)
+bool index_value_pair_cmp(const t_index_value_pair& a, const t_index_value_pair& b) {
+	return (a.second > b.second);
 }
 
 t_vector_pair sort_eigen_decomposition(const t_matrix_pair& eigen_mats, size_t num_eigen_vecs) {
@@ -494,7 +1174,7 @@ t_vector_pair sort_eigen_decomposition(const t_matrix_pair& eigen_mats, size_t n
 	std::sort(index_value_pairs.begin(), index_value_pairs.end(), index_value_pair_cmp);
 
 	// put vectors and values in the same order
-	for (size_t n = 0; n < num_eigen_vecs; n++) {
+	for (size_t n = 0; n < sorted_vecs.size(); n++) {
 		sorted_vecs[n] = eig_vecs.get_col_vec(index_value_pairs[n].first);
 		sorted_vals[n] = index_value_pairs[n].second;
 	}
@@ -504,7 +1184,202 @@ t_vector_pair sort_eigen_decomposition(const t_matrix_pair& eigen_mats, size_t n
 
 
 
-int main() {
+static double elapsed_ms(const std::chrono::steady_clock::time_point& t0) {
+	return (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+}
+
+// times the blocked product against a plain triple loop and the Jacobi
+// solver on a random <dim>x<dim> covariance-like matrix, checking that
+// A * V = V * L and V^T * V = I hold to float precision
+static void run_benchmark(size_t dim, size_t num_threads) {
+	std::mt19937 rng(dim);
+	std::uniform_real_distribution<t_value_type> dist(-1.0f, 1.0f);
+
+	set_num_threads(num_threads);
+
+	t_matrix_type a(dim, dim);
+	t_matrix_type b(dim, dim);
+	t_matrix_type c(dim, dim);
+
+	for (size_t i = 0; i < a.get_size_sq(); i++) {
+		a.get_value(i) = dist(rng);
+		b.get_value(i) = dist(rng);
+	}
+
+	{
+		auto t0 = std::chrono::steady_clock::now();
+
+		for (size_t j = 0; j < dim; j++) {
+			for (size_t p = 0; p < dim; p++) {
+				for (size_t i = 0; i < dim; i++) {
+					c.get_value(i, j) += a.get_value(i, p) * b.get_value(p, j);
+				}
+			}
+		}
+
+		const double loop_ms = elapsed_ms(t0);
+
+		t0 = std::chrono::steady_clock::now();
+		const t_matrix_type r = a * b;
+		const double gemm_ms = elapsed_ms(t0);
+
+		double max_err = 0.0;
+
+		for (size_t i = 0; i < r.get_size_sq(); i++)
+			max_err = std::max(max_err, double(std::fabs(r.get_value(i) - c.get_value(i))));
+
+		const double gflop = (2.0 * dim * dim * dim) * 1e-9;
+
+		printf("[%s] dim=%lu threads=%lu\n", __func__, dim, get_thread_pool().get_num_threads());
+		printf("[%s] gemm: loop=%.1fms (%.2f GFLOP/s) blocked=%.1fms (%.2f GFLOP/s) avx2=%d max_err=%g\n", __func__,
+			loop_ms, gflop / (loop_ms * 1e-3), gemm_ms, gflop / (gemm_ms * 1e-3), have_avx2_fma(), max_err);
+	}
+
+	{
+		// A^T * A / dim is symmetric positive semi-definite
+		const t_matrix_type cov = (a.transpose() * a) / t_value_type(dim);
+
+		const auto t0 = std::chrono::steady_clock::now();
+		const t_matrix_pair& eig = calc_eigen_decomposition(cov);
+		const double jacobi_ms = elapsed_ms(t0);
+
+		const t_matrix_type& vecs = eig.first;
+		const t_matrix_type& vals = eig.second;
+
+		const t_matrix_type av = cov * vecs;
+		const t_matrix_type vtv = vecs.transpose() * vecs;
+
+		double res_sq = 0.0;
+		double cov_sq = 0.0;
+		double orth_err = 0.0;
+
+		for (size_t j = 0; j < dim; j++) {
+			for (size_t i = 0; i < dim; i++) {
+				res_sq += square(double(av.get_value(i, j)) - double(vecs.get_value(i, j)) * vals.get_value(j, j));
+				cov_sq += square(double(cov.get_value(i, j)));
+				orth_err = std::max(orth_err, std::fabs(double(vtv.get_value(i, j)) - (i == j)));
+			}
+		}
+
+		printf("[%s] jacobi: time=%.1fms residual=%g orth_err=%g\n", __func__, jacobi_ms, std::sqrt(res_sq / cov_sq), orth_err);
+	}
+}
+
+
+// writes <num_samples> samples of a rank-<rank> signal (with variance
+// 100/(r+1)^2 along random direction r) plus unit-variance noise and an
+// offset mean, in the headerless format read by t_sample_file
+static bool generate_sample_file(const char* path, size_t num_samples, size_t num_dims, size_t rank) {
+	FILE* f = fopen(path, "wb");
+
+	if (f == nullptr) {
+		printf("[%s] failed to open \"%s\"\n", __func__, path);
+		return false;
+	}
+
+	std::mt19937 rng(num_samples * 31 + num_dims);
+	std::normal_distribution<t_value_type> dist;
+
+	std::vector<t_value_type> basis(rank * num_dims);
+	std::vector<t_value_type> chunk(PCA_STREAM_CHUNK_ROWS * num_dims);
+
+	for (size_t r = 0; r < rank; r++) {
+		double len_sq = 0.0;
+
+		for (size_t i = 0; i < num_dims; i++)
+			len_sq += square(double(basis[r * num_dims + i] = dist(rng)));
+		for (size_t i = 0; i < num_dims; i++)
+			basis[r * num_dims + i] *= (10.0 / (r + 1)) / std::sqrt(len_sq);
+	}
+
+	for (size_t s0 = 0; s0 < num_samples; s0 += PCA_STREAM_CHUNK_ROWS) {
+		const size_t n = std::min(num_samples - s0, size_t(PCA_STREAM_CHUNK_ROWS));
+
+		for (size_t s = 0; s < n; s++) {
+			t_value_type* x = &chunk[s * num_dims];
+
+			for (size_t i = 0; i < num_dims; i++)
+				x[i] = 5.0f + dist(rng);
+
+			for (size_t r = 0; r < rank; r++) {
+				const t_value_type z = dist(rng);
+
+				for (size_t i = 0; i < num_dims; i++) {
+					x[i] += (z * basis[r * num_dims + i]);
+				}
+			}
+		}
+
+		if (fwrite(chunk.data(), sizeof(t_value_type) * num_dims, n, f) != n) {
+			printf("[%s] failed to write \"%s\"\n", __func__, path);
+			fclose(f);
+			return false;
+		}
+	}
+
+	fclose(f);
+	return true;
+}
+
+// one streaming pass over <path> for the mean and covariance, then the
+// top-<k> principal components by the randomized solver; for modest D
+// the full Jacobi decomposition is also run to compare against
+static bool run_streaming_pca(const char* path, size_t num_dims, size_t k, size_t num_threads) {
+	t_sample_file file;
+
+	if (!file.open(path, num_dims))
+		return false;
+
+	set_num_threads(num_threads);
+
+	auto t0 = std::chrono::steady_clock::now();
+	const t_moment_accumulator& moments = calc_streaming_moments(file);
+	const double moments_ms = elapsed_ms(t0);
+
+	const t_matrix_type& cov = moments.get_covariance();
+
+	t0 = std::chrono::steady_clock::now();
+	const t_vector_pair& top_k = sort_eigen_decomposition(calc_randomized_eigen_decomposition(cov, k), k);
+	const double rsvd_ms = elapsed_ms(t0);
+
+	printf("[%s] samples=%lu dims=%lu threads=%lu\n", __func__, moments.get_num_samples(), num_dims, get_thread_pool().get_num_threads());
+	printf("[%s] moments=%.1fms (%.1f MB/s) randomized-top-%lu=%.1fms\n", __func__,
+		moments_ms, (file.get_num_samples() * num_dims * sizeof(t_value_type)) / (moments_ms * 1e3), k, rsvd_ms);
+
+	if (num_dims <= 256) {
+		t0 = std::chrono::steady_clock::now();
+		const t_vector_pair& exact = sort_eigen_decomposition(calc_eigen_decomposition(cov), k);
+		const double jacobi_ms = elapsed_ms(t0);
+
+		printf("[%s] jacobi=%.1fms\n", __func__, jacobi_ms);
+
+		for (size_t n = 0; n < top_k.second.size(); n++) {
+			printf("[%s] eig[%lu]={randomized=%.5f,jacobi=%.5f}\n", __func__, n, top_k.second[n], exact.second[n]);
+		}
+	} else {
+		for (size_t n = 0; n < top_k.second.size(); n++) {
+			printf("[%s] eig[%lu]=%.5f\n", __func__, n, top_k.second[n]);
+		}
+	}
+
+	return true;
+}
+
+
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		run_benchmark((argc > 2)? atoi(argv[2]): 512, (argc > 3)? atoi(argv[3]): std::thread::hardware_concurrency());
+		return 0;
+	}
+	if (argc > 4 && strcmp(argv[1], "--gen") == 0) {
+		// --gen <file> <samples> <dims> [rank]
+		return (generate_sample_file(argv[2], atol(argv[3]), atoi(argv[4]), (argc > 5)? atoi(argv[5]): 8)? 0: 1);
+	}
+	if (argc > 3 && strcmp(argv[1], "--stream") == 0) {
+		// --stream <file> <dims> [k] [threads]
+		return (run_streaming_pca(argv[2], atoi(argv[3]), (argc > 4)? atoi(argv[4]): 8, (argc > 5)? atoi(argv[5]): std::thread::hardware_concurrency())? 0: 1);
+	}
+
 	FILE* RAW_DATA_POINTS_FILE = fopen("raw_data_points.dat", "w");
 	FILE* PCA_DATA_POINTS_FILE = fopen("pca_data_points.dat", "w");
 
@@ -2,18 +2,27 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 
 #if (USE_OMP == 1)
 #include <omp.h>
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <algorithm>
+#include <chrono>
 #include <limits>
+#include <string>
 #include <vector>
 
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
+#include "simple_work_stealing_pool.hpp"
+
 
 
 // typedef  float real32_t;
@@ -49,6 +58,21 @@ static const uint64_t NUM_AA_RAYS_Y = 2;
 
 static const uint64_t MAX_RAYTRACE_DEPTH = 4;
 
+// fraction of newly gathered photons kept per progressive round
+static const real64_t PPM_ALPHA = 0.7;
+
+static const char* IMAGE_FILE_NAME = "image.ppm";
+static const char CHECKPOINT_MAGIC[8] = {'P', 'M', 'C', 'K', 'P', 'T', '0', '1'};
+
+// work granularity for the thread pool
+static const uint64_t RENDER_TILE_SIZE = 16;
+static const uint64_t EMISSION_CHUNK_SIZE = 256;
+static const uint64_t HIT_POINT_CHUNK_SIZE = 1024;
+
+// maximum number of photons per kd-tree leaf (tested as one batch)
+static const uint64_t KD_TREE_LEAF_SIZE = 8;
+static const uint64_t KD_TREE_STACK_SIZE = 64;
+
 
 
 template<typename type> type clamp(const type v, const type vmin, const type vmax) {
@@ -65,28 +89,6 @@ inline uint8_t tone_map(real64_t x) {
 	return (pow(1.0 - exp(-x), 1.0 / 2.2) * 255 + 0.5);
 }
 
-inline uint64_t log2(uint64_t x) {
-	uint64_t n = 0;
-	for (n = 0; x > 1; x >>= 1, ++n) {}
-	return n;
-}
-
-// calculate the median value of a number <n>
-// if n is a power of 2, this will just be n/2
-inline uint64_t calc_median_value(uint64_t n) {
-	const uint64_t s1 =   1 << log2(n); // s1 = 2^h = n (if n is pow2)
-	const uint64_t s2 =  s1 >>       1; // s2 = (2^h)/2 = 2^(h-1)
-	const uint64_t  d =         n - s1; // difference (0 if n is pow2)
-
-	assert(n != 0);
-	assert(n >= s1);
-
-	if (s2 != 0 && d >= s2)
-		return (s1 - 1);
-
-	return (s2 + d);
-}
-
 // simple Halton sequence generator
 real64_t halton_seq(uint64_t p, uint64_t n) {
 	real64_t r = 0.0;
@@ -114,6 +116,7 @@ public:
 		m_y = y_;
 		m_z = z_;
 	}
+	t_vec_xyz(const t_vec_xyz& v) = default;
 
 	t_vec_xyz& operator = (const t_vec_xyz& v) {
 		m_x = v.x();
@@ -375,66 +378,151 @@ private:
 	t_vec64f m_pwr; // current power
 };
 
-bool cmpx(const t_photon& a, const t_photon& b) { return ((a.pos()).x() < (b.pos()).x()); }
-bool cmpy(const t_photon& a, const t_photon& b) { return ((a.pos()).y() < (b.pos()).y()); }
-bool cmpz(const t_photon& a, const t_photon& b) { return ((a.pos()).z() < (b.pos()).z()); }
+// diffuse eye-path vertex for progressive photon mapping; collects the
+// photons of every round within a radius that shrinks over the rounds
+struct t_hit_point {
+public:
+	t_vec64f pos;
+	t_vec64f wgt; // path throughput including the surface albedo
+	t_vec64f flux; // accumulated photon power (radius-corrected)
+
+	real64_t radius_sq;
+	real64_t num_photons; // accumulated (fractional) photon count
+
+	uint64_t pixel;
+};
+
+// everything in a checkpoint that must match the current scene
+struct t_checkpoint_header {
+public:
+	char magic[8];
+
+	uint64_t image_size_x;
+	uint64_t image_size_y;
+	uint64_t max_raytrace_depth;
+	uint64_t num_emission_batches;
+	uint64_t num_emission_photons;
+	uint64_t num_radiance_photons;
+	uint64_t num_hit_points;
+	uint64_t num_rounds;
+
+	real64_t max_gather_dist_sq;
+};
+
+// entry in the bounded max-heap of a k-NN query
+struct t_photon_ngb {
+public:
+	bool operator < (const t_photon_ngb& n) const { return (dist_sq < n.dist_sq); }
+
+	real64_t dist_sq;
+	uint64_t index; // into the tree's photon arrays
+};
 
 
 
+// implicit kd-tree; photons are reordered so every subtree covers a
+// contiguous range [beg, end) of the (SoA) photon arrays and its two
+// children cover [beg, mid) and [mid, end) with mid = (beg + end) / 2
+// such that only the split plane of each inner node has to be stored
+// (in breadth-first order, children of node i are 2i+1 and 2i+2) and
+// leaves of at most KD_TREE_LEAF_SIZE photons are scanned as a batch
 struct t_kd_tree {
 public:
-	// traverse tree-structure to collect the <dsts.size()> nearest-neighbors of <pos> in <ngbs>
-	bool get_nearest_ngbs(std::vector<t_photon*>& ngbs, std::vector<real64_t>& dsts, const t_vec64f& pos) const {
-		assert(!array.empty());
-		assert(ngbs.size() == dsts.size());
-		traverse(ngbs, dsts, pos, 0);
-		return (ngbs[0] != NULL);
+	// collect (at most) the <k> photons nearest to <pos> within distance
+	// sqrt(max_dist_sq) in <ngbs>; returns false if none were found
+	//
+	// ngbs is left in max-heap order, so ngbs[0] is the furthest photon
+	bool get_nearest_ngbs(std::vector<t_photon_ngb>& ngbs, uint64_t k, const t_vec64f& pos, real64_t max_dist_sq) const {
+		assert(!m_pos_x.empty());
+		assert(k != 0);
+
+		ngbs.clear();
+		traverse(pos, max_dist_sq, [&](uint64_t i, real64_t dist_sq) {
+			if (ngbs.size() == k) {
+				// replace the current furthest neighbor
+				std::pop_heap(ngbs.begin(), ngbs.end());
+				ngbs.back() = {dist_sq, i};
+			} else {
+				ngbs.push_back({dist_sq, i});
+			}
+
+			std::push_heap(ngbs.begin(), ngbs.end());
+
+			// once the heap is full only closer photons are of interest
+			return ((ngbs.size() == k)? ngbs[0].dist_sq: max_dist_sq);
+		});
+
+		return (!ngbs.empty());
+	}
+
+	// sum the power of all photons within distance sqrt(max_dist_sq)
+	// of <pos> into <sum_pwr>; returns the number of photons found
+	uint64_t get_ngbs_in_radius(const t_vec64f& pos, real64_t max_dist_sq, t_vec64f& sum_pwr) const {
+		uint64_t num_ngbs = 0;
+
+		traverse(pos, max_dist_sq, [&](uint64_t i, real64_t) {
+			sum_pwr += m_pwrs[i];
+			num_ngbs += 1;
+			return max_dist_sq;
+		});
+
+		return num_ngbs;
 	}
 
-	// recursively construct a tree-structure over the photons
-	// nodes will need to contain O(log N) entries on average
 	void build(std::vector<t_photon>& buf) {
-		array.resize(buf.size(), NULL);
-		nodes.resize(buf.size(), AXIS_IDX_X);
-
-		build_rec(&buf[0], -1, 0, buf.size());
-	}
-
-	void build_rec(t_photon* buf, uint8_t axis_idx, uint64_t node_idx, uint64_t num_nodes) {
-		switch (num_nodes) {
-			case 0: {                                                         } break;
-			case 1: { assert(node_idx < array.size()); array[node_idx] = buf; } break;
-			default: {
-				// const uint64_t median_val = num_nodes >> 1;
-				const uint64_t median_val = calc_median_value(num_nodes);
-
-				assert(num_nodes > median_val);
-				assert(node_idx < nodes.size());
-				assert(nodes[node_idx] <= AXIS_IDX_Z);
-
-				// sort photons along axis of largest separation
-				// but no need to sort along the same axis twice
-				if ((nodes[node_idx] = sep_axis_index(buf, num_nodes)) != axis_idx) {
-					switch (nodes[node_idx]) {
-						case AXIS_IDX_X: { std::sort(buf, buf + num_nodes, cmpx); } break;
-						case AXIS_IDX_Y: { std::sort(buf, buf + num_nodes, cmpy); } break;
-						case AXIS_IDX_Z: { std::sort(buf, buf + num_nodes, cmpz); } break;
-						default: { assert(false); } break;
-					}
-				}
+		uint64_t num_levels = 0;
 
-				// median-value node becomes the root for both subtrees
-				array[node_idx] = &buf[median_val];
-				assert(nodes[node_idx] <= AXIS_IDX_Z);
+		// number of halvings until every range fits into a leaf
+		for (uint64_t n = buf.size(); n > KD_TREE_LEAF_SIZE; n = (n + 1) >> 1)
+			num_levels += 1;
 
-				// recurse until we have a single photon left
-				build_rec(buf,                  nodes[node_idx], node_idx * 2 + 1,             median_val    );
-				build_rec(buf + median_val + 1, nodes[node_idx], node_idx * 2 + 2, num_nodes - median_val - 1);
-			} break;
+		assert(num_levels < KD_TREE_STACK_SIZE);
+
+		m_split_vals.clear();
+		m_split_axes.clear();
+		m_split_vals.resize((uint64_t(1) << num_levels) - 1, 0.0);
+		m_split_axes.resize((uint64_t(1) << num_levels) - 1, AXIS_IDX_X);
+
+		// nth_element instead of a full sort per level; O(n log n) overall
+		build_rec(&buf[0], 0, 0, buf.size());
+
+		m_pos_x.resize(buf.size());
+		m_pos_y.resize(buf.size());
+		m_pos_z.resize(buf.size());
+		m_pwrs.resize(buf.size());
+
+		for (uint64_t i = 0; i < buf.size(); i++) {
+			m_pos_x[i] = buf[i].pos().x();
+			m_pos_y[i] = buf[i].pos().y();
+			m_pos_z[i] = buf[i].pos().z();
+			m_pwrs[i] = buf[i].pwr();
 		}
 	}
 
+	const t_vec64f& get_photon_pwr(uint64_t i) const { return m_pwrs[i]; }
+
 private:
+	void build_rec(t_photon* buf, uint64_t node_idx, uint64_t beg, uint64_t end) {
+		if ((end - beg) <= KD_TREE_LEAF_SIZE)
+			return;
+
+		assert(node_idx < m_split_axes.size());
+
+		const uint64_t mid = (beg + end) >> 1;
+		const uint8_t axis = sep_axis_index(buf + beg, end - beg);
+
+		// everything left of mid is now <= buf[mid] along axis, everything right >=
+		std::nth_element(buf + beg, buf + mid, buf + end, [&](const t_photon& a, const t_photon& b) {
+			return ((a.pos())[axis] < (b.pos())[axis]);
+		});
+
+		m_split_vals[node_idx] = (buf[mid].pos())[axis];
+		m_split_axes[node_idx] = axis;
+
+		build_rec(buf, node_idx * 2 + 1, beg, mid);
+		build_rec(buf, node_idx * 2 + 2, mid, end);
+	}
+
 	uint8_t sep_axis_index(const t_photon* photons, uint64_t n) {
 		t_aabb aabb;
 
@@ -456,77 +544,104 @@ private:
 		return AXIS_IDX_Z;
 	}
 
-	void traverse(std::vector<t_photon*>& ngbs, std::vector<real64_t>& dsts, const t_vec64f& pos, uint64_t node_idx) const {
-		if (node_idx >= array.size())
-			return;
 
-		if ((node_idx * 2 + 1) < array.size()) {
-			assert(node_idx < nodes.size());
-			assert(nodes[node_idx] <= AXIS_IDX_Z);
+	// squared distances from <pos> to photons [beg, end) in <dsts>
+	void calc_leaf_dists(const t_vec64f& pos, uint64_t beg, uint64_t end, real64_t* dsts) const {
+		uint64_t i = beg;
 
-			const  uint8_t axis_idx     = nodes[node_idx];
-			const real64_t axis_dist    = pos[axis_idx] - array[node_idx]->pos()[axis_idx];
-			const real64_t axis_dist_sq = axis_dist * axis_dist;
+		#if defined(__SSE2__)
+		const __m128d px = _mm_set1_pd(pos.x());
+		const __m128d py = _mm_set1_pd(pos.y());
+		const __m128d pz = _mm_set1_pd(pos.z());
 
-			if (axis_dist < 0.0) {
-				// negative extent, visit left subtree
-				traverse(ngbs, dsts, pos, node_idx * 2 + 1);
+		for (; (i + 2) <= end; i += 2) {
+			const __m128d dx = _mm_sub_pd(_mm_loadu_pd(&m_pos_x[i]), px);
+			const __m128d dy = _mm_sub_pd(_mm_loadu_pd(&m_pos_y[i]), py);
+			const __m128d dz = _mm_sub_pd(_mm_loadu_pd(&m_pos_z[i]), pz);
 
-				// dsts[n - 1] is the current largest distance of any of the
-				// dsts.size() photons to (the center of) our nearest-neigbor
-				// search, and this can change (decrease) during traversal
-				//
-				if (axis_dist_sq < dsts[dsts.size() - 1]) {
-					traverse(ngbs, dsts, pos, node_idx * 2 + 2);
-				}
-			} else {
-				// positive extent, visit right subtree
-				traverse(ngbs, dsts, pos, node_idx * 2 + 2);
+			_mm_storeu_pd(&dsts[i - beg], _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz)));
+		}
+		#endif
 
-				if (axis_dist_sq < dsts[dsts.size() - 1]) {
-					traverse(ngbs, dsts, pos, node_idx * 2 + 1);
-				}
-			}
-		} /*else*/ {
-			// distance between current photon (node) and
-			// (the center of) our nearest-neigbor search
-			const real64_t dist_sq = (pos - array[node_idx]->pos()).len_sq();
+		for (; i < end; i++) {
+			const real64_t dx = m_pos_x[i] - pos.x();
+			const real64_t dy = m_pos_y[i] - pos.y();
+			const real64_t dz = m_pos_z[i] - pos.z();
 
-			if (dist_sq >= dsts[dsts.size() - 1])
-				return;
+			dsts[i - beg] = dx * dx + dy * dy + dz * dz;
+		}
+	}
+
+	// calls visitor(i, dist_sq) for every photon closer than the current
+	// search radius; the visitor returns the (possibly shrunken) radius
+	template<typename t_visitor> void traverse(const t_vec64f& pos, real64_t max_dist_sq, const t_visitor& visitor) const {
+		struct t_stack_entry {
+			uint64_t node_idx;
+			uint64_t beg;
+			uint64_t end;
+			real64_t dist_sq; // to the split plane of the parent
+		};
+
+		t_stack_entry stack[KD_TREE_STACK_SIZE];
+		uint64_t stack_size = 0;
 
-			uint64_t lft_idx = 0;
-			uint64_t rgt_idx = dsts.size();
+		stack[stack_size++] = {0, 0, m_pos_x.size(), 0.0};
 
-			// find the insertion-position for the new photon
-			// (use binary-search to do this in O(log n) time)
-			while (lft_idx < rgt_idx) {
-				const uint64_t mid_idx = (lft_idx + rgt_idx) >> 1;
+		while (stack_size > 0) {
+			t_stack_entry entry = stack[--stack_size];
 
-				if (dist_sq < dsts[mid_idx]) {
-					rgt_idx = mid_idx;
+			// the search radius can shrink during traversal, so far
+			// subtrees pushed earlier can often be skipped by now
+			if (entry.dist_sq >= max_dist_sq)
+				continue;
+
+			// descend to the leaf on the near side of every split plane
+			while ((entry.end - entry.beg) > KD_TREE_LEAF_SIZE) {
+				const uint64_t mid = (entry.beg + entry.end) >> 1;
+				const uint8_t axis = m_split_axes[entry.node_idx];
+
+				const real64_t axis_dist = pos[axis] - m_split_vals[entry.node_idx];
+				const real64_t axis_dist_sq = axis_dist * axis_dist;
+
+				const t_stack_entry lft = {entry.node_idx * 2 + 1, entry.beg,       mid, axis_dist_sq};
+				const t_stack_entry rgt = {entry.node_idx * 2 + 2,       mid, entry.end, axis_dist_sq};
+
+				assert(stack_size < KD_TREE_STACK_SIZE);
+
+				if (axis_dist < 0.0) {
+					stack[stack_size++] = rgt;
+					entry = lft;
 				} else {
-					lft_idx = mid_idx + 1;
+					stack[stack_size++] = lft;
+					entry = rgt;
 				}
 			}
 
-			// make room for the photon to be inserted
-			// (distances are in ascending sorted order)
-			for (uint64_t j = dsts.size(); --j > lft_idx; ) {
-				assert(j < ngbs.size());
+			real64_t dsts[KD_TREE_LEAF_SIZE];
 
-				ngbs[j] = ngbs[j - 1];
-				dsts[j] = dsts[j - 1];
-			}
+			calc_leaf_dists(pos, entry.beg, entry.end, dsts);
 
-			ngbs[lft_idx] = array[node_idx];
-			dsts[lft_idx] = dist_sq;
+			for (uint64_t i = entry.beg; i < entry.end; i++) {
+				const real64_t dist_sq = dsts[i - entry.beg];
+
+				if (dist_sq >= max_dist_sq)
+					continue;
+
+				max_dist_sq = visitor(i, dist_sq);
+			}
 		}
 	}
 
 private:
-	std::vector<t_photon*> array;
-	std::vector<uint8_t> nodes;
+	// photon data in tree order
+	std::vector<real64_t> m_pos_x;
+	std::vector<real64_t> m_pos_y;
+	std::vector<real64_t> m_pos_z;
+	std::vector<t_vec64f> m_pwrs;
+
+	// inner nodes
+	std::vector<real64_t> m_split_vals;
+	std::vector< uint8_t> m_split_axes;
 };
 
 
@@ -546,10 +661,10 @@ private:
 
 struct t_camera {
 public:
-	const t_vec64f&  pos() { return m_pos;  }
-	const t_vec64f& zdir() { return m_zdir; }
-	const t_vec64f& xdir() { return m_xdir; }
-	const t_vec64f& ydir() { return m_ydir; }
+	const t_vec64f&  pos() const { return m_pos;  }
+	const t_vec64f& zdir() const { return m_zdir; }
+	const t_vec64f& xdir() const { return m_xdir; }
+	const t_vec64f& ydir() const { return m_ydir; }
 
 	t_vec64f&  pos(const t_vec64f&  pos) { return (m_pos  =  pos); }
 	t_vec64f& zdir(const t_vec64f& zdir) { return (m_zdir = zdir); }
@@ -576,6 +691,16 @@ public:
 		m_max_raytrace_depth = (argc >= 7)? std::max(1, atoi(argv[6])): MAX_RAYTRACE_DEPTH;
 		m_num_render_threads = (argc >= 8)? std::max(1, atoi(argv[7])): boost::thread::hardware_concurrency();
 
+		// radiance estimates ignore photons further away than this (<= 0 means no limit)
+		m_max_gather_dist_sq = (argc >= 9)? std::max(0.0, atof(argv[8])): 0.0;
+		m_max_gather_dist_sq = (m_max_gather_dist_sq > 0.0)? (m_max_gather_dist_sq * m_max_gather_dist_sq): MAX_COOR_VAL;
+
+		// progressive mode; number of photon rounds (0 means a single pass), file
+		// to checkpoint to and resume from, and wall-clock budget per invocation
+		m_num_progressive_rounds = (argc >=  10)? std::max(0, atoi(argv[9])): 0;
+		m_checkpoint_file = (argc >= 11)? argv[10]: "";
+		m_max_render_seconds = (argc >= 12)? std::max(0.0, atof(argv[11])): 0.0;
+
 		m_photons.reserve(m_num_emission_batches * m_num_emission_photons);
 		m_objects.reserve(8);
 		m_lights.resize(m_num_emission_batches, t_light());
@@ -583,14 +708,14 @@ public:
 
 		m_photon_maps.resize(m_num_render_threads);
 		m_photon_ngbs.resize(m_num_render_threads);
-		m_photon_dsts.resize(m_num_render_threads);
 
 		for (uint64_t n = 0; n < m_num_render_threads; n++) {
 			m_photon_maps[n].reserve((m_num_emission_batches * m_num_emission_photons) / m_num_render_threads);
-			m_photon_ngbs[n].resize(m_num_radiance_photons, NULL);
-			m_photon_dsts[n].resize(m_num_radiance_photons, MAX_COOR_VAL);
+			m_photon_ngbs[n].reserve(m_num_radiance_photons);
 		}
 
+		m_thread_pool.spawn_threads(m_num_render_threads);
+
 		for (uint64_t n = 0; n < m_num_emission_batches; n++) {
 			m_lights[n].pos(t_vec64f(50.0 * n - 25.0, 60.0, 85.0));
 			m_lights[n].pwr(t_vec64f(M_PI * 25000.0, M_PI * 25000.0, M_PI * 25000.0));
@@ -616,64 +741,74 @@ public:
 	}
 
 	void render_image() {
+		if (m_num_progressive_rounds > 0) {
+			render_image_progressive();
+			return;
+		}
+
 		// primary pass: emit photons into scene from each light-source
 		// no point creating an image if no photons impacted any surface
-		if (!spawn_photon_emitter_threads(t_vec64u(m_num_render_threads, 1)))
+		if (!spawn_photon_emitter_threads())
 			return;
 
 		build_photon_tree();
 
 		// secondary pass: gather per-pixel radiance
-		switch (m_num_render_threads) {
-			case 1: {
-				// 1x1 block
-				spawn_radiance_gatherer_threads(t_vec64u(1, 0));
-			} break;
+		spawn_radiance_gatherer_threads();
 
-			case 2: {
-				// 2x1 blocks
-				spawn_radiance_gatherer_threads(t_vec64u(1, 2));
-			} break;
+		m_thread_pool.log_stats(stdout, __func__);
+	}
 
-			case 4: {
-				// 2x2 blocks
-				spawn_radiance_gatherer_threads(t_vec64u(2, 2));
-			} break;
+	// progressive photon mapping (Hachisuka et al.); eye paths are traced
+	// once and every round emits a fresh set of photons into the map which
+	// is then gathered at each hit point, so the image keeps converging as
+	// rounds are added instead of being limited by a single photon map
+	void render_image_progressive() {
+		const auto t0 = std::chrono::steady_clock::now();
 
-			case 8: {
-				// 2x4 blocks
-				spawn_radiance_gatherer_threads(t_vec64u(2, 4));
-			} break;
+		uint64_t round_idx = 0;
 
-			case 16: {
-				// 4x4 blocks
-				spawn_radiance_gatherer_threads(t_vec64u(4, 4));
-			} break;
+		// hit points are deterministic, so they need not be checkpointed
+		spawn_eye_path_tracer_threads();
 
-			case 32: {
-				// 8x4 blocks
-				spawn_radiance_gatherer_threads(t_vec64u(4, 8));
-			} break;
+		if (!m_checkpoint_file.empty() && load_checkpoint(m_checkpoint_file.c_str(), round_idx))
+			printf("[%s] resumed from \"%s\" after %lu rounds\n", __func__, m_checkpoint_file.c_str(), round_idx);
 
-			case 64: {
-				// 8x8 blocks
-				spawn_radiance_gatherer_threads(t_vec64u(8, 8));
-			} break;
+		while (round_idx < m_num_progressive_rounds) {
+			const auto t1 = std::chrono::steady_clock::now();
 
-			case 128: {
-				// 8x16 blocks
-				spawn_radiance_gatherer_threads(t_vec64u(8, 16));
-			} break;
+			// rounds continue the photon sequences where the previous ended
+			if (spawn_photon_emitter_threads(round_idx)) {
+				build_photon_tree();
+				spawn_hit_point_updater_threads();
+			}
 
-			case 256: {
-				// 16x16 blocks
-				spawn_radiance_gatherer_threads(t_vec64u(16, 16));
-			} break;
+			round_idx += 1;
 
-			default: {
-				assert(false);
-			} break;
+			if (!m_checkpoint_file.empty())
+				save_checkpoint(m_checkpoint_file.c_str(), round_idx);
+
+			const auto t2 = std::chrono::steady_clock::now();
+
+			printf("[%s] round=%lu/%lu photons=%lu hit_points=%lu round_ms=%.2f\n",
+				__func__,
+				round_idx,
+				m_num_progressive_rounds,
+				m_photons.size(),
+				m_hit_points.size(),
+				std::chrono::duration<double, std::milli>(t2 - t1).count()
+			);
+
+			// stop early if over budget; a later run can resume from the checkpoint
+			if (m_max_render_seconds > 0.0 && std::chrono::duration<double>(t2 - t0).count() >= m_max_render_seconds)
+				break;
 		}
+
+		// main writes the image once, after the final round
+		if (round_idx > 0)
+			accumulate_image(round_idx);
+
+		m_thread_pool.log_stats(stdout, __func__);
 	}
 
 	bool write_image(const char* fname) const {
@@ -692,6 +827,112 @@ public:
 		return true;
 	}
 
+	t_checkpoint_header make_checkpoint_header(uint64_t num_rounds) const {
+		t_checkpoint_header hdr;
+
+		// zero any padding so headers can be compared bytewise
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, CHECKPOINT_MAGIC, sizeof(hdr.magic));
+
+		hdr.image_size_x = m_image_size_x;
+		hdr.image_size_y = m_image_size_y;
+		hdr.max_raytrace_depth = m_max_raytrace_depth;
+		hdr.num_emission_batches = m_num_emission_batches;
+		hdr.num_emission_photons = m_num_emission_photons;
+		hdr.num_radiance_photons = m_num_radiance_photons;
+		hdr.num_hit_points = m_hit_points.size();
+		hdr.num_rounds = num_rounds;
+		hdr.max_gather_dist_sq = m_max_gather_dist_sq;
+		return hdr;
+	}
+
+	// layout: header, per-hit-point state {radius_sq, num_photons, flux}
+	// as doubles, then the image as RGB floats; written to a temporary
+	// file first so an interrupted save never clobbers the last one
+	bool save_checkpoint(const char* fname, uint64_t num_rounds) const {
+		const t_checkpoint_header hdr = make_checkpoint_header(num_rounds);
+		const std::string tmp_fname = std::string(fname) + ".tmp";
+
+		std::vector<real64_t> hit_data;
+		std::vector<float> img_data;
+
+		hit_data.reserve(m_hit_points.size() * 5);
+		img_data.reserve(m_image.size() * 3);
+
+		for (const t_hit_point& hp: m_hit_points) {
+			hit_data.push_back(hp.radius_sq);
+			hit_data.push_back(hp.num_photons);
+			hit_data.push_back(hp.flux.x());
+			hit_data.push_back(hp.flux.y());
+			hit_data.push_back(hp.flux.z());
+		}
+		for (const t_vec64f& pxl: m_image) {
+			img_data.push_back(pxl.x());
+			img_data.push_back(pxl.y());
+			img_data.push_back(pxl.z());
+		}
+
+		FILE* f = fopen(tmp_fname.c_str(), "wb");
+
+		if (f == NULL)
+			return false;
+
+		bool ret = true;
+
+		ret &= (fwrite(&hdr, sizeof(hdr), 1, f) == 1);
+		ret &= (fwrite(hit_data.data(), sizeof(real64_t), hit_data.size(), f) == hit_data.size());
+		ret &= (fwrite(img_data.data(), sizeof(float), img_data.size(), f) == img_data.size());
+		ret &= (fclose(f) == 0);
+
+		if (!ret || rename(tmp_fname.c_str(), fname) != 0) {
+			printf("[%s] failed to write \"%s\"\n", __func__, fname);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool load_checkpoint(const char* fname, uint64_t& num_rounds) {
+		FILE* f = fopen(fname, "rb");
+
+		if (f == NULL)
+			return false;
+
+		t_checkpoint_header hdr;
+		t_checkpoint_header ref;
+
+		std::vector<real64_t> hit_data(m_hit_points.size() * 5);
+		std::vector<float> img_data(m_image.size() * 3);
+
+		bool ret = true;
+
+		ret = ret && (fread(&hdr, sizeof(hdr), 1, f) == 1);
+		ret = ret && (ref = make_checkpoint_header(hdr.num_rounds), memcmp(&hdr, &ref, sizeof(hdr)) == 0);
+		ret = ret && (fread(hit_data.data(), sizeof(real64_t), hit_data.size(), f) == hit_data.size());
+		ret = ret && (fread(img_data.data(), sizeof(float), img_data.size(), f) == img_data.size());
+
+		fclose(f);
+
+		if (!ret) {
+			printf("[%s] ignoring \"%s\" (truncated or made with different parameters)\n", __func__, fname);
+			return false;
+		}
+
+		for (uint64_t i = 0; i < m_hit_points.size(); i++) {
+			t_hit_point& hp = m_hit_points[i];
+
+			hp.radius_sq   = hit_data[i * 5 + 0];
+			hp.num_photons = hit_data[i * 5 + 1];
+			hp.flux        = t_vec64f(hit_data[i * 5 + 2], hit_data[i * 5 + 3], hit_data[i * 5 + 4]);
+		}
+		for (uint64_t i = 0; i < m_image.size(); i++) {
+			m_image[i] = t_vec64f(img_data[i * 3 + 0], img_data[i * 3 + 1], img_data[i * 3 + 2]);
+		}
+
+		num_rounds = hdr.num_rounds;
+		return true;
+	}
+
 	void add_object(const t_sphere& s) { m_objects.emplace_back(s); }
 	void add_photon(const t_photon& p) { m_photons.emplace_back(p); }
 
@@ -704,29 +945,27 @@ private:
 		m_kd_tree.build(m_photons);
 	}
 
-	bool spawn_photon_emitter_threads(const t_vec64u num_threads) {
-		if (m_num_render_threads > 1) {
-			std::vector<boost::thread*> threads(m_num_render_threads, NULL);
+	bool spawn_photon_emitter_threads(uint64_t round_idx = 0) {
+		// photons emitted per light, split into chunks; the last may be partial
+		const uint64_t num_photons = m_num_emission_photons / m_num_emission_batches;
+		const uint64_t num_chunks = (num_photons + EMISSION_CHUNK_SIZE - 1) / EMISSION_CHUNK_SIZE;
 
-			// require perfect division of labor
-			assert((num_threads.x() * num_threads.y()) == m_num_render_threads);
-			assert((m_num_emission_photons % (m_num_emission_batches * m_num_render_threads)) == 0);
+		// each round takes the next range of the (Halton) photon sequence
+		const uint64_t base_photon_id = round_idx * num_photons;
 
-			// photons emitted per thread per light
-			const uint64_t k = m_num_emission_photons / (m_num_emission_batches * m_num_render_threads);
-
-			for (uint64_t n = 0; n < m_num_render_threads; n++) {
-				threads[n] = new boost::thread(boost::bind(&t_scene::emit_photons, this, n, k));
-			}
+		m_photons.clear();
 
-			for (uint64_t n = 0; n < threads.size(); n++) {
-				threads[n]->join();
-				delete threads[n];
-			}
-		} else {
-			emit_photons(0, m_num_emission_batches * m_num_emission_photons);
+		for (uint64_t n = 0; n < m_num_render_threads; n++) {
+			m_photon_maps[n].clear();
 		}
 
+		m_thread_pool.run(m_num_emission_batches * num_chunks, [&](size_t task_idx, size_t thread_idx) {
+			const uint64_t light_id = task_idx / num_chunks;
+			const uint64_t photon_id = (task_idx % num_chunks) * EMISSION_CHUNK_SIZE;
+
+			emit_photons(thread_idx, light_id, base_photon_id + photon_id, std::min(EMISSION_CHUNK_SIZE, num_photons - photon_id));
+		});
+
 		// merge the per-thread maps
 		for (uint64_t n = 0; n < m_num_render_threads; n++) {
 			for (uint64_t k = 0; k < m_photon_maps[n].size(); k++) {
@@ -737,16 +976,14 @@ private:
 		return (!m_photons.empty());
 	}
 
-	void emit_photons(const uint64_t thread_id, const uint64_t num_photons) {
+	void emit_photons(const uint64_t thread_id, const uint64_t light_id, const uint64_t photon_id, const uint64_t num_photons) {
 		t_ray ray;
 		t_vec64f pwr;
 
-		for (uint64_t k = 0; k < m_num_emission_batches; k++) {
-			for (uint64_t n = 0; n < num_photons; ++n) {
-				// each batch corresponds to a different light
-				spawn_photon(&ray, &pwr, thread_id * num_photons + n, k);
-				trace_photon(ray, pwr, thread_id, thread_id * num_photons + n, 0, true);
-			}
+		for (uint64_t n = photon_id; n < (photon_id + num_photons); ++n) {
+			// each batch corresponds to a different light
+			spawn_photon(&ray, &pwr, n, light_id);
+			trace_photon(ray, pwr, thread_id, n, 0, true);
 		}
 	}
 
@@ -864,71 +1101,185 @@ private:
 
 
 
-	void spawn_radiance_gatherer_threads(const t_vec64u num_threads) {
-		std::vector<boost::thread*> threads(num_threads.x() * num_threads.y(), NULL);
+	// like trace_photon(..., false) but records where the (weighted) eye
+	// path ends on a diffuse surface rather than estimating radiance there
+	void trace_eye_path(const t_ray& ray, const t_vec64f& wgt, const uint64_t pixel, const uint64_t cur_depth, std::vector<t_hit_point>& hit_points) const {
+		t_ray_intersection ray_int;
 
-		if (num_threads.y() == 0) {
-			gather_radiance(0, t_vec64u(0, 0), t_vec64u(m_image_size_x, m_image_size_y));
+		if ((cur_depth >= m_max_raytrace_depth) || !intersect_objects(ray, ray_int))
 			return;
+
+		const t_vec64f int_pos = ray_int.pos();
+		const t_vec64f int_nrm = ray_int.nrm();
+
+		const t_material& obj_mat = m_objects[ray_int.id()].mat();
+		const t_vec64f& obj_clr = m_objects[ray_int.id()].clr();
+
+		switch (obj_mat.type()) {
+			case MAT_TYPE_DIFF: {
+				hit_points.push_back({int_pos, wgt.mul(obj_clr), t_vec64f(), 0.0, 0.0, pixel});
+			} break;
+
+			case MAT_TYPE_SPEC: {
+				const t_vec64f ref_dir = ray.dir() - int_nrm * 2.0 * int_nrm.inner(ray.dir());
+
+				trace_eye_path(t_ray(int_pos, ref_dir), wgt.mul(obj_clr), pixel, cur_depth + 1, hit_points);
+			} break;
+
+			case MAT_TYPE_REFR: {
+				const t_ray_interaction& ri = obj_mat.calc_fresnel_interaction_dirs(ray.dir(), int_pos, int_nrm, 1.0, 1.5);
+
+				if (ri.internal_reflection()) {
+					trace_eye_path(ri.reflection_ray(), wgt, pixel, cur_depth + 1, hit_points);
+					break;
+				}
+
+				trace_eye_path(ri.reflection_ray(), wgt.mul(obj_clr) * (      ri.reflection_coeff()), pixel, cur_depth + 1, hit_points);
+				trace_eye_path(ri.refraction_ray(), wgt.mul(obj_clr) * (1.0 - ri.reflection_coeff()), pixel, cur_depth + 1, hit_points);
+			} break;
 		}
+	}
 
-		assert((m_image_size_x % num_threads.x()) == 0);
-		assert((m_image_size_y % num_threads.y()) == 0);
+	void spawn_eye_path_tracer_threads() {
+		const uint64_t num_tiles_x = (m_image_size_x + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+		const uint64_t num_tiles_y = (m_image_size_y + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
 
-		for (uint64_t y = 0; y < num_threads.y(); y++) {
-			for (uint64_t x = 0; x < num_threads.x(); x++) {
-				const t_vec64u mins((x + 0) * (m_image_size_x / num_threads.x()), (y + 0) * (m_image_size_y / num_threads.y()));
-				const t_vec64u maxs((x + 1) * (m_image_size_x / num_threads.x()), (y + 1) * (m_image_size_y / num_threads.y()));
+		// per-tile so the merged order (and thus a checkpoint) does not
+		// depend on which thread happened to execute which tile
+		std::vector< std::vector<t_hit_point> > tile_hit_points(num_tiles_x * num_tiles_y);
 
-				assert(threads[y * num_threads.x() + x] == NULL);
-				threads[y * num_threads.x() + x] = new boost::thread(boost::bind(&t_scene::gather_radiance, this, y * num_threads.x() + x, mins, maxs));
+		m_thread_pool.run(num_tiles_x * num_tiles_y, [&](size_t tile_idx, size_t) {
+			const uint64_t tx = tile_idx % num_tiles_x;
+			const uint64_t ty = tile_idx / num_tiles_x;
+
+			for (uint64_t y = ty * RENDER_TILE_SIZE; y < std::min((ty + 1) * RENDER_TILE_SIZE, m_image_size_y); ++y) {
+				for (uint64_t x = tx * RENDER_TILE_SIZE; x < std::min((tx + 1) * RENDER_TILE_SIZE, m_image_size_x); ++x) {
+					for (uint64_t v = 0; v < NUM_AA_RAYS_Y; ++v) {
+						for (uint64_t u = 0; u < NUM_AA_RAYS_X; ++u) {
+							trace_eye_path(calc_pixel_ray(x, y, u, v), t_vec64f(1.0, 1.0, 1.0), y * m_image_size_x + x, 0, tile_hit_points[tile_idx]);
+						}
+					}
+				}
 			}
+		});
+
+		m_hit_points.clear();
+
+		for (const std::vector<t_hit_point>& hit_points: tile_hit_points) {
+			m_hit_points.insert(m_hit_points.end(), hit_points.begin(), hit_points.end());
 		}
+	}
+
+	void spawn_hit_point_updater_threads() {
+		const uint64_t num_chunks = (m_hit_points.size() + HIT_POINT_CHUNK_SIZE - 1) / HIT_POINT_CHUNK_SIZE;
+
+		m_thread_pool.run(num_chunks, [&](size_t chunk_idx, size_t thread_idx) {
+			for (uint64_t i = chunk_idx * HIT_POINT_CHUNK_SIZE; i < std::min((chunk_idx + 1) * HIT_POINT_CHUNK_SIZE, m_hit_points.size()); i++) {
+				update_hit_point(thread_idx, m_hit_points[i]);
+			}
+		});
+	}
+
+	void update_hit_point(const uint64_t thread_id, t_hit_point& hp) {
+		std::vector<t_photon_ngb>& ngbs = m_photon_ngbs[thread_id];
+
+		if (hp.radius_sq == 0.0) {
+			// initial radius is the maximum gather distance if one was
+			// given, otherwise the distance to the k-th nearest photon
+			if (m_max_gather_dist_sq < MAX_COOR_VAL) {
+				hp.radius_sq = m_max_gather_dist_sq;
+			} else if (m_kd_tree.get_nearest_ngbs(ngbs, m_num_radiance_photons, hp.pos, MAX_COOR_VAL)) {
+				hp.radius_sq = ngbs[0].dist_sq;
+			} else {
+				return;
+			}
+		}
+
+		t_vec64f sum_pwr;
+
+		const uint64_t num_photons = m_kd_tree.get_ngbs_in_radius(hp.pos, hp.radius_sq, sum_pwr);
+
+		if (num_photons == 0)
+			return;
+
+		// keep only a fraction of the new photons and shrink the radius
+		// such that the photon density within it stays the same
+		const real64_t new_num_photons = hp.num_photons + PPM_ALPHA * num_photons;
+		const real64_t radius_sq_scale = new_num_photons / (hp.num_photons + num_photons);
+
+		hp.radius_sq *= radius_sq_scale;
+		hp.num_photons = new_num_photons;
+		hp.flux = (hp.flux + sum_pwr / M_PI) * radius_sq_scale;
+	}
+
+	void accumulate_image(uint64_t num_rounds) {
+		// same normalization as gather_radiance, over the photons of all rounds
+		const real64_t scale = 1.0 / (m_num_emission_batches * m_num_emission_photons * num_rounds * NUM_AA_RAYS_X * NUM_AA_RAYS_Y);
+
+		std::fill(m_image.begin(), m_image.end(), t_vec64f());
+
+		for (const t_hit_point& hp: m_hit_points) {
+			if (hp.radius_sq == 0.0)
+				continue;
 
-		for (uint64_t n = 0; n < threads.size(); n++) {
-			threads[n]->join();
-			delete threads[n];
+			m_image[hp.pixel] += hp.wgt.mul(hp.flux) * (scale / (M_PI * hp.radius_sq));
 		}
 	}
 
+
+
+	void spawn_radiance_gatherer_threads() {
+		// the last row and column of tiles may be partial
+		const uint64_t num_tiles_x = (m_image_size_x + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+		const uint64_t num_tiles_y = (m_image_size_y + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+
+		m_thread_pool.run(num_tiles_x * num_tiles_y, [&](size_t tile_idx, size_t thread_idx) {
+			const uint64_t x = tile_idx % num_tiles_x;
+			const uint64_t y = tile_idx / num_tiles_x;
+
+			const t_vec64u mins((x + 0) * RENDER_TILE_SIZE, (y + 0) * RENDER_TILE_SIZE);
+			const t_vec64u maxs(std::min((x + 1) * RENDER_TILE_SIZE, m_image_size_x), std::min((y + 1) * RENDER_TILE_SIZE, m_image_size_y));
+
+			gather_radiance(thread_idx, mins, maxs);
+		});
+	}
+
 	t_vec64f calc_radiance_estimate(const uint64_t thread_id, const t_vec64f pos, const t_vec64f clr) {
+		std::vector<t_photon_ngb>& ngbs = m_photon_ngbs[thread_id];
+
 		t_vec64f est_flux;
 		t_vec64f est_radi;
 
-		// reset the thread caches
-		for (uint64_t n = 0; n < m_num_radiance_photons; n++) {
-			m_photon_ngbs[thread_id][n] = NULL;
-			m_photon_dsts[thread_id][n] = MAX_COOR_VAL;
-		}
-
-		if (!m_kd_tree.get_nearest_ngbs(m_photon_ngbs[thread_id], m_photon_dsts[thread_id], pos))
+		if (!m_kd_tree.get_nearest_ngbs(ngbs, m_num_radiance_photons, pos, m_max_gather_dist_sq))
 			return est_radi;
 
-		uint64_t num_ngb_photons = 0;
-
 		// sum up the flux, normalize it (by the distance of the
 		// furthest-away neighbor) to get the estimated radiance
-		for (uint64_t j = 0; j < m_num_radiance_photons; num_ngb_photons = j++) {
-			const t_photon* p = m_photon_ngbs[thread_id][j];
-
-			// no more neighbors in our buffer
-			if (p == NULL)
-				break;
-
-			est_flux += (p->pwr() / M_PI);
+		for (uint64_t j = 0; j < ngbs.size(); j++) {
+			est_flux += (m_kd_tree.get_photon_pwr(ngbs[j].index) / M_PI);
 		}
 
+		// ngbs is a max-heap, so its first entry is the furthest away
 		est_radi = est_flux.mul(clr);
-		est_radi = est_radi * (1.0 / (M_PI * m_photon_dsts[thread_id][num_ngb_photons]));
-		// est_radi = est_radi * (1.0 / (dsts[num_ngb_photons] * dsts[num_ngb_photons]));
+		est_radi = est_radi * (1.0 / (M_PI * ngbs[0].dist_sq));
 		return est_radi;
 	}
 
+	// primary ray for anti-aliasing sample (u, v) of pixel (x, y)
+	t_ray calc_pixel_ray(const uint64_t x, const uint64_t y, const uint64_t u, const uint64_t v) const {
+		const real64_t aa_rx = 1.0 / NUM_AA_RAYS_X;
+		const real64_t aa_ry = 1.0 / NUM_AA_RAYS_Y;
+
+		const t_vec64f cam_dx  = m_camera.xdir() * ( ((x + u * aa_rx + (aa_rx * 0.5)) / m_image_size_x) - 0.5);
+		const t_vec64f cam_dy  = m_camera.ydir() * (-((y + v * aa_ry + (aa_ry * 0.5)) / m_image_size_y) + 0.5);
+		const t_vec64f pxl_dir = cam_dx + cam_dy + m_camera.zdir();
+
+		return (t_ray(m_camera.pos() + pxl_dir * 150.0, pxl_dir.norm()));
+	}
+
 	void gather_radiance(const uint64_t thread_id, const t_vec64u mins, const t_vec64u maxs) {
 		// inverse of the total number of primary photon rays (inc. AA)
 		const real64_t scale = 1.0 / (m_num_emission_batches * m_num_emission_photons * NUM_AA_RAYS_X * NUM_AA_RAYS_Y);
-		const real64_t aa_rx = 1.0 / NUM_AA_RAYS_X;
-		const real64_t aa_ry = 1.0 / NUM_AA_RAYS_Y;
 
 		#if (USE_OMP == 1)
 		#pragma omp parallel for schedule(dynamic, 1)
@@ -941,12 +1292,7 @@ private:
 				// anti-aliasing rays
 				for (uint64_t v = 0; v < NUM_AA_RAYS_Y; ++v) {
 					for (uint64_t u = 0; u < NUM_AA_RAYS_X; ++u) {
-						const t_vec64f cam_dx  = m_camera.xdir() * ( ((x + u * aa_rx + (aa_rx * 0.5)) / m_image_size_x) - 0.5);
-						const t_vec64f cam_dy  = m_camera.ydir() * (-((y + v * aa_ry + (aa_ry * 0.5)) / m_image_size_y) + 0.5);
-						const t_vec64f pxl_dir = cam_dx + cam_dy + m_camera.zdir();
-						const t_ray    pxl_ray = t_ray(m_camera.pos() + pxl_dir * 150.0, pxl_dir.norm());
-
-						pxl += trace_photon(pxl_ray, pwr, thread_id, y * IMAGE_SIZE_X + x, 0, false);
+						pxl += trace_photon(calc_pixel_ray(x, y, u, v), pwr, thread_id, y * IMAGE_SIZE_X + x, 0, false);
 					}
 				}
 
@@ -962,15 +1308,17 @@ private:
 	std::vector<t_photon> m_photons;
 	std::vector<t_light> m_lights;
 	std::vector<t_vec64f> m_image;
+	std::vector<t_hit_point> m_hit_points;
 
 	// per-thread caches
-	std::vector< std::vector<t_photon > > m_photon_maps;
-	std::vector< std::vector<t_photon*> > m_photon_ngbs;
-	std::vector< std::vector< real64_t> > m_photon_dsts;
+	std::vector< std::vector<t_photon    > > m_photon_maps;
+	std::vector< std::vector<t_photon_ngb> > m_photon_ngbs;
 
 	t_camera m_camera;
 	t_kd_tree m_kd_tree;
 
+	t_work_stealing_pool m_thread_pool;
+
 	uint64_t m_num_emission_batches;
 	uint64_t m_num_emission_photons;
 	uint64_t m_num_radiance_photons;
@@ -980,6 +1328,13 @@ private:
 
 	uint64_t m_max_raytrace_depth;
 	uint64_t m_num_render_threads;
+
+	real64_t m_max_gather_dist_sq;
+	real64_t m_max_render_seconds;
+
+	uint64_t m_num_progressive_rounds;
+
+	std::string m_checkpoint_file;
 };
 
 
@@ -988,7 +1343,7 @@ int main(int argc, char** argv) {
 	t_scene scene(argc, argv);
 
 	scene.render_image();
-	scene.write_image("image.ppm");
+	scene.write_image(IMAGE_FILE_NAME);
 	return 0;
 }
 
@@ -1,16 +1,36 @@
 // Andrew Kensler's submission for the business-card RT challenge
-// (extended with a kd-tree structure and multithreaded rendering)
+// (extended with kd-tree and BVH structures and multithreaded rendering)
 #include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 
 #include <algorithm>
+#include <chrono>
+#include <new>
 #include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+#include "simple_work_stealing_pool.hpp"
 
 #define ENABLE_KDT 1
+#define ENABLE_BVH 1 // takes precedence over the kd-tree if both are enabled
+#define ENABLE_PKT 1 // trace primary rays as 2x2 packets through the BVH
 #define ENABLE_SMP 1
 #define ENABLE_DOF 0
 
+#define RENDER_TILE_SIZE 16u
+
+#define BVH_NUM_BINS 16
+#define BVH_LEAF_SIZE 4
+#define BVH_STACK_SIZE 128
+
+// maximum number of objects the kd-tree can handle; the BVH has no limit
 #define MAX_NUM_OBJECTS 1024
 #define MAX_OBJECT_COLS 32
 #define MAX_OBJECT_ROWS 16
@@ -24,6 +44,7 @@ struct t_params {
 	unsigned int num_threads;
 	unsigned int num_rays_pp;
 	unsigned int max_bounces;
+	unsigned int num_rnd_objs;
 
 	float ray_weight;
 	float dof_weight;
@@ -119,9 +140,35 @@ struct t_kdtree {
 	t_object** objps; // leaf objects (std::vector<*>)
 };
 
+// flattened BVH node; nodes are stored depth-first so the first child
+// of an internal node always directly follows it, and the array itself
+// is cache-line aligned with two nodes per line
+struct alignas(32) t_bvh_node {
+	t_bbox bbox;
+
+	// leaf: index of first object; internal: index of second child
+	uint32_t index;
+	// leaf: number of objects; internal: zero
+	// (shares a word with axis to keep the node at 32 bytes)
+	uint32_t count: 30;
+	// internal: split axis, decides which child is visited first
+	uint32_t axis: 2;
+};
+
+static_assert(sizeof(t_bvh_node) == 32, "");
+
+struct t_bvh {
+	t_bvh_node* nodes;
+	t_object* objects; // copies of the scene objects, in leaf order
+
+	unsigned int num_nodes;
+	unsigned int num_objects;
+};
+
 struct t_scene {
 	t_object* objects;
 	t_kdtree* kdtree;
+	t_bvh bvh;
 	t_camera camera;
 	t_params params;
 
@@ -212,7 +259,7 @@ static unsigned int init_objects(t_scene& scene) {
 	t_object* objs = scene.objects;
 	t_kdtree* kdt = scene.kdtree;
 
-	t_bbox& bbox = kdt->bbox;
+	t_bbox bbox;
 
 	bbox.mins = t_type3f( 1e6f,  1e6f,  1e6f);
 	bbox.maxs = t_type3f(-1e6f, -1e6f, -1e6f);
@@ -225,7 +272,6 @@ static unsigned int init_objects(t_scene& scene) {
 
 	assert(num_object_rows <= MAX_OBJECT_ROWS);
 	assert(num_object_cols <= MAX_OBJECT_COLS);
-	assert((MAX_OBJECT_ROWS * MAX_OBJECT_COLS) < MAX_NUM_OBJECTS);
 
 	for (unsigned int j = 0; j < num_object_rows; j++) {
 		#if 0
@@ -252,16 +298,32 @@ static unsigned int init_objects(t_scene& scene) {
 
 			obj.p = t_type3f(-2.5f + num_object_cols - k, 0.0f, num_object_rows - j);
 			obj.r = 1.0f;
-
-			bbox.mins.x = std::min(bbox.mins.x, obj.p.x - obj.r);
-			bbox.mins.y = std::min(bbox.mins.y, obj.p.y - obj.r);
-			bbox.mins.z = std::min(bbox.mins.z, obj.p.z - obj.r);
-			bbox.maxs.x = std::max(bbox.maxs.x, obj.p.x + obj.r);
-			bbox.maxs.y = std::max(bbox.maxs.y, obj.p.y + obj.r);
-			bbox.maxs.z = std::max(bbox.maxs.z, obj.p.z + obj.r);
 		}
 	}
 
+	// scatter small random spheres over the ground in view of the camera
+	for (unsigned int n = 0; n < scene.params.num_rnd_objs; n++) {
+		t_object& obj = objs[num_objs++];
+
+		obj.r = urnd(0.05f, 0.25f);
+		obj.p = t_type3f(urnd(-40.0f, 40.0f), urnd(-80.0f, 10.0f), obj.r);
+	}
+
+	for (unsigned int n = 0; n < num_objs; n++) {
+		const t_object& obj = objs[n];
+
+		bbox.mins.x = std::min(bbox.mins.x, obj.p.x - obj.r);
+		bbox.mins.y = std::min(bbox.mins.y, obj.p.y - obj.r);
+		bbox.mins.z = std::min(bbox.mins.z, obj.p.z - obj.r);
+		bbox.maxs.x = std::max(bbox.maxs.x, obj.p.x + obj.r);
+		bbox.maxs.y = std::max(bbox.maxs.y, obj.p.y + obj.r);
+		bbox.maxs.z = std::max(bbox.maxs.z, obj.p.z + obj.r);
+	}
+
+	// only the kd-tree root needs this, the bvh computes its own bounds
+	if (kdt != nullptr)
+		kdt->bbox = bbox;
+
 	// sentinel
 	objs[num_objs].r = -1.0f;
 	return num_objs;
@@ -332,15 +394,201 @@ static void init_kdtree(
 	init_kdtree(scn_objs, tmp_objs, scn_kdt->nodes[1], tmp_kdt, (node_axis + 1) % AXIS_COUNT, cur_depth + 1, max_depth);
 }
 
+static t_bbox calc_object_bbox(const t_object& obj) {
+	return {obj.p - t_type3f(obj.r, obj.r, obj.r), obj.p + t_type3f(obj.r, obj.r, obj.r)};
+}
+
+static t_bbox merge_bboxes(const t_bbox& a, const t_bbox& b) {
+	return {
+		t_type3f(std::min(a.mins.x, b.mins.x), std::min(a.mins.y, b.mins.y), std::min(a.mins.z, b.mins.z)),
+		t_type3f(std::max(a.maxs.x, b.maxs.x), std::max(a.maxs.y, b.maxs.y), std::max(a.maxs.z, b.maxs.z)),
+	};
+}
+
+static float calc_bbox_area(const t_bbox& box) {
+	const t_type3f d = box.maxs - box.mins;
+	return ((d.x * d.y + d.y * d.z + d.z * d.x) * 2.0f);
+}
+
+static const t_bbox EMPTY_BBOX = {t_type3f(1e30f, 1e30f, 1e30f), t_type3f(-1e30f, -1e30f, -1e30f)};
+
+
+// builds the subtree over objects <indcs[beg, end)>, returns its root index
+static unsigned int init_bvh_node(
+	t_bvh& bvh,
+	const t_object* objs,
+	const t_bbox* boxes,
+	unsigned int* indcs,
+	unsigned int beg,
+	unsigned int end
+) {
+	const unsigned int node_idx = bvh.num_nodes++;
+	const unsigned int num_objs = end - beg;
+
+	t_bvh_node& node = bvh.nodes[node_idx];
+
+	t_bbox node_box = EMPTY_BBOX;
+	t_bbox cent_box = EMPTY_BBOX;
+
+	for (unsigned int i = beg; i < end; i++) {
+		node_box = merge_bboxes(node_box, boxes[indcs[i]]);
+		cent_box = merge_bboxes(cent_box, {objs[indcs[i]].p, objs[indcs[i]].p});
+	}
+
+	node.bbox = node_box;
+	node.index = beg;
+	node.count = num_objs;
+	node.axis = 0;
+
+	if (num_objs <= BVH_LEAF_SIZE)
+		return node_idx;
+
+	// binned SAH; evaluate every bin boundary along every axis
+	// and keep the one with the lowest estimated traversal cost
+	float best_cost = 1e30f;
+	unsigned int best_axis = AXIS_COUNT;
+	unsigned int best_split = 0;
+
+	for (unsigned int axis = 0; axis < AXIS_COUNT; axis++) {
+		const float cmin = cent_box.mins[axis];
+		const float cext = cent_box.maxs[axis] - cmin;
+
+		if (cext <= 1e-6f)
+			continue;
+
+		t_bbox bin_boxes[BVH_NUM_BINS];
+		unsigned int bin_counts[BVH_NUM_BINS] = {0};
+
+		std::fill(&bin_boxes[0], &bin_boxes[BVH_NUM_BINS], EMPTY_BBOX);
+
+		for (unsigned int i = beg; i < end; i++) {
+			const unsigned int b = std::min(BVH_NUM_BINS - 1, int(BVH_NUM_BINS * (objs[indcs[i]].p[axis] - cmin) / cext));
+
+			bin_boxes[b] = merge_bboxes(bin_boxes[b], boxes[indcs[i]]);
+			bin_counts[b] += 1;
+		}
+
+		// sweep from the right to get the area and count of every suffix
+		float rgt_areas[BVH_NUM_BINS];
+		unsigned int rgt_counts[BVH_NUM_BINS];
+
+		t_bbox rgt_box = EMPTY_BBOX;
+		unsigned int rgt_count = 0;
+
+		for (unsigned int b = BVH_NUM_BINS - 1; b > 0; b--) {
+			rgt_box = merge_bboxes(rgt_box, bin_boxes[b]);
+			rgt_count += bin_counts[b];
+
+			rgt_areas[b] = calc_bbox_area(rgt_box);
+			rgt_counts[b] = rgt_count;
+		}
+
+		t_bbox lft_box = EMPTY_BBOX;
+		unsigned int lft_count = 0;
+
+		for (unsigned int b = 1; b < BVH_NUM_BINS; b++) {
+			lft_box = merge_bboxes(lft_box, bin_boxes[b - 1]);
+			lft_count += bin_counts[b - 1];
+
+			if (lft_count == 0 || rgt_counts[b] == 0)
+				continue;
+
+			const float cost = calc_bbox_area(lft_box) * lft_count + rgt_areas[b] * rgt_counts[b];
+
+			if (cost >= best_cost)
+				continue;
+
+			best_cost = cost;
+			best_axis = axis;
+			best_split = b;
+		}
+	}
+
+	// all centroids coincide; nothing sensible to split on
+	if (best_axis == AXIS_COUNT)
+		return node_idx;
+
+	// stop if intersecting everything is cheaper than traversing (unit
+	// cost per object, one for the node itself) unless the leaf would
+	// become too big
+	if ((1.0f + best_cost / calc_bbox_area(node_box)) >= num_objs && num_objs <= (BVH_LEAF_SIZE * 4))
+		return node_idx;
+
+	const float cmin = cent_box.mins[best_axis];
+	const float cext = cent_box.maxs[best_axis] - cmin;
+
+	const unsigned int* mid = std::partition(&indcs[beg], &indcs[end], [&](unsigned int i) {
+		return (std::min(BVH_NUM_BINS - 1, int(BVH_NUM_BINS * (objs[i].p[best_axis] - cmin) / cext)) < int(best_split));
+	});
+
+	node.count = 0;
+	node.axis = best_axis;
+
+	init_bvh_node(bvh, objs, boxes, indcs, beg, mid - indcs);
+	node.index = init_bvh_node(bvh, objs, boxes, indcs, mid - indcs, end);
+	return node_idx;
+}
+
+static void init_bvh(t_bvh& bvh, const t_object* objs) {
+	unsigned int num_objs = 0;
+
+	while (objs[num_objs].r != -1.0f)
+		num_objs += 1;
+
+	// leaf counts are stored in 30 bits
+	assert(num_objs < (1u << 30));
+
+	std::vector<t_bbox> boxes(num_objs);
+	std::vector<unsigned int> indcs(num_objs);
+
+	for (unsigned int n = 0; n < num_objs; n++) {
+		boxes[n] = calc_object_bbox(objs[n]);
+		indcs[n] = n;
+	}
+
+	// a binary tree over N leaves never has more than 2N-1 nodes
+	bvh.nodes = static_cast<t_bvh_node*>(::operator new(sizeof(t_bvh_node) * std::max(num_objs * 2, 1u), std::align_val_t(64)));
+	bvh.objects = new t_object[std::max(num_objs, 1u)];
+	bvh.num_nodes = 0;
+	bvh.num_objects = num_objs;
+
+	if (num_objs == 0) {
+		bvh.nodes[bvh.num_nodes++] = {EMPTY_BBOX, 0, 0, 0};
+		return;
+	}
+
+	init_bvh_node(bvh, objs, boxes.data(), indcs.data(), 0, num_objs);
+
+	// store the objects in leaf order so each leaf is a contiguous run
+	for (unsigned int n = 0; n < num_objs; n++) {
+		bvh.objects[n] = objs[indcs[n]];
+	}
+}
+
 static void create_scene(t_scene& scene) {
 	scene.wlp = t_type3f(9.0f,  9.0f, 16.0f);
 	scene.wuv = t_type3f(0.0f,  0.0f,  1.0f);
 
+	// one extra for the sentinel
+	scene.objects = new t_object[MAX_OBJECT_ROWS * MAX_OBJECT_COLS + scene.params.num_rnd_objs + 1];
+	scene.kdtree = nullptr;
+
+	// seeded twice so the random objects do not change the render's own sequence
+	srandom(scene.params.random_seed);
+
+	#if (ENABLE_BVH == 1)
+	init_objects(scene);
+
+	const auto t0 = std::chrono::steady_clock::now();
+	init_bvh(scene.bvh, scene.objects);
+	const auto t1 = std::chrono::steady_clock::now();
+
+	// image goes to stdout
+	fprintf(stderr, "[%s] objects=%u bvh_nodes=%u bvh_build_ms=%.2f\n", __func__, scene.bvh.num_objects, scene.bvh.num_nodes, std::chrono::duration<double, std::milli>(t1 - t0).count());
+	#else
 	// node and object allocation pools
 	static t_kdtree kdts[512];
-	static t_object objs[MAX_NUM_OBJECTS];
 
-	scene.objects = &objs[0];
 	scene.kdtree = &kdts[0];
 
 	// temporary object-pointer storage
@@ -351,14 +599,27 @@ static void create_scene(t_scene& scene) {
 	t_object** tmp_obj = &tmp_objs[0];
 	t_kdtree* tmp_kdt = &kdts[1];
 
-	init_objects(scene);
-	init_kdtree(scene.objects, tmp_obj, scene.kdtree, tmp_kdt);
-	init_camera(scene);
+	const unsigned int num_objs = init_objects(scene);
 
+	assert(num_objs < MAX_NUM_OBJECTS);
+	init_kdtree(scene.objects, tmp_obj, scene.kdtree, tmp_kdt);
 	assert(size_t(tmp_kdt - &kdts[0]) < (sizeof(kdts) / sizeof(kdts[0])));
+	#endif
+
+	init_camera(scene);
 	srandom(scene.params.random_seed);
 }
 
+static void destroy_scene(t_scene& scene) {
+	#if (ENABLE_BVH == 1)
+	::operator delete(scene.bvh.nodes, std::align_val_t(64));
+	delete[] scene.bvh.objects;
+	#endif
+
+	delete[] scene.objects;
+	delete[] scene.camera.image.pdata;
+}
+
 
 
 static bool intersect_sphere(const t_object& obj, const t_ray& ray, t_hit& ray_hit) {
@@ -482,6 +743,199 @@ static bool intersect_kdtree(const t_kdtree& kdt, const t_ray& ray, t_hit& ray_h
 
 
 
+// slab test against a ray given by its origin and inverse direction; only
+// hits closer than <max_t> count, since anything beyond can not improve
+static bool intersect_bvh_box(const t_bbox& box, const t_type3f& pos, const t_type3f& inv_dir, float max_t) {
+	const float tx0 = (box.mins.x - pos.x) * inv_dir.x, tx1 = (box.maxs.x - pos.x) * inv_dir.x;
+	const float ty0 = (box.mins.y - pos.y) * inv_dir.y, ty1 = (box.maxs.y - pos.y) * inv_dir.y;
+	const float tz0 = (box.mins.z - pos.z) * inv_dir.z, tz1 = (box.maxs.z - pos.z) * inv_dir.z;
+
+	const float tmin = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+	const float tmax = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), max_t));
+
+	return (tmin <= tmax);
+}
+
+static t_type3f calc_inv_dir(const t_type3f& dir) {
+	// avoid infinities (and 0*inf NaN's in the slab test) for axis-parallel rays
+	const float x = (std::fabs(dir.x) > 1e-12f)? (1.0f / dir.x): std::copysign(1e30f, dir.x);
+	const float y = (std::fabs(dir.y) > 1e-12f)? (1.0f / dir.y): std::copysign(1e30f, dir.y);
+	const float z = (std::fabs(dir.z) > 1e-12f)? (1.0f / dir.z): std::copysign(1e30f, dir.z);
+	return (t_type3f(x, y, z));
+}
+
+static bool intersect_bvh(const t_bvh& bvh, const t_ray& ray, t_hit& ray_hit) {
+	const t_type3f inv_dir = calc_inv_dir(ray.dir);
+	const bool neg_dir[AXIS_COUNT] = {ray.dir.x < 0.0f, ray.dir.y < 0.0f, ray.dir.z < 0.0f};
+
+	unsigned int stack[BVH_STACK_SIZE];
+	unsigned int stack_size = 0;
+	unsigned int node_idx = 0;
+
+	bool ret = false;
+
+	while (true) {
+		const t_bvh_node& node = bvh.nodes[node_idx];
+
+		if (intersect_bvh_box(node.bbox, ray.pos, inv_dir, ray_hit.t)) {
+			if (node.count != 0) {
+				for (unsigned int i = node.index; i < (node.index + node.count); i++) {
+					ret |= intersect_sphere(bvh.objects[i], ray, ray_hit);
+				}
+			} else {
+				assert(stack_size < BVH_STACK_SIZE);
+
+				// descend into the near child first, so the far child
+				// can often be culled by the hit found in the near one
+				if (neg_dir[node.axis]) {
+					stack[stack_size++] = node_idx + 1;
+					node_idx = node.index;
+				} else {
+					stack[stack_size++] = node.index;
+					node_idx = node_idx + 1;
+				}
+
+				continue;
+			}
+		}
+
+		if (stack_size == 0)
+			break;
+
+		node_idx = stack[--stack_size];
+	}
+
+	return ret;
+}
+
+
+// four coherent rays (sharing an origin) traced together; a node is
+// visited if any active ray hits it, so the per-node cost is shared
+struct t_ray_packet {
+	float dx[4], dy[4], dz[4];
+	float ix[4], iy[4], iz[4];
+	float t[4];
+
+	t_type3f pos;
+
+	int obj[4]; // index of closest object (-1 if none)
+};
+
+#if defined(__SSE2__)
+static int intersect_packet_box(const t_bbox& box, const t_ray_packet& pkt) {
+	const __m128 ix = _mm_loadu_ps(pkt.ix);
+	const __m128 iy = _mm_loadu_ps(pkt.iy);
+	const __m128 iz = _mm_loadu_ps(pkt.iz);
+
+	const __m128 tx0 = _mm_mul_ps(_mm_set1_ps(box.mins.x - pkt.pos.x), ix), tx1 = _mm_mul_ps(_mm_set1_ps(box.maxs.x - pkt.pos.x), ix);
+	const __m128 ty0 = _mm_mul_ps(_mm_set1_ps(box.mins.y - pkt.pos.y), iy), ty1 = _mm_mul_ps(_mm_set1_ps(box.maxs.y - pkt.pos.y), iy);
+	const __m128 tz0 = _mm_mul_ps(_mm_set1_ps(box.mins.z - pkt.pos.z), iz), tz1 = _mm_mul_ps(_mm_set1_ps(box.maxs.z - pkt.pos.z), iz);
+
+	__m128 tmin = _mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1));
+	__m128 tmax = _mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1));
+
+	tmin = _mm_max_ps(tmin, _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+	tmax = _mm_min_ps(tmax, _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_loadu_ps(pkt.t)));
+
+	// one bit per ray that hits the box
+	return (_mm_movemask_ps(_mm_cmple_ps(tmin, tmax)));
+}
+
+static void intersect_packet_sphere(const t_object& obj, int obj_idx, t_ray_packet& pkt) {
+	const t_type3f dif = pkt.pos - obj.p;
+
+	const __m128 dx = _mm_loadu_ps(pkt.dx);
+	const __m128 dy = _mm_loadu_ps(pkt.dy);
+	const __m128 dz = _mm_loadu_ps(pkt.dz);
+
+	// same math as intersect_sphere, c does not depend on the direction
+	const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(dif.x), dx), _mm_mul_ps(_mm_set1_ps(dif.y), dy)), _mm_mul_ps(_mm_set1_ps(dif.z), dz));
+	const __m128 c = _mm_set1_ps(dif % dif - obj.r * obj.r);
+	const __m128 q = _mm_sub_ps(_mm_mul_ps(b, b), c);
+	const __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), b), _mm_sqrt_ps(_mm_max_ps(q, _mm_setzero_ps())));
+
+	const __m128 old_t = _mm_loadu_ps(pkt.t);
+	const __m128 mask = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(q, _mm_setzero_ps()), _mm_cmpgt_ps(t, _mm_set1_ps(0.01f))), _mm_cmplt_ps(t, old_t));
+	const int bits = _mm_movemask_ps(mask);
+
+	if (bits == 0)
+		return;
+
+	_mm_storeu_ps(pkt.t, _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, old_t)));
+
+	for (unsigned int i = 0; i < 4; i++) {
+		if ((bits & (1 << i)) != 0)
+			pkt.obj[i] = obj_idx;
+	}
+}
+#else
+static int intersect_packet_box(const t_bbox& box, const t_ray_packet& pkt) {
+	int bits = 0;
+
+	for (unsigned int i = 0; i < 4; i++) {
+		bits |= (intersect_bvh_box(box, pkt.pos, t_type3f(pkt.ix[i], pkt.iy[i], pkt.iz[i]), pkt.t[i]) << i);
+	}
+
+	return bits;
+}
+
+static void intersect_packet_sphere(const t_object& obj, int obj_idx, t_ray_packet& pkt) {
+	for (unsigned int i = 0; i < 4; i++) {
+		const t_type3f dir = t_type3f(pkt.dx[i], pkt.dy[i], pkt.dz[i]);
+		const t_ray ray = {pkt.pos, pkt.pos + dir * 1e6f, dir};
+
+		t_hit ray_hit;
+		ray_hit.t = pkt.t[i];
+
+		if (!intersect_sphere(obj, ray, ray_hit))
+			continue;
+
+		pkt.t[i] = ray_hit.t;
+		pkt.obj[i] = obj_idx;
+	}
+}
+#endif
+
+static void intersect_bvh_packet(const t_bvh& bvh, t_ray_packet& pkt) {
+	// coherent rays, so the first one decides the visiting order
+	const bool neg_dir[AXIS_COUNT] = {pkt.dx[0] < 0.0f, pkt.dy[0] < 0.0f, pkt.dz[0] < 0.0f};
+
+	unsigned int stack[BVH_STACK_SIZE];
+	unsigned int stack_size = 0;
+	unsigned int node_idx = 0;
+
+	while (true) {
+		const t_bvh_node& node = bvh.nodes[node_idx];
+
+		if (intersect_packet_box(node.bbox, pkt) != 0) {
+			if (node.count != 0) {
+				for (unsigned int i = node.index; i < (node.index + node.count); i++) {
+					intersect_packet_sphere(bvh.objects[i], i, pkt);
+				}
+			} else {
+				assert(stack_size < BVH_STACK_SIZE);
+
+				if (neg_dir[node.axis]) {
+					stack[stack_size++] = node_idx + 1;
+					node_idx = node.index;
+				} else {
+					stack[stack_size++] = node.index;
+					node_idx = node_idx + 1;
+				}
+
+				continue;
+			}
+		}
+
+		if (stack_size == 0)
+			break;
+
+		node_idx = stack[--stack_size];
+	}
+}
+
+
+
 static t_hit intersect_scene(const t_scene& scene, const t_ray& ray) {
 	const float t_ground = -ray.pos.z / ray.dir.z;
 
@@ -497,7 +951,9 @@ static t_hit intersect_scene(const t_scene& scene, const t_ray& ray) {
 		ray_hit.m = HIT_GROUND;
 	}
 
-	#if (ENABLE_KDT == 1)
+	#if (ENABLE_BVH == 1)
+	intersect_bvh(scene.bvh, ray, ray_hit);
+	#elif (ENABLE_KDT == 1)
 	intersect_kdtree(*scene.kdtree, ray, ray_hit);
 	#else
 	for (unsigned int n = 0; (scene.objects[n].r != -1.0f); n++) {
@@ -510,12 +966,51 @@ static t_hit intersect_scene(const t_scene& scene, const t_ray& ray) {
 
 
 
-static t_type3f shade_pixel(const t_scene& scene, const t_ray& ray, unsigned int num_bounces = 0) {
-	if (num_bounces >= scene.params.max_bounces)
-		return (t_type3f());
+// fills in a hit for each ray of the packet; same result as calling
+// intersect_scene for every ray individually
+static void intersect_scene_packet(const t_scene& scene, const t_ray* rays, t_hit* ray_hits) {
+	t_ray_packet pkt;
+
+	pkt.pos = rays[0].pos;
+
+	for (unsigned int i = 0; i < 4; i++) {
+		const t_type3f inv_dir = calc_inv_dir(rays[i].dir);
+		const float t_ground = -rays[i].pos.z / rays[i].dir.z;
+
+		assert(rays[i].pos.x == pkt.pos.x && rays[i].pos.y == pkt.pos.y && rays[i].pos.z == pkt.pos.z);
+
+		pkt.dx[i] = rays[i].dir.x; pkt.ix[i] = inv_dir.x;
+		pkt.dy[i] = rays[i].dir.y; pkt.iy[i] = inv_dir.y;
+		pkt.dz[i] = rays[i].dir.z; pkt.iz[i] = inv_dir.z;
+
+		pkt.t[i] = (t_ground > 0.01f)? t_ground: 1e6f;
+		pkt.obj[i] = -1;
+	}
+
+	intersect_bvh_packet(scene.bvh, pkt);
+
+	for (unsigned int i = 0; i < 4; i++) {
+		const t_ray& ray = rays[i];
+		t_hit& ray_hit = ray_hits[i];
+
+		ray_hit.t = pkt.t[i];
+		ray_hit.p = ray.pos + ray.dir * ray_hit.t;
+
+		if (pkt.obj[i] >= 0) {
+			ray_hit.n = !((ray.pos - scene.bvh.objects[pkt.obj[i]].p) + ray.dir * ray_hit.t);
+			ray_hit.m = HIT_OBJECT;
+			continue;
+		}
 
-	const t_hit& ray_hit = intersect_scene(scene, ray);
+		ray_hit.n = scene.wuv;
+		ray_hit.m = (ray_hit.t < 1e6f)? HIT_GROUND: HIT_NONE;
+	}
+}
 
+
+
+static t_type3f shade_pixel(const t_scene& scene, const t_ray& ray, unsigned int num_bounces = 0);
+static t_type3f shade_hit(const t_scene& scene, const t_ray& ray, const t_hit& ray_hit, unsigned int num_bounces) {
 	// sky (i.e. no) intersection
 	if (ray_hit.m == HIT_NONE)
 		return (DEF_COLORS[3] * std::pow(1.0f - ray.dir.z, 4.0f));
@@ -550,6 +1045,13 @@ static t_type3f shade_pixel(const t_scene& scene, const t_ray& ray, unsigned int
 	return (t_type3f(lobe, lobe, lobe) + shade_pixel(scene, ref_ray, num_bounces + 1) * 0.666f);
 }
 
+static t_type3f shade_pixel(const t_scene& scene, const t_ray& ray, unsigned int num_bounces) {
+	if (num_bounces >= scene.params.max_bounces)
+		return (t_type3f());
+
+	return (shade_hit(scene, ray, intersect_scene(scene, ray), num_bounces));
+}
+
 static t_type3f trace_rays(const t_scene& scene, const t_camera& cam, unsigned int x, unsigned int y) {
 	t_type3f pxl_col = DEF_COLORS[2];
 
@@ -579,10 +1081,64 @@ static t_type3f trace_rays(const t_scene& scene, const t_camera& cam, unsigned i
 	return pxl_col;
 }
 
+// traces the primary rays for (up to) a 2x2 pixel quad as one packet;
+// unused lanes duplicate the first pixel and their results are dropped
+static void trace_ray_packet(const t_scene& scene, const t_camera& cam, const unsigned int* xs, const unsigned int* ys, unsigned int n, t_type3f* cols) {
+	t_ray rays[4];
+	t_hit hits[4];
+
+	for (unsigned int i = 0; i < 4; i++) {
+		const unsigned int j = i * (i < n);
+		const t_type3f raw_dir = cam.ipo + (cam.xdir * xs[j]) + (cam.zdir * ys[j]);
+		const t_type3f pxl_dir = !raw_dir;
+
+		rays[i] = {cam.pos, cam.pos + pxl_dir * 1e6f, pxl_dir};
+	}
+
+	intersect_scene_packet(scene, rays, hits);
+
+	for (unsigned int i = 0; i < n; i++) {
+		cols[i] = DEF_COLORS[2];
+
+		if (scene.params.max_bounces == 0)
+			continue;
+
+		cols[i] = cols[i] + shade_hit(scene, rays[i], hits[i], 0) * scene.params.ray_weight;
+	}
+}
+
 static void render_image_block(const t_scene& scene, const t_block& block) {
 	t_camera& cam = const_cast<t_camera&>(scene.camera);
 	t_image& img = cam.image;
 
+	#if (ENABLE_PKT == 1 && ENABLE_BVH == 1 && ENABLE_DOF == 0)
+	for (unsigned int y = block.ymin; y < block.ymax; y += 2) {
+		for (unsigned int x = block.xmin; x < block.xmax; x += 2) {
+			unsigned int xs[4];
+			unsigned int ys[4];
+			unsigned int n = 0;
+
+			t_type3f cols[4];
+
+			for (unsigned int v = y; v < std::min(y + 2, block.ymax); v++) {
+				for (unsigned int u = x; u < std::min(x + 2, block.xmax); u++) {
+					xs[n] = u;
+					ys[n] = v;
+					n += 1;
+				}
+			}
+
+			trace_ray_packet(scene, cam, xs, ys, n, cols);
+
+			for (unsigned int i = 0; i < n; i++) {
+				img.pdata[ys[i] * img.xsize + xs[i]] = cols[i];
+			}
+		}
+	}
+
+	return;
+	#endif
+
 	for (unsigned int y = block.ymax; (y--) != block.ymin; ) {
 		for (unsigned int x = block.xmax; (x--) != block.xmin; ) {
 			img.pdata[y * img.xsize + x] = trace_rays(scene, cam, x, y);
@@ -590,55 +1146,43 @@ static void render_image_block(const t_scene& scene, const t_block& block) {
 	}
 }
 
-static void render_image_mt(const t_scene& scene, unsigned int num_threads_x, unsigned int num_threads_y) {
+static void render_image_mt(const t_scene& scene, unsigned int num_threads) {
 	const t_camera& cam = scene.camera;
 	const t_image& img = cam.image;
 
-	t_block block = {0, 0, img.xsize, img.ysize};
-
-	#if (ENABLE_SMP == 1)
-	if (num_threads_y == 0)
+	#if (ENABLE_SMP == 0)
+	num_threads = 1;
 	#endif
-	{
-		render_image_block(scene, block);
-		return;
-	}
 
-	assert((num_threads_x * num_threads_y) <= 256);
-	assert((img.xsize % num_threads_x) == 0);
-	assert((img.ysize % num_threads_y) == 0);
+	// the last row and column of tiles may be partial, so the image
+	// size does not have to be a multiple of the tile size
+	const unsigned int num_tiles_x = (img.xsize + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+	const unsigned int num_tiles_y = (img.ysize + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
 
-	std::thread threads[256];
+	t_work_stealing_pool pool(num_threads);
 
-	for (unsigned int y = 0; y < num_threads_y; y++) {
-		for (unsigned int x = 0; x < num_threads_x; x++) {
-			block.xmin = (x + 0) * (img.xsize / num_threads_x);
-			block.ymin = (y + 0) * (img.ysize / num_threads_y);
-			block.xmax = (x + 1) * (img.xsize / num_threads_x);
-			block.ymax = (y + 1) * (img.ysize / num_threads_y);
+	// many more tiles than threads; whichever thread runs out of work
+	// steals tiles from the others, so costly regions are shared out
+	pool.run(num_tiles_x * num_tiles_y, [&](size_t tile_idx, size_t) {
+		const unsigned int x = tile_idx % num_tiles_x;
+		const unsigned int y = tile_idx / num_tiles_x;
 
-			threads[y * num_threads_x + x] = std::move(std::thread(&render_image_block, std::cref(scene), block));
-		}
-	}
+		const t_block block = {
+			(x + 0) * RENDER_TILE_SIZE,
+			(y + 0) * RENDER_TILE_SIZE,
+			std::min((x + 1) * RENDER_TILE_SIZE, img.xsize),
+			std::min((y + 1) * RENDER_TILE_SIZE, img.ysize),
+		};
 
-	for (unsigned int n = 0; n < (num_threads_x * num_threads_y); n++) {
-		threads[n].join();
-	}
+		render_image_block(scene, block);
+	});
+
+	// image goes to stdout
+	pool.log_stats(stderr, __func__);
 }
 
 static void render_image(const t_scene& scene) {
-	switch (scene.params.num_threads) {
-		case   1: { render_image_mt(scene,  1,  0); } break;
-		case   2: { render_image_mt(scene,  1,  2); } break;
-		case   4: { render_image_mt(scene,  2,  2); } break;
-		case   8: { render_image_mt(scene,  2,  4); } break;
-		case  16: { render_image_mt(scene,  4,  4); } break;
-		case  32: { render_image_mt(scene,  4,  8); } break;
-		case  64: { render_image_mt(scene,  8,  8); } break;
-		case 128: { render_image_mt(scene,  8, 16); } break;
-		case 256: { render_image_mt(scene, 16, 16); } break;
-		default: { assert(false); } break;
-	}
+	render_image_mt(scene, std::max(scene.params.num_threads, 1u));
 }
 
 static void output_image(const t_scene& scene) {
@@ -666,6 +1210,7 @@ void parse_params(int argc, char** argv, t_params& params) {
 	params.num_threads = 16;
 	params.num_rays_pp = 64 * ENABLE_DOF;
 	params.max_bounces = 3;
+	params.num_rnd_objs = 0;
 
 	for (int i = 0; i < (argc - 1); i++) {
 		if (std::strcmp(argv[i], "--isx") == 0) { params.img_size_x  = std::atoi(argv[i + 1]); continue; }
@@ -674,6 +1219,7 @@ void parse_params(int argc, char** argv, t_params& params) {
 		if (std::strcmp(argv[i], "--nts") == 0) { params.num_threads = std::atoi(argv[i + 1]); continue; }
 		if (std::strcmp(argv[i], "--rpp") == 0) { params.num_rays_pp = std::atoi(argv[i + 1]); continue; }
 		if (std::strcmp(argv[i], "--nrb") == 0) { params.max_bounces = std::atoi(argv[i + 1]); continue; }
+		if (std::strcmp(argv[i], "--nro") == 0) { params.num_rnd_objs = std::atoi(argv[i + 1]); continue; }
 
 	}
 
@@ -688,6 +1234,7 @@ int main(int argc, char** argv) {
 	create_scene(scene);
 	render_image(scene);
 	output_image(scene);
+	destroy_scene(scene);
 	return 0;
 }
 
@@ -1,12 +1,24 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
 #include <vector>
 
 #include <cassert>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <ctime>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
 // typedef unsigned int uint_type;
 typedef size_t uint_type;
 
@@ -27,6 +39,9 @@ static const uint_type DATA_POINT_COOR_RANGE_Y = 100;
 // regression
 static const float DEMING_REGRESSION_DELTA = 1.0f;
 
+// points per (cache-resident) chunk of the two-pass batch kernels
+static const uint_type REGRESSION_BATCH_SIZE = 1024;
+
 template<typename t> t square(t x) { return (x * x); }
 
 template<typename t> struct t_point {
@@ -59,39 +74,323 @@ typedef t_point<  int> t_point2i;
 
 
 
-template<typename point_type>
-void simple_line_regression(
-	const std::vector<point_type>& data_points,
-	      std::vector<point_type>& data_params
-) {
-	assert(data_points.size() >= 2);
+#if (HAVE_X86_SIMD == 1)
+// sums of x and y, then of the squared and cross deviations from their
+// means, over <n> points; all in double with four lanes per accumulator
+__attribute__((target("avx2,fma")))
+static void calc_batch_moments_avx2(const float* xs, const float* ys, size_t n, double* moments) {
+	__m256d sx = _mm256_setzero_pd();
+	__m256d sy = _mm256_setzero_pd();
 
-	point_type means;
-	point_type sigmas;
-	point_type coeffs;
+	size_t i = 0;
 
-	// calculate means (x,y)
-	for (uint_type n = 0; n < data_points.size(); n++) {
-		means += data_points[n];
+	for (; (i + 4) <= n; i += 4) {
+		sx = _mm256_add_pd(sx, _mm256_cvtps_pd(_mm_loadu_ps(xs + i)));
+		sy = _mm256_add_pd(sy, _mm256_cvtps_pd(_mm_loadu_ps(ys + i)));
 	}
 
-	means /= data_points.size();
+	double lanes[4];
+	double sum_x = 0.0;
+	double sum_y = 0.0;
+
+	_mm256_storeu_pd(lanes, sx); sum_x = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	_mm256_storeu_pd(lanes, sy); sum_y = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+	for (; i < n; i++) {
+		sum_x += xs[i];
+		sum_y += ys[i];
+	}
+
+	const double mean_x = sum_x / n;
+	const double mean_y = sum_y / n;
+
+	const __m256d mx = _mm256_set1_pd(mean_x);
+	const __m256d my = _mm256_set1_pd(mean_y);
+
+	__m256d sxx = _mm256_setzero_pd();
+	__m256d syy = _mm256_setzero_pd();
+	__m256d sxy = _mm256_setzero_pd();
+
+	for (i = 0; (i + 4) <= n; i += 4) {
+		const __m256d dx = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(xs + i)), mx);
+		const __m256d dy = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(ys + i)), my);
+
+		sxx = _mm256_fmadd_pd(dx, dx, sxx);
+		syy = _mm256_fmadd_pd(dy, dy, syy);
+		sxy = _mm256_fmadd_pd(dx, dy, sxy);
+	}
+
+	_mm256_storeu_pd(lanes, sxx); moments[2] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	_mm256_storeu_pd(lanes, syy); moments[3] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	_mm256_storeu_pd(lanes, sxy); moments[4] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+	for (; i < n; i++) {
+		moments[2] += ((xs[i] - mean_x) * (xs[i] - mean_x));
+		moments[3] += ((ys[i] - mean_y) * (ys[i] - mean_y));
+		moments[4] += ((xs[i] - mean_x) * (ys[i] - mean_y));
+	}
+
+	moments[0] = mean_x;
+	moments[1] = mean_y;
+}
+#endif
+
+static void calc_batch_moments_scalar(const float* xs, const float* ys, size_t n, double* moments) {
+	double sum_x = 0.0;
+	double sum_y = 0.0;
+
+	for (size_t i = 0; i < n; i++) {
+		sum_x += xs[i];
+		sum_y += ys[i];
+	}
+
+	const double mean_x = sum_x / n;
+	const double mean_y = sum_y / n;
+
+	moments[0] = mean_x;
+	moments[1] = mean_y;
+	moments[2] = 0.0;
+	moments[3] = 0.0;
+	moments[4] = 0.0;
+
+	for (size_t i = 0; i < n; i++) {
+		moments[2] += ((xs[i] - mean_x) * (xs[i] - mean_x));
+		moments[3] += ((ys[i] - mean_y) * (ys[i] - mean_y));
+		moments[4] += ((xs[i] - mean_x) * (ys[i] - mean_y));
+	}
+}
+
+static bool have_avx2_fma() {
+	#if (HAVE_X86_SIMD == 1)
+	static const bool have = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
+	return have;
+	#else
+	return false;
+	#endif
+}
+
 
-	// calculate variances (x,y) and (x,y)-covariance
-	for (uint_type n = 0; n < data_points.size(); n++) {
-		const point_type dev = data_points[n] - means;
 
-		sigmas.x() += (dev.x() * dev.x());
-		sigmas.y() += (dev.y() * dev.y());
-		sigmas.z() += (dev.x() * dev.y());
+// sufficient statistics of a bivariate sample: the count, the means and
+// the co-moments Sxx = sum((x - mx)^2), Syy and Sxy = sum((x - mx) * (y - my))
+//
+// add() and remove() are Welford's update and its exact inverse, merge()
+// is Chan's pairwise combination, so partial states built by different
+// threads (or over different windows) can be joined in any order; both
+// line fits are available at any time from the current state
+struct t_regression_stats {
+public:
+	void clear() { *this = t_regression_stats(); }
+
+	void add(double x, double y) {
+		const double dx = x - m_mean_x;
+		const double dy = y - m_mean_y;
+
+		m_num_points += 1;
+		m_mean_x += (dx / m_num_points);
+		m_mean_y += (dy / m_num_points);
+
+		// dx and dy are relative to the old means, the second factors to the new ones
+		m_sxx += (dx * (x - m_mean_x));
+		m_syy += (dy * (y - m_mean_y));
+		m_sxy += (dx * (y - m_mean_y));
+	}
+
+	// removes a point that was previously added
+	void remove(double x, double y) {
+		assert(m_num_points >= 1);
+
+		if (m_num_points <= 1) {
+			clear();
+			return;
+		}
+
+		// undo the update which added (x, y) to the remaining points
+		const double mean_x = m_mean_x - ((x - m_mean_x) / (m_num_points - 1));
+		const double mean_y = m_mean_y - ((y - m_mean_y) / (m_num_points - 1));
+
+		m_sxx -= ((x - mean_x) * (x - m_mean_x));
+		m_syy -= ((y - mean_y) * (y - m_mean_y));
+		m_sxy -= ((x - mean_x) * (y - m_mean_y));
+
+		m_num_points -= 1;
+		m_mean_x = mean_x;
+		m_mean_y = mean_y;
 	}
 
-	// normalize variances
-	sigmas /= (data_points.size() - 0);
+	void merge(const t_regression_stats& s) {
+		merge(s.m_num_points, s.m_mean_x, s.m_mean_y, s.m_sxx, s.m_syy, s.m_sxy);
+	}
+
+	void merge(double n, double mean_x, double mean_y, double sxx, double syy, double sxy) {
+		if (n <= 0.0)
+			return;
+
+		const double num_points = m_num_points + n;
+		const double dx = mean_x - m_mean_x;
+		const double dy = mean_y - m_mean_y;
+		const double scale = (m_num_points * n) / num_points;
+
+		m_sxx += (sxx + dx * dx * scale);
+		m_syy += (syy + dy * dy * scale);
+		m_sxy += (sxy + dx * dy * scale);
+
+		m_mean_x += (dx * n / num_points);
+		m_mean_y += (dy * n / num_points);
+		m_num_points = num_points;
+	}
+
+	// folds in <n> points given as separate x- and y-arrays; each chunk
+	// is reduced by a two-pass (SIMD) kernel and merged as a partial state
+	void add_batch(const float* xs, const float* ys, size_t n) {
+		double moments[5];
+
+		for (size_t i = 0; i < n; i += REGRESSION_BATCH_SIZE) {
+			const size_t m = std::min(n - i, size_t(REGRESSION_BATCH_SIZE));
+
+			#if (HAVE_X86_SIMD == 1)
+			if (have_avx2_fma()) {
+				calc_batch_moments_avx2(xs + i, ys + i, m, moments);
+			} else
+			#endif
+			{
+				calc_batch_moments_scalar(xs + i, ys + i, m, moments);
+			}
+
+			merge(m, moments[0], moments[1], moments[2], moments[3], moments[4]);
+		}
+	}
+
+	template<typename point_type> void add_points(const point_type* points, size_t n) {
+		float xs[REGRESSION_BATCH_SIZE];
+		float ys[REGRESSION_BATCH_SIZE];
+
+		for (size_t i = 0; i < n; i += REGRESSION_BATCH_SIZE) {
+			const size_t m = std::min(n - i, size_t(REGRESSION_BATCH_SIZE));
+
+			for (size_t j = 0; j < m; j++) {
+				xs[j] = points[i + j].x();
+				ys[j] = points[i + j].y();
+			}
+
+			add_batch(xs, ys, m);
+		}
+	}
+
+
+	// ordinary least-squares fit of y on x; x() := slope, y() := intercept
+	t_point<double> calc_ols_coeffs() const {
+		t_point<double> coeffs;
+
+		coeffs.x() = m_sxy / m_sxx;
+		coeffs.y() = m_mean_y - coeffs.x() * m_mean_x;
+		return coeffs;
+	}
+
+	// Deming fit for error-variance ratio <delta>; x() := slope, y() :=
+	// intercept, z() := sqrt of the discriminant (normalization cancels,
+	// so the co-moments are used as-is)
+	t_point<double> calc_deming_coeffs(double delta = DEMING_REGRESSION_DELTA) const {
+		t_point<double> coeffs;
+
+		coeffs.z() = std::sqrt(square(m_syy - delta * m_sxx) + 4.0 * delta * square(m_sxy));
+		coeffs.x() = ((m_syy - delta * m_sxx) + coeffs.z()) / (2.0 * m_sxy);
+		coeffs.y() = m_mean_y - coeffs.x() * m_mean_x;
+		return coeffs;
+	}
+
+
+	double get_num_points() const { return m_num_points; }
+	double get_mean_x() const { return m_mean_x; }
+	double get_mean_y() const { return m_mean_y; }
+
+	// population (co-)variances
+	double get_var_x() const { return (m_sxx / std::max(m_num_points, 1.0)); }
+	double get_var_y() const { return (m_syy / std::max(m_num_points, 1.0)); }
+	double get_cov_xy() const { return (m_sxy / std::max(m_num_points, 1.0)); }
+
+private:
+	double m_num_points = 0.0;
+	double m_mean_x = 0.0;
+	double m_mean_y = 0.0;
+
+	double m_sxx = 0.0;
+	double m_syy = 0.0;
+	double m_sxy = 0.0;
+};
+
+
+// regression over the most recent <capacity> points of a stream; every
+// push adds the new point and removes the oldest in O(1), and after each
+// <capacity> removals the state is rebuilt from the window so rounding
+// in the inverse updates can not accumulate without bound
+struct t_sliding_window_regression {
+public:
+	t_sliding_window_regression(size_t capacity): m_xs(capacity), m_ys(capacity) {
+		assert(capacity != 0);
+	}
+
+	void push(float x, float y) {
+		if (m_size == m_xs.size()) {
+			m_stats.remove(m_xs[m_head], m_ys[m_head]);
+
+			if ((m_num_removals += 1) == m_xs.size()) {
+				m_num_removals = 0;
+				m_xs[m_head] = x;
+				m_ys[m_head] = y;
+				m_head = (m_head + 1) % m_xs.size();
+
+				rebuild();
+				return;
+			}
+		} else {
+			m_size += 1;
+		}
+
+		m_xs[m_head] = x;
+		m_ys[m_head] = y;
+		m_head = (m_head + 1) % m_xs.size();
+
+		m_stats.add(x, y);
+	}
+
+	const t_regression_stats& get_stats() const { return m_stats; }
+
+private:
+	void rebuild() {
+		// the full ring is two contiguous runs: [head, end) and [0, head)
+		m_stats.clear();
+		m_stats.add_batch(&m_xs[m_head], &m_ys[m_head], m_xs.size() - m_head);
+		m_stats.add_batch(&m_xs[0], &m_ys[0], m_head);
+	}
+
+private:
+	std::vector<float> m_xs;
+	std::vector<float> m_ys;
+
+	size_t m_head = 0;
+	size_t m_size = 0;
+	size_t m_num_removals = 0;
+
+	t_regression_stats m_stats;
+};
+
+
+
+template<typename point_type>
+void simple_line_regression(
+	const std::vector<point_type>& data_points,
+	      std::vector<point_type>& data_params
+) {
+	assert(data_points.size() >= 2);
+	data_params.reserve(data_points.size() + 1);
+
+	t_regression_stats stats;
+	stats.add_points(data_points.data(), data_points.size());
 
 	// coeffs.x() := a = beta, coeffs.y() := b := alpha
-	coeffs.x() = sigmas.z() / sigmas.x();
-	coeffs.y() = means.y() - coeffs.x() * means.x();
+	const t_point<double>& fit = stats.calc_ols_coeffs();
+	const point_type coeffs(fit.x(), fit.y());
 
 	#if 0
 	// generate points on the regression line (for gnuplot)
@@ -101,6 +400,11 @@ void simple_line_regression(
 
 		data_params.push_back(point_type(x, y));
 	}
+	#else
+	// model point for each data point (vertical projection onto the line)
+	for (uint_type n = 0; n < data_points.size(); n++) {
+		data_params.push_back(point_type(data_points[n].x(), coeffs.x() * data_points[n].x() + coeffs.y()));
+	}
 	#endif
 
 	data_params.push_back(coeffs);
@@ -116,36 +420,12 @@ void deming_line_regression(
 	assert(data_points.size() >= 2);
 	data_params.reserve(data_points.size() + 1);
 
-	point_type means;
-	point_type sigmas;
-	point_type coeffs;
-
-	// calculate means (x,y)
-	for (uint_type n = 0; n < data_points.size(); n++) {
-		means += data_points[n];
-	}
-
-	means /= data_points.size();
-
-	// calculate variances (x,y) and (x,y)-covariance
-	for (uint_type n = 0; n < data_points.size(); n++) {
-		const point_type dev = data_points[n] - means;
-
-		sigmas.x() += (dev.x() * dev.x());
-		sigmas.y() += (dev.y() * dev.y());
-		sigmas.z() += (dev.x() * dev.y());
-	}
-
-	// normalize variances (NOTE: wiki says N-1 here?)
-	sigmas /= (data_points.size() - 0);
+	t_regression_stats stats;
+	stats.add_points(data_points.data(), data_points.size());
 
 	// coeffs.x() := a = b1, coeffs.y() := b := b0
-	coeffs.z() += square(sigmas.y() - DEMING_REGRESSION_DELTA * sigmas.x());
-	coeffs.z() += (4.0f * DEMING_REGRESSION_DELTA * square(sigmas.z()));
-
-	coeffs.z() = std::sqrt(coeffs.z());
-	coeffs.x() = ((sigmas.y() - DEMING_REGRESSION_DELTA * sigmas.x()) + coeffs.z()) / (2.0f * sigmas.z());
-	coeffs.y() = (means.y() - coeffs.x() * means.x());
+	const t_point<double>& fit = stats.calc_deming_coeffs(DEMING_REGRESSION_DELTA);
+	const point_type coeffs(fit.x(), fit.y(), fit.z());
 
 	#if 0
 	// generate points on the regression line (for gnuplot)
@@ -157,11 +437,11 @@ void deming_line_regression(
 	}
 	#else
 	for (uint_type n = 0; n < data_points.size(); n++) {
-		const float y_model = coeffs.x() * data_points[n].x() + coeffs.y();
-		const float y_error = data_points[n].y() - y_model;
+		const float y_error = data_points[n].y() - (coeffs.x() * data_points[n].x() + coeffs.y());
 
-		const float x_error = y_error * (coeffs.y() / (coeffs.y() * coeffs.y() + DEMING_REGRESSION_DELTA));
-		const float x_model = data_points[n].x() + x_error;
+		// x*_i = x_i + b1 / (b1^2 + delta) * (y_i - b0 - b1 x_i)
+		const float x_model = data_points[n].x() + y_error * (coeffs.x() / (coeffs.x() * coeffs.x() + DEMING_REGRESSION_DELTA));
+		const float y_model = coeffs.x() * x_model + coeffs.y();
 
 		data_params.push_back(point_type(x_model, y_model));
 	}
@@ -182,7 +462,112 @@ static void randomize_data_points(std::vector<point_type>& data_points) {
 
 
 
-int main() {
+// fits y = 0.5 x + 3 (with noise on both axes) over <num_points> points
+// per-point, in SIMD batches and with per-thread partial states merged,
+// then runs a sliding window over the same stream and checks its final
+// state against a from-scratch fit of the last window
+static void run_benchmark(size_t num_points, size_t num_threads, size_t window_size) {
+	std::mt19937 rng(num_points);
+	std::uniform_real_distribution<float> xdist(0.0f, 1000.0f);
+	std::normal_distribution<float> noise(0.0f, 5.0f);
+
+	std::vector<float> xs(num_points);
+	std::vector<float> ys(num_points);
+
+	for (size_t i = 0; i < num_points; i++) {
+		const float x = xdist(rng);
+
+		xs[i] = x + noise(rng);
+		ys[i] = 0.5f * x + 3.0f + noise(rng);
+	}
+
+	printf("[%s] points=%lu threads=%lu window=%lu avx2=%d\n", __func__, num_points, num_threads, window_size, have_avx2_fma());
+
+	auto time_ms = [](const std::chrono::steady_clock::time_point& t0) {
+		return (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+	};
+	const char* func = __func__;
+
+	auto report = [&](const char* name, const t_regression_stats& stats, double ms) {
+		const t_point<double>& ols = stats.calc_ols_coeffs();
+		const t_point<double>& dem = stats.calc_deming_coeffs(1.0);
+
+		printf("[%s] %-9s %9.2fms (%7.1f Mpts/s) ols={%.6f,%.4f} deming={%.6f,%.4f}\n", func,
+			name, ms, num_points / (ms * 1e3), ols.x(), ols.y(), dem.x(), dem.y());
+	};
+
+	{
+		t_regression_stats stats;
+
+		const auto t0 = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < num_points; i++)
+			stats.add(xs[i], ys[i]);
+
+		report("add", stats, time_ms(t0));
+	}
+	{
+		t_regression_stats stats;
+
+		const auto t0 = std::chrono::steady_clock::now();
+
+		stats.add_batch(xs.data(), ys.data(), num_points);
+		report("add_batch", stats, time_ms(t0));
+	}
+	{
+		std::vector<t_regression_stats> partials(num_threads);
+		std::vector<std::thread> threads;
+
+		const auto t0 = std::chrono::steady_clock::now();
+
+		for (size_t t = 0; t < num_threads; t++) {
+			threads.emplace_back([&, t]() {
+				const size_t i0 = (num_points * (t + 0)) / num_threads;
+				const size_t i1 = (num_points * (t + 1)) / num_threads;
+
+				partials[t].add_batch(&xs[i0], &ys[i0], i1 - i0);
+			});
+		}
+
+		for (size_t t = 0; t < num_threads; t++) {
+			threads[t].join();
+			partials[0].merge((t == 0)? t_regression_stats(): partials[t]);
+		}
+
+		report("merged", partials[0], time_ms(t0));
+	}
+	{
+		t_sliding_window_regression window(window_size);
+		t_regression_stats exact;
+
+		const auto t0 = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < num_points; i++)
+			window.push(xs[i], ys[i]);
+
+		report("window", window.get_stats(), time_ms(t0));
+
+		const size_t i0 = num_points - std::min(num_points, window_size);
+
+		exact.add_batch(&xs[i0], &ys[i0], num_points - i0);
+
+		printf("[%s] window slope error vs exact: %g\n", __func__,
+			std::fabs(window.get_stats().calc_ols_coeffs().x() - exact.calc_ols_coeffs().x()));
+	}
+}
+
+
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		// --bench [points] [threads] [window]
+		run_benchmark(
+			(argc > 2)? atol(argv[2]): 10000000,
+			(argc > 3)? atoi(argv[3]): std::max(std::thread::hardware_concurrency(), 1u),
+			(argc > 4)? atol(argv[4]): 4096
+		);
+		return 0;
+	}
+
 	srandom(time(NULL));
 
 	FILE* DATA_POINTS_FILE = fopen("data_points.dat", "w");
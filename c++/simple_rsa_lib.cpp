@@ -1,12 +1,20 @@
 #include <cassert>
+#include <cctype>
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
 #include <cmath>
 
+#include <algorithm>
+#include <chrono>
+#include <random>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "simple_work_stealing_pool.hpp"
+
 #define NUM_DECIMAL_DIGITS(n) (t_uint32(blog(10, n)) + 1)
 #define NUM_BINARY_DIGITS(n) (t_uint32(blog(2, n)) + 1)
 
@@ -372,6 +380,62 @@ static size_t fermat_prime_number_sieve(t_uint32 n, t_uint32 k, std::vector<t_ui
 	return (w.size());
 }
 
+// deterministic for every n < 4759123141 (Jaeschke), hence for every
+// t_uint32; candidates with a prime factor below 64 are rejected by
+// trial division before any exponentiation is done
+static bool miller_rabin_primality_test(t_uint32 n) {
+	static const t_uint32 small_primes[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61};
+	static const t_uint32 bases[] = {2, 7, 61};
+
+	if (n < 2)
+		return false;
+
+	for (const t_uint32 p: small_primes) {
+		if ((n % p) == 0)
+			return (n == p);
+	}
+
+	// every composite below 67^2 has a factor <= 61
+	if (n < (67 * 67))
+		return true;
+
+	// n - 1 = d * 2^s
+	const t_uint32 s = __builtin_ctz(n - 1);
+	const t_uint32 d = (n - 1) >> s;
+
+	for (const t_uint32 a: bases) {
+		t_uint64 x = mod_exp_v1(a, d, n);
+
+		if (x == 1 || x == (n - 1))
+			continue;
+
+		t_uint32 r = 1;
+
+		for (; r < s; r++) {
+			if ((x = (x * x) % n) == (n - 1))
+				break;
+		}
+
+		if (r == s)
+			return false;
+	}
+
+	return true;
+}
+
+static size_t miller_rabin_prime_number_sieve(t_uint32 n, std::vector<t_uint32>& w) {
+	w.reserve(n / blog(10, n));
+
+	// skip the smallest primes so they won't get picked as keys
+	for (t_uint64 i = 11; i <= n; i += 2) {
+		if (miller_rabin_primality_test(i)) {
+			w.push_back(i);
+		}
+	}
+
+	return (w.size());
+}
+
 
 // the prime-number Sieve of Eratosthenes
 static size_t eratosthenes_prime_number_sieve(t_uint32 n, std::vector<t_uint32>& w) {
@@ -406,6 +470,108 @@ static size_t eratosthenes_prime_number_sieve(t_uint32 n, std::vector<t_uint32>&
 }
 
 
+// the 8 residues mod 30 coprime to 2, 3 and 5; bit j of byte i in a
+// sieve segment represents the number (30 * i + WHEEL_RESIDUES[j]),
+// so the 2-3-5 wheel stores 30 numbers per byte
+static const t_uint32 WHEEL_RESIDUES[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+// bytes per segment, small enough to stay in L1 while it is sieved
+static const t_uint32 SIEVE_SEGMENT_BYTES = 16384;
+
+// cache-blocked segmented Sieve of Eratosthenes over the 2-3-5 wheel;
+// segments are independent given the base primes up to sqrt(n) and
+// are sieved in parallel, then concatenated in order
+static size_t segmented_prime_number_sieve(t_uint32 n, std::vector<t_uint32>& w, size_t num_threads) {
+	// maps (m % 30) to the bit representing m within its byte
+	t_uint8 wheel_bits[30] = {0};
+
+	for (t_uint32 j = 0; j < 8; j++) {
+		wheel_bits[WHEEL_RESIDUES[j]] = j;
+	}
+
+	// base primes (other than 2, 3, 5) by the plain sieve
+	const t_uint32 root = t_uint32(sqrt(double(n))) + 1;
+
+	std::vector<bool> composite(root + 1, false);
+	std::vector<t_uint32> base_primes;
+
+	for (t_uint32 i = 7; i <= root; i += 2) {
+		if (composite[i] || (i % 3) == 0 || (i % 5) == 0)
+			continue;
+
+		base_primes.push_back(i);
+
+		for (t_uint32 j = i * i; j <= root; j += i) {
+			composite[j] = true;
+		}
+	}
+
+	const t_uint64 seg_span = t_uint64(SIEVE_SEGMENT_BYTES) * 30;
+	const t_uint64 num_segs = (t_uint64(n) / seg_span) + 1;
+
+	std::vector< std::vector<t_uint32> > seg_primes(num_segs);
+	std::vector< std::vector<t_uint8> > seg_bufs(std::max(num_threads, size_t(1)), std::vector<t_uint8>(SIEVE_SEGMENT_BYTES));
+
+	t_work_stealing_pool pool(seg_bufs.size());
+
+	pool.run(num_segs, [&](size_t seg_idx, size_t thread_idx) {
+		std::vector<t_uint8>& seg = seg_bufs[thread_idx];
+		std::vector<t_uint32>& primes = seg_primes[seg_idx];
+
+		const t_uint64 lo = seg_idx * seg_span;
+		const t_uint64 num_bytes = std::min(t_uint64(SIEVE_SEGMENT_BYTES), ((n - lo) / 30) + 1);
+		const t_uint64 hi = lo + num_bytes * 30;
+
+		std::fill(seg.begin(), seg.begin() + num_bytes, 0xff);
+
+		for (const t_uint32 p: base_primes) {
+			if (t_uint64(p) * p >= hi)
+				break;
+
+			// multiples p * k with k coprime to 30 are the only ones on the wheel,
+			// and each residue class of k mod 30 hits a fixed bit every p bytes
+			const t_uint64 k_min = std::max(t_uint64(p), (lo + p - 1) / p);
+
+			for (t_uint32 j = 0; j < 8; j++) {
+				const t_uint64 k = k_min + ((WHEEL_RESIDUES[j] + 30 - (k_min % 30)) % 30);
+				const t_uint64 m = p * k;
+
+				if (m >= hi)
+					continue;
+
+				const t_uint8 mask = ~(1u << wheel_bits[m % 30]);
+
+				for (t_uint64 b = (m - lo) / 30; b < num_bytes; b += p) {
+					seg[b] &= mask;
+				}
+			}
+		}
+
+		// one is not prime
+		if (lo == 0)
+			seg[0] &= ~1u;
+
+		for (t_uint64 b = 0; b < num_bytes; b++) {
+			for (t_uint8 bits = seg[b]; bits != 0; bits &= (bits - 1)) {
+				const t_uint64 v = lo + b * 30 + WHEEL_RESIDUES[__builtin_ctz(bits)];
+
+				// skip the smallest primes so they won't get picked as keys
+				if (v > 10 && v <= n) {
+					primes.push_back(v);
+				}
+			}
+		}
+	});
+
+	w.reserve(w.size() + n / blog(10, n));
+
+	for (const std::vector<t_uint32>& primes: seg_primes) {
+		w.insert(w.end(), primes.begin(), primes.end());
+	}
+
+	return (w.size());
+}
+
+
 // the Euclidean algorithm (finds the
 // greatest common divisor of a and b)
 static inline t_uint32 gcd(t_uint32 a, t_uint32 b) {
@@ -465,9 +631,9 @@ static t_rsa_keypair generate_rsa_keys(bool probabilistic_prime_generation) {
 	std::vector<t_uint32> w;
 
 	if (probabilistic_prime_generation) {
-		fermat_prime_number_sieve(65536, 20, w);
+		miller_rabin_prime_number_sieve(65536, w);
 	} else {
-		eratosthenes_prime_number_sieve(65536, w);
+		segmented_prime_number_sieve(65536, w, std::thread::hardware_concurrency());
 	}
 
 	t_uint32 p = 0, q = 0, n = 0;
@@ -518,194 +684,1718 @@ static t_rsa_keypair generate_rsa_keys(bool probabilistic_prime_generation) {
 
 
 
-static bool encrypt_message(const int argc, const char** argv) {
-	if (argc != 5) {
-		printf("[%s] usage: %s --enc <\"message\"> <n> <e>\n", __FUNCTION__, argv[0]);
-		return false;
+// multi-precision RSA; the 32-bit functions above are limited to
+// moduli below (1 << 32) and reduce with a '%' after every product,
+// everything below works on moduli of (practically) any size and
+// does all modular arithmetic in Montgomery form
+//
+typedef unsigned __int128 t_uint128;
+typedef std::mt19937_64 t_mp_rng;
+
+// largest modulus (in 64-bit limbs) a Montgomery context accepts,
+// bounds the stack scratch-space used by t_mont_ctx::mul
+static const size_t MP_MAX_MONT_LIMBS = 128;
+// number of random-base Miller-Rabin rounds per prime candidate
+static const size_t MP_MILLER_RABIN_ROUNDS = 40;
+// number of blocks read per batch in --mbat mode
+static const size_t MP_BATCH_BLOCKS = 1024;
+// largest record (in key blocks) accepted in --mbat mode, bounds the
+// allocation an untrusted record header can cause
+static const size_t MP_MAX_RECORD_BLOCKS = 1 << 16;
+// candidates are trial-divided by all odd primes below this bound
+static const t_uint32 MP_TRIAL_DIVISION_BOUND = 4096;
+// number of consecutive odd candidates tried per random starting point
+static const t_uint64 MP_PRIME_SEARCH_SPAN = 1 << 16;
+// the customary public exponent (prime, so only needs gcd(e, p - 1) = 1 checks)
+static const t_uint64 MP_PUBLIC_EXPONENT = 65537;
+
+
+
+// arbitrary-precision unsigned integer; limbs are stored least
+// significant first and kept normalized (no leading zero limbs,
+// zero itself has no limbs at all)
+struct t_mp_uint {
+public:
+	t_mp_uint(t_uint64 v = 0) {
+		if (v != 0) {
+			m_limbs.push_back(v);
+		}
 	}
 
-	const std::string& msg = argv[2];
-	const std::string&  ns = argv[3];
-	const std::string&  es = argv[4];
+	static t_mp_uint from_limbs(const t_uint64* limbs, size_t n) {
+		t_mp_uint r;
+		r.m_limbs.assign(limbs, limbs + n);
+		r.normalize();
+		return r;
+	}
 
-	t_uint8 encoded_msg[MAX_MSG_LEN + 1] = {0};
-	t_uint32 cipher_txt[MAX_MSG_LEN + 1] = {0};
+	// parses an optionally 0x-prefixed hex string into <r>; returns false
+	// (leaving <r> unchanged) if there are no digits or any non-hex ones
+	static bool from_hex_string(const std::string& s, t_mp_uint& r) {
+		const size_t o = (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))? 2: 0;
 
-	const t_uint32 n = str2type<t_uint32>(ns);
-	const t_uint32 e = str2type<t_uint32>(es);
-	const t_uint32 s = NUM_DECIMAL_DIGITS(n);
+		if (s.size() == o)
+			return false;
 
-	const t_rsa_key pub_key(n, e, s);
+		t_mp_uint v;
+		v.m_limbs.resize(((s.size() - o) + 15) / 16, 0);
 
-	rsa_encode_message(msg.c_str(), encoded_msg);
-	rsa_encrypt_message(&pub_key, encoded_msg, cipher_txt);
+		for (size_t i = s.size(), n = 0; i > o; i--, n++) {
+			const char c = s[i - 1];
 
-	// show the encoded plaintext message,
-	// then output the encrypted message
-	write_decrypted_message(encoded_msg, &pub_key);
-	write_encrypted_message(cipher_txt, &pub_key);
-	return true;
-}
+			if (!isxdigit(static_cast<unsigned char>(c)))
+				return false;
 
-static bool decrypt_message(const int argc, const char** argv) {
-	if (argc != 5) {
-		printf("[%s] usage: %s --dec <\"message\"> <n> <d>\n", __FUNCTION__, argv[0]);
-		return false;
+			const t_uint64 d = isdigit(c)? (c - '0'): (tolower(c) - 'a' + 10);
+
+			v.m_limbs[n >> 4] |= (d << ((n & 15) << 2));
+		}
+
+		v.normalize();
+		r = std::move(v);
+		return true;
 	}
 
-	const std::string& msg = argv[2];
-	const std::string&  ns = argv[3];
-	const std::string&  ds = argv[4];
+	// big-endian byte-string of exactly <n> bytes
+	static t_mp_uint from_bytes(const t_uint8* bytes, size_t n) {
+		t_mp_uint r;
+		r.m_limbs.resize((n + 7) / 8, 0);
 
-	t_uint32 decoded_msg[MAX_MSG_LEN + 1] = {0};
-	t_uint8 plaintxt_msg[MAX_MSG_LEN + 1] = {0};
+		for (size_t i = 0; i < n; i++) {
+			r.m_limbs[i >> 3] |= (t_uint64(bytes[n - i - 1]) << ((i & 7) << 3));
+		}
 
-	const t_uint32 n = str2type<t_uint32>(ns);
-	const t_uint32 d = str2type<t_uint32>(ds);
-	const t_uint32 s = NUM_DECIMAL_DIGITS(n);
+		r.normalize();
+		return r;
+	}
 
-	const t_rsa_key pri_key(n, d, s);
+	std::string to_hex_string(size_t min_digits = 1) const {
+		static const char* digits = "0123456789abcdef";
 
-	rsa_decode_message(&pri_key, msg.c_str(), decoded_msg);
-	rsa_decrypt_message(&pri_key, decoded_msg, plaintxt_msg);
+		std::string s;
 
-	// show the decoded ciphertext message,
-	// then output the decrypted message
-	write_encrypted_message(decoded_msg, &pri_key);
-	write_decrypted_message(plaintxt_msg, &pri_key);
-	return true;
-}
+		for (size_t n = 0; n < (m_limbs.size() * 16) || s.size() < min_digits; n++) {
+			s += digits[(limb(n >> 4) >> ((n & 15) << 2)) & 15];
+		}
 
-static bool sign_message(const int argc, const char** argv) {
-	if (argc != 5) {
-		printf("[%s] usage: %s --sig <\"message\"> <n> <d>\n", __FUNCTION__, argv[0]);
-		return false;
+		// strip leading zeroes beyond the requested width
+		while (s.size() > min_digits && s[s.size() - 1] == '0')
+			s.erase(s.size() - 1);
+
+		return (std::string(s.rbegin(), s.rend()));
 	}
 
-	const std::string& msg = argv[2];
-	const std::string&  ns = argv[3];
-	const std::string&  ds = argv[4];
+	void to_bytes(t_uint8* bytes, size_t n) const {
+		for (size_t i = 0; i < n; i++) {
+			bytes[n - i - 1] = (limb(i >> 3) >> ((i & 7) << 3)) & 0xff;
+		}
+	}
 
-	t_uint8 encoded_msg[MAX_MSG_LEN + 1] = {0};
-	t_uint32 cipher_txt[MAX_MSG_LEN + 1] = {0};
 
-	const t_uint32 n = str2type<t_uint32>(ns);
-	const t_uint32 d = str2type<t_uint32>(ds);
-	const t_uint32 s = NUM_DECIMAL_DIGITS(n);
+	bool is_zero() const { return (m_limbs.empty()); }
+	bool is_odd() const { return (!m_limbs.empty() && (m_limbs[0] & 1) != 0); }
+	bool test_bit(size_t i) const { return (((limb(i >> 6) >> (i & 63)) & 1) != 0); }
 
-	const t_rsa_key pri_key(n, d, s);
+	size_t num_limbs() const { return (m_limbs.size()); }
+	size_t num_bits() const {
+		if (m_limbs.empty())
+			return 0;
 
-	rsa_encode_message(msg.c_str(), encoded_msg);
-	rsa_encrypt_message(&pri_key, encoded_msg, cipher_txt);
+		return ((m_limbs.size() * 64) - __builtin_clzll(m_limbs.back()));
+	}
 
-	// output the ciphertext signature
-	write_encrypted_message(cipher_txt, &pri_key);
-	return true;
-}
+	t_uint64 limb(size_t i) const { return ((i < m_limbs.size())? m_limbs[i]: 0); }
+	const t_uint64* limbs() const { return (m_limbs.data()); }
 
-static bool auth_message(const int argc, const char** argv) {
-	if (argc != 5) {
-		printf("[%s] usage: %s --aut <\"message\"> <n> <e>\n", __FUNCTION__, argv[0]);
-		return false;
-	}
 
-	const std::string& msg = argv[2];
-	const std::string&  ns = argv[3];
-	const std::string&  es = argv[4];
+	static int cmp(const t_mp_uint& a, const t_mp_uint& b) {
+		if (a.m_limbs.size() != b.m_limbs.size())
+			return ((a.m_limbs.size() < b.m_limbs.size())? -1: 1);
 
-	t_uint32 decoded_msg[MAX_MSG_LEN + 1] = {0};
-	t_uint8 plaintxt_msg[MAX_MSG_LEN + 1] = {0};
+		for (size_t i = a.m_limbs.size(); i > 0; i--) {
+			if (a.m_limbs[i - 1] != b.m_limbs[i - 1]) {
+				return ((a.m_limbs[i - 1] < b.m_limbs[i - 1])? -1: 1);
+			}
+		}
 
-	const t_uint32 n = str2type<t_uint32>(ns);
-	const t_uint32 e = str2type<t_uint32>(es);
-	const t_uint32 s = NUM_DECIMAL_DIGITS(n);
+		return 0;
+	}
 
-	const t_rsa_key pub_key(n, e, s);
+	static t_mp_uint add(const t_mp_uint& a, const t_mp_uint& b) {
+		t_mp_uint r;
+		r.m_limbs.resize(std::max(a.m_limbs.size(), b.m_limbs.size()) + 1, 0);
 
-	rsa_decode_message(&pub_key, msg.c_str(), decoded_msg);
-	rsa_decrypt_message(&pub_key, decoded_msg, plaintxt_msg);
+		t_uint64 carry = 0;
 
-	// output the plaintext signature
-	write_decrypted_message(plaintxt_msg, &pub_key);
-	return true;
-}
+		for (size_t i = 0; i < r.m_limbs.size(); i++) {
+			const t_uint128 s = t_uint128(a.limb(i)) + b.limb(i) + carry;
 
-static bool gen_keypair(const int argc, const char** argv) {
-	if (argc != 2) {
-		printf("[%s] usage: %s --gen\n", __FUNCTION__, argv[0]);
-		return false;
+			r.m_limbs[i] = t_uint64(s);
+			carry = t_uint64(s >> 64);
+		}
+
+		r.normalize();
+		return r;
 	}
 
-	// generate a key-pair
-	const t_rsa_keypair kp = generate_rsa_keys(false);
-	const std::string& kps = kp.to_string();
+	// requires a >= b
+	static t_mp_uint sub(const t_mp_uint& a, const t_mp_uint& b) {
+		assert(cmp(a, b) >= 0);
 
-	printf("[%s]\n%s\n", __FUNCTION__, kps.c_str());
-	return true;
-}
+		t_mp_uint r;
+		r.m_limbs.resize(a.m_limbs.size(), 0);
 
+		t_uint64 borrow = 0;
 
+		for (size_t i = 0; i < r.m_limbs.size(); i++) {
+			const t_uint128 d = t_uint128(a.m_limbs[i]) - b.limb(i) - borrow;
 
-static bool run_unit_test(const int argc, const char** argv) {
-	if (argc != 3) {
-		printf("[%s] usage: %s --tst <N>\n", __FUNCTION__, argv[0]);
-		return false;
+			r.m_limbs[i] = t_uint64(d);
+			borrow = ((d >> 64) != 0);
+		}
+
+		r.normalize();
+		return r;
 	}
 
-	for (unsigned int i = atoi(argv[2]); i > 0; i--) {
-		const t_uint32 m = random(); // 985743564
-		const t_uint32 k = random(); //    385746
-		const t_uint32 n = random(); //   2054687
+	static t_mp_uint mul(const t_mp_uint& a, const t_mp_uint& b) {
+		if (a.is_zero() || b.is_zero())
+			return (t_mp_uint(0));
 
-		const t_uint32 v0 = mod_exp_v0(m, k, n);
-		const t_uint32 v1 = mod_exp_v1(m, k, n);
-		const t_uint32 v2 = mod_exp_v2(m, k, n);
-		const t_uint32 v3 = mod_exp_v3(m, k, n);
+		t_mp_uint r;
+		r.m_limbs.resize(a.m_limbs.size() + b.m_limbs.size(), 0);
 
-		printf("[%u] %u^%u mod %u=%u\n", i, m, k, n, v0);
-		printf("[%u] %u^%u mod %u=%u\n", i, m, k, n, v1);
-		printf("[%u] %u^%u mod %u=%u\n", i, m, k, n, v2);
-		printf("[%u] %u^%u mod %u=%u\n", i, m, k, n, v3);
+		for (size_t i = 0; i < a.m_limbs.size(); i++) {
+			t_uint64 carry = 0;
 
-		assert(v0 == v1);
-		assert(v1 == v2);
-		assert(v2 == v3);
-	}
+			for (size_t j = 0; j < b.m_limbs.size(); j++) {
+				const t_uint128 p = t_uint128(a.m_limbs[i]) * b.m_limbs[j] + r.m_limbs[i + j] + carry;
 
-	return true;
-}
+				r.m_limbs[i + j] = t_uint64(p);
+				carry = t_uint64(p >> 64);
+			}
 
-static bool parse_args(const int argc, const char** argv) {
-	if (argc <= 1) {
-		printf("[%s] usage: %s <--enc | --dec | --sig | --aut | --gen | --tst>\n", __FUNCTION__, argv[0]);
-		return false;
-	}
+			r.m_limbs[i + b.m_limbs.size()] = carry;
+		}
 
-	if (strcmp(argv[1], "--enc") == 0) {
-		// encrypt a plaintext message with public key
-		return (encrypt_message(argc, argv));
-	}
-	if (strcmp(argv[1], "--dec") == 0) {
-		// decrypt a ciphertext message with private key
-		return (decrypt_message(argc, argv));
+		r.normalize();
+		return r;
 	}
 
-	if (strcmp(argv[1], "--sig") == 0) {
-		// sign a plaintext message with private key
-		return (sign_message(argc, argv));
-	}
-	if (strcmp(argv[1], "--aut") == 0) {
-		// authenticate a ciphertext message with public key
-		return (auth_message(argc, argv));
+	static t_uint64 mod_small(const t_mp_uint& a, t_uint64 d) {
+		t_uint128 r = 0;
+
+		for (size_t i = a.m_limbs.size(); i > 0; i--) {
+			r = ((r << 64) | a.m_limbs[i - 1]) % d;
+		}
+
+		return (t_uint64(r));
 	}
 
-	if (strcmp(argv[1], "--gen") == 0) {
-		// generate a (public, private) pair of RSA keys
-		return (gen_keypair(argc, argv));
+	// single-limb divisor; returns quotient, stores remainder in <rem>
+	static t_mp_uint div_small(const t_mp_uint& a, t_uint64 d, t_uint64* rem) {
+		assert(d != 0);
+
+		t_mp_uint q;
+		q.m_limbs.resize(a.m_limbs.size(), 0);
+
+		t_uint128 r = 0;
+
+		for (size_t i = a.m_limbs.size(); i > 0; i--) {
+			r = (r << 64) | a.m_limbs[i - 1];
+			q.m_limbs[i - 1] = t_uint64(r / d);
+			r %= d;
+		}
+
+		if (rem != nullptr)
+			*rem = t_uint64(r);
+
+		q.normalize();
+		return q;
 	}
 
-	if (strcmp(argv[1], "--tst") == 0) {
-		return (run_unit_test(argc, argv));
+	// Knuth's algorithm D (TAOCP vol. 2, 4.3.1); either of <q> and <r> may be null
+	static void div_mod(const t_mp_uint& a, const t_mp_uint& b, t_mp_uint* q, t_mp_uint* r) {
+		assert(!b.is_zero());
+
+		if (cmp(a, b) < 0) {
+			if (q != nullptr) *q = t_mp_uint(0);
+			if (r != nullptr) *r = a;
+			return;
+		}
+
+		if (b.m_limbs.size() == 1) {
+			t_uint64 rem = 0;
+			t_mp_uint quo = div_small(a, b.m_limbs[0], &rem);
+
+			if (q != nullptr) *q = quo;
+			if (r != nullptr) *r = t_mp_uint(rem);
+			return;
+		}
+
+		const size_t n = b.m_limbs.size();
+		const size_t m = a.m_limbs.size() - n;
+		const unsigned int s = __builtin_clzll(b.m_limbs[n - 1]);
+
+		// normalize such that the divisor's top bit is set
+		std::vector<t_uint64> un(a.m_limbs.size() + 1, 0);
+		std::vector<t_uint64> vn(n, 0);
+		std::vector<t_uint64> qn(m + 1, 0);
+
+		for (size_t i = n - 1; i > 0; i--) {
+			vn[i] = (b.m_limbs[i] << s) | ((s != 0)? (b.m_limbs[i - 1] >> (64 - s)): 0);
+		}
+		for (size_t i = a.m_limbs.size() - 1; i > 0; i--) {
+			un[i] = (a.m_limbs[i] << s) | ((s != 0)? (a.m_limbs[i - 1] >> (64 - s)): 0);
+		}
+
+		vn[0] = b.m_limbs[0] << s;
+		un[0] = a.m_limbs[0] << s;
+		un[a.m_limbs.size()] = (s != 0)? (a.m_limbs.back() >> (64 - s)): 0;
+
+		for (size_t j = m + 1; j > 0; j--) {
+			const size_t k = j - 1;
+
+			// estimate quotient limb from the top two dividend limbs, correct at most twice
+			const t_uint128 num = (t_uint128(un[k + n]) << 64) | un[k + n - 1];
+
+			t_uint128 qhat = num / vn[n - 1];
+			t_uint128 rhat = num % vn[n - 1];
+
+			while ((qhat >> 64) != 0 || (qhat * vn[n - 2]) > ((rhat << 64) | un[k + n - 2])) {
+				qhat -= 1;
+				rhat += vn[n - 1];
+
+				if ((rhat >> 64) != 0)
+					break;
+			}
+
+			// multiply and subtract
+			t_uint64 carry = 0;
+			t_uint64 borrow = 0;
+
+			for (size_t i = 0; i < n; i++) {
+				const t_uint128 p = qhat * vn[i] + carry;
+				const t_uint128 d = t_uint128(un[i + k]) - t_uint64(p) - borrow;
+
+				carry = t_uint64(p >> 64);
+				borrow = ((d >> 64) != 0);
+				un[i + k] = t_uint64(d);
+			}
+
+			const t_uint128 d = t_uint128(un[k + n]) - carry - borrow;
+
+			un[k + n] = t_uint64(d);
+
+			if ((d >> 64) != 0) {
+				// subtracted too much, add one divisor back
+				t_uint64 c = 0;
+
+				for (size_t i = 0; i < n; i++) {
+					const t_uint128 t = t_uint128(un[i + k]) + vn[i] + c;
+
+					un[i + k] = t_uint64(t);
+					c = t_uint64(t >> 64);
+				}
+
+				un[k + n] += c;
+				qhat -= 1;
+			}
+
+			qn[k] = t_uint64(qhat);
+		}
+
+		if (q != nullptr) {
+			*q = from_limbs(qn.data(), qn.size());
+		}
+		if (r != nullptr) {
+			for (size_t i = 0; i < n; i++) {
+				un[i] = (un[i] >> s) | ((s != 0)? (un[i + 1] << (64 - s)): 0);
+			}
+
+			*r = from_limbs(un.data(), n);
+		}
+	}
+
+	static t_mp_uint shl(const t_mp_uint& a, size_t bits) {
+		if (a.is_zero())
+			return a;
+
+		const size_t w = bits >> 6;
+		const size_t s = bits & 63;
+
+		t_mp_uint r;
+		r.m_limbs.resize(a.m_limbs.size() + w + 1, 0);
+
+		for (size_t i = 0; i < a.m_limbs.size(); i++) {
+			r.m_limbs[i + w    ] |= (a.m_limbs[i] << s);
+			r.m_limbs[i + w + 1] |= ((s != 0)? (a.m_limbs[i] >> (64 - s)): 0);
+		}
+
+		r.normalize();
+		return r;
+	}
+
+	static t_mp_uint shr(const t_mp_uint& a, size_t bits) {
+		const size_t w = bits >> 6;
+		const size_t s = bits & 63;
+
+		if (w >= a.m_limbs.size())
+			return (t_mp_uint(0));
+
+		t_mp_uint r;
+		r.m_limbs.resize(a.m_limbs.size() - w, 0);
+
+		for (size_t i = 0; i < r.m_limbs.size(); i++) {
+			r.m_limbs[i] = (a.m_limbs[i + w] >> s) | ((s != 0)? (a.limb(i + w + 1) << (64 - s)): 0);
+		}
+
+		r.normalize();
+		return r;
+	}
+
+	// uniformly random integer of exactly <num_bits> bits with the
+	// <top_bits> most significant ones forced to 1, optionally odd
+	static t_mp_uint random(size_t num_bits, size_t top_bits, bool odd, t_mp_rng& rng) {
+		assert(num_bits >= top_bits && num_bits > 0);
+
+		t_mp_uint r;
+		r.m_limbs.resize((num_bits + 63) / 64, 0);
+
+		for (size_t i = 0; i < r.m_limbs.size(); i++) {
+			r.m_limbs[i] = rng();
+		}
+
+		if ((num_bits & 63) != 0)
+			r.m_limbs.back() &= ((t_uint64(1) << (num_bits & 63)) - 1);
+
+		for (size_t i = 0; i < top_bits; i++) {
+			r.m_limbs[(num_bits - i - 1) >> 6] |= (t_uint64(1) << ((num_bits - i - 1) & 63));
+		}
+
+		r.m_limbs[0] |= t_uint64(odd);
+		r.normalize();
+		return r;
+	}
+
+
+	t_mp_uint operator + (const t_mp_uint& b) const { return (add(*this, b)); }
+	t_mp_uint operator - (const t_mp_uint& b) const { return (sub(*this, b)); }
+	t_mp_uint operator * (const t_mp_uint& b) const { return (mul(*this, b)); }
+	t_mp_uint operator / (const t_mp_uint& b) const { t_mp_uint q; div_mod(*this, b, &q, nullptr); return q; }
+	t_mp_uint operator % (const t_mp_uint& b) const { t_mp_uint r; div_mod(*this, b, nullptr, &r); return r; }
+	t_mp_uint operator << (size_t n) const { return (shl(*this, n)); }
+	t_mp_uint operator >> (size_t n) const { return (shr(*this, n)); }
+
+	bool operator == (const t_mp_uint& b) const { return (m_limbs == b.m_limbs); }
+	bool operator != (const t_mp_uint& b) const { return (m_limbs != b.m_limbs); }
+	bool operator <  (const t_mp_uint& b) const { return (cmp(*this, b) <  0); }
+	bool operator >= (const t_mp_uint& b) const { return (cmp(*this, b) >= 0); }
+
+private:
+	void normalize() {
+		while (!m_limbs.empty() && m_limbs.back() == 0)
+			m_limbs.pop_back();
+	}
+
+private:
+	std::vector<t_uint64> m_limbs;
+};
+
+
+
+// precomputed constants for Montgomery arithmetic modulo an odd
+// <n> of k limbs, with R = 2^(64k); values in Montgomery form are
+// stored as fixed-size arrays of k limbs and always fully reduced
+//
+// immutable after construction, so one context can be shared by
+// any number of threads
+struct t_mont_ctx {
+public:
+	t_mont_ctx() {}
+	t_mont_ctx(const t_mp_uint& n) {
+		assert(n.is_odd());
+		assert(n.num_limbs() <= MP_MAX_MONT_LIMBS);
+
+		m_num_limbs = n.num_limbs();
+		m_modulus = n;
+		m_n.assign(n.limbs(), n.limbs() + m_num_limbs);
+
+		// -n^-1 mod 2^64 by Newton iteration (each step doubles the correct low bits)
+		t_uint64 inv = m_n[0];
+
+		for (unsigned int i = 0; i < 5; i++) {
+			inv *= (2 - m_n[0] * inv);
+		}
+
+		m_n0_inv = -inv;
+
+		load(t_mp_uint(1) << (64 * m_num_limbs), m_one);
+		load(t_mp_uint(1) << (128 * m_num_limbs), m_r2);
+	}
+
+	size_t num_limbs() const { return m_num_limbs; }
+	const t_mp_uint& modulus() const { return m_modulus; }
+
+	// <a> mod n as fixed-width limb array
+	void load(const t_mp_uint& a, std::vector<t_uint64>& r) const {
+		const t_mp_uint b = (a < m_modulus)? a: (a % m_modulus);
+
+		r.assign(m_num_limbs, 0);
+		std::copy(b.limbs(), b.limbs() + b.num_limbs(), r.begin());
+	}
+
+	void to_mont(const t_mp_uint& a, std::vector<t_uint64>& r) const {
+		load(a, r);
+		mul(r.data(), r.data(), m_r2.data());
+	}
+
+	t_mp_uint from_mont(const t_uint64* a) const {
+		std::vector<t_uint64> one(m_num_limbs, 0);
+		std::vector<t_uint64> r(m_num_limbs, 0);
+
+		one[0] = 1;
+		mul(r.data(), a, one.data());
+
+		return (t_mp_uint::from_limbs(r.data(), r.size()));
+	}
+
+	const std::vector<t_uint64>& mont_one() const { return m_one; }
+
+
+	// r = a * b * R^-1 mod n by coarsely integrated operand scanning
+	// (CIOS, Koc et al.); inputs must be reduced, <r> may alias them
+	void mul(t_uint64* r, const t_uint64* a, const t_uint64* b) const {
+		const size_t k = m_num_limbs;
+		const t_uint64* n = m_n.data();
+
+		t_uint64 t[MP_MAX_MONT_LIMBS + 2];
+
+		std::fill(t, t + k + 2, 0);
+
+		for (size_t i = 0; i < k; i++) {
+			t_uint64 c = 0;
+
+			for (size_t j = 0; j < k; j++) {
+				const t_uint128 p = t_uint128(a[j]) * b[i] + t[j] + c;
+
+				t[j] = t_uint64(p);
+				c = t_uint64(p >> 64);
+			}
+
+			const t_uint128 s = t_uint128(t[k]) + c;
+
+			t[k    ] = t_uint64(s);
+			t[k + 1] = t_uint64(s >> 64);
+
+			// add m * n such that the lowest limb becomes zero, then shift down one limb
+			const t_uint64 m = t[0] * m_n0_inv;
+
+			c = t_uint64((t_uint128(m) * n[0] + t[0]) >> 64);
+
+			for (size_t j = 1; j < k; j++) {
+				const t_uint128 p = t_uint128(m) * n[j] + t[j] + c;
+
+				t[j - 1] = t_uint64(p);
+				c = t_uint64(p >> 64);
+			}
+
+			const t_uint128 u = t_uint128(t[k]) + c;
+
+			t[k - 1] = t_uint64(u);
+			t[k    ] = t[k + 1] + t_uint64(u >> 64);
+		}
+
+		// t < 2n, one conditional subtraction finishes the reduction
+		bool ge = (t[k] != 0);
+
+		if (!ge) {
+			ge = true;
+
+			for (size_t i = k; i > 0; i--) {
+				if (t[i - 1] != n[i - 1]) {
+					ge = (t[i - 1] > n[i - 1]);
+					break;
+				}
+			}
+		}
+
+		if (ge) {
+			t_uint64 borrow = 0;
+
+			for (size_t i = 0; i < k; i++) {
+				const t_uint128 d = t_uint128(t[i]) - n[i] - borrow;
+
+				r[i] = t_uint64(d);
+				borrow = ((d >> 64) != 0);
+			}
+		} else {
+			std::copy(t, t + k, r);
+		}
+	}
+
+
+	// (b ^ e) mod n by left-to-right sliding-window exponentiation over
+	// a table of precomputed odd powers of <b>; the window grows with the
+	// exponent size so that table setup stays small relative to the scan
+	t_mp_uint exp(const t_mp_uint& b, const t_mp_uint& e) const {
+		const size_t k = m_num_limbs;
+		const size_t num_bits = e.num_bits();
+		const size_t win_size = window_size(num_bits);
+
+		if (num_bits == 0)
+			return (from_mont(m_one.data()));
+
+		// table[i] holds b^(2i + 1) in Montgomery form
+		std::vector<t_uint64> table((size_t(1) << (win_size - 1)) * k);
+		std::vector<t_uint64> bb(k);
+		std::vector<t_uint64> acc(k);
+		std::vector<t_uint64> tmp;
+
+		to_mont(b, tmp);
+		std::copy(tmp.begin(), tmp.end(), table.begin());
+		mul(bb.data(), table.data(), table.data());
+
+		for (size_t i = 1; i < (size_t(1) << (win_size - 1)); i++) {
+			mul(&table[i * k], &table[(i - 1) * k], bb.data());
+		}
+
+		// true until the first window, saves squaring the initial 1's
+		bool acc_is_one = true;
+
+		for (size_t i = num_bits; i > 0; ) {
+			if (!e.test_bit(i - 1)) {
+				if (!acc_is_one)
+					mul(acc.data(), acc.data(), acc.data());
+
+				i -= 1;
+				continue;
+			}
+
+			// longest window [j, i) of at most win_size bits whose lowest bit is set
+			size_t j = (i > win_size)? (i - win_size): 0;
+			size_t w = 0;
+
+			while (!e.test_bit(j))
+				j += 1;
+
+			for (size_t n = i; n > j; n--) {
+				w = (w << 1) | e.test_bit(n - 1);
+			}
+
+			if (acc_is_one) {
+				std::copy(&table[(w >> 1) * k], &table[(w >> 1) * k] + k, acc.begin());
+				acc_is_one = false;
+			} else {
+				for (size_t n = i; n > j; n--) {
+					mul(acc.data(), acc.data(), acc.data());
+				}
+
+				mul(acc.data(), acc.data(), &table[(w >> 1) * k]);
+			}
+
+			i = j;
+		}
+
+		return (from_mont(acc.data()));
+	}
+
+private:
+	static size_t window_size(size_t num_bits) {
+		if (num_bits > 671) return 6;
+		if (num_bits > 239) return 5;
+		if (num_bits >  79) return 4;
+		if (num_bits >  23) return 3;
+		return 1;
+	}
+
+private:
+	size_t m_num_limbs = 0;
+
+	t_uint64 m_n0_inv = 0;
+
+	t_mp_uint m_modulus;
+
+	std::vector<t_uint64> m_n;
+	std::vector<t_uint64> m_one; // R mod n
+	std::vector<t_uint64> m_r2; // R^2 mod n
+};
+
+
+
+// reference exponentiation-by-squaring with a full division after
+// every product, the multi-precision analogue of mod_exp_v1
+static t_mp_uint mp_mod_exp_v0(const t_mp_uint& b, const t_mp_uint& e, const t_mp_uint& n) {
+	t_mp_uint r = t_mp_uint(1) % n;
+	t_mp_uint m = b % n;
+
+	for (size_t i = 0; i < e.num_bits(); i++) {
+		if (e.test_bit(i))
+			r = (r * m) % n;
+
+		m = (m * m) % n;
+	}
+
+	return r;
+}
+
+// inverse of <a> modulo small <m> (requires gcd(a, m) = 1)
+static t_uint64 mod_inv_small(t_uint64 a, t_uint64 m) {
+	long long int t0 = 0, t1 = 1;
+	long long int r0 = m, r1 = a % m;
+
+	while (r1 != 0) {
+		const long long int q = r0 / r1;
+		const long long int t2 = t0 - q * t1;
+		const long long int r2 = r0 - q * r1;
+
+		t0 = t1; t1 = t2;
+		r0 = r1; r1 = r2;
+	}
+
+	assert(r0 == 1);
+	return ((t0 < 0)? (t0 + m): t0);
+}
+
+
+
+static bool mp_miller_rabin_test(const t_mp_uint& n, size_t k, t_mp_rng& rng) {
+	if (n < t_mp_uint(4))
+		return (n == t_mp_uint(2) || n == t_mp_uint(3));
+	if (!n.is_odd())
+		return false;
+
+	const t_mp_uint n1 = n - t_mp_uint(1);
+	const t_mont_ctx ctx(n);
+
+	// n - 1 = d * 2^s
+	size_t s = 0;
+
+	while (!n1.test_bit(s))
+		s += 1;
+
+	const t_mp_uint d = n1 >> s;
+
+	std::vector<t_uint64> x;
+	std::vector<t_uint64> m1;
+
+	ctx.to_mont(n1, m1);
+
+	for (size_t i = 0; i < k; i++) {
+		// witness in [2, n - 2]
+		const t_mp_uint a = t_mp_uint::random(n.num_bits() - 1, 0, false, rng) % (n - t_mp_uint(3)) + t_mp_uint(2);
+
+		ctx.to_mont(ctx.exp(a, d), x);
+
+		if (x == ctx.mont_one() || x == m1)
+			continue;
+
+		size_t r = 1;
+
+		for (; r < s; r++) {
+			ctx.mul(x.data(), x.data(), x.data());
+
+			if (x == m1)
+				break;
+		}
+
+		if (r == s)
+			return false;
+	}
+
+	return true;
+}
+
+// odd primes below MP_TRIAL_DIVISION_BOUND
+static const std::vector<t_uint32>& mp_small_primes() {
+	static const std::vector<t_uint32> primes = []() {
+		std::vector<t_uint32> w = {3, 5, 7};
+		segmented_prime_number_sieve(MP_TRIAL_DIVISION_BOUND - 1, w, 1);
+		return w;
+	}();
+
+	return primes;
+}
+
+// incremental search from a random odd starting point p0: the residues
+// of p0 modulo all small primes are computed once, after which trial
+// division of every candidate (p0 + delta) costs one word-sized add and
+// modulo per prime (stopping at the first hit) instead of a multi-word
+// division, and only survivors reach the Miller-Rabin test
+static t_mp_uint mp_random_prime(size_t num_bits, t_mp_rng& rng) {
+	assert(num_bits >= 32);
+
+	const std::vector<t_uint32>& small_primes = mp_small_primes();
+
+	std::vector<t_uint32> residues(small_primes.size());
+
+	while (true) {
+		// top two bits set so the product of two such primes has exactly 2 * num_bits
+		const t_mp_uint p0 = t_mp_uint::random(num_bits, 2, true, rng);
+		const t_uint64 e_residue = t_mp_uint::mod_small(p0, MP_PUBLIC_EXPONENT);
+
+		for (size_t i = 0; i < small_primes.size(); i++) {
+			residues[i] = t_mp_uint::mod_small(p0, small_primes[i]);
+		}
+
+		for (t_uint64 delta = 0; delta < MP_PRIME_SEARCH_SPAN; delta += 2) {
+			size_t i = 0;
+
+			while (i < small_primes.size() && ((residues[i] + delta) % small_primes[i]) != 0)
+				i += 1;
+
+			if (i < small_primes.size())
+				continue;
+
+			// e must be invertible mod (p - 1)
+			if (((e_residue + delta) % MP_PUBLIC_EXPONENT) == 1)
+				continue;
+
+			const t_mp_uint p = p0 + t_mp_uint(delta);
+
+			// ran past the top of the range, start over
+			if (p.num_bits() != num_bits)
+				break;
+
+			if (mp_miller_rabin_test(p, MP_MILLER_RABIN_ROUNDS, rng))
+				return p;
+		}
+	}
+}
+
+
+
+struct t_mp_rsa_key {
+	t_mp_rsa_key() {}
+	// public key, or private key without CRT parameters
+	t_mp_rsa_key(const t_mp_uint& mod, const t_mp_uint& exp) {
+		m_modulus = mod;
+		m_exponent = exp;
+		m_mont_n = t_mont_ctx(mod);
+	}
+	// private key; exponentiations are split over p and q and recombined
+	// by the Chinese Remainder Theorem, which works on half-size numbers
+	// with half-size exponents (roughly 4x less work)
+	t_mp_rsa_key(const t_mp_uint& p, const t_mp_uint& q, const t_mp_uint& d) {
+		m_modulus = p * q;
+		m_exponent = d;
+		m_mont_n = t_mont_ctx(m_modulus);
+
+		m_p = p;
+		m_q = q;
+		m_dp = d % (p - t_mp_uint(1));
+		m_dq = d % (q - t_mp_uint(1));
+
+		m_mont_p = t_mont_ctx(p);
+		m_mont_q = t_mont_ctx(q);
+
+		// p is prime, so q^-1 = q^(p - 2) mod p
+		m_qinv = m_mont_p.exp(q % p, p - t_mp_uint(2));
+	}
+
+	// computes (m ^ k) % n
+	t_mp_uint apply(const t_mp_uint& m) const {
+		if (!has_crt())
+			return (m_mont_n.exp(m, m_exponent));
+
+		return (apply_crt(m));
+	}
+
+	t_mp_uint apply_crt(const t_mp_uint& m) const {
+		const t_mp_uint m1 = m_mont_p.exp(m % m_p, m_dp);
+		const t_mp_uint m2 = m_mont_q.exp(m % m_q, m_dq);
+
+		// Garner's recombination: m2 + q * (qinv * (m1 - m2) mod p)
+		const t_mp_uint h = (m_qinv * ((m1 + m_p) - (m2 % m_p))) % m_p;
+
+		return (m2 + h * m_q);
+	}
+
+	bool has_crt() const { return (!m_p.is_zero()); }
+
+	const t_mp_uint& get_modulus() const { return m_modulus; }
+	const t_mp_uint& get_exponent() const { return m_exponent; }
+	const t_mp_uint& get_p() const { return m_p; }
+	const t_mp_uint& get_q() const { return m_q; }
+
+	// number of message bytes per block; always below the modulus
+	size_t get_block_size() const { return ((m_modulus.num_bits() - 1) / 8); }
+	// number of bytes per encrypted block
+	size_t get_byte_size() const { return ((m_modulus.num_bits() + 7) / 8); }
+	// number of hex digits per encrypted block
+	size_t get_hex_size() const { return (get_byte_size() * 2); }
+
+private:
+	t_mp_uint m_modulus;  // n = pq
+	t_mp_uint m_exponent; // d or e
+
+	// CRT parameters (zero for public keys)
+	t_mp_uint m_p;
+	t_mp_uint m_q;
+	t_mp_uint m_dp; // d mod (p - 1)
+	t_mp_uint m_dq; // d mod (q - 1)
+	t_mp_uint m_qinv; // q^-1 mod p
+
+	t_mont_ctx m_mont_n;
+	t_mont_ctx m_mont_p;
+	t_mont_ctx m_mont_q;
+};
+
+struct t_mp_rsa_keypair {
+	t_mp_rsa_keypair(const t_mp_rsa_key& pub, const t_mp_rsa_key& pri) {
+		m_pub_key = pub;
+		m_pri_key = pri;
+	}
+
+	const t_mp_rsa_key& get_public_key() const { return m_pub_key; }
+	const t_mp_rsa_key& get_private_key() const { return m_pri_key; }
+
+	std::string to_string() const {
+		const std::string n = m_pub_key.get_modulus().to_hex_string();
+		const std::string e = m_pub_key.get_exponent().to_hex_string();
+		const std::string p = m_pri_key.get_p().to_hex_string();
+		const std::string q = m_pri_key.get_q().to_hex_string();
+		const std::string d = m_pri_key.get_exponent().to_hex_string();
+
+		const std::string s1 = "\tpublic key: (n, e) = (" + n + ", " + e + ")";
+		const std::string s2 = "\tprivate key: (p, q, d) = (" + p + ", " + q + ", " + d + ")";
+		return (s1 + "\n" + s2);
+	}
+
+private:
+	t_mp_rsa_key m_pub_key; // (n, e)
+	t_mp_rsa_key m_pri_key; // (p, q, d)
+};
+
+
+
+static t_mp_rsa_keypair generate_mp_rsa_keys(size_t num_bits, t_mp_rng& rng) {
+	assert(num_bits >= 64);
+
+	t_mp_uint p;
+	t_mp_uint q;
+
+	do {
+		p = mp_random_prime(num_bits - (num_bits / 2), rng);
+		q = mp_random_prime(num_bits / 2, rng);
+	} while (p == q);
+
+	if (p < q)
+		std::swap(p, q);
+
+	const t_mp_uint e = MP_PUBLIC_EXPONENT;
+	const t_mp_uint m = (p - t_mp_uint(1)) * (q - t_mp_uint(1));
+
+	// since e is small, d = (1 + k * m) / e for the k in [0, e)
+	// that makes the numerator divisible, ie. k = -m^-1 mod e
+	t_uint64 mr = 0;
+	t_mp_uint::div_small(m, MP_PUBLIC_EXPONENT, &mr);
+
+	const t_uint64 k = (MP_PUBLIC_EXPONENT - mod_inv_small(mr, MP_PUBLIC_EXPONENT)) % MP_PUBLIC_EXPONENT;
+	const t_mp_uint d = t_mp_uint::div_small(t_mp_uint(1) + t_mp_uint(k) * m, MP_PUBLIC_EXPONENT, nullptr);
+
+	const t_mp_rsa_key pub_key(p * q, e);
+	const t_mp_rsa_key pri_key(p, q, d);
+
+	return (t_mp_rsa_keypair(pub_key, pri_key));
+}
+
+
+
+// splits raw message bytes into blocks of key->get_block_size() bytes
+// (the last one zero-padded) and writes each transformed block as a
+// fixed-width hex string
+static std::string mp_rsa_encrypt_message(const t_mp_rsa_key* key, const std::string& msg) {
+	const size_t size = key->get_block_size();
+
+	std::vector<t_uint8> block(size);
+	std::string s;
+
+	for (size_t i = 0; i < msg.size(); i += size) {
+		std::fill(block.begin(), block.end(), 0);
+		std::copy(msg.begin() + i, msg.begin() + std::min(i + size, msg.size()), block.begin());
+
+		s += key->apply(t_mp_uint::from_bytes(block.data(), size)).to_hex_string(key->get_hex_size());
+	}
+
+	return s;
+}
+
+// inverse of mp_rsa_encrypt_message, strips the trailing padding; returns
+// false if <msg> is not a sequence of hex blocks each smaller than n
+static bool mp_rsa_decrypt_message(const t_mp_rsa_key* key, const std::string& msg, std::string& s) {
+	const size_t size = key->get_block_size();
+	const size_t hsize = key->get_hex_size();
+
+	if ((msg.size() % hsize) != 0)
+		return false;
+
+	std::vector<t_uint8> block(size);
+	t_mp_uint c;
+
+	s.clear();
+
+	for (size_t i = 0; i < msg.size(); i += hsize) {
+		if (!t_mp_uint::from_hex_string(msg.substr(i, hsize), c) || t_mp_uint::cmp(c, key->get_modulus()) >= 0)
+			return false;
+
+		key->apply(c).to_bytes(block.data(), size);
+		s.append(block.begin(), block.end());
+	}
+
+	while (!s.empty() && s[s.size() - 1] == 0)
+		s.erase(s.size() - 1);
+
+	return true;
+}
+
+
+
+
+// batched RSA over a stream of length-prefixed records; every record
+// is a 32-bit little-endian byte count followed by that many bytes
+//
+// in the encrypting direction (--enc, --sig) a record is a message
+// which is cut into key->get_block_size() byte blocks (the last one
+// zero-padded) and turned into key->get_byte_size() bytes per block;
+// the decrypting direction (--dec, --aut) reverses this and strips
+// the padding, so records must not end in zero bytes
+//
+// all blocks of a batch of records are independent exponentiations
+// which are fanned out over the thread pool, output records are then
+// written in input order
+struct t_mp_rsa_batch {
+public:
+	t_mp_rsa_batch(const t_mp_rsa_key* key, bool encrypt, size_t num_threads): m_thread_pool(num_threads) {
+		m_key = key;
+		m_encrypt = encrypt;
+
+		m_in_block_size  = encrypt? key->get_block_size(): key->get_byte_size();
+		m_out_block_size = encrypt? key->get_byte_size(): key->get_block_size();
+	}
+
+	// processes records from <in> until EOF, returns false on a malformed record or write error
+	bool run(FILE* in, FILE* out) {
+		while (true) {
+			const bool eof = !read_batch(in);
+
+			// a malformed record invalidates the whole batch
+			if (m_error)
+				break;
+
+			process_batch();
+
+			for (const t_record& rec: m_records) {
+				if (!write_record(out, rec.output)) {
+					fprintf(stderr, "[%s] failed to write record\n", __FUNCTION__);
+					m_error = true;
+					break;
+				}
+			}
+
+			if (eof || m_error)
+				break;
+		}
+
+		// buffered write errors may only surface here
+		if (fflush(out) != 0) {
+			fprintf(stderr, "[%s] failed to flush output\n", __FUNCTION__);
+			m_error = true;
+		}
+
+		return (!m_error);
+	}
+
+	// transforms <records> in place (no I/O), used by the benchmark
+	void run(std::vector< std::vector<t_uint8> >& records) {
+		m_records.resize(records.size());
+
+		for (size_t i = 0; i < records.size(); i++) {
+			m_records[i].input.swap(records[i]);
+		}
+
+		process_batch();
+
+		for (size_t i = 0; i < records.size(); i++) {
+			records[i].swap(m_records[i].output);
+		}
+	}
+
+	size_t get_num_ops() const { return m_num_ops; }
+	const t_work_stealing_pool& get_thread_pool() const { return m_thread_pool; }
+
+private:
+	struct t_record {
+		std::vector<t_uint8> input;
+		std::vector<t_uint8> output;
+	};
+
+	struct t_block_task {
+		t_uint32 record;
+		t_uint32 block;
+	};
+
+	bool read_record(FILE* f, std::vector<t_uint8>& buf) {
+		t_uint8 hdr[4];
+
+		const size_t hdr_size = fread(hdr, 1, 4, f);
+
+		// clean EOF only between records
+		if (hdr_size == 0)
+			return false;
+
+		if (hdr_size != 4) {
+			fprintf(stderr, "[%s] record %lu: truncated header\n", __FUNCTION__, m_records.size());
+			m_error = true;
+			return false;
+		}
+
+		const size_t rec_size = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | (t_uint32(hdr[3]) << 24);
+
+		// check before allocating; the header is not trusted
+		if (rec_size > (MP_MAX_RECORD_BLOCKS * m_in_block_size)) {
+			fprintf(stderr, "[%s] record %lu: size %lu exceeds %lu\n", __FUNCTION__, m_records.size(), rec_size, MP_MAX_RECORD_BLOCKS * m_in_block_size);
+			m_error = true;
+			return false;
+		}
+
+		buf.resize(rec_size);
+
+		if (buf.empty() || fread(buf.data(), 1, buf.size(), f) == buf.size())
+			return true;
+
+		fprintf(stderr, "[%s] record %lu: truncated\n", __FUNCTION__, m_records.size());
+		m_error = true;
+		return false;
+	}
+
+	static bool write_record(FILE* f, const std::vector<t_uint8>& buf) {
+		const t_uint32 n = buf.size();
+		const t_uint8 hdr[4] = {t_uint8(n), t_uint8(n >> 8), t_uint8(n >> 16), t_uint8(n >> 24)};
+
+		if (fwrite(hdr, 1, 4, f) != 4)
+			return false;
+
+		return (fwrite(buf.data(), 1, buf.size(), f) == buf.size());
+	}
+
+	// reads records until the batch holds MP_BATCH_BLOCKS blocks, false at EOF
+	bool read_batch(FILE* in) {
+		size_t num_blocks = 0;
+
+		m_records.clear();
+
+		while (num_blocks < MP_BATCH_BLOCKS) {
+			t_record rec;
+
+			if (!read_record(in, rec.input))
+				return false;
+
+			if (!m_encrypt && (rec.input.size() % m_in_block_size) != 0) {
+				fprintf(stderr, "[%s] record %lu: size %lu is not a multiple of %lu\n", __FUNCTION__, m_records.size(), rec.input.size(), m_in_block_size);
+				m_error = true;
+				return false;
+			}
+
+			num_blocks += ((rec.input.size() + m_in_block_size - 1) / m_in_block_size);
+			m_records.push_back(std::move(rec));
+		}
+
+		return true;
+	}
+
+	void process_batch() {
+		m_tasks.clear();
+
+		for (size_t i = 0; i < m_records.size(); i++) {
+			t_record& rec = m_records[i];
+
+			const size_t num_blocks = (rec.input.size() + m_in_block_size - 1) / m_in_block_size;
+
+			for (size_t j = 0; j < num_blocks; j++) {
+				m_tasks.push_back({t_uint32(i), t_uint32(j)});
+			}
+
+			rec.output.assign(num_blocks * m_out_block_size, 0);
+		}
+
+		m_thread_pool.run(m_tasks.size(), [&](size_t task_idx, size_t) {
+			const t_block_task& task = m_tasks[task_idx];
+			t_record& rec = m_records[task.record];
+
+			const size_t ofs = task.block * m_in_block_size;
+			const size_t len = std::min(m_in_block_size, rec.input.size() - ofs);
+
+			// copy since the last block of a message may be partial
+			t_uint8 block[MP_MAX_MONT_LIMBS * 8] = {0};
+
+			std::copy(&rec.input[ofs], &rec.input[ofs] + len, block);
+
+			const t_mp_uint r = m_key->apply(t_mp_uint::from_bytes(block, m_in_block_size));
+
+			r.to_bytes(&rec.output[task.block * m_out_block_size], m_out_block_size);
+		});
+
+		if (!m_encrypt) {
+			for (t_record& rec: m_records) {
+				while (!rec.output.empty() && rec.output.back() == 0)
+					rec.output.pop_back();
+			}
+		}
+
+		m_num_ops += m_tasks.size();
+	}
+
+private:
+	const t_mp_rsa_key* m_key;
+
+	std::vector<t_record> m_records;
+	std::vector<t_block_task> m_tasks;
+
+	t_work_stealing_pool m_thread_pool;
+
+	size_t m_in_block_size;
+	size_t m_out_block_size;
+	size_t m_num_ops = 0;
+
+	bool m_encrypt;
+	bool m_error = false;
+};
+
+
+
+
+static bool encrypt_message(const int argc, const char** argv) {
+	if (argc != 5) {
+		printf("[%s] usage: %s --enc <\"message\"> <n> <e>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	const std::string& msg = argv[2];
+	const std::string&  ns = argv[3];
+	const std::string&  es = argv[4];
+
+	t_uint8 encoded_msg[MAX_MSG_LEN + 1] = {0};
+	t_uint32 cipher_txt[MAX_MSG_LEN + 1] = {0};
+
+	const t_uint32 n = str2type<t_uint32>(ns);
+	const t_uint32 e = str2type<t_uint32>(es);
+	const t_uint32 s = NUM_DECIMAL_DIGITS(n);
+
+	const t_rsa_key pub_key(n, e, s);
+
+	rsa_encode_message(msg.c_str(), encoded_msg);
+	rsa_encrypt_message(&pub_key, encoded_msg, cipher_txt);
+
+	// show the encoded plaintext message,
+	// then output the encrypted message
+	write_decrypted_message(encoded_msg, &pub_key);
+	write_encrypted_message(cipher_txt, &pub_key);
+	return true;
+}
+
+static bool decrypt_message(const int argc, const char** argv) {
+	if (argc != 5) {
+		printf("[%s] usage: %s --dec <\"message\"> <n> <d>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	const std::string& msg = argv[2];
+	const std::string&  ns = argv[3];
+	const std::string&  ds = argv[4];
+
+	t_uint32 decoded_msg[MAX_MSG_LEN + 1] = {0};
+	t_uint8 plaintxt_msg[MAX_MSG_LEN + 1] = {0};
+
+	const t_uint32 n = str2type<t_uint32>(ns);
+	const t_uint32 d = str2type<t_uint32>(ds);
+	const t_uint32 s = NUM_DECIMAL_DIGITS(n);
+
+	const t_rsa_key pri_key(n, d, s);
+
+	rsa_decode_message(&pri_key, msg.c_str(), decoded_msg);
+	rsa_decrypt_message(&pri_key, decoded_msg, plaintxt_msg);
+
+	// show the decoded ciphertext message,
+	// then output the decrypted message
+	write_encrypted_message(decoded_msg, &pri_key);
+	write_decrypted_message(plaintxt_msg, &pri_key);
+	return true;
+}
+
+static bool sign_message(const int argc, const char** argv) {
+	if (argc != 5) {
+		printf("[%s] usage: %s --sig <\"message\"> <n> <d>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	const std::string& msg = argv[2];
+	const std::string&  ns = argv[3];
+	const std::string&  ds = argv[4];
+
+	t_uint8 encoded_msg[MAX_MSG_LEN + 1] = {0};
+	t_uint32 cipher_txt[MAX_MSG_LEN + 1] = {0};
+
+	const t_uint32 n = str2type<t_uint32>(ns);
+	const t_uint32 d = str2type<t_uint32>(ds);
+	const t_uint32 s = NUM_DECIMAL_DIGITS(n);
+
+	const t_rsa_key pri_key(n, d, s);
+
+	rsa_encode_message(msg.c_str(), encoded_msg);
+	rsa_encrypt_message(&pri_key, encoded_msg, cipher_txt);
+
+	// output the ciphertext signature
+	write_encrypted_message(cipher_txt, &pri_key);
+	return true;
+}
+
+static bool auth_message(const int argc, const char** argv) {
+	if (argc != 5) {
+		printf("[%s] usage: %s --aut <\"message\"> <n> <e>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	const std::string& msg = argv[2];
+	const std::string&  ns = argv[3];
+	const std::string&  es = argv[4];
+
+	t_uint32 decoded_msg[MAX_MSG_LEN + 1] = {0};
+	t_uint8 plaintxt_msg[MAX_MSG_LEN + 1] = {0};
+
+	const t_uint32 n = str2type<t_uint32>(ns);
+	const t_uint32 e = str2type<t_uint32>(es);
+	const t_uint32 s = NUM_DECIMAL_DIGITS(n);
+
+	const t_rsa_key pub_key(n, e, s);
+
+	rsa_decode_message(&pub_key, msg.c_str(), decoded_msg);
+	rsa_decrypt_message(&pub_key, decoded_msg, plaintxt_msg);
+
+	// output the plaintext signature
+	write_decrypted_message(plaintxt_msg, &pub_key);
+	return true;
+}
+
+static bool gen_keypair(const int argc, const char** argv) {
+	if (argc != 2) {
+		printf("[%s] usage: %s --gen\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	// generate a key-pair
+	const t_rsa_keypair kp = generate_rsa_keys(false);
+	const std::string& kps = kp.to_string();
+
+	printf("[%s]\n%s\n", __FUNCTION__, kps.c_str());
+	return true;
+}
+
+
+
+// builds a public key from hex arguments <n> <e>, or a private one from
+// <p> <q> <d>; rejects non-hex input and moduli the Montgomery contexts
+// cannot take (even, or wider than MP_MAX_MONT_LIMBS)
+static bool parse_mp_rsa_key(const char** args, bool pub, t_mp_rsa_key& key) {
+	t_mp_uint vals[3];
+
+	for (size_t i = 0; i < (pub? 2: 3); i++) {
+		if (!t_mp_uint::from_hex_string(args[i], vals[i])) {
+			fprintf(stderr, "[%s] \"%s\" is not a hex number\n", __FUNCTION__, args[i]);
+			return false;
+		}
+	}
+
+	const t_mp_uint n = pub? vals[0]: (vals[0] * vals[1]);
+
+	if (!n.is_odd() || n.num_bits() < 16 || n.num_limbs() > MP_MAX_MONT_LIMBS || (!pub && (!vals[0].is_odd() || !vals[1].is_odd()))) {
+		fprintf(stderr, "[%s] unsupported modulus\n", __FUNCTION__);
+		return false;
+	}
+
+	key = pub? t_mp_rsa_key(vals[0], vals[1]): t_mp_rsa_key(vals[0], vals[1], vals[2]);
+	return true;
+}
+
+static bool encrypt_mp_message(const int argc, const char** argv) {
+	if (argc != 5) {
+		printf("[%s] usage: %s --menc <\"message\"> <n> <e>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	t_mp_rsa_key pub_key;
+
+	if (!parse_mp_rsa_key(argv + 3, true, pub_key))
+		return false;
+
+	const std::string cipher_txt = mp_rsa_encrypt_message(&pub_key, argv[2]);
+
+	printf("[%s] ciphertext: %s\n", __FUNCTION__, cipher_txt.c_str());
+	return true;
+}
+
+static bool decrypt_mp_message(const int argc, const char** argv) {
+	if (argc != 6) {
+		printf("[%s] usage: %s --mdec <\"message\"> <p> <q> <d>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	t_mp_rsa_key pri_key;
+	std::string plain_txt;
+
+	if (!parse_mp_rsa_key(argv + 3, false, pri_key))
+		return false;
+
+	if (!mp_rsa_decrypt_message(&pri_key, argv[2], plain_txt)) {
+		fprintf(stderr, "[%s] malformed ciphertext\n", __FUNCTION__);
+		return false;
+	}
+
+	printf("[%s] plaintext: %s\n", __FUNCTION__, plain_txt.c_str());
+	return true;
+}
+
+static bool sign_mp_message(const int argc, const char** argv) {
+	if (argc != 6) {
+		printf("[%s] usage: %s --msig <\"message\"> <p> <q> <d>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	t_mp_rsa_key pri_key;
+
+	if (!parse_mp_rsa_key(argv + 3, false, pri_key))
+		return false;
+
+	const std::string signature = mp_rsa_encrypt_message(&pri_key, argv[2]);
+
+	printf("[%s] signature: %s\n", __FUNCTION__, signature.c_str());
+	return true;
+}
+
+static bool auth_mp_message(const int argc, const char** argv) {
+	if (argc != 5) {
+		printf("[%s] usage: %s --maut <\"signature\"> <n> <e>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	t_mp_rsa_key pub_key;
+	std::string plain_txt;
+
+	if (!parse_mp_rsa_key(argv + 3, true, pub_key))
+		return false;
+
+	if (!mp_rsa_decrypt_message(&pub_key, argv[2], plain_txt)) {
+		fprintf(stderr, "[%s] malformed signature\n", __FUNCTION__);
+		return false;
+	}
+
+	printf("[%s] plaintext: %s\n", __FUNCTION__, plain_txt.c_str());
+	return true;
+}
+
+static bool gen_mp_keypair(const int argc, const char** argv) {
+	if (argc != 3) {
+		printf("[%s] usage: %s --mgen <bits>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	t_mp_rng rng((std::random_device())());
+
+	const t_mp_rsa_keypair kp = generate_mp_rsa_keys(atoi(argv[2]), rng);
+	const std::string& kps = kp.to_string();
+
+	printf("[%s]\n%s\n", __FUNCTION__, kps.c_str());
+	return true;
+}
+
+
+
+static bool run_unit_test(const int argc, const char** argv) {
+	if (argc != 3) {
+		printf("[%s] usage: %s --tst <N>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	for (unsigned int i = atoi(argv[2]); i > 0; i--) {
+		const t_uint32 m = random(); // 985743564
+		const t_uint32 k = random(); //    385746
+		const t_uint32 n = random(); //   2054687
+
+		const t_uint32 v0 = mod_exp_v0(m, k, n);
+		const t_uint32 v1 = mod_exp_v1(m, k, n);
+		const t_uint32 v2 = mod_exp_v2(m, k, n);
+		const t_uint32 v3 = mod_exp_v3(m, k, n);
+
+		printf("[%u] %u^%u mod %u=%u\n", i, m, k, n, v0);
+		printf("[%u] %u^%u mod %u=%u\n", i, m, k, n, v1);
+		printf("[%u] %u^%u mod %u=%u\n", i, m, k, n, v2);
+		printf("[%u] %u^%u mod %u=%u\n", i, m, k, n, v3);
+
+		assert(v0 == v1);
+		assert(v1 == v2);
+		assert(v2 == v3);
+	}
+
+	return true;
+}
+
+// compares the prime generators up to <n>; the exact ones must agree,
+// the Fermat test can additionally let Carmichael numbers through
+static bool run_prime_test(const int argc, const char** argv) {
+	if (argc != 4) {
+		printf("[%s] usage: %s --ptst <n> <threads>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	const t_uint32 n = strtoul(argv[2], nullptr, 10);
+	const size_t num_threads = std::max(1, atoi(argv[3]));
+
+	std::vector<t_uint32> w[4];
+	double dt[4] = {0.0, 0.0, 0.0, 0.0};
+
+	for (unsigned int i = 0; i < 4; i++) {
+		const auto t0 = std::chrono::steady_clock::now();
+
+		switch (i) {
+			case 0: { eratosthenes_prime_number_sieve(n, w[i]); } break;
+			case 1: { segmented_prime_number_sieve(n, w[i], num_threads); } break;
+			case 2: { miller_rabin_prime_number_sieve(n, w[i]); } break;
+			case 3: { fermat_prime_number_sieve(n, 20, w[i]); } break;
+		}
+
+		const auto t1 = std::chrono::steady_clock::now();
+
+		dt[i] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+	}
+
+	printf("[%s] n=%u threads=%lu\n", __FUNCTION__, n, num_threads);
+	printf("[%s] eratosthenes: primes=%lu time=%.2fms\n", __FUNCTION__, w[0].size(), dt[0]);
+	printf("[%s] segmented:    primes=%lu time=%.2fms\n", __FUNCTION__, w[1].size(), dt[1]);
+	printf("[%s] miller-rabin: primes=%lu time=%.2fms\n", __FUNCTION__, w[2].size(), dt[2]);
+	printf("[%s] fermat:       primes=%lu time=%.2fms\n", __FUNCTION__, w[3].size(), dt[3]);
+
+	assert(w[0] == w[1]);
+	assert(w[0] == w[2]);
+	return true;
+}
+
+// checks the Montgomery and CRT paths against mp_mod_exp_v0 and
+// times a private-key operation through each of them
+static bool run_mp_unit_test(const int argc, const char** argv) {
+	if (argc != 4) {
+		printf("[%s] usage: %s --mtst <bits> <N>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	const size_t num_bits = atoi(argv[2]);
+	const size_t num_reps = atoi(argv[3]);
+
+	t_mp_rng rng((std::random_device())());
+
+	const auto t0 = std::chrono::steady_clock::now();
+	const t_mp_rsa_keypair kp = generate_mp_rsa_keys(num_bits, rng);
+	const auto t1 = std::chrono::steady_clock::now();
+
+	const t_mp_rsa_key& pub_key = kp.get_public_key();
+	const t_mp_rsa_key& pri_key = kp.get_private_key();
+	const t_mp_uint& n = pub_key.get_modulus();
+
+	double dt[3] = {0.0, 0.0, 0.0};
+
+	for (size_t i = 0; i < num_reps; i++) {
+		const t_mp_uint m = t_mp_uint::random(num_bits - 1, 0, false, rng);
+		const t_mp_uint c = pub_key.apply(m);
+
+		const auto s0 = std::chrono::steady_clock::now();
+		const t_mp_uint v0 = mp_mod_exp_v0(c, pri_key.get_exponent(), n);
+		const auto s1 = std::chrono::steady_clock::now();
+		const t_mp_rsa_key nocrt_key(n, pri_key.get_exponent());
+		const t_mp_uint v1 = nocrt_key.apply(c);
+		const auto s2 = std::chrono::steady_clock::now();
+		const t_mp_uint v2 = pri_key.apply(c);
+		const auto s3 = std::chrono::steady_clock::now();
+
+		dt[0] += std::chrono::duration<double, std::milli>(s1 - s0).count();
+		dt[1] += std::chrono::duration<double, std::milli>(s2 - s1).count();
+		dt[2] += std::chrono::duration<double, std::milli>(s3 - s2).count();
+
+		assert(v0 == m);
+		assert(v1 == m);
+		assert(v2 == m);
+	}
+
+	printf("[%s] bits=%lu keygen=%.2fms\n", __FUNCTION__, num_bits, std::chrono::duration<double, std::milli>(t1 - t0).count());
+	printf("[%s] private-key op (ms): {naive,montgomery,montgomery+crt}={%.3f,%.3f,%.3f}\n", __FUNCTION__, dt[0] / num_reps, dt[1] / num_reps, dt[2] / num_reps);
+	return true;
+}
+
+static bool run_mp_batch(const int argc, const char** argv) {
+	const std::string mode = (argc > 2)? argv[2]: "";
+
+	const bool pub_mode = (mode == "--enc" || mode == "--aut");
+	const bool pri_mode = (mode == "--dec" || mode == "--sig");
+
+	if ((!pub_mode && !pri_mode) || (pub_mode && argc != 8) || (pri_mode && argc != 9)) {
+		printf("[%s] usage: %s --mbat <--enc | --aut> <threads> <infile | -> <outfile | -> <n> <e>\n", __FUNCTION__, argv[0]);
+		printf("[%s] usage: %s --mbat <--dec | --sig> <threads> <infile | -> <outfile | -> <p> <q> <d>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	t_mp_rsa_key key;
+
+	if (!parse_mp_rsa_key(argv + 6, pub_mode, key))
+		return false;
+
+	FILE*  in = (strcmp(argv[4], "-") == 0)? stdin : fopen(argv[4], "rb");
+	FILE* out = (strcmp(argv[5], "-") == 0)? stdout: fopen(argv[5], "wb");
+
+	if (in == nullptr || out == nullptr) {
+		fprintf(stderr, "[%s] failed to open \"%s\" or \"%s\"\n", __FUNCTION__, argv[4], argv[5]);
+		return false;
+	}
+
+	t_mp_rsa_batch batch(&key, (mode == "--enc" || mode == "--sig"), std::max(1, atoi(argv[3])));
+
+	const auto t0 = std::chrono::steady_clock::now();
+	const bool ret = batch.run(in, out);
+	const auto t1 = std::chrono::steady_clock::now();
+	const double dt = std::chrono::duration<double>(t1 - t0).count();
+
+	if (in != stdin) fclose(in);
+	if (out != stdout) fclose(out);
+
+	// stdout may carry the output records, so report to stderr
+	fprintf(stderr, "[%s] ops=%lu time=%.3fs ops/s=%.1f\n", __FUNCTION__, batch.get_num_ops(), dt, batch.get_num_ops() / std::max(dt, 1e-9));
+	return ret;
+}
+
+// measures batch throughput of public- and private-key operations on
+// random single-block messages for 1, 2, 4, ... up to <max_threads>
+static bool run_mp_benchmark(const int argc, const char** argv) {
+	if (argc != 4 && argc != 5) {
+		printf("[%s] usage: %s --mbench <bits> <N> [max_threads]\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	const size_t num_bits = atoi(argv[2]);
+	const size_t num_msgs = atoi(argv[3]);
+	const size_t max_threads = (argc == 5)? atoi(argv[4]): std::max(1u, std::thread::hardware_concurrency());
+
+	t_mp_rng rng((std::random_device())());
+
+	const t_mp_rsa_keypair kp = generate_mp_rsa_keys(num_bits, rng);
+	const t_mp_rsa_key& pub_key = kp.get_public_key();
+	const t_mp_rsa_key& pri_key = kp.get_private_key();
+
+	std::vector< std::vector<t_uint8> > msgs(num_msgs, std::vector<t_uint8>(pub_key.get_block_size()));
+
+	for (std::vector<t_uint8>& msg: msgs) {
+		for (t_uint8& b: msg) {
+			b = rng();
+		}
+
+		// keep the padding-strip from eating message bytes
+		msg.back() |= 1;
+	}
+
+	printf("[%s] bits=%lu msgs=%lu\n", __FUNCTION__, num_bits, num_msgs);
+	printf("[%s] %8s %12s %12s %12s %12s\n", __FUNCTION__, "threads", "pub-ops/s", "pri-ops/s", "pub-speedup", "pri-speedup");
+
+	double base_rates[2] = {0.0, 0.0};
+
+	for (size_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+		t_mp_rsa_batch enc_batch(&pub_key, true, num_threads);
+		t_mp_rsa_batch dec_batch(&pri_key, false, num_threads);
+
+		std::vector< std::vector<t_uint8> > recs = msgs;
+
+		const auto t0 = std::chrono::steady_clock::now();
+		enc_batch.run(recs);
+		const auto t1 = std::chrono::steady_clock::now();
+		dec_batch.run(recs);
+		const auto t2 = std::chrono::steady_clock::now();
+
+		assert(recs == msgs);
+
+		const double rates[2] = {
+			num_msgs / std::chrono::duration<double>(t1 - t0).count(),
+			num_msgs / std::chrono::duration<double>(t2 - t1).count(),
+		};
+
+		if (num_threads == 1) {
+			base_rates[0] = rates[0];
+			base_rates[1] = rates[1];
+		}
+
+		printf("[%s] %8lu %12.1f %12.1f %12.2f %12.2f\n", __FUNCTION__, num_threads, rates[0], rates[1], rates[0] / base_rates[0], rates[1] / base_rates[1]);
+	}
+
+	return true;
+}
+
+static bool parse_args(const int argc, const char** argv) {
+	if (argc <= 1) {
+		printf("[%s] usage: %s <--enc | --dec | --sig | --aut | --gen | --tst | --ptst>\n", __FUNCTION__, argv[0]);
+		printf("[%s] usage: %s <--menc | --mdec | --msig | --maut | --mgen | --mtst | --mbat | --mbench>\n", __FUNCTION__, argv[0]);
+		return false;
+	}
+
+	if (strcmp(argv[1], "--enc") == 0) {
+		// encrypt a plaintext message with public key
+		return (encrypt_message(argc, argv));
+	}
+	if (strcmp(argv[1], "--dec") == 0) {
+		// decrypt a ciphertext message with private key
+		return (decrypt_message(argc, argv));
+	}
+
+	if (strcmp(argv[1], "--sig") == 0) {
+		// sign a plaintext message with private key
+		return (sign_message(argc, argv));
+	}
+	if (strcmp(argv[1], "--aut") == 0) {
+		// authenticate a ciphertext message with public key
+		return (auth_message(argc, argv));
+	}
+
+	if (strcmp(argv[1], "--gen") == 0) {
+		// generate a (public, private) pair of RSA keys
+		return (gen_keypair(argc, argv));
+	}
+
+	if (strcmp(argv[1], "--tst") == 0) {
+		return (run_unit_test(argc, argv));
+	}
+	if (strcmp(argv[1], "--ptst") == 0) {
+		return (run_prime_test(argc, argv));
+	}
+
+	// multi-precision variants, keys are hex strings
+	if (strcmp(argv[1], "--menc") == 0) {
+		return (encrypt_mp_message(argc, argv));
+	}
+	if (strcmp(argv[1], "--mdec") == 0) {
+		return (decrypt_mp_message(argc, argv));
+	}
+	if (strcmp(argv[1], "--msig") == 0) {
+		return (sign_mp_message(argc, argv));
+	}
+	if (strcmp(argv[1], "--maut") == 0) {
+		return (auth_mp_message(argc, argv));
+	}
+	if (strcmp(argv[1], "--mgen") == 0) {
+		return (gen_mp_keypair(argc, argv));
+	}
+	if (strcmp(argv[1], "--mtst") == 0) {
+		return (run_mp_unit_test(argc, argv));
+	}
+
+	if (strcmp(argv[1], "--mbat") == 0) {
+		// stream length-prefixed records from a file or stdin
+		return (run_mp_batch(argc, argv));
+	}
+	if (strcmp(argv[1], "--mbench") == 0) {
+		return (run_mp_benchmark(argc, argv));
 	}
 
 	return false;
@@ -1,11 +1,37 @@
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 #include <algorithm>
+#include <chrono>
 #include <functional>
 #include <iostream>
+#include <limits>
+#include <random>
+#include <thread>
 #include <vector>
 
+#include "simple_work_stealing_pool.hpp"
+
+// ranges of at most this many elements are finished by insertion sort
+#define SORT_INSERTION_SIZE 24
+// ranges larger than this take a ninther instead of a median-of-three pivot
+#define QSORT_NINTHER_SIZE 128
+// smallest number of elements per thread worth splitting a merge sort for
+#define MSORT_MIN_PARALLEL_SIZE (1u << 16)
+// smallest number of elements per thread worth splitting a radix pass for
+#define RADIX_MIN_PARALLEL_SIZE (1u << 16)
+// digit widths; 11-bit histograms (2048 counters) still fit in L1
+#define RADIX_LSD_DIGIT_BITS 11
+#define RADIX_MSD_DIGIT_BITS 8
+// MSD buckets of at most this many elements are finished by insertion sort
+#define RADIX_MSD_INSERTION_SIZE 32
+// inputs of at least this many elements are sorted MSD (in place) rather
+// than LSD, which needs a scratch copy of the keys and values
+#define RADIX_MSD_MIN_SIZE (1u << 26)
 
 
 enum {
@@ -60,17 +86,14 @@ template<typename type> type sum_array(const ext_vector<type>& v, size_t min_idx
 }
 
 
-template<typename type> bool
-is_array_sorted(const ext_vector<type>& v, const std::function<int(type, type)>& f) {
-	if (v.size() >= 2) {
-		const int s = f(v[0], v[1]);
-
-		for (size_t i = 1; i < (v.size() - 1); i++) {
-			if (f(v[i], v[i + 1]) == s)
-				continue;
-
+// comparators are taken as template parameters (<t_cmp_func>, called as
+// f(a, b) and returning one of CMP_*) so that functors like the ones
+// below are inlined; plain functions and std::function also still work
+template<typename type, typename t_cmp_func> bool
+is_array_sorted(const ext_vector<type>& v, const t_cmp_func& f) {
+	for (size_t i = 1; i < v.size(); i++) {
+		if (f(v[i], v[i - 1]) == CMP_LT)
 			return false;
-		}
 	}
 
 	return true;
@@ -92,193 +115,920 @@ template<typename type> int compare_func_inc(type v1, type v2) {
 	return CMP_EQ;
 }
 
+// branch-free functor versions of the above
+template<typename type> struct t_compare_dec {
+	int operator () (const type& v1, const type& v2) const { return (int(v1 < v2) - int(v1 > v2)); }
+};
+template<typename type> struct t_compare_inc {
+	int operator () (const type& v1, const type& v2) const { return (int(v1 > v2) - int(v1 < v2)); }
+};
+
+// adapts a three-way comparator to the strict-weak-order form std:: expects
+template<typename t_cmp_func> struct t_less_func {
+	t_less_func(const t_cmp_func& f): cmp(f) {}
+
+	template<typename type> bool operator () (const type& v1, const type& v2) const { return (cmp(v1, v2) == CMP_LT); }
+
+	const t_cmp_func& cmp;
+};
+
+
+
+static t_work_stealing_pool& get_thread_pool() {
+	static t_work_stealing_pool pool(std::max(std::thread::hardware_concurrency(), 1u));
+	return pool;
+}
+
+static void set_num_threads(size_t num_threads) {
+	if (num_threads != get_thread_pool().get_num_threads()) {
+		get_thread_pool().spawn_threads(num_threads);
+	}
+}
+
+
+
+// stable; sorts v[min_idx, max_idx)
+template<typename type, typename t_cmp_func> void
+insertion_sort(type* v, size_t min_idx, size_t max_idx, const t_cmp_func& f) {
+	for (size_t i = min_idx + 1; i < max_idx; i++) {
+		type x = std::move(v[i]);
+		size_t j = i;
+
+		for (; j > min_idx && f(x, v[j - 1]) == CMP_LT; j--)
+			v[j] = std::move(v[j - 1]);
+
+		v[j] = std::move(x);
+	}
+}
+
+// runs func(i, thread) for i in [0, num_tasks) on the pool, or inline for
+// a single task so serial jobs do not wake the workers
+template<typename t_func> static void run_tasks(size_t num_tasks, const t_func& func) {
+	if (num_tasks == 1) {
+		func(0, 0);
+	} else {
+		get_thread_pool().run(num_tasks, func);
+	}
+}
+
+static size_t floor_log2(size_t n) {
+	size_t k = 0;
+
+	while ((n >>= 1) != 0)
+		k += 1;
+
+	return k;
+}
+
 
 
 namespace lib_msort {
-	template<typename type> std::pair< ext_vector<type>, ext_vector<type> >
-	split_array(const ext_vector<type>& u) {
-		// in case <u> has a non-even number of elements,
-		// add the left-over element to the RHS sub-array
-		ext_vector<type> v((u.size() >> 1) +                0 );
-		ext_vector<type> w((u.size() >> 1) + int(u.size() & 1));
-
-		// play it safe on empty inputs
-		if (u.empty())
-			return (std::pair< ext_vector<type>, ext_vector<type> >(v, w));
-		if (u.size() == 1)
-			return (std::pair< ext_vector<type>, ext_vector<type> >(u, v));
-
-		std::copy(u.begin(),                   u.end() - (u.size() >> 1), v.begin());
-		std::copy(u.begin() + (u.size() >> 1), u.end(),                   w.begin());
-
-		return (std::pair< ext_vector<type>, ext_vector<type> >(v, w));
+	// stable merge of u[0, nu) and v[0, nv) into w; an element of <v> is
+	// only taken when it is strictly less, so equal keys keep their order
+	template<typename type, typename t_cmp_func> void
+	merge_runs(const type* u, size_t nu, const type* v, size_t nv, type* w, const t_cmp_func& f) {
+		size_t i = 0;
+		size_t j = 0;
+
+		while (i < nu && j < nv) {
+			const bool take_v = (f(v[j], u[i]) == CMP_LT);
+
+			*(w++) = take_v? v[j]: u[i];
+
+			j += (    take_v);
+			i += (1 - take_v);
+		}
+
+		w = std::copy(u + i, u + nu, w);
+		w = std::copy(v + j, v + nv, w);
 	}
 
-	template<typename type> ext_vector<type>
-	merge_arrays(const ext_vector<type>& u, const ext_vector<type>& v, const std::function<int(type, type)>& f) {
+	template<typename type, typename t_cmp_func> ext_vector<type>
+	merge_arrays(const ext_vector<type>& u, const ext_vector<type>& v, const t_cmp_func& f) {
 		assert(is_array_sorted(u, f));
 		assert(is_array_sorted(v, f));
 
-		// note: too big if intersect(u,v) != {}, should reserve+push
-		ext_vector<type> w(u.size() + v.size(), 0);
+		ext_vector<type> w;
+		w.resize(u.size() + v.size());
 
-		size_t u_idx = 0;
-		size_t v_idx = 0;
-		size_t w_idx = 0;
+		merge_runs(u.data(), u.size(), v.data(), v.size(), w.data(), f);
+		return w;
+	}
 
-		bool loop = true;
 
-		while (loop) {
-			if (u_idx >= u.size()) {
-				if (!(loop &= (v_idx < v.size())))
-					break;
+	// bottom-up merge sort of v[0, n) which ping-pongs between <v> and <buf>
+	// (each pass merges pairs of runs from one into the other) so nothing is
+	// allocated per level; the initial run width is chosen such that the
+	// number of passes leaves the result in <buf> if <to_buf> or in <v> else
+	template<typename type, typename t_cmp_func> void
+	sort_run(type* v, type* buf, size_t n, bool to_buf, const t_cmp_func& f) {
+		const size_t num_blocks = std::max((n + SORT_INSERTION_SIZE - 1) / SORT_INSERTION_SIZE, size_t(1));
+		// ceil(log2(num_blocks))
+		const size_t num_passes = floor_log2(num_blocks * 2 - 1);
 
-				// <u> exhausted, consume rest of <v>
-				w[w_idx++] = v[v_idx++];
-				continue;
+		// halving the initial width adds exactly one pass
+		size_t width = SORT_INSERTION_SIZE >> ((num_passes & 1) != to_buf);
+
+		for (size_t i = 0; i < n; i += width)
+			insertion_sort(v, i, std::min(i + width, n), f);
+
+		type* src = v;
+		type* dst = buf;
+
+		for (; width < n; width *= 2) {
+			for (size_t i = 0; i < n; i += (width * 2)) {
+				const size_t mid_idx = std::min(i + width, n);
+				const size_t max_idx = std::min(i + width * 2, n);
+
+				merge_runs(src + i, mid_idx - i, src + mid_idx, max_idx - mid_idx, dst + i, f);
 			}
-			if (v_idx >= v.size()) {
-				#if 0
-				// already checked above
-				if (!(loop &= (u_idx < u.size())))
-					break;
-				#endif
-
-				// <v> exhausted, consume rest of <u>
-				w[w_idx++] = u[u_idx++];
-				continue;
+
+			std::swap(src, dst);
+		}
+
+		// too few passes to fix the parity (n <= width)
+		if ((src == buf) != to_buf)
+			std::copy(src, src + n, dst);
+	}
+
+
+	// tournament tree over k sorted runs; internal nodes keep the loser of
+	// the match played there and the overall winner is kept aside, so after
+	// the winner is consumed only the log2(k) matches on the path up from
+	// its leaf are replayed with a single comparison per level (a binary
+	// heap needs two); ties go to the lower run index, which keeps a merge
+	// of consecutive runs stable
+	template<typename type, typename t_cmp_func> class t_loser_tree {
+	public:
+		t_loser_tree(const std::vector<const type*>& heads, const std::vector<const type*>& tails, const t_cmp_func& f): m_heads(heads), m_tails(tails), m_cmp(f) {
+			for (m_num_leaves = 1; m_num_leaves < heads.size(); m_num_leaves *= 2);
+
+			// padding leaves are empty runs and lose every match
+			m_heads.resize(m_num_leaves, nullptr);
+			m_tails.resize(m_num_leaves, nullptr);
+			m_losers.resize(m_num_leaves, 0);
+
+			m_winner = play(1);
+		}
+
+		const type& top() const { return (*m_heads[m_winner]); }
+
+		bool empty() const { return (m_heads[m_winner] == m_tails[m_winner]); }
+
+		void pop() {
+			size_t winner = m_winner;
+
+			m_heads[winner] += 1;
+
+			for (size_t n = (winner + m_num_leaves) >> 1; n != 0; n >>= 1) {
+				if (beats(m_losers[n], winner)) {
+					std::swap(m_losers[n], winner);
+				}
 			}
 
-			switch (f(u[u_idx], v[v_idx])) {
-				case CMP_LT: { w[w_idx++] = u[u_idx++]; } break;
-			//	case CMP_EQ: { w[w_idx++] = u[u_idx++]; } break;
-				case CMP_GT: { w[w_idx++] = v[v_idx++]; } break;
+			m_winner = winner;
+		}
+
+	private:
+		bool beats(size_t a, size_t b) const {
+			if (m_heads[b] == m_tails[b]) return true;
+			if (m_heads[a] == m_tails[a]) return false;
+
+			const int c = m_cmp(*m_heads[a], *m_heads[b]);
+			return (c == CMP_LT || (c == CMP_EQ && a < b));
+		}
+
+		size_t play(size_t node) {
+			if (node >= m_num_leaves)
+				return (node - m_num_leaves);
+
+			const size_t a = play(node * 2 + 0);
+			const size_t b = play(node * 2 + 1);
+
+			if (beats(a, b)) {
+				m_losers[node] = b;
+				return a;
 			}
+
+			m_losers[node] = a;
+			return b;
 		}
 
-		return w;
-	}
+	private:
+		std::vector<const type*> m_heads;
+		std::vector<const type*> m_tails;
+		std::vector<size_t> m_losers;
 
-	template<typename type> ext_vector<type> sort_array(const ext_vector<type>& v, const std::function<int(type, type)>& f) {
-		if (v.size() <= 1)
-			return v;
+		const t_cmp_func& m_cmp;
 
-		const std::pair< ext_vector<type>, ext_vector<type> >& p = split_array(v);
-		const ext_vector<type>& w = merge_arrays(sort_array(p.first, f), sort_array(p.second, f), f);
-		return w;
+		size_t m_num_leaves;
+		size_t m_winner;
+	};
+
+
+	// positions which split every run so that the first <rank> elements of
+	// their (stable) merge are runs[j][0, pos[j]); the merged rank of the
+	// p-th element of run j increases with p and is p plus its lower or
+	// upper bound in every other run, so each position is a binary search
+	template<typename type, typename t_cmp_func> void
+	split_runs(const std::vector<const type*>& heads, const std::vector<const type*>& tails, size_t rank, std::vector<const type*>& pos, const t_cmp_func& f) {
+		const t_less_func<t_cmp_func> less(f);
+
+		const auto calc_rank = [&](size_t j, const type* p) {
+			size_t r = p - heads[j];
+
+			// elements equal to *p come first if their run does
+			for (size_t i = 0; i < j; i++)
+				r += (std::upper_bound(heads[i], tails[i], *p, less) - heads[i]);
+			for (size_t i = j + 1; i < heads.size(); i++)
+				r += (std::lower_bound(heads[i], tails[i], *p, less) - heads[i]);
+
+			return r;
+		};
+
+		pos.resize(heads.size());
+
+		for (size_t j = 0; j < heads.size(); j++) {
+			size_t min_idx = 0;
+			size_t max_idx = tails[j] - heads[j];
+
+			while (min_idx < max_idx) {
+				const size_t mid_idx = (min_idx + max_idx) >> 1;
+
+				if (calc_rank(j, heads[j] + mid_idx) < rank) {
+					min_idx = mid_idx + 1;
+				} else {
+					max_idx = mid_idx;
+				}
+			}
+
+			pos[j] = heads[j] + min_idx;
+		}
 	}
 
 
+	// stable parallel merge sort; the array is cut into one run per pool
+	// thread and the runs are sorted concurrently (into a single scratch
+	// buffer), then the output is cut into as many equal segments which
+	// are each produced by a k-way loser-tree merge of the matching slices
+	// of all runs
+	template<typename type, typename t_cmp_func> void sort_array_ip(ext_vector<type>& v, const t_cmp_func& f) {
+		t_work_stealing_pool& pool = get_thread_pool();
+
+		const size_t num_elems = v.size();
+		const size_t num_runs = std::max(size_t(1), std::min(pool.get_num_threads(), num_elems / MSORT_MIN_PARALLEL_SIZE));
+
+		std::vector<type> buf(num_elems);
+
+		if (num_runs == 1) {
+			sort_run(v.data(), buf.data(), num_elems, false, f);
+			return;
+		}
+
+		std::vector<const type*> heads(num_runs);
+		std::vector<const type*> tails(num_runs);
 
-	// in-place version (TODO)
-	template<typename type> void sort_array_ip(ext_vector<type>&, const std::function<int(type, type)>&) {
+		for (size_t r = 0; r < num_runs; r++) {
+			heads[r] = buf.data() + (num_elems * (r + 0)) / num_runs;
+			tails[r] = buf.data() + (num_elems * (r + 1)) / num_runs;
+		}
+
+		pool.run(num_runs, [&](size_t r, size_t) {
+			const size_t min_idx = heads[r] - buf.data();
+			const size_t max_idx = tails[r] - buf.data();
+
+			sort_run(v.data() + min_idx, buf.data() + min_idx, max_idx - min_idx, true, f);
+		});
+
+		pool.run(num_runs, [&](size_t s, size_t) {
+			const size_t min_idx = (num_elems * (s + 0)) / num_runs;
+			const size_t max_idx = (num_elems * (s + 1)) / num_runs;
+
+			std::vector<const type*> min_pos;
+			std::vector<const type*> max_pos;
+
+			split_runs(heads, tails, min_idx, min_pos, f);
+			split_runs(heads, tails, max_idx, max_pos, f);
+
+			t_loser_tree<type, t_cmp_func> tree(min_pos, max_pos, f);
+
+			for (size_t i = min_idx; i < max_idx; i++) {
+				assert(!tree.empty());
+
+				v[i] = tree.top();
+				tree.pop();
+			}
+
+			assert(tree.empty());
+		});
+	}
+
+	template<typename type, typename t_cmp_func> ext_vector<type> sort_array(const ext_vector<type>& v, const t_cmp_func& f) {
+		ext_vector<type> w = v;
+		sort_array_ip(w, f);
+		return w;
 	}
 }
 
 
 namespace lib_qsort {
-	template<typename type> size_t calc_pivot_index(const ext_vector<type>& v, size_t min_idx, size_t max_idx) {
-		size_t idx = 0;
+	template<typename type, typename t_cmp_func> size_t
+	median_of_three(const type* v, size_t a, size_t b, size_t c, const t_cmp_func& f) {
+		if (f(v[b], v[a]) == CMP_LT)
+			std::swap(a, b);
+
+		// v[a] <= v[b]; the median is v[b] unless v[c] is smaller
+		if (f(v[c], v[b]) == CMP_LT)
+			b = (f(v[c], v[a]) == CMP_LT)? a: c;
+
+		return b;
+	}
+
+	// median of three elements, or for larger ranges Tukey's ninther (the
+	// median of three such medians) spread over the range [min_idx, max_idx)
+	template<typename type, typename t_cmp_func> size_t
+	calc_pivot_index(const type* v, size_t min_idx, size_t max_idx, const t_cmp_func& f) {
+		const size_t mid_idx = min_idx + ((max_idx - min_idx) >> 1);
+		const size_t step = (max_idx - min_idx) >> 3;
 
 		assert(min_idx < max_idx);
 
-		// calculate the average and the element closest in value to this average
-		// max_idx is inclusive, so number of elements is one more
-		const type sum = sum_array(v, min_idx, max_idx);
-		const type avg = sum / ((max_idx + 1) - min_idx);
-		      type dif = std::numeric_limits<type>::max();
+		if ((max_idx - min_idx) <= QSORT_NINTHER_SIZE)
+			return (median_of_three(v, min_idx, mid_idx, max_idx - 1, f));
+
+		const size_t a = median_of_three(v, min_idx               , min_idx + step, min_idx + step * 2, f);
+		const size_t b = median_of_three(v, mid_idx - step        , mid_idx       , mid_idx + step    , f);
+		const size_t c = median_of_three(v, max_idx - 1 - step * 2, max_idx - 1 - step, max_idx - 1  , f);
+
+		return (median_of_three(v, a, b, c, f));
+	}
+
+	// Hoare partition of [min_idx, max_idx) around the pivot, which is
+	// parked at min_idx meanwhile; returns the pivot's final index. both
+	// scans stop on keys equal to the pivot, which splits runs of equal
+	// keys evenly instead of degenerating
+	template<typename type, typename t_cmp_func> size_t
+	partition_array(type* v, size_t min_idx, size_t max_idx, const t_cmp_func& f) {
+		std::swap(v[min_idx], v[calc_pivot_index(v, min_idx, max_idx, f)]);
+
+		const type& pivot = v[min_idx];
+
+		size_t i = min_idx;
+		size_t j = max_idx;
+
+		while (true) {
+			while ((++i) < max_idx && f(v[i], pivot) == CMP_LT);
+			while (f(pivot, v[--j]) == CMP_LT);
+
+			if (i >= j)
+				break;
 
-		for (size_t n = min_idx; n <= max_idx; n++) {
-			if (std::max<type>(v[n] - avg, avg - v[n]) < dif) {
-				dif = std::max<type>(v[n] - avg, avg - v[n]);
-				idx = n;
+			std::swap(v[i], v[j]);
+		}
+
+		std::swap(v[min_idx], v[j]);
+		return j;
+	}
+
+	// introsort; recurses into the smaller side and loops on the larger so
+	// the stack stays O(log N), and falls back to heapsort once <depth>
+	// partitions have been made without the range getting small
+	template<typename type, typename t_cmp_func> void
+	sort_range_ip(type* v, size_t min_idx, size_t max_idx, size_t depth, const t_cmp_func& f) {
+		while ((max_idx - min_idx) > SORT_INSERTION_SIZE) {
+			if (depth == 0) {
+				std::make_heap(v + min_idx, v + max_idx, t_less_func<t_cmp_func>(f));
+				std::sort_heap(v + min_idx, v + max_idx, t_less_func<t_cmp_func>(f));
+				return;
+			}
+
+			const size_t pivot_idx = partition_array(v, min_idx, max_idx, f);
+
+			depth -= 1;
+
+			if ((pivot_idx - min_idx) < (max_idx - pivot_idx)) {
+				sort_range_ip(v, min_idx, pivot_idx, depth, f);
+				min_idx = pivot_idx + 1;
+			} else {
+				sort_range_ip(v, pivot_idx + 1, max_idx, depth, f);
+				max_idx = pivot_idx;
 			}
 		}
 
-		return idx;
+		insertion_sort(v, min_idx, max_idx, f);
 	}
 
-	template<typename type> void partition_array(ext_vector<type>& v, const std::function<int(type, type)>& f, size_t min_idx, size_t max_idx) {
-		if (min_idx >= max_idx)
+	// in-place version
+	template<typename type, typename t_cmp_func> void sort_array_ip(ext_vector<type>& v, const t_cmp_func& f) {
+		if (v.size() <= 1)
 			return;
 
-		const size_t raw_pivot_idx = calc_pivot_index(v, min_idx, max_idx);
-			  size_t new_pivot_idx = 0;
+		sort_range_ip(v.data(), 0, v.size(), floor_log2(v.size()) * 2, f);
+	}
 
-		const type raw_pivot_val = v[raw_pivot_idx];
 
-		size_t i = min_idx;
-		size_t j = max_idx;
 
-		{
-			// calculate the number of elements less than the pivot
-			for (size_t n = min_idx; n <= max_idx; n++) {
-				// new_pivot_idx += (v[n] < raw_pivot_val);
-				new_pivot_idx += (f(v[n], raw_pivot_val) == -1);
+	// out-of-place quicksort; each level partitions its range three ways
+	// from one buffer into the other (a counting pass, then a scatter pass
+	// that keeps equal keys in input order, which makes the sort stable)
+	// and the buffers trade roles for the level below. parts that are done
+	// (the keys equal to the pivot, and small or too-deep ranges) are put
+	// in <out>, which is one of the two buffers
+	template<typename type, typename t_cmp_func> void
+	sort_range_pp(type* src, type* dst, type* out, size_t min_idx, size_t max_idx, size_t depth, const t_cmp_func& f) {
+		if ((max_idx - min_idx) <= SORT_INSERTION_SIZE || depth == 0) {
+			if ((max_idx - min_idx) <= SORT_INSERTION_SIZE) {
+				insertion_sort(src, min_idx, max_idx, f);
+			} else {
+				std::stable_sort(src + min_idx, src + max_idx, t_less_func<t_cmp_func>(f));
 			}
 
-			// put the pivot in its proper place
-			std::swap(v[raw_pivot_idx], v[new_pivot_idx += min_idx]);
+			if (src != out)
+				std::copy(src + min_idx, src + max_idx, out + min_idx);
+
+			return;
 		}
 
-		// look for pairs of values that are inverted wrt the pivot
-		while (i < new_pivot_idx && j > new_pivot_idx) {
-			const int a = f(v[i], raw_pivot_val);
-			const int b = f(v[j], raw_pivot_val);
+		const type pivot = src[calc_pivot_index(src, min_idx, max_idx, f)];
 
-			if (a == CMP_GT && b == CMP_LT) {
-				std::swap(v[i], v[j]);
+		size_t num_lt = 0;
+		size_t num_eq = 0;
 
-				i++;
-				j--;
-			} else {
-				if (a == CMP_LT) { i++; }
-				if (b == CMP_GT) { j--; }
+		for (size_t n = min_idx; n < max_idx; n++) {
+			const int c = f(src[n], pivot);
+
+			num_lt += (c == CMP_LT);
+			num_eq += (c == CMP_EQ);
+		}
+
+		// write cursors for the {LT, EQ, GT} parts, indexed by CMP_* + 1
+		size_t part_idcs[3] = {min_idx, min_idx + num_lt, min_idx + num_lt + num_eq};
+
+		const size_t eq_min_idx = part_idcs[1];
+		const size_t eq_max_idx = part_idcs[2];
+
+		for (size_t n = min_idx; n < max_idx; n++) {
+			const int c = f(src[n], pivot);
+
+			assert(c >= CMP_LT && c <= CMP_GT);
+			dst[part_idcs[c + 1]++] = src[n];
+		}
+
+		if (dst != out)
+			std::copy(dst + eq_min_idx, dst + eq_max_idx, out + eq_min_idx);
+
+		sort_range_pp(dst, src, out, min_idx, eq_min_idx, depth - 1, f);
+		sort_range_pp(dst, src, out, eq_max_idx, max_idx, depth - 1, f);
+	}
+
+	template<typename type, typename t_cmp_func> ext_vector<type> sort_array(const ext_vector<type>& v, const t_cmp_func& f) {
+		ext_vector<type> w = v;
+		std::vector<type> buf(v.size());
+
+		if (v.size() <= 1)
+			return w;
+
+		sort_range_pp(w.data(), buf.data(), w.data(), 0, v.size(), floor_log2(v.size()) * 2, f);
+		return w;
+	}
+}
+
+namespace lib_rsort {
+	// maps keys to unsigned integers with the same order; signed integers
+	// have their sign bit flipped, IEEE floats have every bit flipped when
+	// negative (which reverses the magnitude order) and only the sign bit
+	// otherwise, so -0.0 sorts before +0.0 and NaNs go to the end matching
+	// their sign
+	template<typename type> struct t_radix_key;
+
+	template<> struct t_radix_key<uint32_t> {
+		typedef uint32_t t_bits;
+		static t_bits get_bits(uint32_t k) { return k; }
+	};
+	template<> struct t_radix_key<uint64_t> {
+		typedef uint64_t t_bits;
+		static t_bits get_bits(uint64_t k) { return k; }
+	};
+	template<> struct t_radix_key<int32_t> {
+		typedef uint32_t t_bits;
+		static t_bits get_bits(int32_t k) { return (uint32_t(k) ^ (uint32_t(1) << 31)); }
+	};
+	template<> struct t_radix_key<int64_t> {
+		typedef uint64_t t_bits;
+		static t_bits get_bits(int64_t k) { return (uint64_t(k) ^ (uint64_t(1) << 63)); }
+	};
+	template<> struct t_radix_key<float> {
+		typedef uint32_t t_bits;
+		static t_bits get_bits(float k) {
+			uint32_t b;
+			memcpy(&b, &k, sizeof(b));
+			return (b ^ (uint32_t(int32_t(b) >> 31) | (uint32_t(1) << 31)));
+		}
+	};
+	template<> struct t_radix_key<double> {
+		typedef uint64_t t_bits;
+		static t_bits get_bits(double k) {
+			uint64_t b;
+			memcpy(&b, &k, sizeof(b));
+			return (b ^ (uint64_t(int64_t(b) >> 63) | (uint64_t(1) << 63)));
+		}
+	};
+
+
+	// values which travel along with the keys; the key-only sorts use the
+	// empty t_no_values so the same passes compile without any value moves
+	struct t_no_values {
+		void move(size_t, t_no_values&, size_t) const {}
+		void swap(size_t, size_t) {}
+	};
+
+	template<typename t_val> struct t_value_array {
+		t_value_array(t_val* v): vals(v) {}
+
+		void move(size_t i, t_value_array& dst, size_t j) const { dst.vals[j] = vals[i]; }
+		void swap(size_t i, size_t j) { std::swap(vals[i], vals[j]); }
+
+		t_val* vals;
+	};
+
+
+	template<size_t DIGIT_BITS, typename type> size_t get_digit(const type& k, size_t shift) {
+		return ((t_radix_key<type>::get_bits(k) >> shift) & ((size_t(1) << DIGIT_BITS) - 1));
+	}
+
+
+	// stable LSD radix sort of keys[0, n) (and vals), ping-ponging with the
+	// scratch arrays. one read pass builds the histograms of every digit
+	// and passes whose digit is the same for all keys are skipped; with
+	// several threads each pass counts and scatters one chunk per thread,
+	// every chunk writing to its own slice of each bucket so the result is
+	// the same as the serial sort
+	template<typename type, typename t_values> void
+	sort_lsd(type* keys, type* key_buf, t_values vals, t_values val_buf, size_t n) {
+		typedef typename t_radix_key<type>::t_bits t_bits;
+
+		constexpr size_t NUM_DIGITS = (sizeof(t_bits) * 8 + RADIX_LSD_DIGIT_BITS - 1) / RADIX_LSD_DIGIT_BITS;
+		constexpr size_t NUM_BUCKETS = size_t(1) << RADIX_LSD_DIGIT_BITS;
+
+		const size_t num_chunks = std::max(size_t(1), std::min(get_thread_pool().get_num_threads(), n / RADIX_MIN_PARALLEL_SIZE));
+
+		// indexed by [chunk][digit][bucket]
+		std::vector<size_t> counts(num_chunks * NUM_DIGITS * NUM_BUCKETS, 0);
+		std::vector<size_t> offsets(num_chunks * NUM_BUCKETS);
+
+		const auto get_chunk_idx = [&](size_t c) { return ((n * c) / num_chunks); };
+		const auto get_count_idx = [&](size_t c, size_t d) { return ((c * NUM_DIGITS + d) * NUM_BUCKETS); };
+
+		run_tasks(num_chunks, [&](size_t c, size_t) {
+			size_t* chunk_counts = &counts[get_count_idx(c, 0)];
+
+			for (size_t i = get_chunk_idx(c); i < get_chunk_idx(c + 1); i++) {
+				const t_bits b = t_radix_key<type>::get_bits(keys[i]);
+
+				for (size_t d = 0; d < NUM_DIGITS; d++) {
+					chunk_counts[d * NUM_BUCKETS + ((b >> (d * RADIX_LSD_DIGIT_BITS)) & (NUM_BUCKETS - 1))] += 1;
+				}
+			}
+		});
+
+		type* src_keys = keys;
+		type* dst_keys = key_buf;
+
+		t_values* src_vals = &vals;
+		t_values* dst_vals = &val_buf;
+
+		// per-chunk counts are of the input order, so only valid for one pass
+		bool recount = false;
+
+		for (size_t d = 0; d < NUM_DIGITS; d++) {
+			const size_t shift = d * RADIX_LSD_DIGIT_BITS;
+
+			size_t sum = 0;
+			size_t max = 0;
+
+			for (size_t k = 0; k < NUM_BUCKETS; k++) {
+				size_t bucket_size = 0;
+
+				for (size_t c = 0; c < num_chunks; c++)
+					bucket_size += counts[get_count_idx(c, d) + k];
+
+				max = std::max(max, bucket_size);
+			}
+
+			if (max == n)
+				continue;
+
+			if (recount && num_chunks > 1) {
+				run_tasks(num_chunks, [&](size_t c, size_t) {
+					size_t* chunk_counts = &counts[get_count_idx(c, d)];
+
+					std::fill(chunk_counts, chunk_counts + NUM_BUCKETS, 0);
+
+					for (size_t i = get_chunk_idx(c); i < get_chunk_idx(c + 1); i++) {
+						chunk_counts[get_digit<RADIX_LSD_DIGIT_BITS>(src_keys[i], shift)] += 1;
+					}
+				});
+			}
+
+			for (size_t k = 0; k < NUM_BUCKETS; k++) {
+				for (size_t c = 0; c < num_chunks; c++) {
+					offsets[c * NUM_BUCKETS + k] = sum;
+					sum += counts[get_count_idx(c, d) + k];
+				}
 			}
+
+			run_tasks(num_chunks, [&](size_t c, size_t) {
+				size_t* chunk_offsets = &offsets[c * NUM_BUCKETS];
+
+				for (size_t i = get_chunk_idx(c); i < get_chunk_idx(c + 1); i++) {
+					const size_t j = chunk_offsets[get_digit<RADIX_LSD_DIGIT_BITS>(src_keys[i], shift)]++;
+
+					dst_keys[j] = src_keys[i];
+					src_vals->move(i, *dst_vals, j);
+				}
+			});
+
+			std::swap(src_keys, dst_keys);
+			std::swap(src_vals, dst_vals);
+
+			recount = true;
 		}
 
-		if ((max_idx - min_idx) > 1) {
-			partition_array(v, f, min_idx, new_pivot_idx);
-			partition_array(v, f, new_pivot_idx + 1, max_idx);
+		if (src_keys == keys)
+			return;
+
+		run_tasks(num_chunks, [&](size_t c, size_t) {
+			for (size_t i = get_chunk_idx(c); i < get_chunk_idx(c + 1); i++) {
+				keys[i] = key_buf[i];
+				val_buf.move(i, vals, i);
+			}
+		});
+	}
+
+
+	template<typename type, typename t_values> void
+	insertion_sort_keys(type* keys, t_values& vals, size_t min_idx, size_t max_idx) {
+		for (size_t i = min_idx + 1; i < max_idx; i++) {
+			for (size_t j = i; j > min_idx && t_radix_key<type>::get_bits(keys[j]) < t_radix_key<type>::get_bits(keys[j - 1]); j--) {
+				std::swap(keys[j], keys[j - 1]);
+				vals.swap(j, j - 1);
+			}
+		}
+	}
+
+	// permutes keys[min_idx, ...) in place into the buckets of the
+	// digit at <shift> (American flag sort: every element is swapped
+	// straight into the next free slot of its bucket, so each one moves at
+	// most once) and fills <bounds> with the bucket boundaries
+	template<typename type, typename t_values> void
+	partition_msd(type* keys, t_values& vals, size_t min_idx, size_t shift, const size_t* counts, size_t* bounds) {
+		constexpr size_t NUM_BUCKETS = size_t(1) << RADIX_MSD_DIGIT_BITS;
+
+		size_t heads[NUM_BUCKETS];
+
+		bounds[0] = min_idx;
+
+		for (size_t k = 0; k < NUM_BUCKETS; k++) {
+			heads[k] = bounds[k];
+			bounds[k + 1] = bounds[k] + counts[k];
+		}
+
+		for (size_t k = 0; k < NUM_BUCKETS; k++) {
+			while (heads[k] < bounds[k + 1]) {
+				// follow the cycle starting at the head of bucket k with the
+				// key held in a register; its value stays in the vacated
+				// slot, which it is swapped through along with the key
+				type key = keys[heads[k]];
+				size_t d = get_digit<RADIX_MSD_DIGIT_BITS>(key, shift);
+
+				while (d != k) {
+					std::swap(key, keys[heads[d]]);
+					vals.swap(heads[k], heads[d]);
+
+					heads[d] += 1;
+					d = get_digit<RADIX_MSD_DIGIT_BITS>(key, shift);
+				}
+
+				keys[heads[k]++] = key;
+			}
 		}
 	}
 
-	// in-place recursive version
-	template<typename type> void sort_array_ip(ext_vector<type>& v, const std::function<int(type, type)>& f) {
-		partition_array(v, f, 0, v.size() - 1);
+	template<typename type, typename t_values> void
+	sort_msd(type* keys, t_values& vals, size_t min_idx, size_t max_idx, size_t shift) {
+		constexpr size_t NUM_BUCKETS = size_t(1) << RADIX_MSD_DIGIT_BITS;
+
+		if ((max_idx - min_idx) <= RADIX_MSD_INSERTION_SIZE) {
+			insertion_sort_keys(keys, vals, min_idx, max_idx);
+			return;
+		}
+
+		size_t counts[NUM_BUCKETS] = {0};
+		size_t bounds[NUM_BUCKETS + 1];
+
+		for (size_t i = min_idx; i < max_idx; i++)
+			counts[get_digit<RADIX_MSD_DIGIT_BITS>(keys[i], shift)] += 1;
+
+		// if all keys share this digit the permutation is a plain scan
+		partition_msd(keys, vals, min_idx, shift, counts, bounds);
+
+		if (shift == 0)
+			return;
+
+		for (size_t k = 0; k < NUM_BUCKETS; k++) {
+			// most buckets are empty or singletons near the bottom
+			if ((bounds[k + 1] - bounds[k]) > 1) {
+				sort_msd(keys, vals, bounds[k], bounds[k + 1], shift - RADIX_MSD_DIGIT_BITS);
+			}
+		}
 	}
 
+	// unstable in-place MSD radix sort; the top-level histogram is counted
+	// in parallel chunks and the buckets below it are sorted as independent
+	// pool tasks (work stealing evens out skewed bucket sizes)
+	template<typename type, typename t_values> void sort_msd(type* keys, t_values vals, size_t n) {
+		typedef typename t_radix_key<type>::t_bits t_bits;
 
+		constexpr size_t NUM_BUCKETS = size_t(1) << RADIX_MSD_DIGIT_BITS;
+		constexpr size_t TOP_SHIFT = sizeof(t_bits) * 8 - RADIX_MSD_DIGIT_BITS;
 
-	template<typename type> ext_vector<type> sort_array(const ext_vector<type>& v, const std::function<int(type, type)>& f) {
-		if (v.size() <= 1)
-			return v;
+		static_assert(((sizeof(t_bits) * 8) % RADIX_MSD_DIGIT_BITS) == 0, "");
 
-		// use the average value as pivot
-		const type pivot = sum_array(v, 0, v.size() - 1) / v.size();
+		const size_t num_chunks = std::max(size_t(1), std::min(get_thread_pool().get_num_threads(), n / RADIX_MIN_PARALLEL_SIZE));
 
-		ext_vector<type> vlt; vlt.reserve(v.size());
-		ext_vector<type> veq; veq.reserve(v.size());
-		ext_vector<type> vgt; vgt.reserve(v.size());
+		if (num_chunks == 1) {
+			sort_msd(keys, vals, 0, n, TOP_SHIFT);
+			return;
+		}
+
+		std::vector<size_t> chunk_counts(num_chunks * NUM_BUCKETS, 0);
 
-		for (size_t n = 0; n < v.size(); n++) {
-			switch (f(v[n], pivot)) {
-				case CMP_LT: { vlt.push_back(v[n]); } break;
-				case CMP_EQ: { veq.push_back(v[n]); } break;
-				case CMP_GT: { vgt.push_back(v[n]); } break;
+		size_t counts[NUM_BUCKETS] = {0};
+		size_t bounds[NUM_BUCKETS + 1];
+
+		run_tasks(num_chunks, [&](size_t c, size_t) {
+			for (size_t i = (n * c) / num_chunks; i < (n * (c + 1)) / num_chunks; i++) {
+				chunk_counts[c * NUM_BUCKETS + get_digit<RADIX_MSD_DIGIT_BITS>(keys[i], TOP_SHIFT)] += 1;
+			}
+		});
+
+		for (size_t c = 0; c < num_chunks; c++) {
+			for (size_t k = 0; k < NUM_BUCKETS; k++) {
+				counts[k] += chunk_counts[c * NUM_BUCKETS + k];
 			}
 		}
 
-		return (sort_array(vlt, f) + veq + sort_array(vgt, f));
+		partition_msd(keys, vals, 0, TOP_SHIFT, counts, bounds);
+
+		run_tasks(NUM_BUCKETS, [&](size_t k, size_t) {
+			t_values bucket_vals = vals;
+			sort_msd(keys, bucket_vals, bounds[k], bounds[k + 1], TOP_SHIFT - RADIX_MSD_DIGIT_BITS);
+		});
 	}
+
+
+	// ascending order; small inputs go through LSD (stable, but needs a copy
+	// of the keys and values), large ones through in-place MSD
+	template<typename type> void sort_array_ip(ext_vector<type>& v) {
+		if (v.size() >= RADIX_MSD_MIN_SIZE) {
+			sort_msd(v.data(), t_no_values(), v.size());
+		} else {
+			std::vector<type> buf(v.size());
+			sort_lsd(v.data(), buf.data(), t_no_values(), t_no_values(), v.size());
+		}
+	}
+
+	// key-value version; vals[i] moves along with keys[i]
+	template<typename type, typename t_val> void sort_array_ip(ext_vector<type>& keys, ext_vector<t_val>& vals) {
+		assert(keys.size() == vals.size());
+
+		if (keys.size() >= RADIX_MSD_MIN_SIZE) {
+			sort_msd(keys.data(), t_value_array<t_val>(vals.data()), keys.size());
+		} else {
+			std::vector<type> key_buf(keys.size());
+			std::vector<t_val> val_buf(vals.size());
+			sort_lsd(keys.data(), key_buf.data(), t_value_array<t_val>(vals.data()), t_value_array<t_val>(val_buf.data()), keys.size());
+		}
+	}
+
+	template<typename type> ext_vector<type> sort_array(const ext_vector<type>& v) {
+		ext_vector<type> w = v;
+		sort_array_ip(w);
+		return w;
+	}
+}
+
+
+
+
+template<typename type, typename t_sort_func> static void
+run_benchmark_case(const char* name, const ext_vector<type>& u, const ext_vector<type>& ref, const t_sort_func& sort_func) {
+	ext_vector<type> v = u;
+
+	const auto t0 = std::chrono::steady_clock::now();
+	sort_func(v);
+	const auto t1 = std::chrono::steady_clock::now();
+
+	printf("[%s] %-16s %9.1fms %s\n", __func__, name, std::chrono::duration<double, std::milli>(t1 - t0).count(), (v == ref)? "ok": "WRONG");
 }
 
+static void run_benchmark(size_t num_elems, size_t num_threads) {
+	typedef  t_compare_inc<int>  t_cmp_func;
+
+	const t_cmp_func f;
+	const t_less_func<t_cmp_func> less(f);
+
+	std::mt19937 rng(num_elems);
+
+	set_num_threads(num_threads);
+
+	for (const uint32_t num_keys: {0u, 100u}) {
+		ext_vector<int> u;
+		ext_vector<int> ref;
+
+		u.resize(num_elems);
+
+		// <num_keys> = 0 means all keys are (probably) distinct
+		for (size_t n = 0; n < num_elems; n++)
+			u[n] = (num_keys == 0)? int(rng()): int(rng() % num_keys);
+
+		ref = u;
+		std::sort(ref.begin(), ref.end());
+
+		printf("[%s] elems=%lu keys=%s threads=%lu\n", __func__, num_elems, (num_keys == 0)? "random": "few", num_threads);
+
+		run_benchmark_case("std::sort"       , u, ref, [&](ext_vector<int>& v) { std::sort(v.begin(), v.end(), less); });
+		run_benchmark_case("std::stable_sort", u, ref, [&](ext_vector<int>& v) { std::stable_sort(v.begin(), v.end(), less); });
+		run_benchmark_case("qsort (ip)"      , u, ref, [&](ext_vector<int>& v) { lib_qsort::sort_array_ip(v, f); });
+		run_benchmark_case("qsort (pp)"      , u, ref, [&](ext_vector<int>& v) { v = lib_qsort::sort_array(v, f); });
+		run_benchmark_case("msort (ip)"      , u, ref, [&](ext_vector<int>& v) { lib_msort::sort_array_ip(v, f); });
+		run_benchmark_case("radix (lsd)"     , u, ref, [&](ext_vector<int>& v) { std::vector<int> buf(v.size()); lib_rsort::sort_lsd(v.data(), buf.data(), lib_rsort::t_no_values(), lib_rsort::t_no_values(), v.size()); });
+		run_benchmark_case("radix (msd)"     , u, ref, [&](ext_vector<int>& v) { lib_rsort::sort_msd(v.data(), lib_rsort::t_no_values(), v.size()); });
+	}
+
+	{
+		ext_vector<float> keys;
+		ext_vector<uint32_t> vals;
+
+		keys.resize(num_elems);
+		vals.resize(num_elems);
+
+		for (size_t n = 0; n < num_elems; n++) {
+			keys[n] = std::normal_distribution<float>(0.0f, 1000.0f)(rng);
+			vals[n] = n;
+		}
+
+		printf("[%s] elems=%lu keys=float+value threads=%lu\n", __func__, num_elems, num_threads);
 
+		const ext_vector<float> src_keys = keys;
 
+		ext_vector<float> std_keys = keys;
+		ext_vector<uint32_t> std_vals = vals;
 
+		std::vector< std::pair<float, uint32_t> > pairs(num_elems);
+
+		const auto t0 = std::chrono::steady_clock::now();
+
+		// std::sort has no key-value form; zip, sort, unzip
+		for (size_t n = 0; n < num_elems; n++)
+			pairs[n] = {std_keys[n], std_vals[n]};
+
+		std::sort(pairs.begin(), pairs.end(), [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return (a.first < b.first); });
+
+		for (size_t n = 0; n < num_elems; n++) {
+			std_keys[n] = pairs[n].first;
+			std_vals[n] = pairs[n].second;
+		}
+
+		const auto t1 = std::chrono::steady_clock::now();
+
+		lib_rsort::sort_array_ip(keys, vals);
+
+		const auto t2 = std::chrono::steady_clock::now();
+
+		size_t num_errors = (keys != std_keys);
+
+		for (size_t n = 0; n < num_elems; n++)
+			num_errors += (src_keys[vals[n]] != keys[n]);
+
+		printf("[%s] %-16s %9.1fms\n", __func__, "std::sort", std::chrono::duration<double, std::milli>(t1 - t0).count());
+		printf("[%s] %-16s %9.1fms %s\n", __func__, "radix", std::chrono::duration<double, std::milli>(t2 - t1).count(), (num_errors == 0)? "ok": "WRONG");
+	}
+}
+
+
+
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		// --bench [elems] [threads]
+		run_benchmark(
+			(argc > 2)? atol(argv[2]): 100000000,
+			(argc > 3)? atoi(argv[3]): std::thread::hardware_concurrency()
+		);
+		return 0;
+	}
 
-int main() {
-	const std::function<int(int, int)> f = &compare_func_inc<int>;
+	const t_compare_inc<int> f;
 
 	const ext_vector<int> u = { {325435, 123, 717, 2687, 79374, 56987, 3456, 1123095, 25968} };
 	const ext_vector<int> v = lib_msort::sort_array(u, f);
@@ -293,7 +1043,7 @@ int main() {
 	print_array(u);
 	print_array(v); assert(is_array_sorted(v, f));
 	print_array(w); assert(is_array_sorted(w, f));
-	print_array(a);
+	print_array(a); assert(is_array_sorted(a, f));
 	print_array(b); assert(is_array_sorted(b, f));
 	return 0;
 }
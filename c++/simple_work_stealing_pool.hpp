@@ -0,0 +1,343 @@
+#ifndef SIMPLE_WORK_STEALING_POOL_HDR
+#define SIMPLE_WORK_STEALING_POOL_HDR
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+
+
+// Chase-Lev deque of task indices (fixed capacity, C11 formulation by
+// Le et al.); the owning thread pushes and pops at the bottom, thieves
+// take from the top so they contend with the owner only for the last
+// remaining element
+struct t_work_stealing_deque {
+public:
+	static constexpr uint32_t NULL_TASK = ~uint32_t(0);
+
+	void resize(size_t capacity) {
+		size_t size = 2;
+
+		while (size < capacity)
+			size *= 2;
+
+		if (size > (m_index_mask + 1)) {
+			m_tasks.reset(new std::atomic<uint32_t>[size]);
+			m_index_mask = size - 1;
+		}
+
+		m_top.store(0, std::memory_order_relaxed);
+		m_bottom.store(0, std::memory_order_relaxed);
+	}
+
+	// owner only
+	bool push(uint32_t task) {
+		const int64_t b = m_bottom.load(std::memory_order_relaxed);
+		const int64_t t = m_top.load(std::memory_order_acquire);
+
+		if ((b - t) > int64_t(m_index_mask))
+			return false;
+
+		m_tasks[b & m_index_mask].store(task, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// owner only
+	uint32_t pop() {
+		const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+
+		m_bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		int64_t t = m_top.load(std::memory_order_relaxed);
+
+		if (t > b) {
+			// empty
+			m_bottom.store(b + 1, std::memory_order_relaxed);
+			return NULL_TASK;
+		}
+
+		uint32_t task = m_tasks[b & m_index_mask].load(std::memory_order_relaxed);
+
+		if (t == b) {
+			// last element; race against thieves
+			if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				task = NULL_TASK;
+
+			m_bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		return task;
+	}
+
+	// any thread
+	uint32_t steal() {
+		int64_t t = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = m_bottom.load(std::memory_order_acquire);
+
+		if (t >= b)
+			return NULL_TASK;
+
+		const uint32_t task = m_tasks[t & m_index_mask].load(std::memory_order_relaxed);
+
+		// lost the race against the owner or another thief
+		if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return NULL_TASK;
+
+		return task;
+	}
+
+	bool empty() const { return (m_top.load(std::memory_order_acquire) >= m_bottom.load(std::memory_order_acquire)); }
+
+private:
+	alignas(CACHE_LINE_SIZE) std::atomic<int64_t> m_top = {0};
+	alignas(CACHE_LINE_SIZE) std::atomic<int64_t> m_bottom = {0};
+
+	std::unique_ptr< std::atomic<uint32_t>[] > m_tasks;
+
+	size_t m_index_mask = 0;
+};
+
+
+
+// pool of persistent worker threads which execute jobs consisting of
+// many small independent tasks; task indices are dealt round-robin to
+// per-thread deques at the start of a job and idle threads steal from
+// the others, which balances uneven per-task cost without needing the
+// amount of work to divide evenly over the thread count
+//
+// the thread calling run() participates as thread 0, tasks receive
+// the index of the thread executing them (for per-thread caches)
+class t_work_stealing_pool {
+public:
+	typedef std::function<void(size_t task_idx, size_t thread_idx)> t_task_func;
+
+	struct alignas(CACHE_LINE_SIZE) t_thread_stats {
+		uint64_t busy_ns; // time spent executing tasks
+		uint64_t idle_ns; // time spent looking for or waiting on tasks
+		uint64_t num_tasks;
+		uint64_t num_steals;
+	};
+
+public:
+	t_work_stealing_pool(size_t num_threads = 1) { spawn_threads(num_threads); }
+	~t_work_stealing_pool() { join_threads(); }
+
+	t_work_stealing_pool(const t_work_stealing_pool&) = delete;
+	t_work_stealing_pool& operator = (const t_work_stealing_pool&) = delete;
+
+	void spawn_threads(size_t num_threads) {
+		join_threads();
+
+		m_deques = std::vector<t_work_stealing_deque>(std::max(num_threads, size_t(1)));
+		m_stats = std::vector<t_thread_stats>(m_deques.size());
+
+		clear_stats();
+
+		for (size_t n = 1; n < m_deques.size(); n++) {
+			m_threads.emplace_back(&t_work_stealing_pool::worker_loop, this, n, m_job_index);
+		}
+	}
+
+	void join_threads() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_exit = true;
+		}
+
+		m_job_cond.notify_all();
+
+		for (std::thread& t: m_threads) {
+			t.join();
+		}
+
+		m_threads.clear();
+		m_exit = false;
+	}
+
+
+	// executes func(i, thread) for every i in [0, num_tasks), returns when all are done
+	void run(size_t num_tasks, const t_task_func& func) {
+		assert(num_tasks < t_work_stealing_deque::NULL_TASK);
+
+		if (num_tasks == 0)
+			return;
+
+		const uint64_t t0 = time_ns();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			// workers are all parked, so filling their deques is safe
+			for (t_work_stealing_deque& deque: m_deques) {
+				deque.resize((num_tasks + m_deques.size() - 1) / m_deques.size());
+			}
+			for (size_t i = 0; i < num_tasks; i++) {
+				m_deques[i % m_deques.size()].push(num_tasks - i - 1);
+			}
+
+			m_job_func = &func;
+			m_num_pending.store(num_tasks, std::memory_order_relaxed);
+			m_num_working = m_deques.size() - 1;
+			m_job_index += 1;
+		}
+
+		m_job_cond.notify_all();
+
+		execute_tasks(0);
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			// wait until no worker can touch func anymore
+			m_done_cond.wait(lock, [&]() { return (m_num_working == 0); });
+
+			m_job_func = nullptr;
+		}
+
+		const uint64_t t1 = time_ns();
+
+		// a job's idle time is whatever part of it a thread did not spend on tasks
+		for (size_t n = 0; n < m_stats.size(); n++) {
+			const uint64_t job_busy_ns = m_stats[n].busy_ns - m_job_busy_ns[n];
+
+			m_stats[n].idle_ns += ((t1 - t0) - std::min(t1 - t0, job_busy_ns));
+			m_job_busy_ns[n] = m_stats[n].busy_ns;
+		}
+	}
+
+
+	void clear_stats() {
+		for (t_thread_stats& stats: m_stats) {
+			stats = {0, 0, 0, 0};
+		}
+
+		m_job_busy_ns.assign(m_stats.size(), 0);
+	}
+
+	void log_stats(FILE* out, const char* header = "") const {
+		for (size_t n = 0; n < m_stats.size(); n++) {
+			const t_thread_stats& stats = m_stats[n];
+			const double busy_frac = stats.busy_ns / std::max(1.0, double(stats.busy_ns + stats.idle_ns));
+
+			fprintf(out, "[work_stealing_pool::%s][%s] thread=%lu {busy,idle}_ms={%.2f,%.2f} util=%.3f {tasks,steals}={%lu,%lu}\n",
+				__func__,
+				header,
+				n,
+				stats.busy_ns * 1e-6,
+				stats.idle_ns * 1e-6,
+				busy_frac,
+				stats.num_tasks,
+				stats.num_steals
+			);
+		}
+	}
+
+	size_t get_num_threads() const { return (m_deques.size()); }
+	const t_thread_stats& get_thread_stats(size_t n) const { return m_stats[n]; }
+
+private:
+	static uint64_t time_ns() {
+		const auto now = std::chrono::steady_clock::now();
+		return (std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count());
+	}
+
+	void worker_loop(size_t thread_idx, size_t job_index) {
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_job_cond.wait(lock, [&]() { return (m_exit || m_job_index != job_index); });
+
+				if (m_exit)
+					return;
+
+				job_index = m_job_index;
+			}
+
+			execute_tasks(thread_idx);
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				if ((m_num_working -= 1) == 0)
+					m_done_cond.notify_one();
+			}
+		}
+	}
+
+	void execute_tasks(size_t thread_idx) {
+		t_thread_stats& stats = m_stats[thread_idx];
+		t_work_stealing_deque& deque = m_deques[thread_idx];
+
+		// cheap xorshift state for picking victims
+		uint64_t rng = thread_idx * 0x9E3779B97F4A7C15ull + 1;
+
+		while (m_num_pending.load(std::memory_order_acquire) != 0) {
+			uint32_t task = deque.pop();
+
+			if (task == t_work_stealing_deque::NULL_TASK) {
+				// own deque is empty; try a random victim (only one, then
+				// re-check the pending count so we stop once job is done)
+				rng ^= (rng << 13);
+				rng ^= (rng >>  7);
+				rng ^= (rng << 17);
+
+				const size_t victim = rng % m_deques.size();
+
+				if (victim == thread_idx || (task = m_deques[victim].steal()) == t_work_stealing_deque::NULL_TASK) {
+					std::this_thread::yield();
+					continue;
+				}
+
+				stats.num_steals += 1;
+			}
+
+			const uint64_t t0 = time_ns();
+
+			(*m_job_func)(task, thread_idx);
+
+			stats.busy_ns += (time_ns() - t0);
+			stats.num_tasks += 1;
+
+			m_num_pending.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	}
+
+private:
+	std::vector<std::thread> m_threads;
+	std::vector<t_work_stealing_deque> m_deques;
+	std::vector<t_thread_stats> m_stats;
+	std::vector<uint64_t> m_job_busy_ns;
+
+	std::mutex m_mutex;
+	std::condition_variable m_job_cond;
+	std::condition_variable m_done_cond;
+
+	const t_task_func* m_job_func = nullptr;
+
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_num_pending = {0};
+
+	size_t m_num_working = 0;
+	size_t m_job_index = 0;
+
+	bool m_exit = false;
+};
+
+#endif